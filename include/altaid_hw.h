@@ -8,6 +8,19 @@
 
 #include "i8080.h"
 
+/* RAM write tracking: one flag per 256-byte line of the 512K RAM. */
+#define ALTAID_DIRTY_SHIFT	8
+#define ALTAID_DIRTY_LINE	(1u << ALTAID_DIRTY_SHIFT)
+#define ALTAID_DIRTY_LINES	((8u * 0x10000u) >> ALTAID_DIRTY_SHIFT)
+
+/*
+ * Each consumer of the dirty map owns one bit of every flag. Stores set
+ * all bits; a consumer clears only its own after taking a snapshot.
+ */
+#define ALTAID_DIRTY_CHECKPOINT	0x01u
+#define ALTAID_DIRTY_REWIND	0x02u
+#define ALTAID_DIRTY_ALL	0xFFu
+
 /* Altaid 8800 port map (ALTAID05 family)
 *
 * OUT 0xC0 OUTPUT_PORT: multiplexed front panel + TXDATA
@@ -58,9 +71,27 @@ typedef struct {
 	bool    rom_low_mapped;           /* true => reads from ROM at 0x0000-0x7FFF */
 	bool    rom_hi_mapped;            /* true => reads from ROM at 0x8000-0xBFFF */
 
+	/*
+	* Direct memory map for the CPU fast path (see I8080Bus.rd_page).
+	* Rebuilt by altaid_hw_remap() whenever a mapping latch changes.
+	*/
+	const uint8_t *rd_page[I8080_PAGE_COUNT];
+	uint8_t       *wr_page[I8080_PAGE_COUNT];
+	uint8_t       *wr_dirty[I8080_PAGE_COUNT];
+
+	/*
+	* ram_dirty[n] is set to ALTAID_DIRTY_ALL when flat RAM line n (bytes
+	* n*256 onwards of ram[][]) is stored to. Checkpoints and the rewind
+	* buffer save only lines with their bit set, then clear that bit.
+	*/
+	uint8_t ram_dirty[ALTAID_DIRTY_LINES];
+
 	/* last output port value */
 	uint8_t out_c0;
 
+	/* IN 0x40 reads so far; lets the core spot input polling loops */
+	uint32_t input_reads;
+
 	/* bit-serial lines */
 	bool tx_line;                     /* derived from out_c0 bit7 */
 	bool rx_level;                    /* driven by SerialDev */
@@ -128,6 +159,17 @@ void altaid_hw_init(AltaidHW *hw);
 /* Reset CPU-visible hardware state to power-on defaults, preserving ROM and RAM contents. */
 void altaid_hw_reset_runtime(AltaidHW *hw);
 bool altaid_hw_load_rom64k(AltaidHW *hw, const char *path);
+/*
+ * Rebuild rd_page/wr_page from the ROM/RAM mapping fields. Called internally
+ * on mapping OUTs; call it after restoring those fields directly.
+ */
+void altaid_hw_remap(AltaidHW *hw);
+/* Flag every RAM line dirty (after host-side RAM writes). */
+void altaid_hw_dirty_all(AltaidHW *hw);
+/* Clear the given consumer bits (ALTAID_DIRTY_*) on every line. */
+void altaid_hw_dirty_clear(AltaidHW *hw, uint8_t bits);
+/* Point a bus at this HW's handlers and direct memory map. */
+void altaid_hw_attach_bus(AltaidHW *hw, I8080Bus *bus);
 
 /* 8080 bus handlers */
 uint8_t altaid_mem_read(I8080Bus *bus, uint16_t addr);
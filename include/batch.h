@@ -0,0 +1,83 @@
+/* SPDX-License-Identifier: MIT */
+
+#ifndef ALTAID_BATCH_H
+#define ALTAID_BATCH_H
+
+#include "cli.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Batch runner (--batch <manifest>).
+ *
+ * Runs many independent headless EmuCores on a pool of worker threads.
+ * Each manifest line is one job:
+ *
+ *   <name> [rom=<file>] [in=<file>] [out=<file>] [run-ms=<ms>]
+ *          [hz=<cpu_hz>] [baud=<baud>] [rx-baud=<baud>]
+ *
+ * Fields left out inherit the command line (ROM positional, --hz, --baud,
+ * --rx-baud, --run-ms). '#' starts a comment; blank lines are skipped.
+ * in= is scripted UART RX, parsed like headless stdin (Ctrl-P chords
+ * press panel keys); out= receives the decoded TX bytes.
+ */
+
+#define BATCH_NAME_MAX 64u
+#define BATCH_ERR_MAX 128u
+
+/* Used when neither run-ms= nor --run-ms is given: jobs must end. */
+#define BATCH_DEFAULT_RUN_MS 1000u
+
+struct BatchJob {
+	/* From the manifest. */
+	char		name[BATCH_NAME_MAX];
+	char		*rom_path;
+	char		*in_path;	/* NULL = no RX input */
+	char		*out_path;	/* NULL = count TX bytes only */
+	uint32_t	cpu_hz;
+	uint32_t	baud;
+	uint32_t	rx_baud;
+	uint32_t	run_ms;
+	uint32_t	hold_ms;
+
+	/* Filled in by batch_run_job(). */
+	bool		ok;
+	char		err[BATCH_ERR_MAX];
+	uint64_t	ticks;
+	uint64_t	insns;
+	uint64_t	rx_bytes;
+	uint64_t	tx_bytes;
+	uint64_t	wall_nsec;
+};
+
+struct BatchManifest {
+	struct BatchJob	*jobs;
+	size_t		count;
+	size_t		cap;
+};
+
+/*
+ * Parse one manifest line into *job, starting from *defaults.
+ * Returns 1 for a job, 0 for a blank or comment line, -1 on error.
+ */
+int batch_parse_line(const char *line, const struct BatchJob *defaults,
+		     struct BatchJob *job, char *err, unsigned err_cap);
+
+bool batch_manifest_load(struct BatchManifest *m, const char *path,
+			 const struct BatchJob *defaults,
+			 char *err, unsigned err_cap);
+void batch_manifest_free(struct BatchManifest *m);
+
+/* Run one job to completion on the calling thread. */
+void batch_run_job(struct BatchJob *job);
+
+/*
+ * Run every job in cfg->batch_path on cfg->batch_threads workers
+ * (0 = one per online CPU) and print the report to stdout.
+ * Returns the process exit status: 0 if every job succeeded.
+ */
+int batch_run(const struct Config *cfg);
+
+#endif /* ALTAID_BATCH_H */
@@ -19,8 +19,40 @@
 *    measured in CPU ticks.
 *  - This avoids assuming a fixed bit rate or encoding; any ROM/software
 *    that produces/consumes a digital waveform on those lines should work.
+*
+* Storage:
+*  - The tape lives on disk, not in memory. Recording appends edges to the
+*    tape file through a CASSETTE_WINDOW-edge buffer, patching the header
+*    count at every flush, so a crash loses at most one buffer. Playback
+*    reads the file a window at a time. Memory use does not depend on tape
+*    length.
+*  - New tapes are written as ALTAP002: blocks of up to CASSETTE_WINDOW
+*    varint/delta-coded edges with an index of block offsets and start
+*    ticks. ALTAP001 tapes (raw 32-bit durations) still load and append
+*    in their own format; their index is built when they are opened.
+*  - The index doubles as a cumulative-time index, so seeking to a tape
+*    time costs a binary search plus one window, whatever the length.
+*  - A WAV path is decoded into a temp-backed tape on open (see wav.h)
+*    and rendered back to the WAV at wav_rate on save.
+*  - A tape attached without a path (tests, old state files) is backed by
+*    an unlinked temp file; cassette_save() copies it to the path.
 */
 
+/* Durations held in memory: the playback read window / record buffer. */
+#define CASSETTE_WINDOW	1024u
+
+/* Default sample rate for tapes saved as WAV. */
+#define CASSETTE_WAV_RATE	44100u
+
+/* cassette_next_edge() when no edge is coming. */
+#define CASSETTE_NEVER	UINT64_MAX
+
+/* Checkpoint every CASSETTE_WINDOW edges (an ALTAP002 block). */
+typedef struct {
+	uint64_t	off;	/* file offset of the block (header) */
+	uint64_t	tick;	/* tape time at its first edge */
+} CassetteBlock;
+
 /*
  * Transport state. Playback and recording are mutually exclusive, so they
  * live in a single enum rather than two bools. "attached" is a separate
@@ -49,15 +81,41 @@ typedef struct {
 	bool		play_level;
 	size_t		play_index; /* next duration index */
 	uint64_t	play_next_edge_tick;
+	uint64_t	play_tape_tick;	/* tape time of that edge */
 
 	/* recording */
 	uint64_t	rec_last_edge_tick;
 	bool		rec_last_level;
 
-	/* pulse durations (CPU ticks between edges) */
-	uint32_t	*durations;
-	size_t		dur_count;
-	size_t		dur_cap;
+	/* tape: pulse durations (CPU ticks between edges) */
+	size_t		dur_count;	/* edges on tape, buffered ones included */
+	uint64_t	tape_ticks;	/* tape length: sum of all durations */
+	int		fd;		/* tape file, -1 = none yet */
+	bool		fd_temp;	/* unlinked temp file (no path, WAV) */
+	bool		wav;		/* path is a WAV file */
+	uint32_t	wav_rate;	/* sample rate a WAV is saved at */
+
+	unsigned	version;	/* file format: 1 = ALTAP001, 2 = ALTAP002 */
+	size_t		disk_count;	/* edge count in the file header */
+
+	/*
+	 * Checkpoint b is edge b * CASSETTE_WINDOW: the ALTAP002 block index,
+	 * built on load for ALTAP001. Kept current while recording.
+	 */
+	CassetteBlock	*blocks;
+	size_t		nblocks;
+	size_t		blocks_cap;
+	uint64_t	index_off;	/* on-disk index in the header, 0 = none */
+	bool		index_dirty;	/* blocks changed since the index */
+
+	uint32_t	win[CASSETTE_WINDOW];
+	size_t		win_start;	/* tape index of win[0] */
+	size_t		win_len;
+	bool		win_dirty;	/* win holds edges not yet written */
+
+	/* cassette_hash() of the first hash_count edges, extended as asked. */
+	uint64_t	hash;
+	size_t		hash_count;
 } Cassette;
 
 void cassette_init(Cassette *c, uint32_t cpu_hz);
@@ -66,22 +124,107 @@ void cassette_free(Cassette *c);
 /* Attach a tape image (loads if it exists; otherwise attaches empty). */
 bool cassette_open(Cassette *c, const char *path);
 
-/* Persist current tape contents to the attached file. */
+/*
+ * Write any buffered edges, the ALTAP002 block index and the header count
+ * to the tape file (copying a temp-backed tape to c->path first).
+ */
 bool cassette_save(Cassette *c);
 
+/*
+ * Append one edge duration at the end of the tape, as recording does.
+ * Returns false if the tape file cannot be created or written.
+ */
+bool cassette_append(Cassette *c, uint32_t dur);
+
+/* Append n edge durations, a window-sized copy at a time. */
+bool cassette_append_n(Cassette *c, const uint32_t *dur, size_t n);
+
+/*
+ * Copy the tape at in_path to out_path in format version (1 = ALTAP001,
+ * 2 = ALTAP002), or as a WAV at wav_rate if out_path ends in ".wav". A
+ * WAV input is decoded at cpu_hz ticks per second. Returns false if
+ * in_path is not a tape, the paths are the same, or the copy cannot be
+ * written.
+ */
+bool cassette_convert(const char *in_path, const char *out_path,
+		      unsigned version, uint32_t cpu_hz, uint32_t wav_rate);
+
+/* Duration of edge i (0 past the end). Reads the tape file as needed. */
+uint32_t cassette_duration(Cassette *c, size_t i);
+
+/*
+ * Tape time (ticks from the start) at which edge i begins; the tape length
+ * for i >= dur_count. One checkpoint lookup plus at most a window of edges.
+ */
+uint64_t cassette_tick_at(Cassette *c, size_t i);
+
+/*
+ * Write buffered edges and the header count to the tape file, so that it
+ * holds every edge a state saved now counts. Returns false on a write
+ * error.
+ */
+bool cassette_flush(Cassette *c);
+
+/*
+ * FNV-1a hash of the first n edge durations, which identifies the tape a
+ * state was saved against. Reads only the edges past the last call's n,
+ * unless n is smaller.
+ */
+uint64_t cassette_hash(Cassette *c, size_t n);
+
+/*
+ * After a state load: reopen path unless it already backs the tape. The
+ * file is left as it is, edges after count included; the transport fields
+ * are the caller's to restore. Returns false if the tape holds fewer than
+ * count edges.
+ */
+bool cassette_reattach(Cassette *c, const char *path, size_t count);
+
+/*
+ * Make count the end of the tape, for a recording resumed from a state.
+ * A tape file stays untouched: its first count edges are copied to a
+ * temp-backed tape, which cassette_save() writes back to the path. Returns
+ * false if the copy cannot be made.
+ */
+bool cassette_fork(Cassette *c, size_t count);
+
 /* Transport */
 void cassette_stop(Cassette *c);
 void cassette_rewind(Cassette *c);
 void cassette_ff(Cassette *c, uint32_t seconds, uint64_t now_tick);
+void cassette_reverse(Cassette *c, uint32_t seconds, uint64_t now_tick);
+
+/*
+ * Move the playing tape to tape time tape_tick (clamped to its length) as
+ * of now_tick: a binary search over the checkpoints, then at most a window
+ * of edges. ff/reverse seek relative to cassette_position().
+ */
+void cassette_seek(Cassette *c, uint64_t tape_tick, uint64_t now_tick);
+
+/* Tape time under the head at now_tick (0 when stopped). */
+uint64_t cassette_position(const Cassette *c, uint64_t now_tick);
 void cassette_start_play(Cassette *c, uint64_t now_tick);
 void cassette_start_record(Cassette *c, uint64_t now_tick);
 
 /* Called when OUT 0x44 changes while recording. */
 void cassette_on_out_change(Cassette *c, uint64_t tick, bool new_level);
 
+/*
+ * Record n OUT 0x44 changes at ascending ticks in one go, the output
+ * ending at last_level. Same tape as n cassette_on_out_change() calls.
+ */
+void cassette_on_out_edges(Cassette *c, const uint64_t *ticks, size_t n,
+			   bool last_level);
+
 /* Sample cassette input level at a given tick (returns idle when stopped). */
 bool cassette_in_level_at(Cassette *c, uint64_t tick);
 
+/*
+ * Tick of the next playback edge, or CASSETTE_NEVER when not playing or
+ * past the end. cassette_in_level_at() cannot change before it.
+ */
+uint64_t cassette_next_edge(const Cassette *c);
+
 const char *cassette_status(const Cassette *c);
 
 #endif /* ALTAID_EMU_CASSETTE_H */
@@ -21,6 +21,7 @@ enum panel_text_mode {
 /*
  * Persistence specifications.  An IoSpec is one of:
  *   ram:<file>                 full 512 KiB RAM
+ *   ramz:<file>                full RAM, compressed image
  *   ram@<addr>:<file>          raw blob, bank 0, at addr
  *   ram@<bank>.<addr>:<file>   raw blob, specific bank, at addr
  *   state:<file>               CPU + devices + RAM snapshot
@@ -35,18 +36,21 @@ struct IoSpec {
 	unsigned		bank;		/* ram only */
 	uint16_t		addr;		/* ram only */
 	bool			has_addr;	/* false = full ram */
+	bool			packed;		/* ramz: (save compressed) */
 	const char		*path;
 };
 
 #define CLI_IO_SPEC_MAX 16
 
 struct Config {
-	/* Required positional ROM path (64 KiB). */
+	/* Required positional ROM path (64 KiB); optional with --batch. */
 	const char	*rom_path;
 
 	/* Core. */
 	uint32_t	cpu_hz;
 	uint32_t	baud;
+	uint32_t	rx_baud;	/* --rx-baud; 0 = same as baud */
+	bool		tx_block;	/* --tx-overflow block: stall instead of drop */
 
 	/* Panel/UI. */
 	bool		start_panel;
@@ -75,6 +79,7 @@ struct Config {
 	const char	*cassette_path;
 	bool		cassette_play;
 	bool		cassette_rec;
+	uint32_t	cassette_wav_rate;	/* sample rate for .wav saves */
 
 	/* Persistence: parsed --load/--save/--default specs. */
 	struct IoSpec	load_specs[CLI_IO_SPEC_MAX];
@@ -90,6 +95,8 @@ struct Config {
 	bool		quiet;
 	bool		headless;
 	bool		realtime;
+	uint32_t	latency_ms;	/* idle batch growth budget, 0 = fixed */
+	bool		threaded;	/* core on its own thread (not headless) */
 	bool		show_help;
 	bool		show_version;
 	bool		debug_panel;	/* trace panel key press/release/scan events */
@@ -99,6 +106,19 @@ struct Config {
 	 * has run this many milliseconds of CPU time. 0 means "run forever".
 	 */
 	uint32_t	max_run_ms;
+
+	/* Periodic incremental checkpoints (base + dirty-page deltas). */
+	const char	*checkpoint_path;
+	uint32_t	checkpoint_ms;
+
+	/* In-memory rewind buffer (Ctrl-P B). rewind_mb 0 = disabled. */
+	uint32_t	rewind_mb;
+	uint32_t	rewind_ms;	/* snapshot interval */
+	uint32_t	rewind_step_ms;	/* how far one Ctrl-P B goes back */
+
+	/* Batch mode: run every job in this manifest, then exit. */
+	const char	*batch_path;
+	uint32_t	batch_threads;	/* --jobs; 0 = one per online CPU */
 };
 
 void cli_usage(const char *argv0);
@@ -12,7 +12,19 @@
 #include <stddef.h>
 #include <stdint.h>
 
-#define EMU_TXBUF_SIZE 4096
+/* TX ring size; must be a power of two (indices wrap with EMU_TXBUF_MASK). */
+#define EMU_TXBUF_SIZE 4096u
+#define EMU_TXBUF_MASK (EMU_TXBUF_SIZE - 1u)
+
+/*
+* What the core does with a decoded TX byte when the ring is full:
+* drop it (counted in tx_dropped), or stop running batches until the host
+* drains the ring.
+*/
+enum emu_tx_overflow {
+	EMU_TX_DROP = 0,
+	EMU_TX_BLOCK,
+};
 
 /*
 * EmuCore is the deterministic emulation state:
@@ -21,8 +33,48 @@
 * It MUST NOT touch host resources (stdio, PTYs, termios, select(), wall clock).
 */
 struct EmuCoreConfig {
-	uint32_t	cpu_hz;
-	uint32_t	baud;
+	uint32_t		cpu_hz;
+	uint32_t		baud;
+	uint32_t		rx_baud;	/* RX line only; 0 = same as baud */
+	enum emu_tx_overflow	tx_overflow;
+};
+
+/* One contiguous run of pending TX bytes (see emu_core_tx_peek()). */
+struct EmuTxSpan {
+	const uint8_t	*data;
+	size_t		len;
+};
+
+/*
+* Event scheduler slots. Each holds the absolute ser.tick at which that
+* device next needs servicing, or EMU_EV_NEVER when nothing is pending.
+*/
+enum emu_event {
+	EMU_EV_TIMER = 0,	/* next timer pulse */
+	EMU_EV_RX,		/* next RX line change or end of frame */
+	EMU_EV_CASSETTE,	/* next cassette playback edge */
+	EMU_EV_TX,		/* next TX decoder sample point */
+	EMU_EV_KEY,		/* next front-panel key auto-release */
+	EMU_EV_COUNT
+};
+
+#define EMU_EV_NEVER UINT64_MAX
+
+/* OUT 0x44 edges buffered per batch before they are appended to the tape. */
+#define EMU_CAS_REC_BATCH 64u
+
+/*
+* Idle detection state (derived). A polling loop is a candidate once two
+* consecutive IN 0x40 reads leave the CPU in the same state at the same PC
+* with only side-effect-free instructions in between; from then on whole
+* loop passes can be skipped until the next scheduler event.
+*/
+struct EmuIdle {
+	bool		tracing;	/* vetting opcodes since the last IN 0x40 */
+	uint32_t	in_seen;	/* hw.input_reads at the last check */
+	I8080		cpu;		/* CPU state just after the candidate IN */
+	uint64_t	tick;		/* ser.tick at the candidate IN */
+	uint64_t	insns;		/* insn_count at the candidate IN */
 };
 
 struct EmuCore {
@@ -35,19 +87,61 @@ struct EmuCore {
 
 	Cassette	cas;
 	bool		cas_attached;
+	/*
+	* Ticks of OUT 0x44 edges recorded this batch, not yet on the tape
+	* (always empty between batches).
+	*/
+	uint64_t	cas_rec[EMU_CAS_REC_BATCH];
+	unsigned	cas_rec_len;
 
 	uint64_t	timer_period;
 	uint64_t	next_timer_tick;
 
-	/* Decoded TX bytes from the emulated serial bitstream. */
+	/* Instructions executed since init/reset (statistics; not saved). */
+	uint64_t	insn_count;
+	/* Ticks fast-forwarded while HALTed or polling (statistics). */
+	uint64_t	idle_ticks;
+
+	struct EmuIdle	idle;
+
+	/* Decoded basic blocks for the CPU fast path (see i8080.h). */
+	I8080BlockCache	bcache;
+
+	/*
+	* Scheduler state (derived; rebuilt at the start of every batch).
+	* Input lines are re-evaluated only when ser.tick reaches lines_due
+	* (the earliest timer/RX/cassette slot) or lines_poll is set.
+	*/
+	uint64_t	ev_due[EMU_EV_COUNT];
+	uint64_t	lines_due;
+	bool		lines_poll;
+
+	/*
+	* Decoded TX bytes from the emulated serial bitstream. tx_r/tx_w stay
+	* in [0, EMU_TXBUF_SIZE) and one slot is kept free, so the ring holds
+	* at most EMU_TXBUF_SIZE - 1 bytes.
+	*/
 	uint8_t		tx_buf[EMU_TXBUF_SIZE];
 	uint32_t	tx_r;
 	uint32_t	tx_w;
+	uint64_t	tx_dropped;	/* bytes lost to EMU_TX_DROP overflow */
 };
 
 void emu_core_init(struct EmuCore *core, uint32_t cpu_hz, uint32_t baud);
 bool emu_core_load_rom64k(struct EmuCore *core, const char *rom_path);
 
+/*
+* Drop cached decoded code. Call after writing hw.rom or hw.ram from
+* outside the CPU (file loaders, state restore).
+*/
+void emu_core_mem_changed(struct EmuCore *core);
+
+/*
+* Run the RX line at its own baud (0 = --baud). Survives emu_core_reset().
+* The ROM's receive routine must be able to sample at the chosen rate.
+*/
+void emu_core_set_rx_baud(struct EmuCore *core, uint32_t rx_baud);
+
 /* Reset emulated machine state. Does not clear RAM contents. */
 void emu_core_reset(struct EmuCore *core);
 
@@ -57,4 +151,13 @@ void emu_core_run_batch(struct EmuCore *core, uint64_t batch_cycles);
 /* Pop decoded TX bytes produced by the emulated machine. */
 size_t emu_core_tx_pop(struct EmuCore *core, uint8_t *dst, size_t cap);
 
+/*
+* Zero-copy TX access. Fills span[0] and span[1] with the pending bytes in
+* order (the second is empty unless the data wraps) and returns the total.
+* The spans stay valid until emu_core_tx_commit() or the next batch;
+* commit marks the first n bytes as consumed.
+*/
+size_t emu_core_tx_peek(const struct EmuCore *core, struct EmuTxSpan span[2]);
+void emu_core_tx_commit(struct EmuCore *core, size_t n);
+
 #endif /* ALTAID_EMU_CORE_H */
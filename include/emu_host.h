@@ -5,6 +5,10 @@
 
 #include "cli.h"
 #include "emu_core.h"
+#include "hostev.h"
+#include "rewind.h"
+#include "runloop_batch.h"
+#include "runloop_pace.h"
 #include "serial_routing.h"
 #include "ui.h"
 
@@ -26,6 +30,7 @@ struct EmuHost {
 
 	int		pty_fd;
 	int		pty_slave_fd;
+	struct HostEv	ev;		/* waits on PTY, stdin and deadlines */
 	char		pty_name[128];
 
 	int		serial_file_fd;
@@ -39,8 +44,17 @@ struct EmuHost {
 
 	uint64_t	next_panel_tick;
 
-	uint32_t	wall_start_usec;
-	uint64_t	emu_start_tick;
+	/* Tick deadlines serviced by runloop_core_step(). */
+	uint64_t	run_deadline_tick;	/* --run-ms; EMU_EV_NEVER = none */
+	uint64_t	checkpoint_period;
+	uint64_t	next_checkpoint_tick;
+	uint64_t	rewind_period;
+	uint64_t	next_rewind_tick;
+
+	unsigned	checkpoint_deltas;	/* records in --checkpoint file */
+	struct Rewind	rewind_buf;		/* Ctrl-P B snapshots */
+	struct RunBatch	batch;			/* adaptive batch size + stats */
+	struct RunPace	pace;			/* --realtime pacing + stats */
 };
 
 /*
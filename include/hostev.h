@@ -0,0 +1,50 @@
+/* SPDX-License-Identifier: MIT */
+
+#ifndef ALTAID_HOSTEV_H
+#define ALTAID_HOSTEV_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Host event loop: a single wait on the PTY master, stdin, a wakeup pipe
+ * and the realtime deadline.
+ *
+ * On Linux this is an epoll set plus a timerfd armed for the timeout, so
+ * a sleep ends on the first input byte or exactly at the deadline, with no
+ * millisecond rounding. Elsewhere, or if epoll/timerfd are unavailable, it
+ * falls back to poll() and sleeps out the sub-millisecond rest of the
+ * timeout after it. An fd that cannot be polled (a regular file on stdin)
+ * always counts as ready; the reader sees EOF and unwatches it.
+ */
+enum {
+	HOSTEV_STDIN	= 1u << 0,
+	HOSTEV_PTY	= 1u << 1,
+	HOSTEV_WAKE	= 1u << 2,	/* --threaded: the other thread kicked */
+	HOSTEV_NSRC	= 3
+};
+
+struct HostEv {
+	int		fd[HOSTEV_NSRC];	/* per source, -1 = unwatched */
+	unsigned	ready;		/* sources seen readable, not yet read */
+	unsigned	always;		/* unpollable sources: always ready */
+	unsigned	armed;		/* sources registered with epfd */
+	int		epfd;		/* -1: poll() fallback */
+	int		tfd;		/* timerfd for the timeout */
+};
+
+/* Start with nothing watched. Never fails; it falls back to poll(). */
+void hostev_init(struct HostEv *ev);
+void hostev_close(struct HostEv *ev);
+
+/* Watch fd for source src (HOSTEV_*); fd < 0 stops watching it. */
+void hostev_watch(struct HostEv *ev, unsigned src, int fd);
+
+/*
+ * Wait up to timeout_ns for a watched source in mask to become readable
+ * (0 only checks). Readable sources are added to ev->ready, which is
+ * returned; the caller clears a bit once it has read that source.
+ */
+unsigned hostev_wait(struct HostEv *ev, unsigned mask, uint64_t timeout_ns);
+
+#endif /* ALTAID_HOSTEV_H */
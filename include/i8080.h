@@ -8,6 +8,14 @@
 
 typedef struct I8080Bus I8080Bus;
 
+/* PSW flag bits, in 8080 layout (S Z 0 AC 0 P 1 CY). */
+#define I8080_FLAG_CY		0x01
+#define I8080_FLAG_FIXED	0x02
+#define I8080_FLAG_P		0x04
+#define I8080_FLAG_AC		0x10
+#define I8080_FLAG_Z		0x40
+#define I8080_FLAG_S		0x80
+
 typedef struct {
 	uint8_t		a;
 	uint8_t		b;
@@ -19,18 +27,73 @@ typedef struct {
 	uint16_t	pc;
 	uint16_t	sp;
 
-	/* flags */
-	bool		z;
-	bool		s;
-	bool		p;
-	bool		cy;
-	bool		ac;
+	/*
+	 * Flags as a packed PSW byte (I8080_FLAG_*). Bit 1 is always set and
+	 * bits 3/5 are always clear, so PUSH PSW stores f unchanged.
+	 */
+	uint8_t		f;
 
 	bool		inte;
 	bool		ei_pending;
 	bool		halted;
 } I8080;
 
+static inline bool i8080_flag(const I8080 *cpu, uint8_t mask)
+{
+	return (cpu->f & mask) != 0;
+}
+
+static inline void i8080_set_flag(I8080 *cpu, uint8_t mask, bool on)
+{
+	cpu->f = (uint8_t)(on ? (cpu->f | mask) : (cpu->f & ~mask));
+}
+
+/* Direct memory map granularity: 16 pages of 4K. */
+#define I8080_PAGE_SHIFT	12
+#define I8080_PAGE_SIZE		(1u << I8080_PAGE_SHIFT)
+#define I8080_PAGE_MASK		(I8080_PAGE_SIZE - 1u)
+#define I8080_PAGE_COUNT	(0x10000u >> I8080_PAGE_SHIFT)
+
+/*
+* Basic-block cache.
+*
+* A block is a run of straight-line code starting at one PC, decoded once
+* into table-engine handlers with a precomputed worst-case t-state total.
+* It ends after a jump, call, return, RST or PCHL; before IN, OUT, EI, DI
+* or HLT, so port I/O and interrupt state stay with the caller; at a page
+* boundary; or after I8080_BLOCK_MAX_OPS instructions.
+*
+* Blocks are keyed by (rd_page entry, PC), so a bank switch selects other
+* blocks rather than flushing. Stores made by the CPU through a bus with a
+* cache attached invalidate every block covering the written byte,
+* including the one running. Host code that writes ROM/RAM directly must
+* call i8080_bcache_flush().
+*
+* Blocks always run table-engine handlers, whichever engine i8080_step()
+* uses, so emu_core only attaches a cache in table builds; a switch build
+* runs every instruction through the switch engine.
+*/
+#define I8080_BLOCK_MAX_OPS	16u
+#define I8080_BLOCK_MAX_BYTES	(I8080_BLOCK_MAX_OPS * 3u)
+#define I8080_BCACHE_SLOTS	1024u	/* power of two; slot = PC & (SLOTS - 1) */
+
+typedef int (*i8080_op_fn)(I8080 *cpu, I8080Bus *bus);
+
+typedef struct {
+	const uint8_t	*page;		/* rd_page[] entry decoded from; NULL when empty */
+	uint16_t	pc;
+	uint8_t		len;		/* bytes covered */
+	uint8_t		n_ops;		/* 0: PC starts with a stop opcode */
+	uint16_t	max_cycles;	/* upper bound on t-states for the whole block */
+	bool		writes;		/* contains an op that may store to memory */
+	i8080_op_fn	ops[I8080_BLOCK_MAX_OPS];
+} I8080Block;
+
+typedef struct {
+	I8080Block	slot[I8080_BCACHE_SLOTS];
+	uint8_t		code_line[256];	/* 256-byte lines that hold RAM-backed blocks */
+} I8080BlockCache;
+
 typedef uint8_t (*i8080_mem_read_fn)(I8080Bus *bus, uint16_t addr);
 typedef void (*i8080_mem_write_fn)(I8080Bus *bus, uint16_t addr, uint8_t v);
 typedef uint8_t (*i8080_io_in_fn)(I8080Bus *bus, uint8_t port);
@@ -42,6 +105,25 @@ struct I8080Bus {
 	i8080_mem_write_fn	mem_write;
 	i8080_io_in_fn		io_in;
 	i8080_io_out_fn		io_out;
+
+	/*
+	* Optional direct memory map. When set, entry n points at the host
+	* bytes backing addresses n*I8080_PAGE_SIZE onwards and the CPU loads
+	* and stores through it instead of calling mem_read/mem_write. The
+	* owner keeps the tables current across bank switches.
+	*/
+	const uint8_t * const	*rd_page;
+	uint8_t * const		*wr_page;
+
+	/*
+	* Optional store tracking alongside wr_page: entry n points at one
+	* flag byte per 256-byte line of page n, and every direct store sets
+	* its line's flag to 0xFF. The owner clears them.
+	*/
+	uint8_t * const		*wr_dirty;
+
+	/* Optional basic-block cache (table handlers); needs rd_page. */
+	I8080BlockCache		*bcache;
 };
 
 void i8080_reset(I8080 *cpu);
@@ -49,6 +131,39 @@ void i8080_reset(I8080 *cpu);
 /* Execute one instruction. Returns exact 8080 t-states for that instruction. */
 int i8080_step(I8080 *cpu, I8080Bus *bus);
 
+/*
+* Dispatch engines behind i8080_step().
+*
+* The switch engine decodes opcode groups with a switch; the table engine
+* jumps through a 256-entry table of per-opcode handlers. Both are always
+* built and produce identical results; building with -DI8080_DISPATCH_TABLE
+* (make CPU_DISPATCH=table) makes i8080_step() use the table engine and
+* turns on the block cache, which is built from table handlers too.
+*/
+int i8080_step_switch(I8080 *cpu, I8080Bus *bus);
+int i8080_step_table(I8080 *cpu, I8080Bus *bus);
+
+/* Empty the cache (after host-side ROM/RAM changes). */
+void i8080_bcache_flush(I8080BlockCache *bc);
+
+/*
+* Return the block for the current PC, decoding it on a miss, or NULL when
+* the bus has no cache or page map. A block with n_ops == 0 means the next
+* instruction must go through i8080_step().
+*/
+const I8080Block *i8080_block_lookup(const I8080 *cpu, I8080Bus *bus);
+
+/*
+* Run a block from its first op. Returns the t-states spent and stores the
+* number of instructions executed in *n_ops; that is fewer than blk->n_ops
+* only when a store invalidated the block mid-way.
+*/
+int i8080_block_run(I8080 *cpu, I8080Bus *bus, const I8080Block *blk,
+	unsigned *n_ops);
+
+/* True for opcodes that may store to memory (including stack pushes). */
+bool i8080_op_writes(uint8_t op);
+
 /* Request that EI takes effect after the next instruction (8080 behavior). */
 void i8080_set_ei_pending(I8080 *cpu);
 
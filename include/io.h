@@ -14,12 +14,12 @@
  */
 int write_full(int fd, const void *buf, size_t len);
 
+struct iovec;
+
 /*
- * Sleep for up to @us, but wake early when stdin/pty have data.
- *
- * Intended for real-time throttling: avoid busy waits while staying responsive
- * to user input.
+ * writev() counterpart of write_full(): writes every iov entry in order,
+ * resuming after short writes. Returns 0 on success, -1 on error.
  */
-void sleep_or_wait_input_usec(uint32_t usec, bool use_pty, int pty_fd, bool headless);
+int writev_full(int fd, const struct iovec *iov, int iovcnt);
 
 #endif /* ALTAID_IO_H */
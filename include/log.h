@@ -8,6 +8,8 @@
 
 int log_open(const char *path, bool quiet, bool flush_each_write);
 void log_close(void);
+/* Write out buffered lines (--log-flush 0); a no-op otherwise. */
+void log_flush(void);
 void log_printf(const char *fmt, ...);
 void log_vprintf(const char *fmt, va_list ap);
 
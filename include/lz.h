@@ -0,0 +1,35 @@
+/* SPDX-License-Identifier: MIT */
+
+#ifndef ALTAID_LZ_H
+#define ALTAID_LZ_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Small byte-oriented LZ77 codec for RAM images.
+ *
+ * The stream is a run of sequences, each a token byte (literal count in
+ * the high nibble, match length - 4 in the low nibble; 15 means more
+ * length bytes follow, each adding up to 255), the literals, then a u16le
+ * match offset (1..65535) and any extra match length bytes. The last
+ * sequence has literals only. Greedy single-probe hashing keeps it fast
+ * rather than tight, and the encoder strides faster through data that
+ * does not match; long zero runs cost about 1 byte per 255.
+ */
+
+/*
+ * Compress len bytes from src into dst. Returns the compressed size, or 0
+ * if it would exceed cap (store the data raw instead).
+ */
+size_t lz_compress(const uint8_t *src, size_t len, uint8_t *dst, size_t cap);
+
+/*
+ * Decompress src into exactly out_len bytes at dst. Returns false on a
+ * malformed stream or one that does not produce exactly out_len bytes.
+ */
+bool lz_decompress(const uint8_t *src, size_t len, uint8_t *dst,
+		   size_t out_len);
+
+#endif /* ALTAID_LZ_H */
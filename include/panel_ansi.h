@@ -14,6 +14,7 @@
 
 void panel_ansi_set_output(FILE *out);
 
+/* Probed once per output stream, then cached. */
 bool panel_ansi_is_tty(void);
 void panel_ansi_begin(void);
 void panel_ansi_end(void);
@@ -27,6 +28,12 @@ void panel_ansi_set_serial_ro(bool enable);
 void panel_ansi_set_statusline(bool enable);
 void panel_ansi_set_status_override(const char *s);
 void panel_ansi_clear_status_override(void);
+/* Tape transport/position for the statusline ("" hides it). */
+void panel_ansi_set_tape_status(const char *s);
+/*
+ * The terminal size is probed once and kept until this is called (on
+ * SIGWINCH) or a layout setting changes.
+ */
 void panel_ansi_handle_resize(void);
 void panel_ansi_set_term_size_override(bool enable, int rows, int cols);
 void panel_ansi_goto_serial(void);
@@ -0,0 +1,65 @@
+/* SPDX-License-Identifier: MIT */
+
+#ifndef ALTAID_REWIND_H
+#define ALTAID_REWIND_H
+
+#include "emu_core.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Rewind buffer: in-memory snapshots of an EmuCore, oldest first.
+ *
+ * Snapshots use the stateio body layouts (see stateio_snapshot()). A full
+ * snapshot is taken first and whenever the deltas since the last full one
+ * add up to its size, so a restore never replays more than about two full
+ * snapshots' worth of data. When the buffer is over budget the oldest
+ * full snapshot and its deltas are dropped together.
+ */
+
+/*
+ * Smallest nonzero --rewind-mb. A group (a full snapshot of the 512 KiB
+ * RAM plus deltas up to its size) takes just over 1 MiB, and eviction
+ * never drops the newest group, so a smaller budget could not be kept.
+ */
+#define REWIND_MIN_MB	2u
+
+struct RewindSnap {
+	uint64_t	tick;
+	bool		full;
+	uint8_t		*buf;
+	size_t		len;
+};
+
+struct Rewind {
+	struct RewindSnap *snaps;
+	size_t		count;
+	size_t		cap;
+
+	size_t		bytes;		/* total of snaps[].len */
+	size_t		budget;		/* 0 = disabled */
+	size_t		since_full;	/* delta bytes since the last full */
+	bool		force_full;	/* next capture must be full */
+};
+
+void rewind_init(struct Rewind *rw, size_t budget);
+void rewind_free(struct Rewind *rw);
+
+static inline bool rewind_enabled(const struct Rewind *rw)
+{
+	return rw->budget != 0;
+}
+
+/* Snapshot the core now. Returns false on allocation failure. */
+bool rewind_capture(struct Rewind *rw, struct EmuCore *core);
+
+/*
+ * Restore the newest snapshot taken at or before tick (the oldest one if
+ * tick is earlier than that) and drop every snapshot after it. Returns
+ * false if the buffer is empty or a snapshot fails to apply.
+ */
+bool rewind_to(struct Rewind *rw, struct EmuCore *core, uint64_t tick);
+
+#endif /* ALTAID_REWIND_H */
@@ -0,0 +1,58 @@
+/* SPDX-License-Identifier: MIT */
+
+#ifndef ALTAID_RUNLOOP_BATCH_H
+#define ALTAID_RUNLOOP_BATCH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Adaptive CPU batch size for the host runloop.
+ *
+ * Each pass of the runloop polls input, services Ctrl-P requests and
+ * routes output around one emu_core_run_batch() call. With short batches
+ * that host work dominates a --turbo run. While the machine is idle
+ * (nothing queued for it, nothing coming out of it) the batch doubles as
+ * long as a full one would take at most half the latency budget in wall
+ * time, and halves once one would take longer. Realtime runs also cap it
+ * at the budget in emulated time, so paced input is still seen within
+ * the budget. Any sign of activity drops straight back to the minimum
+ * (~0.5 ms), and no batch runs past the next host deadline (panel
+ * refresh, checkpoint, rewind snapshot, --run-ms).
+ */
+struct RunBatch {
+	uint64_t	min_cycles;
+	uint64_t	max_cycles;
+	uint64_t	cycles;		/* idle batch size */
+	uint64_t	budget_nsec;	/* 0: always min_cycles */
+	uint64_t	last_cycles;	/* size of the latest batch */
+
+	/* Totals since init, for runloop_batch_host_permille(). */
+	uint64_t	batches;
+	uint64_t	cycles_run;
+	uint64_t	core_nsec;
+	uint64_t	host_nsec;
+};
+
+void runloop_batch_init(struct RunBatch *b, uint32_t cpu_hz,
+			uint32_t budget_ms, bool realtime);
+
+/*
+ * Size of the next batch. busy resets the idle size to the minimum;
+ * until_due (ticks to the next host deadline) caps it, and 0 (a deadline
+ * already passed) runs a minimum batch.
+ */
+uint64_t runloop_batch_next(struct RunBatch *b, bool busy, uint64_t until_due);
+
+/*
+ * Record a batch of cycles that took core_nsec of wall time, plus the
+ * host_nsec the runloop spent around it (excluding throttle sleeps), and
+ * adjust the idle size. Both come from monotonic_nsec(), the pacing clock.
+ */
+void runloop_batch_account(struct RunBatch *b, uint64_t cycles,
+			   uint64_t core_nsec, uint64_t host_nsec);
+
+/* Host share of the non-sleeping runloop time, in tenths of a percent. */
+unsigned runloop_batch_host_permille(const struct RunBatch *b);
+
+#endif /* ALTAID_RUNLOOP_BATCH_H */
@@ -0,0 +1,164 @@
+/* SPDX-License-Identifier: MIT */
+
+#ifndef ALTAID_RUNLOOP_CORE_H
+#define ALTAID_RUNLOOP_CORE_H
+
+/*
+ * Emulation side of the runloop.
+ *
+ * runloop_core_step() sizes and runs one CPU batch, never past a tick
+ * deadline (--checkpoint, rewind snapshot, --run-ms), then services the
+ * deadlines that fell due. The single-threaded runloop calls it between
+ * input polling and rendering.
+ *
+ * With --threaded, a RunThread calls it on its own thread instead, with
+ * its own realtime pacing, so a slow terminal write or panel redraw on
+ * the UI thread cannot stall emulated time. The two threads share three
+ * lock-free SPSC rings: decoded TX bytes and per-batch EmuFrame snapshots
+ * (panel latches, keys, tape status) go to the UI thread, and serial
+ * bytes and panel keys come back as 2-byte input records. Each side
+ * kicks the other through a pipe it waits on (HOSTEV_WAKE). Ctrl-P
+ * commands that touch the machine (save/load, rewind, cassette, reset,
+ * stats) park the core thread at a batch boundary and run on the UI
+ * thread as before.
+ */
+
+#include "altaid_hw.h"
+#include "emu_core.h"
+#include "emu_host.h"
+#include "hostev.h"
+#include "runloop_render.h"
+#include "spsc.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Ticks from now until due, 0 if due has passed. */
+static inline uint64_t runloop_ticks_until(uint64_t now, uint64_t due)
+{
+	return due > now ? due - now : 0;
+}
+
+/*
+ * Arm the tick deadlines in host from its config, writing the first
+ * --checkpoint base if one is configured.
+ */
+void runloop_core_init(struct EmuHost *host, struct EmuCore *core);
+
+/* Serial input queued or on the wire, or a panel key held. */
+bool runloop_core_busy(const struct EmuCore *core);
+
+/* True once --run-ms of emulated time has run. */
+bool runloop_core_done(const struct EmuHost *host, const struct EmuCore *core);
+
+/*
+ * Run one batch of at most until ticks (see runloop_batch_next() for busy)
+ * and service the tick deadlines it reached. Returns the batch size and
+ * stores the wall time spent inside the core in *core_nsec.
+ */
+uint64_t runloop_core_step(struct EmuHost *host, struct EmuCore *core,
+			   bool busy, uint64_t until, uint64_t *core_nsec);
+
+/* Input records queued for the core thread: { kind, value }. */
+enum {
+	RUN_INPUT_SERIAL = 0,	/* byte for serial_host_enqueue() */
+	RUN_INPUT_KEY,		/* key for altaid_hw_panel_press_key() */
+};
+
+/* What the UI thread needs from one batch. */
+struct EmuFrame {
+	uint64_t	tick;
+	uint32_t	latched_seq;
+	uint16_t	latched_addr;
+	uint8_t		latched_data;
+	uint8_t		latched_stat;
+	bool		latched_valid;
+	uint8_t		led_row_nibble[7];
+	bool		key_down[11];
+	uint8_t		ram_bank;
+	uint8_t		rom_half;
+	bool		rom_low_mapped;
+	bool		rom_hi_mapped;
+	bool		timer_en;
+	char		tape[48];
+};
+
+struct RunThread {
+	struct EmuHost	*host;
+	struct EmuCore	*core;
+	pthread_t	tid;
+
+	struct Spsc	tx;		/* core -> UI: decoded TX bytes */
+	struct Spsc	frames;		/* core -> UI: struct EmuFrame */
+	struct Spsc	input;		/* UI -> core: input records */
+	struct UiInputSink sink;	/* ui_poll() -> input */
+
+	int		ui_pipe[2];	/* kicks the UI (host->ev HOSTEV_WAKE) */
+	int		core_pipe[2];	/* kicks the core thread (ev) */
+	struct HostEv	ev;		/* the core thread's wait */
+	bool		ui_kicked;	/* a byte sits in ui_pipe */
+	bool		core_kicked;	/* a byte sits in core_pipe */
+	bool		tx_stalled;	/* core waits for room in tx */
+	bool		input_stalled;	/* UI waits for room in input */
+
+	pthread_mutex_t	lock;
+	pthread_cond_t	cond;
+	bool		park;		/* UI wants the core held */
+	bool		parked;		/* core is held */
+	bool		stop;
+	bool		done;		/* --run-ms reached; core thread ended */
+
+	uint64_t	key_hold_cycles;
+	uint8_t		held[2];	/* input record waiting for RX room */
+	bool		holding;
+
+	/*
+	 * UI thread's copy of the latest frame. view_hw is a whole AltaidHW
+	 * so the renderers take it as is; only its panel fields are set, and
+	 * the untouched memory arrays stay unbacked zero pages.
+	 */
+	AltaidHW	*view_hw;
+	struct PanelView view;
+};
+
+/*
+ * Start the core thread on core. On failure nothing is left running and
+ * the caller keeps the single-threaded loop.
+ */
+bool runloop_thread_start(struct RunThread *t, struct EmuHost *host,
+			  struct EmuCore *core, uint64_t key_hold_cycles);
+
+/* Stop and join the core thread and free the rings. */
+void runloop_thread_stop(struct RunThread *t);
+
+/* Hold the core thread at its next batch boundary / let it go again. */
+void runloop_thread_park(struct RunThread *t);
+void runloop_thread_resume(struct RunThread *t);
+
+/* True once the core thread has run out --run-ms. */
+bool runloop_thread_done(const struct RunThread *t);
+
+/* UI side: clear a HOSTEV_WAKE kick before looking at the rings. */
+void runloop_thread_woken(struct RunThread *t);
+
+/* UI side: apply queued frames to t->view. Returns true if any arrived. */
+bool runloop_thread_sync(struct RunThread *t);
+
+/* UI side: runloop_tx_drain() for bytes from the core thread. */
+size_t runloop_thread_tx_drain(struct RunThread *t, const PtyOut *pty_out,
+			       const FdOut *serial_out, bool tui_active,
+			       const struct OutputTopology *topo,
+			       bool *had_nl);
+
+/*
+ * UI side: room left for input records. At 0 the core kicks the UI
+ * (HOSTEV_WAKE) once it makes room.
+ */
+uint32_t runloop_thread_input_space(struct RunThread *t);
+
+/* UI side: serial_routing_pty_poll() into the input ring. */
+void runloop_thread_pty_poll(struct RunThread *t, int pty_fd);
+
+#endif /* ALTAID_RUNLOOP_CORE_H */
@@ -0,0 +1,71 @@
+/* SPDX-License-Identifier: MIT */
+
+#ifndef ALTAID_RUNLOOP_PACE_H
+#define ALTAID_RUNLOOP_PACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Realtime pacing for --realtime.
+ *
+ * Emulated time since the base tick is compared with wall time since the
+ * base, both in 64-bit nanoseconds, so a session can run for years
+ * without either side wrapping. Every check measures the phase error
+ * against an absolute target, so oversleeping one wait is paid back by
+ * the next one and never accumulates into drift.
+ *
+ * When the host falls behind (a stall, a slow terminal, a debugger), the
+ * lag is not run off in one full-speed burst. It goes into slew, which
+ * moves the target back, and each check takes slew down by
+ * 1/RUNLOOP_PACE_CATCHUP of the emulated time run since the previous
+ * one: every emulated second run while behind pays back 1/8 s, so the
+ * machine runs at most 8/7 of real speed until it has caught up. Lag
+ * beyond RUNLOOP_PACE_MAX_SLEW_NS (suspend/resume) is dropped rather
+ * than caught up, and counted as a slip.
+ */
+#define RUNLOOP_PACE_CATCHUP		8u
+#define RUNLOOP_PACE_MAX_SLEW_NS	1000000000ull
+
+struct RunPace {
+	uint32_t	cpu_hz;
+	uint64_t	base_tick;
+	uint64_t	base_ns;	/* wall time at base_tick */
+	uint64_t	last_emu_ns;	/* emulated ns at the previous check */
+	uint64_t	slew_ns;	/* lag still being caught up */
+
+	/*
+	 * Metrics since init, kept across rebases. The pacing error is
+	 * emulated minus wall time at a check: ahead means a wait, behind
+	 * is lag that the slew then absorbs.
+	 */
+	int64_t		err_ns;		/* latest, < 0: behind */
+	uint64_t	lag_ns;		/* sum of lag over all checks */
+	uint64_t	lag_max_ns;
+	uint64_t	checks;
+	uint64_t	slips;
+	uint64_t	slipped_ns;
+	uint64_t	waits;		/* waits that ran to their deadline */
+	uint64_t	overshoot_ns;	/* sum of wakeups past the deadline */
+	uint64_t	overshoot_max_ns;
+};
+
+void runloop_pace_init(struct RunPace *p, uint32_t cpu_hz);
+
+/* Pin tick to wall time now_ns (start, reset, state load, rewind). */
+void runloop_pace_rebase(struct RunPace *p, uint64_t tick, uint64_t now_ns);
+
+/*
+ * Emulated time has reached tick at wall time now_ns. Returns how long
+ * to wait before running on, 0 to run now.
+ */
+uint64_t runloop_pace_check(struct RunPace *p, uint64_t tick, uint64_t now_ns);
+
+/* A wait that should have ended at due_ns timed out at now_ns. */
+void runloop_pace_woke(struct RunPace *p, uint64_t due_ns, uint64_t now_ns);
+
+/* Mean lag behind wall time and mean oversleep, in ns (0 before any). */
+uint64_t runloop_pace_lag_avg_ns(const struct RunPace *p);
+uint64_t runloop_pace_overshoot_avg_ns(const struct RunPace *p);
+
+#endif /* ALTAID_RUNLOOP_PACE_H */
@@ -40,26 +40,77 @@ typedef struct {
 } FdOut;
 
 /*
- * Drain any decoded TX bytes sitting in EmuCore's tx buffer to the right
- * host destinations (PTY, serial-out file, TUI serial view). Returns the
- * number of bytes drained; *had_nl is set true if a newline byte was seen.
+ * Host output topology: which stream the UI draws on, whether the standard
+ * streams are terminals, and where non-PTY serial output goes. Probing it
+ * costs isatty()/fstat() syscalls, so the runloop computes it once and
+ * again only on an explicit UI event (UI/panel/read-only toggle, SIGWINCH,
+ * reset). The ui_mode/show_panel/serial_ro fields record the UI state it
+ * was computed for.
+ */
+struct OutputTopology {
+	bool	valid;
+	FILE	*ui_out;
+	int	ui_fd;
+	bool	ui_tty;		/* ui_fd is a terminal */
+	bool	tui_active;	/* --ui wanted and ui_fd is a terminal */
+	bool	stdout_tty;
+	bool	stderr_tty;
+	int	serial_fd;	/* non-PTY serial-out fd, -1 none */
+
+	bool	ui_mode;
+	bool	show_panel;
+	bool	serial_ro;
+};
+
+/*
+ * What the panel renderers draw: the core itself, or under --threaded the
+ * UI thread's copy of the latest published state (see runloop_core.h).
+ */
+struct PanelView {
+	const AltaidHW	*hw;
+	uint64_t	tick;
+	char		tape[48];	/* statusline tape field, "" if none */
+};
+
+/*
+ * Write decoded TX bytes (two spans, the second empty unless they wrap)
+ * to the right host destinations (PTY, serial-out file, TUI serial view).
+ * Returns the number of bytes written; *had_nl is set true if a newline
+ * byte was seen.
+ */
+size_t runloop_tx_write(const struct EmuHost *host,
+			const struct EmuTxSpan span[2], const PtyOut *pty_out,
+			const FdOut *serial_out, bool tui_active,
+			const struct OutputTopology *topo, bool *had_nl);
+
+/*
+ * Drain any decoded TX bytes sitting in EmuCore's tx buffer through
+ * runloop_tx_write(). Returns the number of bytes drained.
  */
 size_t runloop_tx_drain(struct EmuCore *core, const struct EmuHost *host,
 			const PtyOut *pty_out, const FdOut *serial_out,
-			bool tui_active, FILE *ui_out, bool *had_nl);
+			bool tui_active, const struct OutputTopology *topo,
+			bool *had_nl);
 
 /*
- * Emit a text-mode panel snapshot to ui_out, inserting a leading newline
- * if the tty cursor isn't at beginning-of-line.
+ * Emit a text-mode panel snapshot to the UI stream, inserting a leading
+ * newline if the tty cursor isn't at beginning-of-line.
  */
 void runloop_text_snapshot_emit(const struct EmuHost *host,
-				const struct EmuCore *core, FILE *ui_out);
+				const struct PanelView *view,
+				const struct OutputTopology *topo);
+
+/* "Tape:PLAY 1:05/12:30" for the statusline, "" with no tape attached. */
+void runloop_tape_status(const struct EmuCore *core, char *buf, size_t cap);
+
+/* Point view at the live core. */
+void runloop_panel_view(const struct EmuCore *core, struct PanelView *view);
 
 /*
  * Render the front panel via the active renderer (ANSI or text).
  */
 void runloop_panel_render(const struct EmuHost *host,
-			  const struct EmuCore *core, bool tui_active);
+			  const struct PanelView *view, bool tui_active);
 
 /*
  * Recompute panel refresh policy from config + UI state. Sets
@@ -72,7 +123,8 @@ void runloop_compute_panel_policy(const struct EmuHost *host, bool tui_active,
 
 /*
  * Resolve the serial-output fd based on current UI stream, TUI state,
- * panel visibility, and user overrides.
+ * panel visibility, and user overrides. Called when the topology is
+ * recomputed; it probes the terminals itself.
  */
 void runloop_compute_serial_routing(const struct EmuHost *host,
 	const FILE *ui_out, bool tui_active, int *out_fd);
@@ -7,11 +7,14 @@
 #include "emu_host.h"
 
 /*
- * If realtime mode is enabled, sleep (or wait on input) just long enough
- * to keep emulated CPU time from running ahead of wall time. No-op when
- * --turbo is in effect.
+ * If realtime mode is enabled, wait on ev for the sources in mask
+ * (HOSTEV_*) until either one is readable or emulated CPU time no longer
+ * runs ahead of the host->pace target (see runloop_pace.h). Buffered log
+ * lines are flushed first. Returns true if it waited, leaving ev->ready
+ * current; false when behind or under --turbo.
  */
-void runloop_realtime_throttle(const struct EmuHost *host,
-			       const struct EmuCore *core);
+bool runloop_realtime_throttle(struct EmuHost *host,
+			       const struct EmuCore *core,
+			       struct HostEv *ev, unsigned mask);
 
 #endif /* ALTAID_RUNLOOP_TIME_H */
@@ -13,11 +13,18 @@
 #define SERIAL_RX_QUEUE_SIZE 4096u
 #define SERIAL_RX_QUEUE_MASK (SERIAL_RX_QUEUE_SIZE - 1u)
 
+/* Start bit + 8 data bits + stop bit: at most this many level changes. */
+#define SERIAL_RX_EDGES 10u
+
+/* Next-change tick when nothing is scheduled. */
+#define SERIAL_NEVER UINT64_MAX
+
 typedef struct {
 	/* configuration */
 	uint32_t	cpu_hz;
 	uint32_t	baud;
 	uint32_t	ticks_per_bit;	/* integer approximation */
+	uint32_t	rx_ticks_per_bit; /* RX line; == ticks_per_bit by default */
 
 	/* current time in cpu ticks */
 	uint64_t	tick;
@@ -38,6 +45,18 @@ typedef struct {
 	uint64_t	rx_frame_start;
 	uint8_t		rx_byte;
 
+	/*
+	 * The active frame, planned when it starts (derived; not saved): the
+	 * ticks at which the line changes level, runs of equal bits merged,
+	 * and the level from each on. The last entry is the end of the stop
+	 * bit, where the frame ends.
+	 */
+	uint64_t	rx_edge_tick[SERIAL_RX_EDGES];
+	uint8_t		rx_edge_level[SERIAL_RX_EDGES];
+	uint8_t		rx_edge_n;
+	uint8_t		rx_edge_i;	/* next entry */
+	uint8_t		rx_level;	/* line level before rx_edge_i */
+
 	/* interrupt latch: goes true on RX start-bit edge */
 	bool		rx_irq_latched;
 
@@ -55,10 +74,46 @@ void serial_init(SerialDev *s, uint32_t cpu_hz, uint32_t baud);
 int serial_tick_tx(SerialDev *s, uint8_t tx_level,
 void (*putch)(int ch, void *u), void *u);
 
+/*
+ * Clock the RX line at @baud instead of the TX rate (0 restores it). An
+ * active frame is re-planned, so call this after restoring the RX fields
+ * from a state file.
+ */
+void serial_set_rx_baud(SerialDev *s, uint32_t baud);
+
 void serial_host_enqueue(SerialDev *s, uint8_t ch);
 
+/*
+ * Free RX queue slots. Hosts read at most this many bytes from their
+ * input so a full queue holds input back instead of dropping it.
+ */
+static inline uint32_t serial_rx_space(const SerialDev *s)
+{
+	return (s->rx_qh - s->rx_qt - 1u) & SERIAL_RX_QUEUE_MASK;
+}
+
 uint8_t serial_current_rx_level(SerialDev *s);
 
+/*
+ * Tick at which the RX line next changes level or its frame ends, or
+ * SERIAL_NEVER when idle. serial_current_rx_level() returns the same
+ * value until then (unless a new frame starts from the queue).
+ */
+static inline uint64_t serial_rx_next_change(const SerialDev *s)
+{
+	return s->rx_active ? s->rx_edge_tick[s->rx_edge_i] : SERIAL_NEVER;
+}
+
+/*
+ * Tick of the next TX decoder sample point, or SERIAL_NEVER when no frame
+ * is being decoded. Until then serial_tick_tx() only has work when the
+ * line changes.
+ */
+static inline uint64_t serial_tx_next_sample(const SerialDev *s)
+{
+	return s->tx_active ? s->tx_next_sample : SERIAL_NEVER;
+}
+
 static inline void serial_advance(SerialDev *s, uint32_t ticks)
 {
 	s->tick += ticks;
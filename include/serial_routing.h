@@ -47,15 +47,19 @@ int serial_routing_fd(int ui_fd, bool tui_active, bool panel_visible,
 
 /*
  * Drain bytes available on pty_fd (non-blocking) into the emulated serial
- * RX queue. No-op when pty_fd < 0 or ser is NULL.
+ * RX queue. No-op when pty_fd < 0 or ser is NULL. Reads stop when the
+ * queue is full; the rest stays in the PTY until it drains. Call it when
+ * the host event loop reports the PTY readable.
  */
 void serial_routing_pty_poll(int pty_fd, SerialDev *ser);
 
 /*
  * Drain bytes available on STDIN (non-blocking) into the emulated serial
  * RX queue. '\n' is translated to '\r' to match terminal conventions.
+ * Like the PTY poll, reading pauses while the queue is full. Returns
+ * false once stdin hits EOF or fails, so the caller can stop watching it.
  */
-void serial_routing_stdin_poll(SerialDev *ser);
+bool serial_routing_stdin_poll(SerialDev *ser);
 
 /*
  * Parse `n` bytes from `buf` as either UART RX input or Ctrl-P panel
@@ -80,9 +84,10 @@ void serial_routing_stdin_dispatch(const uint8_t *buf, size_t n,
 /*
  * Drain bytes available on STDIN (non-blocking) and split them between
  * the UART RX queue and the panel-press API via
- * serial_routing_stdin_dispatch().
+ * serial_routing_stdin_dispatch(). Returns false at EOF, as
+ * serial_routing_stdin_poll() does.
  */
-void serial_routing_stdin_poll_with_panel(SerialDev *ser, AltaidHW *hw,
+bool serial_routing_stdin_poll_with_panel(SerialDev *ser, AltaidHW *hw,
 					  uint64_t now_tick,
 					  uint64_t hold_cycles,
 					  struct StdinPanelState *state);
@@ -0,0 +1,52 @@
+/* SPDX-License-Identifier: MIT */
+
+#ifndef ALTAID_SPSC_H
+#define ALTAID_SPSC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Lock-free single-producer/single-consumer byte ring.
+ *
+ * One thread writes, one thread reads; neither ever blocks or takes a
+ * lock. head and tail run freely and wrap at 2^32, so with a power-of-two
+ * size head - tail is always the fill level and the whole buffer is
+ * usable. The producer publishes head with a release store after copying
+ * the data in, and the consumer publishes tail the same way after
+ * copying it out, so each side sees the other's bytes complete.
+ *
+ * Fixed-size records go through spsc_push()/spsc_pop(), which move a
+ * whole record or nothing; a record may straddle the end of the buffer.
+ */
+struct Spsc {
+	uint8_t		*buf;
+	uint32_t	size;		/* power of two */
+	uint32_t	head;		/* written by the producer */
+	uint32_t	tail;		/* written by the consumer */
+};
+
+/* Allocate size bytes, rounded up to a power of two. False on OOM. */
+bool spsc_init(struct Spsc *r, uint32_t size);
+void spsc_free(struct Spsc *r);
+
+/* Producer side. */
+uint32_t spsc_space(const struct Spsc *r);
+uint32_t spsc_write(struct Spsc *r, const void *src, uint32_t n);
+bool spsc_push(struct Spsc *r, const void *rec, uint32_t n);
+
+/* Consumer side. */
+uint32_t spsc_avail(const struct Spsc *r);
+uint32_t spsc_read(struct Spsc *r, void *dst, uint32_t n);
+bool spsc_pop(struct Spsc *r, void *rec, uint32_t n);
+
+/*
+ * Zero-copy read: point data[0]/len[0] and data[1]/len[1] at the pending
+ * bytes in order (the second is empty unless they wrap) and return the
+ * total. They stay valid until spsc_commit() frees the first n.
+ */
+uint32_t spsc_peek(const struct Spsc *r, const uint8_t *data[2],
+		   uint32_t len[2]);
+void spsc_commit(struct Spsc *r, uint32_t n);
+
+#endif /* ALTAID_SPSC_H */
@@ -6,24 +6,59 @@
 #include "emu_core.h"
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 /*
  * Persistence helpers.
  *
  * - "state" = CPU + devices + RAM + timing (ROM content is NOT saved).
- *             Self-describing with magic + version for format evolution.
- * - "ram"   = raw bytes.  Save writes the full 512 KiB of RAM; load reads
- *             a file of any size into the given bank at the given offset.
+ *             Self-describing with magic + version for format evolution;
+ *             the RAM is compressed per bank, and version 1 files with raw
+ *             RAM still load. Saves build the file in memory and replace
+ *             it atomically (temp file, fsync, rename); loads map the file.
+ *             The cassette tape stays in its own file: saves flush it
+ *             first and record its edge count, length and hash, and loads
+ *             fail if the reopened tape is shorter or differs up to there.
+ * - "ram"   = raw bytes.  Save writes the full 512 KiB of RAM, or with
+ *             packed a compressed image of it; load reads a raw file of
+ *             any size into the given bank at the given offset, or a
+ *             packed image (recognised by its magic) over all of RAM.
  */
 
-bool stateio_save_state(const struct EmuCore *core, const char *path,
+bool stateio_save_state(struct EmuCore *core, const char *path,
 			char *err, unsigned err_cap);
 bool stateio_load_state(struct EmuCore *core, const char *path,
 			char *err, unsigned err_cap);
 
-bool stateio_save_ram(const struct EmuCore *core, const char *path,
+/*
+ * Incremental checkpoints. With base=true, writes a full state to path
+ * (same as stateio_save_state()); otherwise appends a delta record with
+ * only the RAM lines stored to since the previous checkpoint. Both clear
+ * the core's ALTAID_DIRTY_CHECKPOINT bits on success. stateio_load_state()
+ * restores the base plus every complete delta. Use one checkpoint file per
+ * core.
+ */
+bool stateio_checkpoint(struct EmuCore *core, const char *path, bool base,
 			char *err, unsigned err_cap);
+
+/*
+ * In-memory snapshots for the rewind buffer. stateio_snapshot() returns a
+ * malloc'd body in the state file layout (full) or the checkpoint delta
+ * layout with the RAM lines stored to since the previous snapshot, and
+ * clears the ALTAID_DIRTY_REWIND bits. stateio_restore() applies one; a
+ * delta must go on top of the snapshot taken just before it. Only the
+ * last one restored needs to pass tape=true, which checks the cassette
+ * tape against that snapshot and sets its position; the tape file itself
+ * is never cut.
+ */
+bool stateio_snapshot(struct EmuCore *core, bool full,
+		      uint8_t **out, size_t *out_len);
+bool stateio_restore(struct EmuCore *core, bool full,
+		     const uint8_t *buf, size_t len, bool tape);
+
+bool stateio_save_ram(const struct EmuCore *core, const char *path,
+			bool packed, char *err, unsigned err_cap);
 bool stateio_load_ram(struct EmuCore *core, const char *path,
 			uint32_t flat_offset,
 			char *err, unsigned err_cap);
@@ -8,12 +8,22 @@
 #include <stdint.h>
 
 /*
- * Define TIMEUTIL_USE_CLOCK_GETTIME to use clock_gettime(CLOCK_MONOTONIC)
- * instead of gettimeofday().
+ * CLOCK_MONOTONIC nanoseconds since the first call. 64 bits never wrap,
+ * so realtime pacing compares absolute times with it.
+ */
+uint64_t monotonic_nsec(void);
+
+/*
+ * The same clock in microseconds, truncated to 32 bits: it wraps after
+ * ~71 minutes, so only take short differences of it. The runloop times
+ * batches and pacing with monotonic_nsec() instead.
  */
 uint32_t monotonic_usec(void);
-uint32_t emu_tick_to_usec(uint64_t tick, uint32_t hz);
+
+uint64_t emu_tick_to_usec(uint64_t tick, uint32_t hz);
+uint64_t emu_tick_to_nsec(uint64_t tick, uint32_t hz);
 
 void sleep_usec(uint32_t usec);
+void sleep_nsec(uint64_t nsec);
 
 #endif /* ALTAID_TIMEUTIL_H */
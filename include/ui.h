@@ -10,6 +10,19 @@
 #include <stdint.h>
 #include <stdio.h>
 
+/*
+ * Where ui_poll() sends serial bytes and panel keys when the core runs on
+ * another thread (--threaded). Without one they go straight to the core.
+ * space() is how many more the sink takes now; a key byte may send two
+ * (a chord), so ui_poll() reads at most half that from stdin.
+ */
+struct UiInputSink {
+	void	*ctx;
+	void	(*serial)(void *ctx, uint8_t ch);
+	void	(*key)(void *ctx, uint8_t key);
+	uint32_t (*space)(void *ctx);
+};
+
 typedef struct {
 	enum {
 		UI_PROMPT_NONE = 0,
@@ -20,6 +33,7 @@ typedef struct {
 
 	char	state_path[512];
 	char	ram_path[512];
+	bool	ram_packed;	/* Ctrl-P b saves a compressed image */
 	char	cass_path[512];
 
 	bool	prompt_active;
@@ -30,6 +44,8 @@ typedef struct {
 	bool	req_state_load;
 	bool	req_ram_save;
 	bool	req_ram_load;
+	bool	req_rewind;
+	bool	req_stats;	/* print batch size and host overhead */
 
 	bool	req_cass_attach;
 	bool	req_cass_save;
@@ -38,6 +54,7 @@ typedef struct {
 	bool	req_cass_stop;
 	bool	req_cass_rewind;
 	bool	req_cass_ff;
+	bool	req_cass_back;
 
 	bool	panel_prefix;	/* saw Ctrl-P */
 	bool	show_panel;	/* toggle live panel rendering */
@@ -51,6 +68,8 @@ typedef struct {
 	bool	pty_mode;	/* --pty active */
 	bool	pty_input;	/* reserved; PTY mode forces serial read-only */
 	bool	event;		/* UI performed an action */
+
+	const struct UiInputSink *sink;	/* NULL: input goes to the core */
 } UI;
 
 const char *ui_help_string(bool direct);
@@ -60,7 +79,13 @@ void ui_shutdown(UI *ui);
 
 void ui_set_output(FILE *out);
 
-void ui_poll(UI *ui, SerialDev *s, AltaidHW *hw, uint64_t now_tick,
+/*
+ * Read and act on the keys waiting on stdin. Returns false once stdin hits
+ * EOF or fails, so the caller can stop watching it. With ui->sink set, s
+ * may be NULL, hw is only read (Ctrl-P d), and bytes the sink has no room
+ * for stay in stdin.
+ */
+bool ui_poll(UI *ui, SerialDev *s, AltaidHW *hw, uint64_t now_tick,
 uint64_t key_hold_cycles);
 
 #endif /* ALTAID_EMU_UI_H */
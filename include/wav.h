@@ -0,0 +1,38 @@
+/* SPDX-License-Identifier: MIT */
+
+#ifndef ALTAID_WAV_H
+#define ALTAID_WAV_H
+
+#include "cassette.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * PCM WAV front end for the cassette edge model.
+ *
+ * Import runs a comparator with hysteresis over the first channel of an
+ * 8-bit (unsigned) or 16-bit (signed) PCM file: a slow DC tracker removes
+ * offset, a decaying peak envelope sets the thresholds at a quarter of the
+ * recent amplitude, and each threshold crossing becomes an edge. Export
+ * renders the edges as a 16-bit mono square wave. Both stream the file a
+ * block at a time; memory use does not depend on its length.
+ */
+
+/* True if fd holds a RIFF/WAVE file. */
+bool wav_sniff(int fd);
+
+/*
+ * Decode the WAV file in fd, appending one duration (in c->cpu_hz ticks)
+ * per comparator edge to c. Returns false on a format it cannot read
+ * (not PCM, not 8/16-bit) or a failed append.
+ */
+bool wav_import(int fd, Cassette *c);
+
+/*
+ * Write c's edges to fd as a WAV file at rate samples/s, starting at
+ * c->idle_level. fd should be empty.
+ */
+bool wav_export(Cassette *c, int fd, uint32_t rate);
+
+#endif /* ALTAID_WAV_H */
@@ -37,6 +37,57 @@ static void recompute_ram_bank(AltaidHW *hw)
 	hw->ram_bank = (uint8_t)((hw->ram_a18 ? 4 : 0) | (hw->ram_a17 ? 2 : 0) | (hw->ram_a16 ? 1 : 0));
 }
 
+void altaid_hw_remap(AltaidHW *hw)
+{
+	uint8_t *ram;
+	const uint8_t *rom;
+
+	hw->ram_bank &= 7u;
+	hw->rom_half &= 1u;
+	ram = hw->ram[hw->ram_bank];
+	rom = hw->rom[hw->rom_half];
+
+	for (unsigned i = 0; i < I8080_PAGE_COUNT; i++) {
+		uint32_t base = (uint32_t)i << I8080_PAGE_SHIFT;
+
+		/* Shadow ROM: writes always go to RAM. */
+		hw->wr_page[i] = ram + base;
+		hw->wr_dirty[i] = hw->ram_dirty +
+			((((uint32_t)hw->ram_bank << 16) | base) >> ALTAID_DIRTY_SHIFT);
+		hw->rd_page[i] = ram + base;
+
+		if (base < 0x8000u && hw->rom_low_mapped)
+			hw->rd_page[i] = rom + base;
+		else if (base >= 0x8000u && base < 0xC000u && hw->rom_hi_mapped)
+			hw->rd_page[i] = rom + (base - 0x8000u);
+	}
+}
+
+void altaid_hw_dirty_all(AltaidHW *hw)
+{
+	memset(hw->ram_dirty, ALTAID_DIRTY_ALL, sizeof(hw->ram_dirty));
+}
+
+void altaid_hw_dirty_clear(AltaidHW *hw, uint8_t bits)
+{
+	uint8_t keep = (uint8_t)~bits;
+
+	for (size_t i = 0; i < sizeof(hw->ram_dirty); i++)
+		hw->ram_dirty[i] &= keep;
+}
+
+void altaid_hw_attach_bus(AltaidHW *hw, I8080Bus *bus)
+{
+	bus->user = hw;
+	bus->mem_read = altaid_mem_read;
+	bus->mem_write = altaid_mem_write;
+	bus->io_in = altaid_io_in;
+	bus->io_out = altaid_io_out;
+	bus->rd_page = hw->rd_page;
+	bus->wr_page = hw->wr_page;
+	bus->wr_dirty = hw->wr_dirty;
+}
+
 static void panel_latch_if_complete(AltaidHW *hw)
 {
 	uint16_t a;
@@ -110,6 +161,7 @@ void altaid_hw_init(AltaidHW *hw)
 
 	hw->rom_low_mapped = true;  /* latch starts at 0 => enable ROM at 0000 */
 	hw->rom_hi_mapped = false;
+	altaid_hw_remap(hw);
 
 	hw->out_c0 = 0;
 	hw->tx_line = true;         /* idle high */
@@ -152,6 +204,7 @@ void altaid_hw_reset_runtime(AltaidHW *hw)
 
 	hw->rom_low_mapped = true;
 	hw->rom_hi_mapped = false;
+	altaid_hw_remap(hw);
 
 	hw->out_c0 = 0;
 	hw->tx_line = true;  /* idle high */
@@ -225,6 +278,8 @@ void altaid_mem_write(I8080Bus *bus, uint16_t addr, uint8_t v)
 
 	/* Shadow ROM: writes always go to RAM, even if reads are coming from ROM. */
 	hw->ram[hw->ram_bank][addr] = v;
+	hw->ram_dirty[((uint32_t)hw->ram_bank << 8) | (addr >> ALTAID_DIRTY_SHIFT)] =
+		ALTAID_DIRTY_ALL;
 }
 
 uint8_t altaid_io_in(I8080Bus *bus, uint8_t port)
@@ -238,6 +293,8 @@ uint8_t altaid_io_in(I8080Bus *bus, uint8_t port)
 		/* switch columns for current scan row */
 		uint8_t row = (uint8_t)(hw->scan_row & 7u);
 		uint8_t sw = panel_switch_nibble_for_row(hw, row);
+
+		hw->input_reads++;
 		v = (uint8_t)((v & 0xF0u) | (sw & 0x0Fu));
 
 		/*
@@ -289,29 +346,35 @@ void altaid_io_out(I8080Bus *bus, uint8_t port, uint8_t v)
 
 	case ALTAID_PORT_ROM_HI:
 		hw->rom_hi_mapped = (v != 0);
+		altaid_hw_remap(hw);
 		break;
 
 	case ALTAID_PORT_ROM_LOW:
 		hw->rom_low_mapped = (v == 0);
+		altaid_hw_remap(hw);
 		break;
 
 	case ALTAID_PORT_B15:
 		hw->rom_half = (uint8_t)(v & 1u);
+		altaid_hw_remap(hw);
 		break;
 
 	case ALTAID_PORT_B16:
 		hw->ram_a16 = (uint8_t)(v & 1u);
 		recompute_ram_bank(hw);
+		altaid_hw_remap(hw);
 		break;
 
 	case ALTAID_PORT_B17:
 		hw->ram_a17 = (uint8_t)(v & 1u);
 		recompute_ram_bank(hw);
+		altaid_hw_remap(hw);
 		break;
 
 	case ALTAID_PORT_B18:
 		hw->ram_a18 = (uint8_t)(v & 1u);
 		recompute_ram_bank(hw);
+		altaid_hw_remap(hw);
 		break;
 
 	case ALTAID_PORT_TIMER:
@@ -0,0 +1,566 @@
+/* SPDX-License-Identifier: MIT */
+
+/* For pthreads and sysconf() in strict C99 builds. */
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "batch.h"
+
+#include "emu_core.h"
+#include "serial_routing.h"
+#include "timeutil.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define BATCH_LINE_MAX 4096u
+
+static void err_set(char *err, unsigned cap, const char *msg)
+{
+	if (!err || cap == 0)
+		return;
+	snprintf(err, cap, "%s", msg ? msg : "error");
+}
+
+static char *str_dup(const char *s)
+{
+	size_t n;
+	char *p;
+
+	if (!s)
+		return NULL;
+	n = strlen(s) + 1u;
+	p = malloc(n);
+	if (p)
+		memcpy(p, s, n);
+	return p;
+}
+
+static bool parse_u32(const char *s, uint32_t *out)
+{
+	unsigned long v;
+	char *end;
+
+	if (!*s || *s == '-')
+		return false;
+	errno = 0;
+	v = strtoul(s, &end, 10);
+	if (errno || *end || v > UINT32_MAX)
+		return false;
+	*out = (uint32_t)v;
+	return true;
+}
+
+static void job_free(struct BatchJob *job)
+{
+	free(job->rom_path);
+	free(job->in_path);
+	free(job->out_path);
+	job->rom_path = NULL;
+	job->in_path = NULL;
+	job->out_path = NULL;
+}
+
+/* Replace *slot with a private copy of s. */
+static bool set_path(char **slot, const char *s)
+{
+	char *p = str_dup(s);
+
+	if (!p)
+		return false;
+	free(*slot);
+	*slot = p;
+	return true;
+}
+
+int batch_parse_line(const char *line, const struct BatchJob *defaults,
+		     struct BatchJob *job, char *err, unsigned err_cap)
+{
+	char buf[BATCH_LINE_MAX];
+	char *tok;
+	char *save;
+	char *hash;
+
+	if (!line || !defaults || !job) {
+		err_set(err, err_cap, "invalid arguments");
+		return -1;
+	}
+	if (strlen(line) >= sizeof(buf)) {
+		err_set(err, err_cap, "line too long");
+		return -1;
+	}
+	strcpy(buf, line);
+	hash = strchr(buf, '#');
+	if (hash)
+		*hash = '\0';
+
+	tok = strtok_r(buf, " \t\r\n", &save);
+	if (!tok)
+		return 0;
+	if (strchr(tok, '=') || strlen(tok) >= BATCH_NAME_MAX) {
+		err_set(err, err_cap, "line must start with a job name");
+		return -1;
+	}
+
+	*job = *defaults;
+	job->rom_path = NULL;
+	job->in_path = NULL;
+	job->out_path = NULL;
+	snprintf(job->name, sizeof(job->name), "%s", tok);
+	if (defaults->rom_path && !set_path(&job->rom_path, defaults->rom_path))
+		goto oom;
+
+	while ((tok = strtok_r(NULL, " \t\r\n", &save)) != NULL) {
+		char *val = strchr(tok, '=');
+		bool ok;
+
+		if (!val || val == tok || !val[1]) {
+			snprintf(err, err_cap, "expected key=value, got '%s'", tok);
+			goto fail;
+		}
+		*val++ = '\0';
+
+		if (!strcmp(tok, "rom")) {
+			if (!set_path(&job->rom_path, val))
+				goto oom;
+			continue;
+		}
+		if (!strcmp(tok, "in")) {
+			if (!set_path(&job->in_path, val))
+				goto oom;
+			continue;
+		}
+		if (!strcmp(tok, "out")) {
+			if (!set_path(&job->out_path, val))
+				goto oom;
+			continue;
+		}
+
+		if (!strcmp(tok, "run-ms"))
+			ok = parse_u32(val, &job->run_ms) && job->run_ms;
+		else if (!strcmp(tok, "hz"))
+			ok = parse_u32(val, &job->cpu_hz) && job->cpu_hz;
+		else if (!strcmp(tok, "baud"))
+			ok = parse_u32(val, &job->baud) && job->baud;
+		else if (!strcmp(tok, "rx-baud"))
+			ok = parse_u32(val, &job->rx_baud);
+		else {
+			snprintf(err, err_cap, "unknown key '%s'", tok);
+			goto fail;
+		}
+		if (!ok) {
+			snprintf(err, err_cap, "bad value for %s: '%s'", tok, val);
+			goto fail;
+		}
+	}
+
+	if (!job->rom_path) {
+		err_set(err, err_cap, "no ROM (add rom= or pass a ROM argument)");
+		goto fail;
+	}
+	return 1;
+
+oom:
+	err_set(err, err_cap, "out of memory");
+fail:
+	job_free(job);
+	return -1;
+}
+
+static bool manifest_push(struct BatchManifest *m, const struct BatchJob *job)
+{
+	if (m->count == m->cap) {
+		size_t cap = m->cap ? m->cap * 2u : 16u;
+		struct BatchJob *p = realloc(m->jobs, cap * sizeof(*p));
+
+		if (!p)
+			return false;
+		m->jobs = p;
+		m->cap = cap;
+	}
+	m->jobs[m->count++] = *job;
+	return true;
+}
+
+bool batch_manifest_load(struct BatchManifest *m, const char *path,
+			 const struct BatchJob *defaults,
+			 char *err, unsigned err_cap)
+{
+	char line[BATCH_LINE_MAX];
+	char msg[BATCH_ERR_MAX];
+	unsigned lineno = 0;
+	FILE *f;
+
+	if (!m || !path || !defaults) {
+		err_set(err, err_cap, "invalid arguments");
+		return false;
+	}
+	memset(m, 0, sizeof(*m));
+
+	f = fopen(path, "r");
+	if (!f) {
+		snprintf(err, err_cap, "open %s: %s", path, strerror(errno));
+		return false;
+	}
+
+	while (fgets(line, sizeof(line), f)) {
+		struct BatchJob job;
+		int r;
+
+		lineno++;
+		if (!strchr(line, '\n') && !feof(f)) {
+			snprintf(err, err_cap, "%s:%u: line too long", path, lineno);
+			goto fail;
+		}
+
+		r = batch_parse_line(line, defaults, &job, msg, sizeof(msg));
+		if (r < 0) {
+			snprintf(err, err_cap, "%s:%u: %s", path, lineno, msg);
+			goto fail;
+		}
+		if (r == 0)
+			continue;
+		if (!manifest_push(m, &job)) {
+			job_free(&job);
+			err_set(err, err_cap, "out of memory");
+			goto fail;
+		}
+	}
+
+	if (ferror(f)) {
+		snprintf(err, err_cap, "read %s: %s", path, strerror(errno));
+		goto fail;
+	}
+	fclose(f);
+
+	if (m->count == 0) {
+		snprintf(err, err_cap, "%s: no jobs", path);
+		return false;
+	}
+	return true;
+
+fail:
+	fclose(f);
+	batch_manifest_free(m);
+	return false;
+}
+
+void batch_manifest_free(struct BatchManifest *m)
+{
+	if (!m)
+		return;
+	for (size_t i = 0; i < m->count; i++)
+		job_free(&m->jobs[i]);
+	free(m->jobs);
+	memset(m, 0, sizeof(*m));
+}
+
+static uint8_t *read_file(const char *path, size_t *len)
+{
+	uint8_t *buf = NULL;
+	size_t cap = 0;
+	size_t n = 0;
+	FILE *f;
+
+	*len = 0;
+	f = fopen(path, "rb");
+	if (!f)
+		return NULL;
+
+	for (;;) {
+		size_t got;
+
+		if (n == cap) {
+			size_t ncap = cap ? cap * 2u : 4096u;
+			uint8_t *p = realloc(buf, ncap);
+
+			if (!p) {
+				free(buf);
+				fclose(f);
+				return NULL;
+			}
+			buf = p;
+			cap = ncap;
+		}
+		got = fread(buf + n, 1, cap - n, f);
+		n += got;
+		if (got == 0)
+			break;
+	}
+
+	if (ferror(f)) {
+		free(buf);
+		fclose(f);
+		return NULL;
+	}
+	fclose(f);
+	*len = n;
+	return buf;
+}
+
+/* Write out (or just count) everything the core has decoded. */
+static bool drain_tx(struct EmuCore *core, FILE *out, uint64_t *total)
+{
+	struct EmuTxSpan span[2];
+	size_t n = emu_core_tx_peek(core, span);
+
+	if (!n)
+		return true;
+	for (int i = 0; out && i < 2; i++) {
+		if (span[i].len &&
+		    fwrite(span[i].data, 1, span[i].len, out) != span[i].len)
+			return false;
+	}
+	emu_core_tx_commit(core, n);
+	*total += n;
+	return true;
+}
+
+void batch_run_job(struct BatchJob *job)
+{
+	struct StdinPanelState panel = { false };
+	struct EmuCore *core;
+	uint8_t *in = NULL;
+	size_t in_len = 0;
+	size_t in_pos = 0;
+	FILE *out = NULL;
+	uint64_t end_tick;
+	uint64_t batch_cycles;
+	uint64_t hold_cycles;
+	uint64_t start;
+
+	if (!job)
+		return;
+
+	job->ok = false;
+	job->err[0] = '\0';
+	job->ticks = 0;
+	job->insns = 0;
+	job->rx_bytes = 0;
+	job->tx_bytes = 0;
+	job->wall_nsec = 0;
+
+	core = malloc(sizeof(*core));
+	if (!core) {
+		err_set(job->err, sizeof(job->err), "out of memory");
+		return;
+	}
+
+	emu_core_init(core, job->cpu_hz, job->baud);
+	emu_core_set_rx_baud(core, job->rx_baud);
+	/* Nothing may be lost: stall instead of dropping TX bytes. */
+	core->cfg.tx_overflow = EMU_TX_BLOCK;
+
+	if (!emu_core_load_rom64k(core, job->rom_path)) {
+		snprintf(job->err, sizeof(job->err), "cannot load ROM %s",
+			 job->rom_path);
+		goto done;
+	}
+
+	if (job->in_path) {
+		in = read_file(job->in_path, &in_len);
+		if (!in) {
+			snprintf(job->err, sizeof(job->err), "read %s: %s",
+				 job->in_path, strerror(errno));
+			goto done;
+		}
+	}
+
+	if (job->out_path) {
+		out = fopen(job->out_path, "wb");
+		if (!out) {
+			snprintf(job->err, sizeof(job->err), "open %s: %s",
+				 job->out_path, strerror(errno));
+			goto done;
+		}
+	}
+
+	/* Same batch and hold timing as the interactive runloop. */
+	end_tick = (uint64_t)job->cpu_hz * (uint64_t)job->run_ms / 1000ull;
+	batch_cycles = job->cpu_hz / 2000u;
+	if (batch_cycles < 32)
+		batch_cycles = 32;
+	hold_cycles = (uint64_t)job->cpu_hz * (uint64_t)job->hold_ms / 1000ull;
+	if (hold_cycles == 0)
+		hold_cycles = 1;
+
+	start = monotonic_nsec();
+	while (core->ser.tick < end_tick) {
+		uint64_t left = end_tick - core->ser.tick;
+
+		/* Feed scripted RX only as fast as the queue accepts it. */
+		if (in_pos < in_len) {
+			size_t n = serial_rx_space(&core->ser);
+
+			if (n > in_len - in_pos)
+				n = in_len - in_pos;
+			serial_routing_stdin_dispatch(in + in_pos, n, &core->ser,
+						      &core->hw, core->ser.tick,
+						      hold_cycles, &panel);
+			in_pos += n;
+		}
+
+		emu_core_run_batch(core, left < batch_cycles ? left : batch_cycles);
+
+		if (!drain_tx(core, out, &job->tx_bytes)) {
+			snprintf(job->err, sizeof(job->err), "write %s: %s",
+				 job->out_path, strerror(errno));
+			goto done;
+		}
+	}
+	job->wall_nsec = monotonic_nsec() - start;
+	job->ok = true;
+
+done:
+	job->ticks = core->ser.tick;
+	job->insns = core->insn_count;
+	job->rx_bytes = in_pos;
+	if (out && fclose(out) != 0 && job->ok) {
+		job->ok = false;
+		snprintf(job->err, sizeof(job->err), "close %s: %s",
+			 job->out_path, strerror(errno));
+	}
+	free(in);
+	cassette_free(&core->cas);
+	free(core);
+}
+
+/* Jobs are claimed in manifest order; idle workers take the next one. */
+struct BatchPool {
+	struct BatchManifest	*m;
+	size_t			next;
+	pthread_mutex_t		lock;
+};
+
+static void *batch_worker(void *arg)
+{
+	struct BatchPool *pool = arg;
+
+	for (;;) {
+		size_t i;
+
+		pthread_mutex_lock(&pool->lock);
+		i = pool->next++;
+		pthread_mutex_unlock(&pool->lock);
+
+		if (i >= pool->m->count)
+			break;
+		batch_run_job(&pool->m->jobs[i]);
+	}
+	return NULL;
+}
+
+/* n per microsecond of nsec wall time (insns: MIPS). */
+static double per_usec(uint64_t n, uint64_t nsec)
+{
+	return nsec ? (double)n * 1e3 / (double)nsec : 0.0;
+}
+
+static void print_report(const struct BatchManifest *m, unsigned threads,
+			 uint64_t wall_nsec)
+{
+	uint64_t insns = 0;
+	double emu_sec = 0.0;
+	size_t failed = 0;
+
+	for (size_t i = 0; i < m->count; i++) {
+		const struct BatchJob *job = &m->jobs[i];
+
+		if (!job->ok) {
+			failed++;
+			printf("job %s: FAIL %s\n", job->name, job->err);
+			continue;
+		}
+		printf("job %s: ok ticks=%llu insns=%llu rx=%llu tx=%llu "
+		       "wall_ms=%.1f mips=%.1f\n",
+		       job->name,
+		       (unsigned long long)job->ticks,
+		       (unsigned long long)job->insns,
+		       (unsigned long long)job->rx_bytes,
+		       (unsigned long long)job->tx_bytes,
+		       job->wall_nsec / 1e6,
+		       per_usec(job->insns, job->wall_nsec));
+		insns += job->insns;
+		emu_sec += (double)job->ticks / (double)job->cpu_hz;
+	}
+
+	printf("batch: %zu jobs, %zu failed, %u threads, wall_ms=%.1f, "
+	       "mips=%.1f, realtime=%.1fx\n",
+	       m->count, failed, threads, wall_nsec / 1e6,
+	       per_usec(insns, wall_nsec),
+	       wall_nsec ? emu_sec * 1e9 / wall_nsec : 0.0);
+}
+
+int batch_run(const struct Config *cfg)
+{
+	struct BatchJob defaults;
+	struct BatchManifest m;
+	struct BatchPool pool;
+	pthread_t *tids;
+	unsigned threads;
+	unsigned started = 0;
+	uint64_t start;
+	char err[256];
+	int rc = 0;
+
+	if (!cfg || !cfg->batch_path)
+		return 2;
+
+	memset(&defaults, 0, sizeof(defaults));
+	defaults.rom_path = (char *)cfg->rom_path;
+	defaults.cpu_hz = cfg->cpu_hz;
+	defaults.baud = cfg->baud;
+	defaults.rx_baud = cfg->rx_baud;
+	defaults.run_ms = cfg->max_run_ms ? cfg->max_run_ms : BATCH_DEFAULT_RUN_MS;
+	defaults.hold_ms = cfg->hold_ms;
+
+	if (!batch_manifest_load(&m, cfg->batch_path, &defaults,
+				 err, sizeof(err))) {
+		fprintf(stderr, "--batch: %s\n", err);
+		return 2;
+	}
+
+	threads = cfg->batch_threads;
+	if (threads == 0) {
+		long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+		threads = n > 0 ? (unsigned)n : 1u;
+	}
+	if (threads > m.count)
+		threads = (unsigned)m.count;
+
+	pool.m = &m;
+	pool.next = 0;
+	pthread_mutex_init(&pool.lock, NULL);
+
+	/* Prime the shared clock base before any worker reads it. */
+	start = monotonic_nsec();
+
+	/* The calling thread is worker 0. */
+	tids = calloc(threads, sizeof(*tids));
+	for (unsigned i = 1; tids && i < threads; i++) {
+		if (pthread_create(&tids[i], NULL, batch_worker, &pool) != 0)
+			break;
+		started++;
+	}
+	batch_worker(&pool);
+	for (unsigned i = 1; i <= started; i++)
+		pthread_join(tids[i], NULL);
+	free(tids);
+	pthread_mutex_destroy(&pool.lock);
+
+	print_report(&m, started + 1u, monotonic_nsec() - start);
+	fflush(stdout);
+
+	for (size_t i = 0; i < m.count; i++) {
+		if (!m.jobs[i].ok)
+			rc = 1;
+	}
+	batch_manifest_free(&m);
+	return rc;
+}
@@ -1,15 +1,28 @@
 /* SPDX-License-Identifier: MIT */
 
+/* For pread(), pwrite() and mkstemp() in strict C99 builds. */
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+
 #include "cassette.h"
+#include "wav.h"
 
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 enum { CAS_MAGIC_LEN = 8 };
 
 static const unsigned char k_magic[CAS_MAGIC_LEN] = {'A','L','T','A','P','0','0','1'};
+static const unsigned char k_magic2[CAS_MAGIC_LEN] = {'A','L','T','A','P','0','0','2'};
 
+/* ALTAP001: host-order header, then one uint32_t per edge. */
 typedef struct {
 	unsigned char magic[CAS_MAGIC_LEN];
 	uint32_t version;       /* 1 */
@@ -19,123 +32,918 @@ typedef struct {
 	uint32_t count;         /* number of durations */
 } CassFileHdr;
 
-static void vec_reserve(Cassette *c, size_t want)
+/*
+ * ALTAP002 (all little-endian):
+ *   header  magic[8] u32 cpu_hz, u8 initial_level, u8 reserved[3],
+ *           u64 count, u64 index_off (0 = no index; scan the blocks)
+ *   blocks  u32 payload_len, u32 edges, u64 ticks, payload
+ *   index   u64 nblocks, then u64 off, u64 start_tick per block
+ * Block b holds edges b * CASSETTE_WINDOW on; all but the last are full.
+ * The payload is a run of varints: v even is one duration, zigzag(v / 2)
+ * added to the previous one in the block (starting from 0); v odd repeats
+ * the previous two durations v / 2 times.
+ */
+enum {
+	CAS_HDR2_LEN = 32,
+	CAS_BLK_HDR_LEN = 16,
+	/* A 33-bit zigzag delta plus the tag bit fits 5 varint bytes. */
+	CAS_BLK_MAX = CASSETTE_WINDOW * 5,
+};
+
+/* Format new tapes are written in. */
+#define CAS_VERSION_DEFAULT	2u
+
+/* 64-bit FNV-1a, for cassette_hash(). */
+#define CAS_FNV_BASIS	0xcbf29ce484222325ull
+#define CAS_FNV_PRIME	0x100000001b3ull
+
+static void put_le(uint8_t *p, uint64_t v, unsigned n)
+{
+	for (unsigned i = 0; i < n; i++)
+		p[i] = (uint8_t)(v >> (8u * i));
+}
+
+static uint64_t get_le(const uint8_t *p, unsigned n)
+{
+	uint64_t v = 0;
+
+	for (unsigned i = 0; i < n; i++)
+		v |= (uint64_t)p[i] << (8u * i);
+	return v;
+}
+
+/* File offset of edge i (ALTAP001). */
+static off_t edge_off(size_t i)
 {
-	if (want <= c->dur_cap) return;
-	size_t nc = c->dur_cap ? c->dur_cap : 1024;
-	while (nc < want) nc *= 2;
-	uint32_t *np = (uint32_t *)realloc(c->durations, nc * sizeof(uint32_t));
-	if (!np) return;
-	c->durations = np;
-	c->dur_cap = nc;
+	return (off_t)sizeof(CassFileHdr) + (off_t)i * (off_t)sizeof(uint32_t);
 }
 
-static void vec_push(Cassette *c, uint32_t v)
+/* pread() up to len bytes; returns how many were read before EOF/error. */
+static size_t pread_upto(int fd, void *dst, size_t len, off_t off)
 {
-	vec_reserve(c, c->dur_count + 1);
-	if (c->dur_count < c->dur_cap) {
-		c->durations[c->dur_count++] = v;
+	uint8_t *p = dst;
+	size_t got = 0;
+
+	while (got < len) {
+		ssize_t n = pread(fd, p + got, len - got, off + (off_t)got);
+		if (n < 0 && errno == EINTR) continue;
+		if (n <= 0) break;
+		got += (size_t)n;
 	}
+	return got;
 }
 
-void cassette_init(Cassette *c, uint32_t cpu_hz)
+static bool pwrite_all(int fd, const void *src, size_t len, off_t off)
 {
-	memset(c, 0, sizeof(*c));
-	c->cpu_hz = cpu_hz;
-	c->idle_level = true; /* idle high is a sane default for the MIO comparator */
-	c->in_level = c->idle_level;
+	const uint8_t *p = src;
+
+	while (len) {
+		ssize_t n = pwrite(fd, p, len, off);
+		if (n < 0 && errno == EINTR) continue;
+		if (n <= 0) return false;
+		p += n;
+		len -= (size_t)n;
+		off += n;
+	}
+	return true;
 }
 
-void cassette_free(Cassette *c)
+static bool hdr_write(Cassette *c, int fd, uint64_t count, uint64_t index_off)
 {
-	cassette_stop(c);
-	if (c->durations) {
-		free(c->durations);
-		c->durations = NULL;
+	CassFileHdr h;
+	uint8_t h2[CAS_HDR2_LEN];
+
+	if (c->version == 1) {
+		memset(&h, 0, sizeof(h));
+		memcpy(h.magic, k_magic, CAS_MAGIC_LEN);
+		h.version = 1;
+		h.cpu_hz = c->cpu_hz;
+		h.initial_level = (uint8_t)(c->idle_level ? 1 : 0);
+		h.count = (uint32_t)count;
+		return pwrite_all(fd, &h, sizeof(h), 0);
+	}
+
+	memset(h2, 0, sizeof(h2));
+	memcpy(h2, k_magic2, CAS_MAGIC_LEN);
+	put_le(h2 + 8, c->cpu_hz, 4);
+	h2[12] = (uint8_t)(c->idle_level ? 1 : 0);
+	put_le(h2 + 16, count, 8);
+	put_le(h2 + 24, index_off, 8);
+	return pwrite_all(fd, h2, sizeof(h2), 0);
+}
+
+static size_t put_varint(uint8_t *p, uint64_t v)
+{
+	size_t n = 0;
+
+	while (v >= 0x80u) {
+		p[n++] = (uint8_t)(v | 0x80u);
+		v >>= 7;
+	}
+	p[n++] = (uint8_t)v;
+	return n;
+}
+
+static bool get_varint(const uint8_t *p, size_t len, size_t *ip, uint64_t *v)
+{
+	*v = 0;
+	for (unsigned shift = 0; shift < 64u; shift += 7u) {
+		uint8_t b;
+
+		if (*ip >= len) return false;
+		b = p[(*ip)++];
+		*v |= (uint64_t)(b & 0x7Fu) << shift;
+		if (!(b & 0x80u)) return true;
+	}
+	return false;
+}
+
+/* Encode n durations as a block payload; returns its length. */
+static size_t blk_encode(const uint32_t *d, size_t n, uint8_t *out)
+{
+	uint32_t prev = 0;
+	size_t op = 0;
+	size_t i = 0;
+
+	while (i < n) {
+		size_t k = 0;
+		int64_t delta;
+		uint64_t zz;
+
+		/* Pulse trains repeat the previous (duration, duration) pair. */
+		if (i >= 2) {
+			while (i + 2 * k + 1 < n && d[i + 2 * k] == d[i - 2] &&
+			       d[i + 2 * k + 1] == d[i - 1])
+				k++;
+		}
+		if (k) {
+			op += put_varint(out + op, ((uint64_t)k << 1) | 1u);
+			i += 2 * k;
+			continue;
+		}
+
+		delta = (int64_t)d[i] - (int64_t)prev;
+		zz = delta < 0 ? ((uint64_t)-delta << 1) - 1u
+			       : (uint64_t)delta << 1;
+		op += put_varint(out + op, zz << 1);
+		prev = d[i++];
+	}
+	return op;
+}
+
+static bool blk_decode(const uint8_t *p, size_t len, uint32_t *d, size_t n)
+{
+	uint32_t prev = 0;
+	size_t ip = 0;
+	size_t op = 0;
+
+	while (op < n) {
+		uint64_t v;
+
+		if (!get_varint(p, len, &ip, &v)) return false;
+		if (v & 1u) {
+			uint64_t k = v >> 1;
+
+			if (op < 2 || k == 0 || k > (n - op) / 2) return false;
+			for (; k; k--, op += 2) {
+				d[op] = d[op - 2];
+				d[op + 1] = d[op - 1];
+			}
+		} else {
+			uint64_t zz = v >> 1;
+			int64_t x = (int64_t)prev;
+
+			x += (zz & 1u) ? -(int64_t)(zz >> 1) - 1 : (int64_t)(zz >> 1);
+			if (x < 0 || x > (int64_t)UINT32_MAX) return false;
+			d[op++] = prev = (uint32_t)x;
+		}
+	}
+	return ip == len;
+}
+
+/* Read the header of ALTAP002 block b. */
+static bool blk_hdr(Cassette *c, size_t b, uint32_t *len, uint32_t *edges,
+		    uint64_t *ticks)
+{
+	uint8_t h[CAS_BLK_HDR_LEN];
+
+	if (b >= c->nblocks ||
+	    pread_upto(c->fd, h, sizeof(h), (off_t)c->blocks[b].off) != sizeof(h))
+		return false;
+	*len = (uint32_t)get_le(h, 4);
+	*edges = (uint32_t)get_le(h + 4, 4);
+	*ticks = get_le(h + 8, 8);
+	return *len <= CAS_BLK_MAX && *edges && *edges <= CASSETTE_WINDOW;
+}
+
+static bool blk_push(Cassette *c, size_t b, uint64_t off, uint64_t tick)
+{
+	if (b >= c->blocks_cap) {
+		size_t cap = c->blocks_cap ? c->blocks_cap * 2 : 64;
+		CassetteBlock *p = realloc(c->blocks, cap * sizeof(*p));
+
+		if (!p) return false;
+		c->blocks = p;
+		c->blocks_cap = cap;
+	}
+	c->blocks[b].off = off;
+	c->blocks[b].tick = tick;
+	c->nblocks = b + 1;
+	return true;
+}
+
+/*
+ * Write the window as ALTAP002 block win_start / CASSETTE_WINDOW, dropping
+ * any blocks after it, then the header count. An on-disk index is
+ * invalidated first: the block may land on top of it.
+ */
+static bool blk_flush(Cassette *c)
+{
+	uint8_t buf[CAS_BLK_HDR_LEN + CAS_BLK_MAX];
+	size_t b = c->win_start / CASSETTE_WINDOW;
+	uint64_t off = CAS_HDR2_LEN;
+	uint64_t tick = 0;
+	uint64_t sum = 0;
+	size_t len;
+
+	if (b > c->nblocks) return false;
+	if (b > 0) {
+		uint32_t plen, pedges;
+		uint64_t pticks;
+
+		if (!blk_hdr(c, b - 1, &plen, &pedges, &pticks)) return false;
+		off = c->blocks[b - 1].off + CAS_BLK_HDR_LEN + plen;
+		tick = c->blocks[b - 1].tick + pticks;
 	}
+
+	for (size_t i = 0; i < c->win_len; i++)
+		sum += c->win[i];
+	len = blk_encode(c->win, c->win_len, buf + CAS_BLK_HDR_LEN);
+	put_le(buf, len, 4);
+	put_le(buf + 4, c->win_len, 4);
+	put_le(buf + 8, sum, 8);
+
+	if (c->index_off) {
+		if (!hdr_write(c, c->fd, c->disk_count, 0)) return false;
+		c->index_off = 0;
+	}
+	if (!pwrite_all(c->fd, buf, CAS_BLK_HDR_LEN + len, (off_t)off) ||
+	    !blk_push(c, b, off, tick))
+		return false;
+	c->index_dirty = true;
+	return true;
+}
+
+/*
+ * Write buffered edges out and bring the header count up to date, so the
+ * file is a complete tape after every flush.
+ */
+static bool tape_flush(Cassette *c)
+{
+	if (!c->win_dirty || c->fd < 0) return true;
+	if (c->version == 1) {
+		if (!pwrite_all(c->fd, c->win, c->win_len * sizeof(uint32_t),
+				edge_off(c->win_start)))
+			return false;
+	} else if (!blk_flush(c)) {
+		return false;
+	}
+	c->win_dirty = false;
+	if (!hdr_write(c, c->fd, c->dur_count, 0)) return false;
+	c->disk_count = c->dur_count;
+	return true;
+}
+
+/*
+ * Flush, then append the ALTAP002 block index after the last block so the
+ * next open does not have to walk the blocks.
+ */
+static bool tape_sync(Cassette *c)
+{
+	uint8_t *idx;
+	uint64_t end;
+	size_t len;
+	uint32_t blen, bedges;
+	uint64_t bticks;
+	bool ok;
+
+	if (!tape_flush(c)) return false;
+	if (c->fd < 0 || c->version == 1 || !c->index_dirty || !c->nblocks)
+		return true;
+	if (!blk_hdr(c, c->nblocks - 1, &blen, &bedges, &bticks)) return false;
+	end = c->blocks[c->nblocks - 1].off + CAS_BLK_HDR_LEN + blen;
+
+	len = 8 + 16 * c->nblocks;
+	idx = malloc(len);
+	if (!idx) return false;
+	put_le(idx, c->nblocks, 8);
+	for (size_t b = 0; b < c->nblocks; b++) {
+		put_le(idx + 8 + 16 * b, c->blocks[b].off, 8);
+		put_le(idx + 16 + 16 * b, c->blocks[b].tick, 8);
+	}
+	ok = pwrite_all(c->fd, idx, len, (off_t)end) &&
+	     ftruncate(c->fd, (off_t)(end + len)) == 0 &&
+	     hdr_write(c, c->fd, c->dur_count, end);
+	free(idx);
+	if (!ok) return false;
+	c->index_off = end;
+	c->index_dirty = false;
+	return true;
+}
+
+static void tape_close(Cassette *c)
+{
+	if (c->fd >= 0) close(c->fd);
+	c->fd = -1;
+	c->fd_temp = false;
+	c->win_start = 0;
+	c->win_len = 0;
+	c->win_dirty = false;
+	c->nblocks = 0;
+	c->tape_ticks = 0;
+	c->index_off = 0;
+	c->index_dirty = false;
+	c->disk_count = 0;
+	c->hash_count = 0;
+}
+
+/*
+ * Start an empty tape file: at c->path, or unlinked in $TMPDIR when there
+ * is no path or the path is a WAV file (written out on save).
+ */
+static bool tape_create(Cassette *c, unsigned version)
+{
+	tape_close(c);
 	c->dur_count = 0;
-	c->dur_cap = 0;
+	c->version = version;
+
+	if (c->path[0] && !c->wav) {
+		c->fd = open(c->path, O_RDWR | O_CREAT | O_TRUNC, 0666);
+	} else {
+		const char *dir = getenv("TMPDIR");
+		char tmp[512];
+
+		snprintf(tmp, sizeof(tmp), "%s/altaid-tape-XXXXXX",
+			 dir && *dir ? dir : "/tmp");
+		c->fd = mkstemp(tmp);
+		if (c->fd >= 0) unlink(tmp);
+		c->fd_temp = true;
+	}
+	if (c->fd < 0) {
+		c->fd_temp = false;
+		return false;
+	}
+	if (!hdr_write(c, c->fd, 0, 0)) {
+		tape_close(c);
+		return false;
+	}
+	return true;
 }
 
 static void cassette_clear(Cassette *c)
 {
 	c->dur_count = 0;
+	c->hash_count = 0;
 	c->play_index = 0;
 	c->play_next_edge_tick = 0;
 	c->play_level = c->idle_level;
 	c->in_level = c->idle_level;
 }
 
-bool cassette_open(Cassette *c, const char *path)
+/* Load the ALTAP002 block index written at index_off, if it fits. */
+static bool idx_load(Cassette *c, uint64_t index_off, size_t want)
 {
-	if (!path || !path[0]) return false;
-	strncpy(c->path, path, sizeof(c->path)-1);
-	c->path[sizeof(c->path)-1] = '\0';
+	uint8_t e[16];
 
-	/* If file exists, try to load it. If not, we simply "attach" it for recording. */
-	FILE *f = fopen(path, "rb");
-	if (!f) {
-		cassette_clear(c);
-		c->attached = true;
-		return true;
+	if (pread_upto(c->fd, e, 8, (off_t)index_off) != 8 ||
+	    get_le(e, 8) != want)
+		return false;
+	for (size_t b = 0; b < want; b++) {
+		uint64_t off;
+
+		if (pread_upto(c->fd, e, 16, (off_t)(index_off + 8 + 16 * b)) != 16)
+			return false;
+		off = get_le(e, 8);
+		if (off < CAS_HDR2_LEN || off >= index_off ||
+		    (b && off <= c->blocks[b - 1].off) ||
+		    !blk_push(c, b, off, get_le(e + 8, 8)))
+			return false;
 	}
+	return true;
+}
 
-	CassFileHdr h;
-	size_t n = fread(&h, 1, sizeof(h), f);
-	if (n != sizeof(h) || memcmp(h.magic, k_magic, CAS_MAGIC_LEN) != 0 || h.version != 1) {
-		fclose(f);
-		cassette_clear(c);
-		c->attached = true;
-		return true;
+/*
+ * No usable index (crash before it was written): walk the block headers.
+ * The tape ends at the first block that is missing or malformed.
+ */
+static void idx_scan(Cassette *c, size_t want, off_t size)
+{
+	uint64_t off = CAS_HDR2_LEN;
+	uint64_t tick = 0;
+
+	c->nblocks = 0;
+	for (size_t b = 0; b < want; b++) {
+		uint32_t len, edges;
+		uint64_t ticks;
+
+		if (!blk_push(c, b, off, tick) ||
+		    !blk_hdr(c, b, &len, &edges, &ticks) ||
+		    off + CAS_BLK_HDR_LEN + len > (uint64_t)size ||
+		    (b + 1 < want && edges != CASSETTE_WINDOW)) {
+			c->nblocks = b;
+			break;
+		}
+		off += CAS_BLK_HDR_LEN + len;
+		tick += ticks;
 	}
+	if (c->dur_count > c->nblocks * CASSETTE_WINDOW)
+		c->dur_count = c->nblocks * CASSETTE_WINDOW;
+}
 
-	cassette_clear(c);
+static bool tape_open2(Cassette *c, const struct stat *st)
+{
+	uint8_t h[CAS_HDR2_LEN];
+	uint64_t count;
+	uint64_t index_off;
+	size_t want;
+
+	if (pread_upto(c->fd, h, sizeof(h), 0) != sizeof(h) ||
+	    memcmp(h, k_magic2, CAS_MAGIC_LEN) != 0)
+		return false;
+
+	c->version = 2;
+	c->cpu_hz = get_le(h + 8, 4) ? (uint32_t)get_le(h + 8, 4) : c->cpu_hz;
+	c->idle_level = (h[12] != 0);
+	count = get_le(h + 16, 8);
+	index_off = get_le(h + 24, 8);
+	if (count > SIZE_MAX - CASSETTE_WINDOW) return false;
+
+	c->dur_count = (size_t)count;
+	c->disk_count = c->dur_count;
+	want = (c->dur_count + CASSETTE_WINDOW - 1) / CASSETTE_WINDOW;
+	if (index_off && index_off < (uint64_t)st->st_size &&
+	    idx_load(c, index_off, want)) {
+		c->index_off = index_off;
+	} else {
+		idx_scan(c, want, st->st_size);
+		c->index_dirty = true;
+	}
+
+	if (c->nblocks) {
+		uint32_t len, edges;
+		uint64_t ticks;
+
+		if (!blk_hdr(c, c->nblocks - 1, &len, &edges, &ticks))
+			return false;
+		c->tape_ticks = c->blocks[c->nblocks - 1].tick + ticks;
+	}
+	return true;
+}
+
+static bool tape_open1(Cassette *c, const struct stat *st)
+{
+	CassFileHdr h;
+	size_t have;
+
+	if (pread_upto(c->fd, &h, sizeof(h), 0) != sizeof(h) ||
+	    memcmp(h.magic, k_magic, CAS_MAGIC_LEN) != 0 || h.version != 1)
+		return false;
+
+	c->version = 1;
 	c->cpu_hz = h.cpu_hz ? h.cpu_hz : c->cpu_hz;
 	c->idle_level = (h.initial_level != 0);
+
+	/* A header claiming more than the file holds (crash, truncation). */
+	have = (size_t)((st->st_size - (off_t)sizeof(h)) / (off_t)sizeof(uint32_t));
+	c->dur_count = h.count < have ? h.count : have;
+	c->disk_count = c->dur_count;
+
+	/*
+	 * ALTAP001 has no index: build one in a single pass, the same
+	 * per-window checkpoints ALTAP002 stores.
+	 */
+	for (size_t i = 0; i < c->dur_count; i += CASSETTE_WINDOW) {
+		size_t k = c->dur_count - i;
+
+		if (k > CASSETTE_WINDOW) k = CASSETTE_WINDOW;
+		if (!blk_push(c, i / CASSETTE_WINDOW, (uint64_t)edge_off(i),
+			      c->tape_ticks))
+			return false;
+		c->win_start = i;
+		c->win_len = pread_upto(c->fd, c->win, k * sizeof(uint32_t),
+					edge_off(i)) / sizeof(uint32_t);
+		for (size_t j = 0; j < c->win_len; j++)
+			c->tape_ticks += c->win[j];
+		if (c->win_len < k) {
+			c->dur_count = i + c->win_len;
+			break;
+		}
+	}
+	return true;
+}
+
+static bool path_is_wav(const char *path)
+{
+	size_t n = strlen(path);
+	const char *ext = ".wav";
+
+	if (n < 4) return false;
+	for (size_t i = 0; i < 4; i++) {
+		if (tolower((unsigned char)path[n - 4 + i]) != ext[i])
+			return false;
+	}
+	return true;
+}
+
+/*
+ * A WAV file is decoded into a temp-backed tape; c->path stays the WAV
+ * so a save renders the edges back to it.
+ */
+static bool tape_open_wav(Cassette *c)
+{
+	int src = c->fd;
+	bool ok;
+
+	c->fd = -1;
+	c->idle_level = true;
+	ok = tape_create(c, CAS_VERSION_DEFAULT) && wav_import(src, c);
+	close(src);
+	return ok;
+}
+
+/*
+ * Open the tape at c->path for playback (and appending, if writable).
+ * A missing file or a bad header leaves an empty tape with no file; the
+ * file is (re)created when recording starts or on save. The format is
+ * taken from the file's header: ALTAP002, ALTAP001 or a RIFF/WAVE file;
+ * a new file is a WAV if its name ends in ".wav".
+ */
+static void tape_open(Cassette *c)
+{
+	struct stat st;
+
+	tape_close(c);
+	cassette_clear(c);
+	c->wav = path_is_wav(c->path);
+
+	c->fd = open(c->path, O_RDWR);
+	if (c->fd < 0) c->fd = open(c->path, O_RDONLY);
+	if (c->fd < 0) return;
+
+	c->wav = wav_sniff(c->fd);
+	if (c->wav ? !tape_open_wav(c) :
+	    (fstat(c->fd, &st) != 0 ||
+	     (!tape_open2(c, &st) && !tape_open1(c, &st)))) {
+		tape_close(c);
+		c->dur_count = 0;
+		return;
+	}
 	c->play_level = c->idle_level;
 	c->in_level = c->idle_level;
+}
 
-	vec_reserve(c, h.count);
-	c->dur_count = 0;
-	for (uint32_t i=0;i<h.count;i++) {
-		uint32_t d;
-		if (fread(&d, 1, sizeof(d), f) != sizeof(d)) break;
-		vec_push(c, d);
+/* Read the window holding edge i. */
+static bool win_load(Cassette *c, size_t i)
+{
+	uint8_t buf[CAS_BLK_MAX];
+	size_t want;
+	size_t got;
+
+	if (!tape_flush(c)) return false;
+	c->win_start = i - i % CASSETTE_WINDOW;
+	want = c->dur_count - c->win_start;
+	if (want > CASSETTE_WINDOW) want = CASSETTE_WINDOW;
+
+	if (c->version == 1) {
+		got = pread_upto(c->fd, c->win, want * sizeof(uint32_t),
+				 edge_off(c->win_start)) / sizeof(uint32_t);
+	} else {
+		size_t b = c->win_start / CASSETTE_WINDOW;
+		uint32_t len, edges;
+		uint64_t ticks;
+
+		got = 0;
+		if (blk_hdr(c, b, &len, &edges, &ticks) && edges >= want &&
+		    pread_upto(c->fd, buf, len, (off_t)(c->blocks[b].off +
+						      CAS_BLK_HDR_LEN)) == len &&
+		    blk_decode(buf, len, c->win, edges))
+			got = want;
+		else if (c->nblocks > b)
+			c->nblocks = b;
+	}
+	c->win_len = got;
+	/* The file shrank under us: the tape ends here. */
+	if (got < want) c->dur_count = c->win_start + got;
+	if (c->hash_count > c->dur_count) c->hash_count = 0;
+	return i < c->win_start + c->win_len;
+}
+
+uint32_t cassette_duration(Cassette *c, size_t i)
+{
+	if (i >= c->dur_count || c->fd < 0) return 0;
+	if (i < c->win_start || i - c->win_start >= c->win_len) {
+		if (!win_load(c, i)) return 0;
+	}
+	return c->win[i - c->win_start];
+}
+
+/*
+ * Make the window the tail of the tape, with room. Windows stay aligned
+ * to CASSETTE_WINDOW (ALTAP002 blocks), so a partial tail is read back in
+ * to be extended.
+ */
+static bool win_tail(Cassette *c)
+{
+	if (c->win_start + c->win_len != c->dur_count ||
+	    c->win_len == CASSETTE_WINDOW) {
+		if (!tape_flush(c)) return false;
+		if (c->dur_count % CASSETTE_WINDOW) {
+			if (!win_load(c, c->dur_count - 1)) return false;
+		} else {
+			c->win_start = c->dur_count;
+			c->win_len = 0;
+		}
+	}
+	/* A new window is a new checkpoint; ALTAP002 fills in off on flush. */
+	if (c->win_len == 0 &&
+	    !blk_push(c, c->dur_count / CASSETTE_WINDOW,
+		      c->version == 1 ? (uint64_t)edge_off(c->dur_count) : 0,
+		      c->tape_ticks))
+		return false;
+	return true;
+}
+
+bool cassette_append_n(Cassette *c, const uint32_t *dur, size_t n)
+{
+	if (c->fd < 0 && !tape_create(c, CAS_VERSION_DEFAULT)) return false;
+
+	while (n) {
+		size_t k;
+
+		if (!win_tail(c)) return false;
+		k = CASSETTE_WINDOW - c->win_len;
+		if (k > n) k = n;
+		memcpy(c->win + c->win_len, dur, k * sizeof(*dur));
+		for (size_t i = 0; i < k; i++)
+			c->tape_ticks += dur[i];
+		c->win_len += k;
+		c->win_dirty = true;
+		c->dur_count += k;
+		dur += k;
+		n -= k;
 	}
-	fclose(f);
+	return true;
+}
+
+bool cassette_append(Cassette *c, uint32_t dur)
+{
+	return cassette_append_n(c, &dur, 1);
+}
 
+uint64_t cassette_tick_at(Cassette *c, size_t i)
+{
+	size_t b = i / CASSETTE_WINDOW;
+	uint64_t t;
+
+	if (i >= c->dur_count) return c->tape_ticks;
+	if (b >= c->nblocks) return 0;
+	t = c->blocks[b].tick;
+	for (size_t j = b * CASSETTE_WINDOW; j < i; j++)
+		t += cassette_duration(c, j);
+	return t;
+}
+
+void cassette_init(Cassette *c, uint32_t cpu_hz)
+{
+	memset(c, 0, sizeof(*c));
+	c->cpu_hz = cpu_hz;
+	c->idle_level = true; /* idle high is a sane default for the MIO comparator */
+	c->in_level = c->idle_level;
+	c->fd = -1;
+	c->wav_rate = CASSETTE_WAV_RATE;
+}
+
+void cassette_free(Cassette *c)
+{
+	cassette_stop(c);
+	(void)tape_sync(c);
+	tape_close(c);
+	free(c->blocks);
+	c->blocks = NULL;
+	c->blocks_cap = 0;
+	c->dur_count = 0;
+}
+
+bool cassette_open(Cassette *c, const char *path)
+{
+	if (!path || !path[0]) return false;
+
+	/* Finish with the previous tape (saving a recording in progress). */
+	cassette_free(c);
+	strncpy(c->path, path, sizeof(c->path)-1);
+	c->path[sizeof(c->path)-1] = '\0';
+
+	tape_open(c);
 	c->attached = true;
 	return true;
 }
 
+/* Copy a temp-backed tape to c->path and continue on that file. */
+static bool tape_copy_to_path(Cassette *c)
+{
+	uint8_t buf[4096];
+	struct stat st;
+	off_t off = 0;
+	int dst;
+
+	if (!tape_flush(c) || fstat(c->fd, &st) != 0) return false;
+	dst = open(c->path, O_RDWR | O_CREAT | O_TRUNC, 0666);
+	if (dst < 0) return false;
+
+	while (off < st.st_size) {
+		size_t k = pread_upto(c->fd, buf, sizeof(buf), off);
+
+		if (k == 0 || !pwrite_all(dst, buf, k, off)) {
+			close(dst);
+			return false;
+		}
+		off += (off_t)k;
+	}
+
+	close(c->fd);
+	c->fd = dst;
+	c->fd_temp = false;
+	return tape_sync(c);
+}
+
+/* Render the temp-backed tape to c->path as a WAV file. */
+static bool tape_save_wav(Cassette *c)
+{
+	int dst;
+	bool ok;
+
+	if (!tape_flush(c)) return false;
+	dst = open(c->path, O_RDWR | O_CREAT | O_TRUNC, 0666);
+	if (dst < 0) return false;
+	ok = wav_export(c, dst, c->wav_rate);
+	return close(dst) == 0 && ok;
+}
+
 bool cassette_save(Cassette *c)
 {
 	if (!c->attached || !c->path[0]) return false;
-	FILE *f = fopen(c->path, "wb");
-	if (!f) return false;
+	if (c->fd < 0 && !tape_create(c, CAS_VERSION_DEFAULT)) return false;
+	if (c->wav) return tape_save_wav(c);
+	if (c->fd_temp) return tape_copy_to_path(c);
+	return tape_sync(c);
+}
 
-	CassFileHdr h;
-	memset(&h, 0, sizeof(h));
-	memcpy(h.magic, k_magic, CAS_MAGIC_LEN);
-	h.version = 1;
-	h.cpu_hz = c->cpu_hz;
-	h.initial_level = (uint8_t)(c->idle_level ? 1 : 0);
-	h.count = (uint32_t)c->dur_count;
-
-	if (fwrite(&h, 1, sizeof(h), f) != sizeof(h)) {
-		fclose(f);
-		return false;
+bool cassette_flush(Cassette *c)
+{
+	return tape_flush(c);
+}
+
+uint64_t cassette_hash(Cassette *c, size_t n)
+{
+	if (n > c->dur_count) n = c->dur_count;
+	if (n < c->hash_count || c->hash_count == 0) {
+		c->hash = CAS_FNV_BASIS;
+		c->hash_count = 0;
 	}
-	if (c->dur_count) {
-		if (fwrite(c->durations, sizeof(uint32_t), c->dur_count, f) != c->dur_count) {
-			fclose(f);
-			return false;
+	for (size_t i = c->hash_count; i < n; i++) {
+		uint32_t d = cassette_duration(c, i);
+
+		for (unsigned k = 0; k < 4; k++) {
+			c->hash ^= (d >> (8 * k)) & 0xFFu;
+			c->hash *= CAS_FNV_PRIME;
 		}
 	}
-	fclose(f);
+	c->hash_count = n;
+	return c->hash;
+}
+
+bool cassette_reattach(Cassette *c, const char *path, size_t count)
+{
+	if (!path) path = "";
+
+	(void)tape_flush(c);
+	if (c->fd < 0 || strcmp(c->path, path) != 0) {
+		(void)tape_sync(c);
+		tape_close(c);
+		strncpy(c->path, path, sizeof(c->path)-1);
+		c->path[sizeof(c->path)-1] = '\0';
+		if (c->path[0])
+			tape_open(c);
+		else
+			c->dur_count = 0;
+	}
+	return count <= c->dur_count;
+}
+
+/* Cut a temp-backed tape, which no one else sees, back to count edges. */
+static void tape_cut(Cassette *c, size_t count)
+{
+	size_t keep = (count + CASSETTE_WINDOW - 1) / CASSETTE_WINDOW;
+
+	(void)tape_flush(c);
+	c->tape_ticks = cassette_tick_at(c, count);
+	c->dur_count = count;
+	if (c->hash_count > count) c->hash_count = 0;
+	if (c->nblocks > keep) {
+		c->nblocks = keep;
+		c->index_dirty = c->version == 2;
+	}
+	if (c->win_start >= count) {
+		c->win_start = 0;
+		c->win_len = 0;
+	} else if (c->win_start + c->win_len > count) {
+		c->win_len = count - c->win_start;
+	}
+}
+
+bool cassette_fork(Cassette *c, size_t count)
+{
+	Cassette t;
+	uint32_t d[CASSETTE_WINDOW];
+	bool ok;
+
+	if (count > c->dur_count) return false;
+	if (count == c->dur_count) return true;
+	if (c->fd_temp) {
+		tape_cut(c, count);
+		return true;
+	}
+
+	cassette_init(&t, c->cpu_hz);
+	t.idle_level = c->idle_level;
+	ok = tape_create(&t, c->version);
+	for (size_t i = 0; ok && i < count; i += CASSETTE_WINDOW) {
+		size_t k = count - i < CASSETTE_WINDOW ? count - i
+						       : CASSETTE_WINDOW;
+
+		for (size_t j = 0; j < k; j++)
+			d[j] = cassette_duration(c, i + j);
+		ok = cassette_append_n(&t, d, k);
+	}
+	if (!ok) {
+		tape_close(&t);
+		free(t.blocks);
+		return false;
+	}
+
+	/* Done with the file; the copy carries on under its path. */
+	(void)tape_sync(c);
+	tape_close(c);
+	free(c->blocks);
+	t.attached = c->attached;
+	memcpy(t.path, c->path, sizeof(t.path));
+	t.wav = c->wav;
+	t.wav_rate = c->wav_rate;
+	*c = t;
 	return true;
 }
 
+bool cassette_convert(const char *in_path, const char *out_path,
+		      unsigned version, uint32_t cpu_hz, uint32_t wav_rate)
+{
+	Cassette in;
+	Cassette out;
+	bool ok;
+
+	if (!in_path || !out_path || strcmp(in_path, out_path) == 0 ||
+	    (version != 1 && version != 2) || !cpu_hz || !wav_rate)
+		return false;
+
+	cassette_init(&in, cpu_hz);
+	cassette_init(&out, 0);
+	cassette_open(&in, in_path);
+	ok = in.fd >= 0;
+	if (ok) {
+		out.cpu_hz = in.cpu_hz;
+		out.idle_level = in.idle_level;
+		out.wav_rate = wav_rate;
+		out.wav = path_is_wav(out_path);
+		strncpy(out.path, out_path, sizeof(out.path)-1);
+		out.attached = true;
+		ok = tape_create(&out, version);
+	}
+	/* A window at a time: load the one holding edge i, copy the rest. */
+	for (size_t i = 0; ok && i < in.dur_count;
+	     i = in.win_start + in.win_len) {
+		(void)cassette_duration(&in, i);
+		if (i < in.win_start || i >= in.win_start + in.win_len)
+			break;
+		ok = cassette_append_n(&out, in.win + (i - in.win_start),
+				       in.win_start + in.win_len - i);
+	}
+	/* A short read leaves in.dur_count below what the loop wanted. */
+	ok = ok && out.dur_count == in.dur_count && cassette_save(&out);
+
+	cassette_free(&in);
+	cassette_free(&out);
+	return ok;
+}
+
 void cassette_stop(Cassette *c)
 {
 	enum cassette_state prev = c->state;
@@ -152,28 +960,90 @@ void cassette_rewind(Cassette *c)
 	c->play_level = c->idle_level;
 	c->in_level = c->idle_level;
 	c->play_next_edge_tick = 0;
+	c->play_tape_tick = cassette_duration(c, 0);
 }
 
-void cassette_ff(Cassette *c, uint32_t seconds, uint64_t now_tick)
+uint64_t cassette_position(const Cassette *c, uint64_t now_tick)
 {
+	uint64_t ahead;
+
+	switch (c->state) {
+	case CASSETTE_RECORDING:
+		return c->tape_ticks + (now_tick - c->rec_last_edge_tick);
+	case CASSETTE_PLAYING:
+		if (c->play_index >= c->dur_count) return c->tape_ticks;
+		ahead = c->play_next_edge_tick > now_tick ?
+			c->play_next_edge_tick - now_tick : 0;
+		return c->play_tape_tick > ahead ? c->play_tape_tick - ahead : 0;
+	case CASSETTE_STOPPED:
+	default:
+		return 0;
+	}
+}
+
+void cassette_seek(Cassette *c, uint64_t tape_tick, uint64_t now_tick)
+{
+	size_t lo = 0;
+	size_t hi = c->nblocks;
+	size_t i;
+	uint64_t t;
+	uint64_t dt = 0;
+
 	if (c->state != CASSETTE_PLAYING || c->dur_count == 0) return;
-	uint64_t skip = (uint64_t)c->cpu_hz * (uint64_t)seconds;
-	uint64_t target = now_tick + skip;
 
-	/* Fast-forward by simulating edges until we pass target. */
-	uint64_t t = now_tick;
-	while (c->play_index < c->dur_count) {
-		uint64_t dt = c->durations[c->play_index];
-		if (t + dt >= target) break;
+	if (tape_tick >= c->tape_ticks || hi == 0) {
+		/* Past the end: every edge has played. */
+		c->play_index = c->dur_count;
+		c->play_level = (c->dur_count & 1u) ? !c->idle_level
+						    : c->idle_level;
+		c->play_tape_tick = c->tape_ticks;
+		c->play_next_edge_tick = now_tick;
+		c->in_level = c->play_level;
+		return;
+	}
+
+	/* The last checkpoint at or before tape_tick, then edges from it. */
+	while (hi - lo > 1) {
+		size_t mid = lo + (hi - lo) / 2;
+
+		if (c->blocks[mid].tick <= tape_tick)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	i = lo * CASSETTE_WINDOW;
+	t = c->blocks[lo].tick;
+	for (; i < c->dur_count; i++) {
+		dt = cassette_duration(c, i);
+		if (t + dt > tape_tick) break;
 		t += dt;
-		c->play_index++;
-		c->play_level = !c->play_level;
 	}
 
-	c->play_next_edge_tick = t + (c->play_index < c->dur_count ? c->durations[c->play_index] : 0);
+	c->play_index = i;
+	c->play_level = (i & 1u) ? !c->idle_level : c->idle_level;
+	c->play_tape_tick = t + dt;
+	c->play_next_edge_tick = now_tick + (t + dt - tape_tick);
 	c->in_level = c->play_level;
 }
 
+void cassette_ff(Cassette *c, uint32_t seconds, uint64_t now_tick)
+{
+	uint64_t skip = (uint64_t)c->cpu_hz * (uint64_t)seconds;
+
+	if (c->state != CASSETTE_PLAYING || c->dur_count == 0) return;
+	cassette_seek(c, cassette_position(c, now_tick) + skip, now_tick);
+}
+
+void cassette_reverse(Cassette *c, uint32_t seconds, uint64_t now_tick)
+{
+	uint64_t skip = (uint64_t)c->cpu_hz * (uint64_t)seconds;
+	uint64_t pos;
+
+	if (c->state != CASSETTE_PLAYING || c->dur_count == 0) return;
+	pos = cassette_position(c, now_tick);
+	cassette_seek(c, pos > skip ? pos - skip : 0, now_tick);
+}
+
 void cassette_start_play(Cassette *c, uint64_t now_tick)
 {
 	if (!c->attached) return;
@@ -181,7 +1051,8 @@ void cassette_start_play(Cassette *c, uint64_t now_tick)
 	c->play_level = c->idle_level;
 	c->in_level = c->play_level;
 	c->play_index = 0;
-	c->play_next_edge_tick = now_tick + (c->dur_count ? c->durations[0] : 0);
+	c->play_tape_tick = cassette_duration(c, 0);
+	c->play_next_edge_tick = now_tick + c->play_tape_tick;
 }
 
 void cassette_start_record(Cassette *c, uint64_t now_tick)
@@ -193,16 +1064,42 @@ void cassette_start_record(Cassette *c, uint64_t now_tick)
 	c->rec_last_level = false;
 	c->idle_level = true;
 	c->in_level = c->idle_level;
+	/* Recording replaces the tape; if this fails, appends retry. */
+	(void)tape_create(c, CAS_VERSION_DEFAULT);
+}
+
+void cassette_on_out_edges(Cassette *c, const uint64_t *ticks, size_t n,
+			   bool last_level)
+{
+	uint32_t dur[64];
+
+	if (c->state != CASSETTE_RECORDING || n == 0) return;
+	while (n) {
+		size_t k = n < 64u ? n : 64u;
+
+		for (size_t i = 0; i < k; i++) {
+			uint64_t dt = ticks[i] - c->rec_last_edge_tick;
+
+			dur[i] = dt > 0xFFFFFFFFull ? 0xFFFFFFFFu : (uint32_t)dt;
+			c->rec_last_edge_tick = ticks[i];
+		}
+		(void)cassette_append_n(c, dur, k);
+		ticks += k;
+		n -= k;
+	}
+	c->rec_last_level = last_level;
 }
 
 void cassette_on_out_change(Cassette *c, uint64_t tick, bool new_level)
 {
-	if (c->state != CASSETTE_RECORDING) return;
-	uint64_t dt64 = tick - c->rec_last_edge_tick;
-	uint32_t dt = (dt64 > 0xFFFFFFFFull) ? 0xFFFFFFFFu : (uint32_t)dt64;
-	vec_push(c, dt);
-	c->rec_last_edge_tick = tick;
-	c->rec_last_level = new_level;
+	cassette_on_out_edges(c, &tick, 1, new_level);
+}
+
+uint64_t cassette_next_edge(const Cassette *c)
+{
+	if (c->state != CASSETTE_PLAYING || c->play_index >= c->dur_count)
+		return CASSETTE_NEVER;
+	return c->play_next_edge_tick;
 }
 
 bool cassette_in_level_at(Cassette *c, uint64_t tick)
@@ -217,7 +1114,10 @@ bool cassette_in_level_at(Cassette *c, uint64_t tick)
 		c->play_level = !c->play_level;
 		c->play_index++;
 		if (c->play_index < c->dur_count) {
-			c->play_next_edge_tick += c->durations[c->play_index];
+			uint32_t d = cassette_duration(c, c->play_index);
+
+			c->play_next_edge_tick += d;
+			c->play_tape_tick += d;
 		}
 	}
 
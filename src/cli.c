@@ -5,6 +5,7 @@
 #endif
 
 #include "cli.h"
+#include "rewind.h"
 
 #include <errno.h>
 #include <getopt.h>
@@ -22,6 +23,12 @@ static void cfg_defaults(struct Config *cfg)
 	cfg->hold_ms = 300u;
 	cfg->realtime = true;
 	cfg->log_flush = true;
+	cfg->checkpoint_ms = 1000u;
+	cfg->rewind_mb = 16u;
+	cfg->rewind_ms = 100u;
+	cfg->rewind_step_ms = 1000u;
+	cfg->cassette_wav_rate = 44100u;
+	cfg->latency_ms = 10u;
 	cfg->panel_text_mode = PANEL_TEXT_MODE_BURST;
 	cfg->panel_compact = true;
 }
@@ -31,6 +38,7 @@ static void cfg_defaults(struct Config *cfg)
  *
  *   "state:<path>"
  *   "ram:<path>"
+ *   "ramz:<path>"
  *   "ram@<addr>:<path>"
  *   "ram@<bank>.<addr>:<path>"
  *
@@ -59,6 +67,15 @@ static int parse_io_spec(const char *arg, struct IoSpec *out)
 		return 0;
 	}
 
+	if (!strncmp(arg, "ramz:", 5)) {
+		if (!arg[5])
+			return -1;
+		out->kind = IO_SPEC_RAM;
+		out->packed = true;
+		out->path = arg + 5;
+		return 0;
+	}
+
 	if (!strncmp(arg, "ram@", 4)) {
 		const char *p = arg + 4;
 		const char *colon;
@@ -172,6 +189,11 @@ void cli_usage(const char *argv0)
 		"Core options:\n"
 		"  -C, --hz <cpu_hz>         CPU clock (default 2000000).\n"
 		"  -b, --baud <baud>         Serial baud for bit-level UART (default 9600).\n"
+		"  --rx-baud <baud>          Clock the RX line only at <baud> (default: --baud).\n"
+		"                          The ROM's receive routine must keep up.\n"
+		"  --tx-overflow <drop|block>\n"
+		"                          When the TX buffer is full: drop bytes (default)\n"
+		"                          or pause the CPU until the host drains it.\n"
 		"\n"
 		"Panel / TUI options:\n"
 		"  -p, --panel               Enable front-panel display.\n"
@@ -198,9 +220,10 @@ void cli_usage(const char *argv0)
 		"  -a, --serial-append       When --serial-out is a file, append instead of truncating.\n"
 		"\n"
 		"Cassette options (Altaid05 @ ports 0x44/0x45):\n"
-		"  -c, --cass <file>         Attach cassette file (ALTAP001).\n"
+		"  -c, --cass <file>         Attach cassette file (ALTAP, or PCM .wav).\n"
 		"  -L, --cass-play           Start playing at tick 0.\n"
 		"  -R, --cass-rec            Start recording at tick 0 (overwrites on exit).\n"
+		"  --cass-rate <Hz>          Sample rate when saving a .wav tape (default 44100).\n"
 		"\n"
 		"Persistence options (repeatable):\n"
 		"  --load <spec>             Load bytes at startup (see SPECS below).\n"
@@ -210,19 +233,36 @@ void cli_usage(const char *argv0)
 		"  SPECS:\n"
 		"    state:<file>                CPU + devices + RAM snapshot.\n"
 		"    ram:<file>                  Full 512 KiB RAM.\n"
+		"    ramz:<file>                 Full RAM, compressed (loads as ram: too).\n"
 		"    ram@<addr>:<file>           Raw blob, bank 0, at address.\n"
 		"    ram@<bank>.<addr>:<file>    Raw blob, specific bank, at address.\n"
 		"\n"
+		"  --checkpoint <file>       Write a state base, then append RAM deltas;\n"
+		"                          --load state:<file> restores the latest.\n"
+		"  --checkpoint-ms <ms>      Emulated ms between deltas (default 1000).\n"
+		"  --rewind-mb <MiB>         Memory for the Ctrl-P B rewind buffer\n"
+		"                          (default 16, 0 = off, else at least 2).\n"
+		"  --rewind-ms <ms>          Emulated ms between rewind snapshots (default 100).\n"
+		"  --rewind-step <ms>        How far back one Ctrl-P B goes (default 1000).\n"
+		"\n"
 		"Other options:\n"
 		"  -H, --hold <ms>           Momentary key press duration (default 300).\n"
 		"  -r, --realtime            Throttle emulation to real-time (default on).\n"
 		"  -z, --turbo               Run as fast as possible (disables --realtime).\n"
+		"  --latency-ms <ms>         Grow CPU batches up to <ms> while idle\n"
+		"                          (default 10, 0 = fixed 0.5 ms batches).\n"
+		"  --threaded                Run the CPU on its own thread so terminal\n"
+		"                          output cannot stall it (ignored with --headless).\n"
 		"  -l, --log <file>          Write non-panel messages to a log file.\n"
-		"  -f, --log-flush <0|1>     Flush log on each write (default 1).\n"
+		"  -f, --log-flush <0|1>     Flush log on each write (default 1; 0 buffers\n"
+		"                          and flushes while the emulator is idle).\n"
 		"  -q, --quiet               Suppress non-essential messages (still prints PTY path).\n"
 		"  -n, --headless            Do not enter raw mode and do not enable UI keybindings.\n"
 		"  -D, --debug-panel         Log front-panel press/release/scan events (pair with --log).\n"
 		"  -T, --run-ms <ms>         Exit after <ms> of emulated CPU time (0 = unlimited, default).\n"
+		"  --batch <manifest>        Run the manifest's jobs headless on a thread pool,\n"
+		"                          print per-job results and exit (ROM optional).\n"
+		"  --jobs <n>                Worker threads for --batch (default: CPU count).\n"
 		"  -h, --help                Show this help and exit.\n"
 		"  -V, --version             Print version and exit.\n",
 		argv0);
@@ -235,6 +275,8 @@ int cli_parse_args(int argc, char **argv, struct Config *cfg)
 	static const struct option kLongOpts[] = {
 		{"hz",            required_argument, 0, 'C'},
 		{"baud",          required_argument, 0, 'b'},
+		{"rx-baud",       required_argument, 0,  5 },
+		{"tx-overflow",   required_argument, 0,  4 },
 		{"panel",         no_argument,       0, 'p'},
 		{"panel-mode",    required_argument, 0, 'm'},
 		{"panel-echo-chars", no_argument,     0, 'E'},
@@ -256,6 +298,7 @@ int cli_parse_args(int argc, char **argv, struct Config *cfg)
 		{"cass",          required_argument, 0, 'c'},
 		{"cass-play",     no_argument,       0, 'L'},
 		{"cass-rec",      no_argument,       0, 'R'},
+		{"cass-rate",     required_argument, 0, 13 },
 		{"load",          required_argument, 0,  1 },
 		{"save",          required_argument, 0,  2 },
 		{"default",       required_argument, 0,  3 },
@@ -265,8 +308,17 @@ int cli_parse_args(int argc, char **argv, struct Config *cfg)
 		{"headless",      no_argument,       0, 'n'},
 		{"realtime",      no_argument,       0, 'r'},
 		{"turbo",         no_argument,       0, 'z'},
+		{"latency-ms",    required_argument, 0, 14 },
+		{"threaded",      no_argument,       0, 15 },
 		{"debug-panel",   no_argument,       0, 'D'},
 		{"run-ms",        required_argument, 0, 'T'},
+		{"checkpoint",    required_argument, 0,  8 },
+		{"checkpoint-ms", required_argument, 0,  9 },
+		{"rewind-mb",     required_argument, 0, 10 },
+		{"rewind-ms",     required_argument, 0, 11 },
+		{"rewind-step",   required_argument, 0, 12 },
+		{"batch",         required_argument, 0,  6 },
+		{"jobs",          required_argument, 0,  7 },
 		{"help",          no_argument,       0, 'h'},
 		{"version",       no_argument,       0, 'V'},
 		{0, 0, 0, 0},
@@ -294,6 +346,18 @@ int cli_parse_args(int argc, char **argv, struct Config *cfg)
 			if (parse_u32(optarg, &cfg->baud) < 0)
 				return -2;
 			break;
+		case 5: /* --rx-baud */
+			if (parse_u32(optarg, &cfg->rx_baud) < 0 || !cfg->rx_baud)
+				return -2;
+			break;
+		case 4: /* --tx-overflow */
+			if (!strcmp(optarg, "drop"))
+				cfg->tx_block = false;
+			else if (!strcmp(optarg, "block"))
+				cfg->tx_block = true;
+			else
+				return -2;
+			break;
 		case 'p':
 			cfg->start_panel = true;
 			break;
@@ -379,6 +443,11 @@ int cli_parse_args(int argc, char **argv, struct Config *cfg)
 		case 'R':
 			cfg->cassette_rec = true;
 			break;
+		case 13: /* --cass-rate */
+			if (parse_u32(optarg, &cfg->cassette_wav_rate) < 0 ||
+			    !cfg->cassette_wav_rate)
+				return -2;
+			break;
 		case 1: /* --load */
 			if (push_spec(cfg->load_specs, &cfg->load_count,
 				      CLI_IO_SPEC_MAX, optarg) < 0)
@@ -424,6 +493,13 @@ int cli_parse_args(int argc, char **argv, struct Config *cfg)
 		case 'z':
 			cfg->realtime = false;
 			break;
+		case 14: /* --latency-ms */
+			if (parse_u32(optarg, &cfg->latency_ms) < 0)
+				return -2;
+			break;
+		case 15: /* --threaded */
+			cfg->threaded = true;
+			break;
 		case 'D':
 			cfg->debug_panel = true;
 			break;
@@ -431,6 +507,37 @@ int cli_parse_args(int argc, char **argv, struct Config *cfg)
 			if (parse_u32(optarg, &cfg->max_run_ms) < 0)
 				return -2;
 			break;
+		case 8: /* --checkpoint */
+			cfg->checkpoint_path = optarg;
+			break;
+		case 9: /* --checkpoint-ms */
+			if (parse_u32(optarg, &cfg->checkpoint_ms) < 0 ||
+			    !cfg->checkpoint_ms)
+				return -2;
+			break;
+		case 10: /* --rewind-mb */
+			if (parse_u32(optarg, &cfg->rewind_mb) < 0 ||
+			    cfg->rewind_mb > 4096u ||
+			    (cfg->rewind_mb && cfg->rewind_mb < REWIND_MIN_MB))
+				return -2;
+			break;
+		case 11: /* --rewind-ms */
+			if (parse_u32(optarg, &cfg->rewind_ms) < 0 ||
+			    !cfg->rewind_ms)
+				return -2;
+			break;
+		case 12: /* --rewind-step */
+			if (parse_u32(optarg, &cfg->rewind_step_ms) < 0 ||
+			    !cfg->rewind_step_ms)
+				return -2;
+			break;
+		case 6: /* --batch */
+			cfg->batch_path = optarg;
+			break;
+		case 7: /* --jobs */
+			if (parse_u32(optarg, &cfg->batch_threads) < 0)
+				return -2;
+			break;
 		case 'h':
 			cfg->show_help = true;
 			break;
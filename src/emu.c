@@ -18,6 +18,8 @@ int emu_init(struct Emu *emu, const struct Config *cfg)
 	memset(emu, 0, sizeof(*emu));
 
 	emu_core_init(&emu->core, cfg->cpu_hz, cfg->baud);
+	emu->core.cfg.tx_overflow = cfg->tx_block ? EMU_TX_BLOCK : EMU_TX_DROP;
+	emu_core_set_rx_baud(&emu->core, cfg->rx_baud);
 	if (!emu_core_load_rom64k(&emu->core, cfg->rom_path)) return -1;
 
 	/* Apply --load specs in the order given; later loads overwrite overlapping
@@ -48,6 +50,9 @@ int emu_init(struct Emu *emu, const struct Config *cfg)
 void emu_shutdown(struct Emu *emu)
 {
 	if (!emu) return;
+	if (emu->core.tx_dropped)
+		log_printf("serial: %llu TX bytes dropped (buffer full; see --tx-overflow)\n",
+			   (unsigned long long)emu->core.tx_dropped);
 	emu_host_shutdown(&emu->host, &emu->core);
 }
 
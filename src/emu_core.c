@@ -10,6 +10,7 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <string.h>
 
 static void txbuf_clear(struct EmuCore *core)
 {
@@ -17,34 +18,78 @@ static void txbuf_clear(struct EmuCore *core)
 	core->tx_w = 0;
 }
 
+static uint32_t txbuf_count(const struct EmuCore *core)
+{
+	return (core->tx_w - core->tx_r) & EMU_TXBUF_MASK;
+}
+
+static bool txbuf_full(const struct EmuCore *core)
+{
+	return txbuf_count(core) == EMU_TXBUF_MASK;
+}
+
 static void txbuf_putch_cb(int ch, void *u)
 {
 	struct EmuCore *core = (struct EmuCore *)u;
-	uint32_t next;
 
 	if (!core) return;
 
-	next = (core->tx_w + 1u) % EMU_TXBUF_SIZE;
-	if (next == core->tx_r) {
-		/* Drop on overflow (best-effort). */
+	if (txbuf_full(core)) {
+		/* EMU_TX_BLOCK ends the batch before this can happen. */
+		core->tx_dropped++;
 		return;
 	}
 
 	core->tx_buf[core->tx_w] = (uint8_t)ch;
-	core->tx_w = next;
+	core->tx_w = (core->tx_w + 1u) & EMU_TXBUF_MASK;
+}
+
+size_t emu_core_tx_peek(const struct EmuCore *core, struct EmuTxSpan span[2])
+{
+	uint32_t n;
+	uint32_t first;
+
+	if (!core || !span) return 0;
+
+	n = txbuf_count(core);
+	first = EMU_TXBUF_SIZE - core->tx_r;
+	if (first > n)
+		first = n;
+
+	span[0].data = core->tx_buf + core->tx_r;
+	span[0].len = first;
+	span[1].data = core->tx_buf;
+	span[1].len = n - first;
+	return n;
+}
+
+void emu_core_tx_commit(struct EmuCore *core, size_t n)
+{
+	if (!core) return;
+
+	if (n > txbuf_count(core))
+		n = txbuf_count(core);
+	core->tx_r = (uint32_t)((core->tx_r + n) & EMU_TXBUF_MASK);
 }
 
 size_t emu_core_tx_pop(struct EmuCore *core, uint8_t *dst, size_t cap)
 {
+	struct EmuTxSpan span[2];
 	size_t n;
 
 	if (!core || !dst || cap == 0) return 0;
 
+	(void)emu_core_tx_peek(core, span);
 	n = 0;
-	while (core->tx_r != core->tx_w && n < cap) {
-		dst[n++] = core->tx_buf[core->tx_r];
-		core->tx_r = (core->tx_r + 1u) % EMU_TXBUF_SIZE;
+	for (int i = 0; i < 2 && n < cap; i++) {
+		size_t len = span[i].len;
+
+		if (len > cap - n)
+			len = cap - n;
+		memcpy(dst + n, span[i].data, len);
+		n += len;
 	}
+	emu_core_tx_commit(core, n);
 	return n;
 }
 
@@ -54,26 +99,35 @@ void emu_core_init(struct EmuCore *core, uint32_t cpu_hz, uint32_t baud)
 
 	core->cfg.cpu_hz = cpu_hz;
 	core->cfg.baud = baud;
+	core->cfg.rx_baud = 0;
+	core->cfg.tx_overflow = EMU_TX_DROP;
+	core->tx_dropped = 0;
 
 	altaid_hw_init(&core->hw);
 
 	i8080_reset(&core->cpu);
 	core->cpu.pc = 0x0000;
 
-	core->bus.user = &core->hw;
-	core->bus.mem_read = altaid_mem_read;
-	core->bus.mem_write = altaid_mem_write;
-	core->bus.io_in = altaid_io_in;
-	core->bus.io_out = altaid_io_out;
+	altaid_hw_attach_bus(&core->hw, &core->bus);
+	i8080_bcache_flush(&core->bcache);
+#ifdef I8080_DISPATCH_TABLE
+	/* Blocks run table handlers; switch builds step every instruction. */
+	core->bus.bcache = &core->bcache;
+#endif
 
 	serial_init(&core->ser, cpu_hz, baud);
 	cassette_init(&core->cas, cpu_hz);
 	core->cas_attached = false;
+	core->cas_rec_len = 0;
+	core->ev_due[EMU_EV_CASSETTE] = 0;
 
 	core->timer_period = cpu_hz / 1000u;
 	if (core->timer_period == 0)
 	core->timer_period = 1;
 	core->next_timer_tick = 0;
+	core->insn_count = 0;
+	core->idle_ticks = 0;
+	core->idle.tracing = false;
 
 	txbuf_clear(core);
 }
@@ -81,9 +135,23 @@ void emu_core_init(struct EmuCore *core, uint32_t cpu_hz, uint32_t baud)
 bool emu_core_load_rom64k(struct EmuCore *core, const char *rom_path)
 {
 	if (!core) return false;
+	emu_core_mem_changed(core);
 	return altaid_hw_load_rom64k(&core->hw, rom_path);
 }
 
+void emu_core_mem_changed(struct EmuCore *core)
+{
+	if (!core) return;
+	i8080_bcache_flush(&core->bcache);
+}
+
+void emu_core_set_rx_baud(struct EmuCore *core, uint32_t rx_baud)
+{
+	if (!core) return;
+	core->cfg.rx_baud = rx_baud;
+	serial_set_rx_baud(&core->ser, rx_baud);
+}
+
 void emu_core_reset(struct EmuCore *core)
 {
 	if (!core) return;
@@ -93,9 +161,13 @@ void emu_core_reset(struct EmuCore *core)
 	altaid_hw_reset_runtime(&core->hw);
 
 	serial_init(&core->ser, core->cfg.cpu_hz, core->cfg.baud);
+	serial_set_rx_baud(&core->ser, core->cfg.rx_baud);
 	txbuf_clear(core);
 
 	core->next_timer_tick = 0;
+	core->insn_count = 0;
+	core->idle_ticks = 0;
+	core->idle.tracing = false;
 
 	if (core->cas_attached)
 	cassette_stop(&core->cas);
@@ -109,9 +181,13 @@ static void set_hw_lines(struct EmuCore *core)
 	bool timer_level;
 
 	rx_level = (serial_current_rx_level(&core->ser) != 0);
+	/* The tape level only moves at its next edge. */
 	cas_level = false;
-	if (core->cas_attached)
-	cas_level = cassette_in_level_at(&core->cas, core->ser.tick);
+	if (core->cas_attached) {
+		if (core->ser.tick >= core->ev_due[EMU_EV_CASSETTE])
+			(void)cassette_in_level_at(&core->cas, core->ser.tick);
+		cas_level = core->cas.in_level;
+	}
 
 	/*
 	* Timer is modeled as a single-tick active-low pulse at a fixed period.
@@ -136,46 +212,280 @@ static void set_hw_lines(struct EmuCore *core)
 	core->hw.timer_level = timer_level;
 }
 
+/*
+* Refresh the input-line slots after set_hw_lines(). Between these
+* deadlines every line is constant, except in two cases that need a look
+* at every instruction: a queued RX byte waiting for INTE (frame start
+* depends on the CPU), and a timer pulse that must end after one
+* instruction.
+*/
+static void sched_lines_update(struct EmuCore *core)
+{
+	uint64_t due;
+
+	core->ev_due[EMU_EV_TIMER] = core->timer_period ? core->next_timer_tick : EMU_EV_NEVER;
+	core->ev_due[EMU_EV_RX] = serial_rx_next_change(&core->ser);
+	core->ev_due[EMU_EV_CASSETTE] = core->cas_attached ?
+		cassette_next_edge(&core->cas) : EMU_EV_NEVER;
+
+	due = core->ev_due[EMU_EV_TIMER];
+	if (core->ev_due[EMU_EV_RX] < due)
+		due = core->ev_due[EMU_EV_RX];
+	if (core->ev_due[EMU_EV_CASSETTE] < due)
+		due = core->ev_due[EMU_EV_CASSETTE];
+	core->lines_due = due;
+
+	core->lines_poll = !core->hw.timer_level ||
+		(!core->ser.rx_active && core->ser.rx_qh != core->ser.rx_qt);
+}
+
+static void sched_tx_update(struct EmuCore *core)
+{
+	core->ev_due[EMU_EV_TX] = serial_tx_next_sample(&core->ser);
+}
+
+static void sched_key_update(struct EmuCore *core)
+{
+	uint64_t due = EMU_EV_NEVER;
+
+	for (int i = 0; i < 11; i++) {
+		if (core->hw.fp_key_down[i] && core->hw.fp_key_until[i] < due)
+			due = core->hw.fp_key_until[i];
+	}
+	core->ev_due[EMU_EV_KEY] = due;
+}
+
+/* Earliest tick at which the batch loop has anything to service. */
+static uint64_t sched_next_due(const struct EmuCore *core, uint64_t batch_end)
+{
+	uint64_t due = batch_end;
+
+	if (core->lines_due < due)
+		due = core->lines_due;
+	if (core->ev_due[EMU_EV_TX] < due)
+		due = core->ev_due[EMU_EV_TX];
+	if (core->ev_due[EMU_EV_KEY] < due)
+		due = core->ev_due[EMU_EV_KEY];
+	return due;
+}
+
+/*
+* True when the next few instructions need no per-instruction service:
+* input lines are not being polled, no EI is about to take effect and no
+* RX interrupt is waiting to be taken.
+*/
+static bool core_quiet(const struct EmuCore *core)
+{
+	return !core->lines_poll && !core->cpu.ei_pending &&
+		!(core->ser.rx_irq_latched && core->cpu.inte);
+}
+
+/*
+* Skip n repetitions of a span of period ticks and insns instructions that
+* leaves the machine state unchanged. The caller guarantees that no
+* scheduler event falls inside the skipped span.
+*/
+static void idle_skip(struct EmuCore *core, uint64_t period, uint64_t insns,
+	uint64_t due)
+{
+	uint64_t n;
+
+	if (period == 0 || due <= core->ser.tick)
+		return;
+	n = (due - 1u - core->ser.tick) / period;
+	core->ser.tick += n * period;
+	core->insn_count += n * insns;
+	core->idle_ticks += n * period;
+}
+
+/*
+* HALT: i8080_step() only burns EMU_HALT_TICKS until an interrupt, and the
+* only interrupt source (RX) is raised by set_hw_lines() at a scheduled
+* tick, so jump to the last halt step before the next event.
+*/
+#define EMU_HALT_TICKS 4u
+
+static void idle_halt(struct EmuCore *core, uint64_t batch_end)
+{
+	if (!core_quiet(core))
+		return;
+	idle_skip(core, EMU_HALT_TICKS, 1u, sched_next_due(core, batch_end));
+}
+
+/*
+* Opcodes a polling loop may contain: anything that only reads memory or
+* changes CPU state. Stores, stack pushes, OUT, HLT and interrupt-enable
+* changes end the candidate.
+*/
+static bool idle_op_pure(uint8_t op)
+{
+	return !i8080_op_writes(op) &&
+		op != 0xD3 && op != 0x76 && op != 0xF3 && op != 0xFB;
+}
+
+static bool idle_cpu_equal(const I8080 *a, const I8080 *b)
+{
+	return a->pc == b->pc && a->sp == b->sp && a->a == b->a &&
+		a->f == b->f && a->b == b->b && a->c == b->c &&
+		a->d == b->d && a->e == b->e && a->h == b->h &&
+		a->l == b->l && a->inte == b->inte &&
+		a->ei_pending == b->ei_pending && a->halted == b->halted;
+}
+
+/*
+* Called after an instruction that read IN 0x40. If the CPU is back in the
+* state it had after the previous read, with only pure opcodes executed in
+* between, every further pass of the loop is identical until an input line
+* can change: skip whole passes up to the next event. Otherwise start a
+* new candidate here.
+*/
+static void idle_on_input(struct EmuCore *core, uint64_t batch_end)
+{
+	struct EmuIdle *id = &core->idle;
+
+	id->in_seen = core->hw.input_reads;
+
+	if (id->tracing && idle_cpu_equal(&core->cpu, &id->cpu)) {
+		/* Held keys log their scan reads (altaid_hw_set_debug). */
+		if (!core->lines_poll && core->ev_due[EMU_EV_KEY] == EMU_EV_NEVER)
+			idle_skip(core, core->ser.tick - id->tick,
+				core->insn_count - id->insns,
+				sched_next_due(core, batch_end));
+	} else {
+		id->tracing = true;
+		id->cpu = core->cpu;
+	}
+	id->tick = core->ser.tick;
+	id->insns = core->insn_count;
+}
+
+/*
+* Run the cached basic block at PC when it is certain to finish before the
+* next scheduled event. Blocks contain no port I/O or interrupt-enable
+* changes, so nothing the batch loop services can happen inside one.
+*/
+static bool core_run_block(struct EmuCore *core, uint64_t batch_end)
+{
+	const I8080Block *blk;
+	unsigned n;
+	int t;
+
+	if (!core_quiet(core))
+		return false;
+	blk = i8080_block_lookup(&core->cpu, &core->bus);
+	if (!blk || blk->n_ops == 0 ||
+	    core->ser.tick + blk->max_cycles >= sched_next_due(core, batch_end))
+		return false;
+
+	t = i8080_block_run(&core->cpu, &core->bus, blk, &n);
+	serial_advance(&core->ser, (uint32_t)t);
+	core->insn_count += n;
+	if (blk->writes)
+		core->idle.tracing = false;
+	return true;
+}
+
+/* Hand the edges recorded so far this batch to the tape. */
+static void cas_rec_flush(struct EmuCore *core)
+{
+	if (!core->cas_rec_len)
+		return;
+	cassette_on_out_edges(&core->cas, core->cas_rec, core->cas_rec_len,
+		core->hw.cassette_out_level);
+	core->cas_rec_len = 0;
+}
+
 void emu_core_run_batch(struct EmuCore *core, uint64_t batch_cycles)
 {
 	uint64_t batch_end;
+	bool tx_stall = false;
 
 	if (!core) return;
 
+	/* Back-pressure: no progress until the host makes room. */
+	if (core->cfg.tx_overflow == EMU_TX_BLOCK && txbuf_full(core))
+		return;
+
+	/*
+	 * The host may have queued RX bytes, pressed keys, moved the tape or
+	 * loaded state since the last batch: rebuild every slot up front.
+	 */
+	core->lines_poll = true;
+	core->ev_due[EMU_EV_CASSETTE] = 0;
+	sched_tx_update(core);
+	sched_key_update(core);
+	core->idle.tracing = false;
+	core->idle.in_seen = core->hw.input_reads;
+
 	batch_end = core->ser.tick + batch_cycles;
-	while (core->ser.tick < batch_end) {
+	while (core->ser.tick < batch_end && !tx_stall) {
 		int t;
 
-		/*
-		 * Mirror the CPU's interrupt-enable state so the UART only pops
-		 * new RX frames from the queue when the ROM can actually receive
-		 * them (see serial.c).
-		 */
-		core->ser.gate_inte = core->cpu.inte;
+		if (core->lines_poll || core->ser.tick >= core->lines_due) {
+			/*
+			 * Mirror the CPU's interrupt-enable state so the UART
+			 * only pops new RX frames from the queue when the ROM
+			 * can actually receive them (see serial.c).
+			 */
+			core->ser.gate_inte = core->cpu.inte;
+
+			set_hw_lines(core);
+			sched_lines_update(core);
+		}
 
-		set_hw_lines(core);
+		if (core->cpu.halted)
+			idle_halt(core, batch_end);
+		else if (core_run_block(core, batch_end))
+			continue;
+		else if (core->idle.tracing &&
+		    !idle_op_pure(altaid_mem_read(&core->bus, core->cpu.pc)))
+			core->idle.tracing = false;
 
 		t = i8080_step(&core->cpu, &core->bus);
 		serial_advance(&core->ser, (uint32_t)t);
+		core->insn_count++;
 
 		/* Service pending interrupt (RST7) on RX start-bit edge. */
 		if (core->ser.rx_irq_latched && core->cpu.inte) {
 			core->ser.rx_irq_latched = false;
 			i8080_intr_service(&core->cpu, &core->bus, 7);
+			core->idle.tracing = false;
 		}
 
-		/* TX: decode into the core TX buffer. */
-		serial_tick_tx(&core->ser, altaid_hw_tx_level(&core->hw),
-		txbuf_putch_cb, core);
+		/*
+		 * TX: decode into the core TX buffer. The decoder only has
+		 * work on a line change (OUT 0xC0) or at a sample point.
+		 */
+		if (altaid_hw_tx_level(&core->hw) != core->ser.last_tx ||
+		    core->ser.tick >= core->ev_due[EMU_EV_TX]) {
+			serial_tick_tx(&core->ser, altaid_hw_tx_level(&core->hw),
+			txbuf_putch_cb, core);
+			sched_tx_update(core);
+
+			/* End the batch early rather than drop the next byte. */
+			tx_stall = core->cfg.tx_overflow == EMU_TX_BLOCK &&
+				txbuf_full(core);
+		}
 
 		/* Cassette record: capture edges driven by OUT 0x44. */
 		if (core->cas_attached && core->hw.cassette_out_dirty) {
 			core->hw.cassette_out_dirty = false;
-			cassette_on_out_change(&core->cas, core->ser.tick,
-			core->hw.cassette_out_level);
+			if (core->cas.state == CASSETTE_RECORDING) {
+				core->cas_rec[core->cas_rec_len++] = core->ser.tick;
+				if (core->cas_rec_len == EMU_CAS_REC_BATCH)
+					cas_rec_flush(core);
+			}
 		}
 
 		/* Front panel key auto-release. */
-		altaid_hw_panel_tick(&core->hw, core->ser.tick);
+		if (core->ser.tick >= core->ev_due[EMU_EV_KEY]) {
+			altaid_hw_panel_tick(&core->hw, core->ser.tick);
+			sched_key_update(core);
+		}
+
+		/* Idle detection: vet the loop around each IN 0x40. */
+		if (core->hw.input_reads != core->idle.in_seen)
+			idle_on_input(core, batch_end);
 	}
+	cas_rec_flush(core);
 }
@@ -74,10 +74,13 @@ const struct Config *cfg)
 	host->serial_mirror_fd_spec = EMU_FD_UNSPEC;
 	host->serial_fd_override = EMU_FD_UNSPEC;
 	host->next_panel_tick = 0;
+	hostev_init(&host->ev);
+	rewind_init(&host->rewind_buf, (size_t)host->cfg.rewind_mb << 20);
 
 	(void)setlocale(LC_CTYPE, "");
 
 	/* Cassette attachment is host-facing (file IO). */
+	core->cas.wav_rate = host->cfg.cassette_wav_rate;
 	if (host->cfg.cassette_path) {
 		if (!cassette_open(&core->cas, host->cfg.cassette_path)) {
 			fprintf(stderr, "Failed to open cassette '%s': %s\n",
@@ -130,6 +133,7 @@ const struct Config *cfg)
 		} else if (s->kind == IO_SPEC_RAM && s->path) {
 			strncpy(host->ui.ram_path, s->path,
 				sizeof(host->ui.ram_path) - 1);
+			host->ui.ram_packed = s->packed;
 		}
 	}
 	host->ui.state_path[sizeof(host->ui.state_path) - 1] = '\0';
@@ -213,6 +217,13 @@ const struct Config *cfg)
 		}
 	}
 
+	/* Host inputs the runloop waits on. */
+	if (host->pty_fd >= 0)
+		hostev_watch(&host->ev, HOSTEV_PTY, host->pty_fd);
+	if (!host->cfg.headless || host->serial_in_stdin)
+		hostev_watch(&host->ev, HOSTEV_STDIN, STDIN_FILENO);
+
+	runloop_pace_init(&host->pace, core->cfg.cpu_hz);
 	emu_host_epoch_reset(host, core);
 
 	return 0;
@@ -238,6 +249,32 @@ void emu_host_shutdown(struct EmuHost *host, struct EmuCore *core)
 		host->ui_inited = false;
 	}
 
+	rewind_free(&host->rewind_buf);
+	hostev_close(&host->ev);
+
+	if (host->cfg.log_path && host->batch.batches) {
+		unsigned pm = runloop_batch_host_permille(&host->batch);
+
+		log_printf("[STATS] %llu batches, avg %llu cycles, host %u.%u%%\n",
+			   (unsigned long long)host->batch.batches,
+			   (unsigned long long)(host->batch.cycles_run /
+						host->batch.batches),
+			   pm / 10u, pm % 10u);
+	}
+	if (host->cfg.log_path && host->pace.checks) {
+		const struct RunPace *pc = &host->pace;
+
+		log_printf("[STATS] pace lag avg %llu us max %llu us, "
+			   "oversleep avg %llu us max %llu us, "
+			   "%llu slips (%llu ms dropped)\n",
+			   (unsigned long long)(runloop_pace_lag_avg_ns(pc) / 1000u),
+			   (unsigned long long)(pc->lag_max_ns / 1000u),
+			   (unsigned long long)(runloop_pace_overshoot_avg_ns(pc) / 1000u),
+			   (unsigned long long)(pc->overshoot_max_ns / 1000u),
+			   (unsigned long long)pc->slips,
+			   (unsigned long long)(pc->slipped_ns / 1000000u));
+	}
+
 	if (host->pty_slave_fd >= 0) {
 		close(host->pty_slave_fd);
 		host->pty_slave_fd = -1;
@@ -265,7 +302,6 @@ void emu_host_epoch_reset(struct EmuHost *host, const struct EmuCore *core)
 {
 	if (!host || !core) return;
 
-	host->wall_start_usec = monotonic_usec();
-	host->emu_start_tick = core->ser.tick;
+	runloop_pace_rebase(&host->pace, core->ser.tick, monotonic_nsec());
 	host->next_panel_tick = core->ser.tick;
 }
@@ -0,0 +1,198 @@
+/* SPDX-License-Identifier: MIT */
+
+/* For poll() and nanosleep() in strict C99 builds. */
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "hostev.h"
+
+#include "timeutil.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#define HOSTEV_EPOLL 1
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#endif
+
+/* epoll tag of the timerfd; sources are tagged by index. */
+#define HOSTEV_TIMER_TAG	HOSTEV_NSRC
+
+void hostev_init(struct HostEv *ev)
+{
+	memset(ev, 0, sizeof(*ev));
+	for (unsigned i = 0; i < HOSTEV_NSRC; i++)
+		ev->fd[i] = -1;
+	ev->epfd = -1;
+	ev->tfd = -1;
+
+#ifdef HOSTEV_EPOLL
+	ev->epfd = epoll_create1(EPOLL_CLOEXEC);
+	ev->tfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+	if (ev->epfd >= 0 && ev->tfd >= 0) {
+		struct epoll_event e;
+
+		memset(&e, 0, sizeof(e));
+		e.events = EPOLLIN;
+		e.data.u32 = HOSTEV_TIMER_TAG;
+		if (epoll_ctl(ev->epfd, EPOLL_CTL_ADD, ev->tfd, &e) == 0)
+			return;
+	}
+	hostev_close(ev);
+#endif
+}
+
+void hostev_close(struct HostEv *ev)
+{
+	if (ev->epfd >= 0)
+		close(ev->epfd);
+	if (ev->tfd >= 0)
+		close(ev->tfd);
+	ev->epfd = -1;
+	ev->tfd = -1;
+	ev->armed = 0;
+}
+
+#ifdef HOSTEV_EPOLL
+/* Register exactly the sources in want with epfd. */
+static void hostev_sync(struct HostEv *ev, unsigned want)
+{
+	for (unsigned i = 0; i < HOSTEV_NSRC; i++) {
+		unsigned bit = 1u << i;
+		struct epoll_event e;
+
+		if (!((ev->armed ^ want) & bit))
+			continue;
+		memset(&e, 0, sizeof(e));
+		e.events = EPOLLIN;
+		e.data.u32 = i;
+		if (!(want & bit)) {
+			(void)epoll_ctl(ev->epfd, EPOLL_CTL_DEL, ev->fd[i], &e);
+			ev->armed &= ~bit;
+		} else if (epoll_ctl(ev->epfd, EPOLL_CTL_ADD, ev->fd[i], &e) == 0) {
+			ev->armed |= bit;
+		} else if (errno == EPERM) {
+			/* Regular file or /dev/null: reads never block. */
+			ev->always |= bit;
+		}
+	}
+}
+#endif
+
+void hostev_watch(struct HostEv *ev, unsigned src, int fd)
+{
+	for (unsigned i = 0; i < HOSTEV_NSRC; i++) {
+		unsigned bit = 1u << i;
+
+		if (!(src & bit))
+			continue;
+#ifdef HOSTEV_EPOLL
+		if (ev->armed & bit)
+			hostev_sync(ev, ev->armed & ~bit);
+#endif
+		ev->fd[i] = fd;
+		ev->ready &= ~bit;
+		ev->always &= ~bit;
+	}
+}
+
+static unsigned hostev_poll(struct HostEv *ev, unsigned mask,
+			    uint64_t timeout_ns)
+{
+	struct pollfd p[HOSTEV_NSRC];
+	unsigned src[HOSTEV_NSRC];
+	nfds_t n = 0;
+	uint64_t ms;
+	int r;
+
+	for (unsigned i = 0; i < HOSTEV_NSRC; i++) {
+		if (!(mask & (1u << i)))
+			continue;
+		p[n].fd = ev->fd[i];
+		p[n].events = POLLIN;
+		p[n].revents = 0;
+		src[n++] = 1u << i;
+	}
+	if (!n) {
+		sleep_nsec(timeout_ns);
+		return ev->ready;
+	}
+
+	ms = timeout_ns / 1000000ull;
+	r = poll(p, n, ms > INT_MAX ? INT_MAX : (int)ms);
+	if (r > 0) {
+		for (nfds_t k = 0; k < n; k++) {
+			if (p[k].revents)
+				ev->ready |= src[k];
+		}
+	} else if (r == 0 && ms <= INT_MAX) {
+		/* poll() counts whole milliseconds; sleep out the rest. */
+		sleep_nsec(timeout_ns % 1000000ull);
+	}
+	return ev->ready;
+}
+
+unsigned hostev_wait(struct HostEv *ev, unsigned mask, uint64_t timeout_ns)
+{
+	unsigned watched = 0;
+
+	for (unsigned i = 0; i < HOSTEV_NSRC; i++) {
+		if (ev->fd[i] >= 0)
+			watched |= 1u << i;
+	}
+	mask &= watched;
+
+#ifdef HOSTEV_EPOLL
+	if (ev->epfd >= 0) {
+		struct epoll_event evs[HOSTEV_NSRC + 1];
+		int n;
+
+		hostev_sync(ev, mask & ~ev->always);
+		ev->ready |= mask & ev->always;
+		if (ev->ready & mask)
+			return ev->ready;
+		if (!timeout_ns && !ev->armed)
+			return ev->ready;
+
+		if (timeout_ns) {
+			struct itimerspec its;
+
+			memset(&its, 0, sizeof(its));
+			its.it_value.tv_sec = (time_t)(timeout_ns / 1000000000ull);
+			its.it_value.tv_nsec = (long)(timeout_ns % 1000000000ull);
+			if (timerfd_settime(ev->tfd, 0, &its, NULL) != 0)
+				return hostev_poll(ev, mask & ~ev->always,
+						   timeout_ns);
+		}
+
+		/* A signal (SIGWINCH, SIGINT) ends the wait early too. */
+		n = epoll_wait(ev->epfd, evs, HOSTEV_NSRC + 1,
+			       timeout_ns ? -1 : 0);
+		for (int k = 0; k < n; k++) {
+			uint32_t tag = evs[k].data.u32;
+
+			if (tag == HOSTEV_TIMER_TAG) {
+				uint64_t expired;
+
+				/* Clear the expiry; EAGAIN if it was re-armed. */
+				if (read(ev->tfd, &expired, sizeof(expired)) < 0)
+					continue;
+			} else {
+				ev->ready |= 1u << tag;
+			}
+		}
+		return ev->ready;
+	}
+#endif
+
+	ev->ready |= mask & ev->always;
+	if (ev->ready & mask)
+		return ev->ready;
+	return hostev_poll(ev, mask, timeout_ns);
+}
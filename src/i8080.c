@@ -3,28 +3,80 @@
 #include "i8080.h"
 #include <string.h>
 
-// We keep EI-pending state in a private static (single CPU instance, minimalist).
+/* EI's one-instruction delay is tracked per CPU in I8080.ei_pending. */
 
 static inline uint16_t HL(const I8080 *c) { return (uint16_t)((uint16_t)c->h<<8) | c->l; }
 static inline void setHL(I8080 *c, uint16_t v) { c->h=(uint8_t)(v>>8); c->l=(uint8_t)v; }
 
-static inline bool parity(uint8_t v)
+#define F_S	I8080_FLAG_S
+#define F_Z	I8080_FLAG_Z
+#define F_AC	I8080_FLAG_AC
+#define F_P	I8080_FLAG_P
+#define F_CY	I8080_FLAG_CY
+
+/* S, Z and P for every result byte, already in PSW bit positions. */
+static const uint8_t k_zsp[256] = {
+	/* 00 */ 0x44, 0x00, 0x00, 0x04, 0x00, 0x04, 0x04, 0x00,
+	/* 08 */ 0x00, 0x04, 0x04, 0x00, 0x04, 0x00, 0x00, 0x04,
+	/* 10 */ 0x00, 0x04, 0x04, 0x00, 0x04, 0x00, 0x00, 0x04,
+	/* 18 */ 0x04, 0x00, 0x00, 0x04, 0x00, 0x04, 0x04, 0x00,
+	/* 20 */ 0x00, 0x04, 0x04, 0x00, 0x04, 0x00, 0x00, 0x04,
+	/* 28 */ 0x04, 0x00, 0x00, 0x04, 0x00, 0x04, 0x04, 0x00,
+	/* 30 */ 0x04, 0x00, 0x00, 0x04, 0x00, 0x04, 0x04, 0x00,
+	/* 38 */ 0x00, 0x04, 0x04, 0x00, 0x04, 0x00, 0x00, 0x04,
+	/* 40 */ 0x00, 0x04, 0x04, 0x00, 0x04, 0x00, 0x00, 0x04,
+	/* 48 */ 0x04, 0x00, 0x00, 0x04, 0x00, 0x04, 0x04, 0x00,
+	/* 50 */ 0x04, 0x00, 0x00, 0x04, 0x00, 0x04, 0x04, 0x00,
+	/* 58 */ 0x00, 0x04, 0x04, 0x00, 0x04, 0x00, 0x00, 0x04,
+	/* 60 */ 0x04, 0x00, 0x00, 0x04, 0x00, 0x04, 0x04, 0x00,
+	/* 68 */ 0x00, 0x04, 0x04, 0x00, 0x04, 0x00, 0x00, 0x04,
+	/* 70 */ 0x00, 0x04, 0x04, 0x00, 0x04, 0x00, 0x00, 0x04,
+	/* 78 */ 0x04, 0x00, 0x00, 0x04, 0x00, 0x04, 0x04, 0x00,
+	/* 80 */ 0x80, 0x84, 0x84, 0x80, 0x84, 0x80, 0x80, 0x84,
+	/* 88 */ 0x84, 0x80, 0x80, 0x84, 0x80, 0x84, 0x84, 0x80,
+	/* 90 */ 0x84, 0x80, 0x80, 0x84, 0x80, 0x84, 0x84, 0x80,
+	/* 98 */ 0x80, 0x84, 0x84, 0x80, 0x84, 0x80, 0x80, 0x84,
+	/* A0 */ 0x84, 0x80, 0x80, 0x84, 0x80, 0x84, 0x84, 0x80,
+	/* A8 */ 0x80, 0x84, 0x84, 0x80, 0x84, 0x80, 0x80, 0x84,
+	/* B0 */ 0x80, 0x84, 0x84, 0x80, 0x84, 0x80, 0x80, 0x84,
+	/* B8 */ 0x84, 0x80, 0x80, 0x84, 0x80, 0x84, 0x84, 0x80,
+	/* C0 */ 0x84, 0x80, 0x80, 0x84, 0x80, 0x84, 0x84, 0x80,
+	/* C8 */ 0x80, 0x84, 0x84, 0x80, 0x84, 0x80, 0x80, 0x84,
+	/* D0 */ 0x80, 0x84, 0x84, 0x80, 0x84, 0x80, 0x80, 0x84,
+	/* D8 */ 0x84, 0x80, 0x80, 0x84, 0x80, 0x84, 0x84, 0x80,
+	/* E0 */ 0x80, 0x84, 0x84, 0x80, 0x84, 0x80, 0x80, 0x84,
+	/* E8 */ 0x84, 0x80, 0x80, 0x84, 0x80, 0x84, 0x84, 0x80,
+	/* F0 */ 0x84, 0x80, 0x80, 0x84, 0x80, 0x84, 0x84, 0x80,
+	/* F8 */ 0x80, 0x84, 0x84, 0x80, 0x84, 0x80, 0x80, 0x84,
+};
+
+static inline void set_zsp(I8080 *c, uint8_t v)
 {
-	v ^= (uint8_t)(v>>4);
-	v ^= (uint8_t)(v>>2);
-	v ^= (uint8_t)(v>>1);
-	return ((~v) & 1u) != 0;
+	c->f = (uint8_t)((c->f & ~(F_S | F_Z | F_P)) | k_zsp[v]);
 }
 
-static inline void set_zsp(I8080 *c, uint8_t v)
+static inline bool get_cy(const I8080 *c) { return (c->f & F_CY) != 0; }
+static inline void set_cy(I8080 *c, bool on) { c->f = (uint8_t)(on ? (c->f | F_CY) : (c->f & ~F_CY)); }
+
+static inline uint8_t rd(I8080Bus *b, uint16_t a)
 {
-	c->z = (v == 0);
-	c->s = (v & 0x80) != 0;
-	c->p = parity(v);
+	if (b->rd_page)
+		return b->rd_page[a >> I8080_PAGE_SHIFT][a & I8080_PAGE_MASK];
+	return b->mem_read(b, a);
 }
+static void bcache_invalidate(I8080BlockCache *bc, uint16_t a);
 
-static inline uint8_t rd(I8080Bus *b, uint16_t a) { return b->mem_read(b, a); }
-static inline void    wr(I8080Bus *b, uint16_t a, uint8_t v) { b->mem_write(b, a, v); }
+static inline void wr(I8080Bus *b, uint16_t a, uint8_t v)
+{
+	if (b->wr_page) {
+		b->wr_page[a >> I8080_PAGE_SHIFT][a & I8080_PAGE_MASK] = v;
+		if (b->wr_dirty)
+			b->wr_dirty[a >> I8080_PAGE_SHIFT][(a & I8080_PAGE_MASK) >> 8] = 0xFFu;
+	} else
+		b->mem_write(b, a, v);
+	if (b->bcache && b->bcache->code_line[a >> 8])
+		bcache_invalidate(b->bcache, a);
+}
 static inline uint8_t in(I8080Bus *b, uint8_t p) { return b->io_in(b, p); }
 static inline void    out(I8080Bus *b, uint8_t p, uint8_t v) { b->io_out(b, p, v); }
 
@@ -44,22 +96,11 @@ static inline uint16_t pop16(I8080 *c, I8080Bus *b)
 
 static inline uint8_t pack_flags(const I8080 *c)
 {
-	return (uint8_t)(
-	(c->s ? 0x80 : 0) |
-	(c->z ? 0x40 : 0) |
-	(c->ac? 0x10 : 0) |
-	(c->p ? 0x04 : 0) |
-	0x02 |
-	(c->cy? 0x01 : 0)
-	);
+	return c->f;
 }
 static inline void unpack_flags(I8080 *c, uint8_t f)
 {
-	c->s  = (f & 0x80) != 0;
-	c->z  = (f & 0x40) != 0;
-	c->ac = (f & 0x10) != 0;
-	c->p  = (f & 0x04) != 0;
-	c->cy = (f & 0x01) != 0;
+	c->f = (uint8_t)((f & (F_S | F_Z | F_AC | F_P | F_CY)) | I8080_FLAG_FIXED);
 }
 
 static inline uint16_t rp_bc(const I8080 *c) { return (uint16_t)((uint16_t)c->b<<8)|c->c; }
@@ -96,66 +137,60 @@ static inline void set_r(I8080 *c, I8080Bus *b, int r, uint8_t v)
 static inline void add8(I8080 *c, uint8_t x, bool with_carry)
 {
 	uint16_t a = c->a;
-	uint16_t y = (uint16_t)x + ((with_carry && c->cy) ? 1u : 0u);
+	uint16_t y = (uint16_t)x + ((with_carry && get_cy(c)) ? 1u : 0u);
 	uint16_t r = a + y;
-	c->ac = ((a & 0x0F) + (y & 0x0F)) > 0x0F;
-	c->cy = r > 0xFF;
 	c->a  = (uint8_t)r;
-	set_zsp(c, c->a);
+	c->f  = (uint8_t)(k_zsp[c->a] | I8080_FLAG_FIXED
+		| ((((a & 0x0F) + (y & 0x0F)) > 0x0F) ? F_AC : 0)
+		| ((r > 0xFF) ? F_CY : 0));
 }
 static inline void sub8(I8080 *c, uint8_t x, bool with_borrow)
 {
 	uint16_t a = c->a;
-	uint16_t y = (uint16_t)x + ((with_borrow && c->cy) ? 1u : 0u);
+	uint16_t y = (uint16_t)x + ((with_borrow && get_cy(c)) ? 1u : 0u);
 	uint16_t r = a - y;
-	c->ac = ((a & 0x0F) < (y & 0x0F));
-	c->cy = a < y;
 	c->a  = (uint8_t)r;
-	set_zsp(c, c->a);
+	c->f  = (uint8_t)(k_zsp[c->a] | I8080_FLAG_FIXED
+		| (((a & 0x0F) < (y & 0x0F)) ? F_AC : 0)
+		| ((a < y) ? F_CY : 0));
 }
 static inline void cmp8(I8080 *c, uint8_t x)
 {
 	uint16_t a = c->a;
 	uint16_t r = a - x;
-	c->ac = ((a & 0x0F) < (x & 0x0F));
-	c->cy = a < x;
-	set_zsp(c, (uint8_t)r);
+	c->f  = (uint8_t)(k_zsp[(uint8_t)r] | I8080_FLAG_FIXED
+		| (((a & 0x0F) < (x & 0x0F)) ? F_AC : 0)
+		| ((a < x) ? F_CY : 0));
 }
 
 static inline void ana8(I8080 *c, uint8_t x)
 {
 	c->a &= x;
-	c->cy = false;
-	c->ac = true;
-	set_zsp(c, c->a);
+	c->f = (uint8_t)(k_zsp[c->a] | I8080_FLAG_FIXED | F_AC);
 }
 static inline void xra8(I8080 *c, uint8_t x)
 {
 	c->a ^= x;
-	c->cy = false;
-	c->ac = false;
-	set_zsp(c, c->a);
+	c->f = (uint8_t)(k_zsp[c->a] | I8080_FLAG_FIXED);
 }
 static inline void ora8(I8080 *c, uint8_t x)
 {
 	c->a |= x;
-	c->cy = false;
-	c->ac = false;
-	set_zsp(c, c->a);
+	c->f = (uint8_t)(k_zsp[c->a] | I8080_FLAG_FIXED);
 }
 
 static inline uint8_t inr8(I8080 *c, uint8_t v)
 {
 	uint8_t r = (uint8_t)(v + 1u);
-	c->ac = ((v & 0x0F) + 1u) > 0x0F;
-	set_zsp(c, r);
+	c->f = (uint8_t)((c->f & F_CY) | k_zsp[r] | I8080_FLAG_FIXED
+		| (((v & 0x0F) == 0x0F) ? F_AC : 0));
 	return r;
 }
 static inline uint8_t dcr8(I8080 *c, uint8_t v)
 {
 	uint8_t r = (uint8_t)(v - 1u);
-	c->ac = ((v & 0x0F) == 0x00);
-	set_zsp(c, r);
+	c->f = (uint8_t)((c->f & F_CY) | k_zsp[r] | I8080_FLAG_FIXED
+		| (((v & 0x0F) == 0x00) ? F_AC : 0));
 	return r;
 }
 
@@ -163,29 +198,29 @@ static inline void daa(I8080 *c)
 {
 	uint8_t a = c->a;
 	uint8_t adj = 0;
-	bool cy = c->cy;
+	bool cy = get_cy(c);
 
-	if (c->ac || ((a & 0x0F) > 9)) adj |= 0x06;
+	if ((c->f & F_AC) || ((a & 0x0F) > 9)) adj |= 0x06;
 	if (cy || (a > 0x99)) { adj |= 0x60; cy = true; }
 
 	uint16_t r = (uint16_t)a + adj;
 	c->a = (uint8_t)r;
-	c->cy = cy;
-	c->ac = ((a & 0x0F) + (adj & 0x0F)) > 0x0F;
-	set_zsp(c, c->a);
+	c->f = (uint8_t)(k_zsp[c->a] | I8080_FLAG_FIXED
+		| (cy ? F_CY : 0)
+		| ((((a & 0x0F) + (adj & 0x0F)) > 0x0F) ? F_AC : 0));
 }
 
 static inline bool cond(const I8080 *c, int cc)
 {
 	switch (cc) {
-	case 0: return !c->z;  // NZ
-	case 1: return  c->z;  // Z
-	case 2: return !c->cy; // NC
-	case 3: return  c->cy; // C
-	case 4: return !c->p;  // PO
-	case 5: return  c->p;  // PE
-	case 6: return !c->s;  // P
-	case 7: return  c->s;  // M
+	case 0: return !(c->f & F_Z);  // NZ
+	case 1: return  (c->f & F_Z);  // Z
+	case 2: return !(c->f & F_CY); // NC
+	case 3: return  (c->f & F_CY); // C
+	case 4: return !(c->f & F_P);  // PO
+	case 5: return  (c->f & F_P);  // PE
+	case 6: return !(c->f & F_S);  // P
+	case 7: return  (c->f & F_S);  // M
 	default: return false;
 	}
 }
@@ -193,6 +228,7 @@ static inline bool cond(const I8080 *c, int cc)
 void i8080_reset(I8080 *cpu)
 {
 	memset(cpu, 0, sizeof(*cpu));
+	cpu->f = I8080_FLAG_FIXED;
 	cpu->pc = 0x0000;
 	cpu->sp = 0x0000;
 	cpu->inte = false;
@@ -216,7 +252,7 @@ void i8080_intr_service(I8080 *cpu, I8080Bus *bus, uint8_t rst_vector)
 	cpu->pc = (uint16_t)((rst_vector & 7u) * 8u);
 }
 
-int i8080_step(I8080 *c, I8080Bus *b)
+int i8080_step_switch(I8080 *c, I8080Bus *b)
 {
 	// EI takes effect after one following instruction
 	bool apply_ei_after = c->ei_pending;
@@ -318,22 +354,22 @@ int i8080_step(I8080 *c, I8080Bus *b)
 	case 0x3E: c->a=rd(b,c->pc++); t=7; break;
 
 		// Rotates
-	case 0x07: { uint8_t x=c->a; c->cy=(x&0x80)!=0; c->a=(uint8_t)((x<<1) | (c->cy?1:0)); t=4; } break; // RLC
-	case 0x0F: { uint8_t x=c->a; c->cy=(x&0x01)!=0; c->a=(uint8_t)((x>>1) | (c->cy?0x80:0)); t=4; } break; // RRC
-	case 0x17: { uint8_t x=c->a; bool old=c->cy; c->cy=(x&0x80)!=0; c->a=(uint8_t)((x<<1) | (old?1:0)); t=4; } break; // RAL
-	case 0x1F: { uint8_t x=c->a; bool old=c->cy; c->cy=(x&0x01)!=0; c->a=(uint8_t)((x>>1) | (old?0x80:0)); t=4; } break; // RAR
+	case 0x07: { uint8_t x=c->a; set_cy(c,(x&0x80)!=0); c->a=(uint8_t)((x<<1) | (x>>7)); t=4; } break; // RLC
+	case 0x0F: { uint8_t x=c->a; set_cy(c,(x&0x01)!=0); c->a=(uint8_t)((x>>1) | (x<<7)); t=4; } break; // RRC
+	case 0x17: { uint8_t x=c->a; bool old=get_cy(c); set_cy(c,(x&0x80)!=0); c->a=(uint8_t)((x<<1) | (old?1:0)); t=4; } break; // RAL
+	case 0x1F: { uint8_t x=c->a; bool old=get_cy(c); set_cy(c,(x&0x01)!=0); c->a=(uint8_t)((x>>1) | (old?0x80:0)); t=4; } break; // RAR
 
 		// DAD
-	case 0x09: { uint32_t r=(uint32_t)HL(c) + rp_bc(c); c->cy = (r>0xFFFF); setHL(c,(uint16_t)r); t=10; } break;
-	case 0x19: { uint32_t r=(uint32_t)HL(c) + rp_de(c); c->cy = (r>0xFFFF); setHL(c,(uint16_t)r); t=10; } break;
-	case 0x29: { uint32_t r=(uint32_t)HL(c) + HL(c);   c->cy = (r>0xFFFF); setHL(c,(uint16_t)r); t=10; } break;
-	case 0x39: { uint32_t r=(uint32_t)HL(c) + c->sp;   c->cy = (r>0xFFFF); setHL(c,(uint16_t)r); t=10; } break;
+	case 0x09: { uint32_t r=(uint32_t)HL(c) + rp_bc(c); set_cy(c, r>0xFFFF); setHL(c,(uint16_t)r); t=10; } break;
+	case 0x19: { uint32_t r=(uint32_t)HL(c) + rp_de(c); set_cy(c, r>0xFFFF); setHL(c,(uint16_t)r); t=10; } break;
+	case 0x29: { uint32_t r=(uint32_t)HL(c) + HL(c);   set_cy(c, r>0xFFFF); setHL(c,(uint16_t)r); t=10; } break;
+	case 0x39: { uint32_t r=(uint32_t)HL(c) + c->sp;   set_cy(c, r>0xFFFF); setHL(c,(uint16_t)r); t=10; } break;
 
 		// DAA/CMA/STC/CMC
 	case 0x27: daa(c); t=4; break;
 	case 0x2F: c->a = (uint8_t)~c->a; t=4; break;
-	case 0x37: c->cy = true; t=4; break;
-	case 0x3F: c->cy = !c->cy; t=4; break;
+	case 0x37: c->f |= F_CY; t=4; break;
+	case 0x3F: c->f ^= F_CY; t=4; break;
 
 		// Direct memory
 	case 0x22: { uint8_t lo=rd(b,c->pc++), hi=rd(b,c->pc++); uint16_t a=(uint16_t)((uint16_t)hi<<8)|lo; wr(b,a,c->l); wr(b,(uint16_t)(a+1),c->h); t=16; } break; // SHLD
@@ -414,3 +450,549 @@ int i8080_step(I8080 *c, I8080Bus *b)
 	if (apply_ei_after) { c->inte = true; c->ei_pending = false; }
 	return t;
 }
+
+/*
+ * Table-driven engine.
+ *
+ * One specialized handler per opcode, indexed by the fetched byte. Handlers
+ * run with PC already past the opcode and return the instruction's t-states.
+ * EI/HLT bookkeeping stays in the dispatcher so both engines share it.
+ */
+
+static inline uint16_t fetch16(I8080 *c, I8080Bus *b)
+{
+	uint8_t lo = rd(b, c->pc++);
+	uint8_t hi = rd(b, c->pc++);
+	return (uint16_t)((uint16_t)hi<<8) | lo;
+}
+
+static int op_nop(I8080 *c, I8080Bus *b) { (void)c; (void)b; return 4; }
+static int op_hlt(I8080 *c, I8080Bus *b) { (void)b; c->halted = true; return 7; }
+
+/* MOV r,r (self-moves are a 5 t-state no-op) */
+static int op_mov_self(I8080 *c, I8080Bus *b) { (void)c; (void)b; return 5; }
+
+#define OP_MOV_RR(dst, src) \
+	static int op_mov_##dst##_##src(I8080 *c, I8080Bus *b) \
+	{ (void)b; c->dst = c->src; return 5; }
+#define OP_MOV_RM(dst) \
+	static int op_mov_##dst##_m(I8080 *c, I8080Bus *b) \
+	{ c->dst = rd(b, HL(c)); return 7; }
+#define OP_MOV_MR(src) \
+	static int op_mov_m_##src(I8080 *c, I8080Bus *b) \
+	{ wr(b, HL(c), c->src); return 7; }
+#define OP_MOV_ROW(dst, s1, s2, s3, s4, s5, s6) \
+	OP_MOV_RR(dst, s1) OP_MOV_RR(dst, s2) OP_MOV_RR(dst, s3) \
+	OP_MOV_RR(dst, s4) OP_MOV_RR(dst, s5) OP_MOV_RR(dst, s6) \
+	OP_MOV_RM(dst) OP_MOV_MR(dst)
+
+OP_MOV_ROW(b, c, d, e, h, l, a)
+OP_MOV_ROW(c, b, d, e, h, l, a)
+OP_MOV_ROW(d, b, c, e, h, l, a)
+OP_MOV_ROW(e, b, c, d, h, l, a)
+OP_MOV_ROW(h, b, c, d, e, l, a)
+OP_MOV_ROW(l, b, c, d, e, h, a)
+OP_MOV_ROW(a, b, c, d, e, h, l)
+
+/* ALU A,r / A,M / A,imm */
+#define ALU_ADD(c, v) add8(c, v, false)
+#define ALU_ADC(c, v) add8(c, v, true)
+#define ALU_SUB(c, v) sub8(c, v, false)
+#define ALU_SBB(c, v) sub8(c, v, true)
+#define ALU_ANA(c, v) ana8(c, v)
+#define ALU_XRA(c, v) xra8(c, v)
+#define ALU_ORA(c, v) ora8(c, v)
+#define ALU_CMP(c, v) cmp8(c, v)
+
+#define OP_ALU_R(name, reg, APPLY) \
+	static int op_##name##_##reg(I8080 *c, I8080Bus *b) \
+	{ (void)b; APPLY(c, c->reg); return 4; }
+#define OP_ALU(name, APPLY) \
+	OP_ALU_R(name, b, APPLY) OP_ALU_R(name, c, APPLY) \
+	OP_ALU_R(name, d, APPLY) OP_ALU_R(name, e, APPLY) \
+	OP_ALU_R(name, h, APPLY) OP_ALU_R(name, l, APPLY) \
+	OP_ALU_R(name, a, APPLY) \
+	static int op_##name##_m(I8080 *c, I8080Bus *b) \
+	{ APPLY(c, rd(b, HL(c))); return 7; } \
+	static int op_##name##_i(I8080 *c, I8080Bus *b) \
+	{ APPLY(c, rd(b, c->pc++)); return 7; }
+
+OP_ALU(add, ALU_ADD)
+OP_ALU(adc, ALU_ADC)
+OP_ALU(sub, ALU_SUB)
+OP_ALU(sbb, ALU_SBB)
+OP_ALU(ana, ALU_ANA)
+OP_ALU(xra, ALU_XRA)
+OP_ALU(ora, ALU_ORA)
+OP_ALU(cmp, ALU_CMP)
+
+/* INR/DCR/MVI */
+#define OP_REG8(reg) \
+	static int op_inr_##reg(I8080 *c, I8080Bus *b) \
+	{ (void)b; c->reg = inr8(c, c->reg); return 5; } \
+	static int op_dcr_##reg(I8080 *c, I8080Bus *b) \
+	{ (void)b; c->reg = dcr8(c, c->reg); return 5; } \
+	static int op_mvi_##reg(I8080 *c, I8080Bus *b) \
+	{ c->reg = rd(b, c->pc++); return 7; }
+
+OP_REG8(b)
+OP_REG8(c)
+OP_REG8(d)
+OP_REG8(e)
+OP_REG8(h)
+OP_REG8(l)
+OP_REG8(a)
+
+static int op_inr_m(I8080 *c, I8080Bus *b) { uint16_t a = HL(c); wr(b, a, inr8(c, rd(b, a))); return 10; }
+static int op_dcr_m(I8080 *c, I8080Bus *b) { uint16_t a = HL(c); wr(b, a, dcr8(c, rd(b, a))); return 10; }
+static int op_mvi_m(I8080 *c, I8080Bus *b) { wr(b, HL(c), rd(b, c->pc++)); return 10; }
+
+/* Register pairs: LXI/INX/DCX/DAD/PUSH/POP */
+#define OP_RP(rp, hi, lo) \
+	static int op_lxi_##rp(I8080 *c, I8080Bus *b) \
+	{ c->lo = rd(b, c->pc++); c->hi = rd(b, c->pc++); return 10; } \
+	static int op_inx_##rp(I8080 *c, I8080Bus *b) \
+	{ (void)b; if (++c->lo == 0) c->hi++; return 5; } \
+	static int op_dcx_##rp(I8080 *c, I8080Bus *b) \
+	{ (void)b; if (c->lo-- == 0) c->hi--; return 5; } \
+	static int op_dad_##rp(I8080 *c, I8080Bus *b) \
+	{ \
+		uint32_t r = (uint32_t)HL(c) + (uint16_t)((uint16_t)c->hi<<8 | c->lo); \
+		(void)b; set_cy(c, r > 0xFFFF); setHL(c, (uint16_t)r); return 10; \
+	} \
+	static int op_push_##rp(I8080 *c, I8080Bus *b) \
+	{ push16(c, b, (uint16_t)((uint16_t)c->hi<<8 | c->lo)); return 11; } \
+	static int op_pop_##rp(I8080 *c, I8080Bus *b) \
+	{ c->lo = rd(b, c->sp); c->hi = rd(b, (uint16_t)(c->sp + 1)); c->sp = (uint16_t)(c->sp + 2); return 10; }
+
+OP_RP(b, b, c)
+OP_RP(d, d, e)
+OP_RP(h, h, l)
+
+static int op_lxi_sp(I8080 *c, I8080Bus *b) { c->sp = fetch16(c, b); return 10; }
+static int op_inx_sp(I8080 *c, I8080Bus *b) { (void)b; c->sp = (uint16_t)(c->sp + 1); return 5; }
+static int op_dcx_sp(I8080 *c, I8080Bus *b) { (void)b; c->sp = (uint16_t)(c->sp - 1); return 5; }
+static int op_dad_sp(I8080 *c, I8080Bus *b)
+{
+	uint32_t r = (uint32_t)HL(c) + c->sp;
+	(void)b;
+	set_cy(c, r > 0xFFFF);
+	setHL(c, (uint16_t)r);
+	return 10;
+}
+static int op_push_psw(I8080 *c, I8080Bus *b) { push16(c, b, (uint16_t)((uint16_t)c->a<<8) | pack_flags(c)); return 11; }
+static int op_pop_psw(I8080 *c, I8080Bus *b)
+{
+	uint16_t v = pop16(c, b);
+	c->a = (uint8_t)(v >> 8);
+	unpack_flags(c, (uint8_t)v);
+	return 10;
+}
+
+static int op_stax_b(I8080 *c, I8080Bus *b) { wr(b, rp_bc(c), c->a); return 7; }
+static int op_stax_d(I8080 *c, I8080Bus *b) { wr(b, rp_de(c), c->a); return 7; }
+static int op_ldax_b(I8080 *c, I8080Bus *b) { c->a = rd(b, rp_bc(c)); return 7; }
+static int op_ldax_d(I8080 *c, I8080Bus *b) { c->a = rd(b, rp_de(c)); return 7; }
+
+/* Rotates and accumulator/carry ops */
+static int op_rlc(I8080 *c, I8080Bus *b)
+{
+	(void)b;
+	set_cy(c, (c->a & 0x80) != 0);
+	c->a = (uint8_t)((c->a << 1) | (c->a >> 7));
+	return 4;
+}
+static int op_rrc(I8080 *c, I8080Bus *b)
+{
+	(void)b;
+	set_cy(c, (c->a & 0x01) != 0);
+	c->a = (uint8_t)((c->a >> 1) | (c->a << 7));
+	return 4;
+}
+static int op_ral(I8080 *c, I8080Bus *b)
+{
+	bool old = get_cy(c);
+	(void)b;
+	set_cy(c, (c->a & 0x80) != 0);
+	c->a = (uint8_t)((c->a << 1) | (old ? 1 : 0));
+	return 4;
+}
+static int op_rar(I8080 *c, I8080Bus *b)
+{
+	bool old = get_cy(c);
+	(void)b;
+	set_cy(c, (c->a & 0x01) != 0);
+	c->a = (uint8_t)((c->a >> 1) | (old ? 0x80 : 0));
+	return 4;
+}
+static int op_daa(I8080 *c, I8080Bus *b) { (void)b; daa(c); return 4; }
+static int op_cma(I8080 *c, I8080Bus *b) { (void)b; c->a = (uint8_t)~c->a; return 4; }
+static int op_stc(I8080 *c, I8080Bus *b) { (void)b; c->f |= F_CY; return 4; }
+static int op_cmc(I8080 *c, I8080Bus *b) { (void)b; c->f ^= F_CY; return 4; }
+
+/* Direct memory */
+static int op_shld(I8080 *c, I8080Bus *b)
+{
+	uint16_t a = fetch16(c, b);
+	wr(b, a, c->l);
+	wr(b, (uint16_t)(a + 1), c->h);
+	return 16;
+}
+static int op_lhld(I8080 *c, I8080Bus *b)
+{
+	uint16_t a = fetch16(c, b);
+	c->l = rd(b, a);
+	c->h = rd(b, (uint16_t)(a + 1));
+	return 16;
+}
+static int op_sta(I8080 *c, I8080Bus *b) { wr(b, fetch16(c, b), c->a); return 13; }
+static int op_lda(I8080 *c, I8080Bus *b) { c->a = rd(b, fetch16(c, b)); return 13; }
+
+/* XCHG/XTHL/SPHL/PCHL */
+static int op_xchg(I8080 *c, I8080Bus *b)
+{
+	uint8_t th = c->h, tl = c->l;
+	(void)b;
+	c->h = c->d; c->l = c->e;
+	c->d = th; c->e = tl;
+	return 5;
+}
+static int op_xthl(I8080 *c, I8080Bus *b)
+{
+	uint8_t lo = rd(b, c->sp);
+	uint8_t hi = rd(b, (uint16_t)(c->sp + 1));
+	wr(b, c->sp, c->l);
+	wr(b, (uint16_t)(c->sp + 1), c->h);
+	c->l = lo;
+	c->h = hi;
+	return 18;
+}
+static int op_sphl(I8080 *c, I8080Bus *b) { (void)b; c->sp = HL(c); return 5; }
+static int op_pchl(I8080 *c, I8080Bus *b) { (void)b; c->pc = HL(c); return 5; }
+
+/* JMP/CALL/RET and conditional forms */
+static int op_jmp(I8080 *c, I8080Bus *b) { c->pc = fetch16(c, b); return 10; }
+static int op_call(I8080 *c, I8080Bus *b)
+{
+	uint16_t a = fetch16(c, b);
+	push16(c, b, c->pc);
+	c->pc = a;
+	return 17;
+}
+static int op_ret(I8080 *c, I8080Bus *b) { c->pc = pop16(c, b); return 10; }
+
+#define OP_COND(cc, test) \
+	static int op_j##cc(I8080 *c, I8080Bus *b) \
+	{ uint16_t a = fetch16(c, b); if (test) c->pc = a; return 10; } \
+	static int op_c##cc(I8080 *c, I8080Bus *b) \
+	{ \
+		uint16_t a = fetch16(c, b); \
+		if (!(test)) return 11; \
+		push16(c, b, c->pc); c->pc = a; return 17; \
+	} \
+	static int op_r##cc(I8080 *c, I8080Bus *b) \
+	{ if (!(test)) return 5; c->pc = pop16(c, b); return 11; }
+
+OP_COND(nz, !(c->f & F_Z))
+OP_COND(z, (c->f & F_Z))
+OP_COND(nc, !(c->f & F_CY))
+OP_COND(c, (c->f & F_CY))
+OP_COND(po, !(c->f & F_P))
+OP_COND(pe, (c->f & F_P))
+OP_COND(p, !(c->f & F_S))
+OP_COND(m, (c->f & F_S))
+
+#define OP_RST(n) \
+	static int op_rst##n(I8080 *c, I8080Bus *b) \
+	{ push16(c, b, c->pc); c->pc = (uint16_t)((n) * 8u); return 11; }
+
+OP_RST(0)
+OP_RST(1)
+OP_RST(2)
+OP_RST(3)
+OP_RST(4)
+OP_RST(5)
+OP_RST(6)
+OP_RST(7)
+
+/* IN/OUT, EI/DI */
+static int op_in(I8080 *c, I8080Bus *b) { c->a = in(b, rd(b, c->pc++)); return 10; }
+static int op_out(I8080 *c, I8080Bus *b) { out(b, rd(b, c->pc++), c->a); return 10; }
+static int op_di(I8080 *c, I8080Bus *b) { (void)b; c->inte = false; c->ei_pending = false; return 4; }
+static int op_ei(I8080 *c, I8080Bus *b) { (void)b; i8080_set_ei_pending(c); return 4; }
+
+/* Undocumented opcodes execute as NOP, matching the switch engine. */
+static const i8080_op_fn k_op_table[256] = {
+	/* 00 */ op_nop, op_lxi_b, op_stax_b, op_inx_b, op_inr_b, op_dcr_b, op_mvi_b, op_rlc,
+	/* 08 */ op_nop, op_dad_b, op_ldax_b, op_dcx_b, op_inr_c, op_dcr_c, op_mvi_c, op_rrc,
+	/* 10 */ op_nop, op_lxi_d, op_stax_d, op_inx_d, op_inr_d, op_dcr_d, op_mvi_d, op_ral,
+	/* 18 */ op_nop, op_dad_d, op_ldax_d, op_dcx_d, op_inr_e, op_dcr_e, op_mvi_e, op_rar,
+	/* 20 */ op_nop, op_lxi_h, op_shld, op_inx_h, op_inr_h, op_dcr_h, op_mvi_h, op_daa,
+	/* 28 */ op_nop, op_dad_h, op_lhld, op_dcx_h, op_inr_l, op_dcr_l, op_mvi_l, op_cma,
+	/* 30 */ op_nop, op_lxi_sp, op_sta, op_inx_sp, op_inr_m, op_dcr_m, op_mvi_m, op_stc,
+	/* 38 */ op_nop, op_dad_sp, op_lda, op_dcx_sp, op_inr_a, op_dcr_a, op_mvi_a, op_cmc,
+	/* 40 */ op_mov_self, op_mov_b_c, op_mov_b_d, op_mov_b_e, op_mov_b_h, op_mov_b_l, op_mov_b_m, op_mov_b_a,
+	/* 48 */ op_mov_c_b, op_mov_self, op_mov_c_d, op_mov_c_e, op_mov_c_h, op_mov_c_l, op_mov_c_m, op_mov_c_a,
+	/* 50 */ op_mov_d_b, op_mov_d_c, op_mov_self, op_mov_d_e, op_mov_d_h, op_mov_d_l, op_mov_d_m, op_mov_d_a,
+	/* 58 */ op_mov_e_b, op_mov_e_c, op_mov_e_d, op_mov_self, op_mov_e_h, op_mov_e_l, op_mov_e_m, op_mov_e_a,
+	/* 60 */ op_mov_h_b, op_mov_h_c, op_mov_h_d, op_mov_h_e, op_mov_self, op_mov_h_l, op_mov_h_m, op_mov_h_a,
+	/* 68 */ op_mov_l_b, op_mov_l_c, op_mov_l_d, op_mov_l_e, op_mov_l_h, op_mov_self, op_mov_l_m, op_mov_l_a,
+	/* 70 */ op_mov_m_b, op_mov_m_c, op_mov_m_d, op_mov_m_e, op_mov_m_h, op_mov_m_l, op_hlt, op_mov_m_a,
+	/* 78 */ op_mov_a_b, op_mov_a_c, op_mov_a_d, op_mov_a_e, op_mov_a_h, op_mov_a_l, op_mov_a_m, op_mov_self,
+	/* 80 */ op_add_b, op_add_c, op_add_d, op_add_e, op_add_h, op_add_l, op_add_m, op_add_a,
+	/* 88 */ op_adc_b, op_adc_c, op_adc_d, op_adc_e, op_adc_h, op_adc_l, op_adc_m, op_adc_a,
+	/* 90 */ op_sub_b, op_sub_c, op_sub_d, op_sub_e, op_sub_h, op_sub_l, op_sub_m, op_sub_a,
+	/* 98 */ op_sbb_b, op_sbb_c, op_sbb_d, op_sbb_e, op_sbb_h, op_sbb_l, op_sbb_m, op_sbb_a,
+	/* A0 */ op_ana_b, op_ana_c, op_ana_d, op_ana_e, op_ana_h, op_ana_l, op_ana_m, op_ana_a,
+	/* A8 */ op_xra_b, op_xra_c, op_xra_d, op_xra_e, op_xra_h, op_xra_l, op_xra_m, op_xra_a,
+	/* B0 */ op_ora_b, op_ora_c, op_ora_d, op_ora_e, op_ora_h, op_ora_l, op_ora_m, op_ora_a,
+	/* B8 */ op_cmp_b, op_cmp_c, op_cmp_d, op_cmp_e, op_cmp_h, op_cmp_l, op_cmp_m, op_cmp_a,
+	/* C0 */ op_rnz, op_pop_b, op_jnz, op_jmp, op_cnz, op_push_b, op_add_i, op_rst0,
+	/* C8 */ op_rz, op_ret, op_jz, op_nop, op_cz, op_call, op_adc_i, op_rst1,
+	/* D0 */ op_rnc, op_pop_d, op_jnc, op_out, op_cnc, op_push_d, op_sub_i, op_rst2,
+	/* D8 */ op_rc, op_nop, op_jc, op_in, op_cc, op_nop, op_sbb_i, op_rst3,
+	/* E0 */ op_rpo, op_pop_h, op_jpo, op_xthl, op_cpo, op_push_h, op_ana_i, op_rst4,
+	/* E8 */ op_rpe, op_pchl, op_jpe, op_xchg, op_cpe, op_nop, op_xra_i, op_rst5,
+	/* F0 */ op_rp, op_pop_psw, op_jp, op_di, op_cp, op_push_psw, op_ora_i, op_rst6,
+	/* F8 */ op_rm, op_sphl, op_jm, op_ei, op_cm, op_nop, op_cmp_i, op_rst7,
+};
+
+int i8080_step_table(I8080 *c, I8080Bus *b)
+{
+	bool apply_ei_after = c->ei_pending;
+	int t;
+
+	if (c->halted) {
+		if (apply_ei_after) { c->inte = true; c->ei_pending = false; }
+		return 4;
+	}
+
+	t = k_op_table[rd(b, c->pc++)](c, b);
+
+	if (apply_ei_after) { c->inte = true; c->ei_pending = false; }
+	return t;
+}
+
+/*
+* Basic-block cache.
+*
+* Blocks reuse the table-engine handlers: each op is entered with PC on its
+* opcode byte, steps past it and lets the handler fetch operands, so only
+* the opcode itself is decoded ahead of time.
+*/
+
+/* Worst-case t-states per opcode (conditional CALL/RET taken). */
+static const uint8_t k_op_cycles[256] = {
+	/* 00 */  4, 10,  7,  5,  5,  5,  7,  4,
+	/* 08 */  4, 10,  7,  5,  5,  5,  7,  4,
+	/* 10 */  4, 10,  7,  5,  5,  5,  7,  4,
+	/* 18 */  4, 10,  7,  5,  5,  5,  7,  4,
+	/* 20 */  4, 10, 16,  5,  5,  5,  7,  4,
+	/* 28 */  4, 10, 16,  5,  5,  5,  7,  4,
+	/* 30 */  4, 10, 13,  5, 10, 10, 10,  4,
+	/* 38 */  4, 10, 13,  5,  5,  5,  7,  4,
+	/* 40 */  5,  5,  5,  5,  5,  5,  7,  5,
+	/* 48 */  5,  5,  5,  5,  5,  5,  7,  5,
+	/* 50 */  5,  5,  5,  5,  5,  5,  7,  5,
+	/* 58 */  5,  5,  5,  5,  5,  5,  7,  5,
+	/* 60 */  5,  5,  5,  5,  5,  5,  7,  5,
+	/* 68 */  5,  5,  5,  5,  5,  5,  7,  5,
+	/* 70 */  7,  7,  7,  7,  7,  7,  7,  7,
+	/* 78 */  5,  5,  5,  5,  5,  5,  7,  5,
+	/* 80 */  4,  4,  4,  4,  4,  4,  7,  4,
+	/* 88 */  4,  4,  4,  4,  4,  4,  7,  4,
+	/* 90 */  4,  4,  4,  4,  4,  4,  7,  4,
+	/* 98 */  4,  4,  4,  4,  4,  4,  7,  4,
+	/* A0 */  4,  4,  4,  4,  4,  4,  7,  4,
+	/* A8 */  4,  4,  4,  4,  4,  4,  7,  4,
+	/* B0 */  4,  4,  4,  4,  4,  4,  7,  4,
+	/* B8 */  4,  4,  4,  4,  4,  4,  7,  4,
+	/* C0 */ 11, 10, 10, 10, 17, 11,  7, 11,
+	/* C8 */ 11, 10, 10,  4, 17, 17,  7, 11,
+	/* D0 */ 11, 10, 10, 10, 17, 11,  7, 11,
+	/* D8 */ 11,  4, 10, 10, 17,  4,  7, 11,
+	/* E0 */ 11, 10, 10, 18, 17, 11,  7, 11,
+	/* E8 */ 11,  5, 10,  5, 17,  4,  7, 11,
+	/* F0 */ 11, 10, 10,  4, 17, 11,  7, 11,
+	/* F8 */ 11,  5, 10,  4, 17,  4,  7, 11,
+};
+
+static unsigned op_len(uint8_t op)
+{
+	switch (op) {
+	case 0x01: case 0x11: case 0x21: case 0x31:	/* LXI */
+	case 0x22: case 0x2A: case 0x32: case 0x3A:	/* SHLD/LHLD/STA/LDA */
+	case 0xC2: case 0xC3: case 0xCA: case 0xD2:	/* JMP, Jcc */
+	case 0xDA: case 0xE2: case 0xEA: case 0xF2: case 0xFA:
+	case 0xC4: case 0xCC: case 0xCD: case 0xD4:	/* CALL, Ccc */
+	case 0xDC: case 0xE4: case 0xEC: case 0xF4: case 0xFC:
+		return 3;
+	case 0x06: case 0x0E: case 0x16: case 0x1E:	/* MVI */
+	case 0x26: case 0x2E: case 0x36: case 0x3E:
+	case 0xC6: case 0xCE: case 0xD6: case 0xDE:	/* ALU imm */
+	case 0xE6: case 0xEE: case 0xF6: case 0xFE:
+	case 0xD3: case 0xDB:				/* OUT, IN */
+		return 2;
+	default:
+		return 1;
+	}
+}
+
+/* Ops that end a block after executing: every change of PC flow. */
+static bool op_ends_block(uint8_t op)
+{
+	switch (op) {
+	case 0xC3: case 0xC2: case 0xCA: case 0xD2:	/* JMP, Jcc */
+	case 0xDA: case 0xE2: case 0xEA: case 0xF2: case 0xFA:
+	case 0xCD: case 0xC4: case 0xCC: case 0xD4:	/* CALL, Ccc */
+	case 0xDC: case 0xE4: case 0xEC: case 0xF4: case 0xFC:
+	case 0xC9: case 0xC0: case 0xC8: case 0xD0:	/* RET, Rcc */
+	case 0xD8: case 0xE0: case 0xE8: case 0xF0: case 0xF8:
+	case 0xC7: case 0xCF: case 0xD7: case 0xDF:	/* RST */
+	case 0xE7: case 0xEF: case 0xF7: case 0xFF:
+	case 0xE9:					/* PCHL */
+		return true;
+	default:
+		return false;
+	}
+}
+
+/* Ops left to i8080_step(): port I/O, interrupt enable and HLT. */
+static bool op_stops_block(uint8_t op)
+{
+	return op == 0xD3 || op == 0xDB || op == 0xF3 || op == 0xFB ||
+		op == 0x76;
+}
+
+bool i8080_op_writes(uint8_t op)
+{
+	switch (op) {
+	case 0x02: case 0x12: case 0x22: case 0x32:	/* STAX B/D, SHLD, STA */
+	case 0x34: case 0x35: case 0x36:		/* INR/DCR/MVI M */
+	case 0x70: case 0x71: case 0x72: case 0x73:	/* MOV M,r */
+	case 0x74: case 0x75: case 0x77:
+	case 0xCD: case 0xC4: case 0xCC: case 0xD4:	/* CALL, Ccc */
+	case 0xDC: case 0xE4: case 0xEC: case 0xF4: case 0xFC:
+	case 0xC5: case 0xD5: case 0xE5: case 0xF5:	/* PUSH */
+	case 0xC7: case 0xCF: case 0xD7: case 0xDF:	/* RST */
+	case 0xE7: case 0xEF: case 0xF7: case 0xFF:
+	case 0xE3:					/* XTHL */
+		return true;
+	default:
+		return false;
+	}
+}
+
+void i8080_bcache_flush(I8080BlockCache *bc)
+{
+	if (!bc) return;
+
+	for (unsigned i = 0; i < I8080_BCACHE_SLOTS; i++)
+		bc->slot[i].page = NULL;
+	memset(bc->code_line, 0, sizeof(bc->code_line));
+}
+
+/*
+* Drop every block covering address a. Blocks never cross a page, so only
+* starts in [a - I8080_BLOCK_MAX_BYTES + 1, a] within a's page can match.
+*/
+static void bcache_invalidate(I8080BlockCache *bc, uint16_t a)
+{
+	unsigned lo = a & ~I8080_PAGE_MASK;
+	unsigned start = a >= lo + I8080_BLOCK_MAX_BYTES ?
+		a - I8080_BLOCK_MAX_BYTES + 1u : lo;
+
+	for (unsigned pc = start; pc <= a; pc++) {
+		I8080Block *blk = &bc->slot[pc & (I8080_BCACHE_SLOTS - 1u)];
+
+		if (blk->page && blk->pc <= a && a < blk->pc + blk->len)
+			blk->page = NULL;
+	}
+}
+
+static void block_decode(I8080Block *blk, const uint8_t *page, uint16_t pc)
+{
+	unsigned off = pc & I8080_PAGE_MASK;
+	unsigned cycles = 0;
+	unsigned n = 0;
+
+	blk->page = page;
+	blk->pc = pc;
+	blk->writes = false;
+
+	while (n < I8080_BLOCK_MAX_OPS) {
+		uint8_t op = page[off];
+		unsigned len = op_len(op);
+
+		if (op_stops_block(op) || off + len > I8080_PAGE_SIZE)
+			break;
+		blk->ops[n++] = k_op_table[op];
+		cycles += k_op_cycles[op];
+		if (i8080_op_writes(op))
+			blk->writes = true;
+		off += len;
+		if (op_ends_block(op))
+			break;
+	}
+
+	blk->n_ops = (uint8_t)n;
+	blk->len = (uint8_t)(off - (pc & I8080_PAGE_MASK));
+	blk->max_cycles = (uint16_t)cycles;
+}
+
+const I8080Block *i8080_block_lookup(const I8080 *cpu, I8080Bus *bus)
+{
+	I8080BlockCache *bc = bus->bcache;
+	const uint8_t *page;
+	I8080Block *blk;
+	unsigned p;
+
+	if (!bc || !bus->rd_page)
+		return NULL;
+
+	p = cpu->pc >> I8080_PAGE_SHIFT;
+	page = bus->rd_page[p];
+	blk = &bc->slot[cpu->pc & (I8080_BCACHE_SLOTS - 1u)];
+	if (blk->page == page && blk->pc == cpu->pc)
+		return blk;
+
+	block_decode(blk, page, cpu->pc);
+
+	/* RAM-backed code can be overwritten by the CPU: watch its lines. */
+	if (bus->wr_page && (const uint8_t *)bus->wr_page[p] == page && blk->len) {
+		unsigned last = cpu->pc + blk->len - 1u;
+
+		for (unsigned line = cpu->pc >> 8; line <= (last >> 8); line++)
+			bc->code_line[line] = 1;
+	}
+	return blk;
+}
+
+int i8080_block_run(I8080 *c, I8080Bus *b, const I8080Block *blk,
+	unsigned *n_ops)
+{
+	unsigned n = blk->n_ops;
+	unsigned i;
+	int t = 0;
+
+	for (i = 0; i < n; i++) {
+		c->pc++;
+		t += blk->ops[i](c, b);
+		/* A store into the block itself makes the remaining ops stale. */
+		if (!blk->page) {
+			i++;
+			break;
+		}
+	}
+	*n_ops = i;
+	return t;
+}
+
+int i8080_step(I8080 *c, I8080Bus *b)
+{
+#ifdef I8080_DISPATCH_TABLE
+	return i8080_step_table(c, b);
+#else
+	return i8080_step_switch(c, b);
+#endif
+}
@@ -1,10 +1,5 @@
 /* SPDX-License-Identifier: MIT */
 
-/* For select() in strict C99 builds. */
-#ifndef _POSIX_C_SOURCE
-#define _POSIX_C_SOURCE 200809L
-#endif
-
 #include "io.h"
 
 #include "io_sys.h"
@@ -12,10 +7,12 @@
 
 #include <errno.h>
 #include <stdint.h>
-#include <sys/select.h>
-#include <sys/time.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
+/* Longest vector writev_full() handles in one call; more falls back. */
+#define IO_WRITEV_MAX 8
+
 int write_full(int fd, const void *buf, size_t len)
 {
 	const uint8_t *p;
@@ -56,39 +53,62 @@ int write_full(int fd, const void *buf, size_t len)
 	return 0;
 }
 
-void sleep_or_wait_input_usec(uint32_t usec, bool use_pty, int pty_fd, bool headless)
+int writev_full(int fd, const struct iovec *iov, int iovcnt)
 {
-	fd_set rfds;
-	int maxfd = -1;
-	struct timeval tv;
+	struct iovec local[IO_WRITEV_MAX];
+	int cnt;
+	int first;
 
-	if (usec == 0) {
-		return;
+	if (fd < 0) {
+		return -1;
 	}
 
-	FD_ZERO(&rfds);
+	if (!iov || iovcnt <= 0) {
+		return 0;
+	}
 
-	if (!headless) {
-		FD_SET(0, &rfds);
-		maxfd = 0;
+	/* Fall back to one write per entry for long vectors. */
+	if (iovcnt > IO_WRITEV_MAX) {
+		for (int i = 0; i < iovcnt; i++) {
+			if (write_full(fd, iov[i].iov_base, iov[i].iov_len) < 0)
+				return -1;
+		}
+		return 0;
 	}
 
-	if (use_pty && pty_fd >= 0) {
-		FD_SET(pty_fd, &rfds);
+	cnt = 0;
+	for (int i = 0; i < iovcnt; i++) {
+		if (iov[i].iov_len)
+			local[cnt++] = iov[i];
+	}
+
+	first = 0;
+	while (first < cnt) {
+		ssize_t n = ALTAID_IO_WRITEV(fd, local + first, cnt - first);
+
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
 
-		if (pty_fd > maxfd) {
-			maxfd = pty_fd;
+		if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			sleep_usec(1000u);
+			continue;
 		}
-	}
 
-	tv.tv_sec = (time_t)(usec / 1000000u);
-	tv.tv_usec = (suseconds_t)(usec % 1000000u);
+		if (n <= 0) {
+			return -1;
+		}
 
-	if (maxfd < 0) {
-		sleep_usec(usec);
-		return;
+		/* Skip fully written entries, then trim the partial one. */
+		while (first < cnt && (size_t)n >= local[first].iov_len) {
+			n -= (ssize_t)local[first].iov_len;
+			first++;
+		}
+		if (first < cnt) {
+			local[first].iov_base = (uint8_t *)local[first].iov_base + n;
+			local[first].iov_len -= (size_t)n;
+		}
 	}
 
-	/* select() wakes early on readiness or when interrupted by a signal. */
-	(void)select(maxfd + 1, &rfds, NULL, NULL, &tv);
+	return 0;
 }
@@ -8,12 +8,14 @@
  *
  * Production code uses real host syscalls.
  *
- * Unit tests may override `ALTAID_IO_READ` / `ALTAID_IO_WRITE` before
- * including any `.c` that includes this header (typically via
- * `#include "io.c"` or `#include "runloop.c"` in a spec file).
+ * Unit tests may override `ALTAID_IO_READ` / `ALTAID_IO_WRITE` /
+ * `ALTAID_IO_WRITEV` before including any `.c` that includes this header
+ * (typically via `#include "io.c"` or `#include "runloop.c"` in a spec
+ * file).
  */
 
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
 #ifndef ALTAID_IO_READ
@@ -24,4 +26,8 @@
 #define ALTAID_IO_WRITE write
 #endif
 
+#ifndef ALTAID_IO_WRITEV
+#define ALTAID_IO_WRITEV writev
+#endif
+
 #endif /* ALTAID_IO_SYS_H */
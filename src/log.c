@@ -30,15 +30,25 @@ int log_open(const char *path, bool quiet, bool flush_each_write)
 		return -1;
 	}
 
-	/* Default behavior preserves pre-existing flush-on-write semantics. */
+	/*
+	 * Default behavior preserves pre-existing flush-on-write semantics.
+	 * Otherwise buffer fully; the runloop calls log_flush() before it
+	 * sleeps, so lines still land while the emulator is idle.
+	 */
 	if (g_flush_each_write)
 	setvbuf(g_logf, NULL, _IONBF, 0);
 	else
-	setvbuf(g_logf, NULL, _IOLBF, 0);
+	setvbuf(g_logf, NULL, _IOFBF, 0);
 
 	return 0;
 }
 
+void log_flush(void)
+{
+	if (g_logf && !g_flush_each_write)
+		fflush(g_logf);
+}
+
 void log_close(void)
 {
 	if (g_logf) {
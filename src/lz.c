@@ -0,0 +1,178 @@
+/* SPDX-License-Identifier: MIT */
+
+#include "lz.h"
+
+#include <string.h>
+
+#define LZ_MIN_MATCH	4u
+#define LZ_MAX_OFFSET	65535u
+#define LZ_HASH_BITS	13
+#define LZ_HASH_SIZE	(1u << LZ_HASH_BITS)
+#define LZ_SKIP_SHIFT	5
+
+static uint32_t load32(const uint8_t *p)
+{
+	uint32_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static uint32_t hash4(uint32_t v)
+{
+	return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+/* Length beyond the 15 in a nibble: 255s, then the remainder. */
+static bool put_len(uint8_t *dst, size_t *op, size_t cap, size_t n)
+{
+	while (n >= 255u) {
+		if (*op >= cap)
+			return false;
+		dst[(*op)++] = 255u;
+		n -= 255u;
+	}
+	if (*op >= cap)
+		return false;
+	dst[(*op)++] = (uint8_t)n;
+	return true;
+}
+
+/* One sequence: lits literals, then a match unless mlen is 0. */
+static bool put_seq(uint8_t *dst, size_t *op, size_t cap,
+		    const uint8_t *lits, size_t nlit, size_t off, size_t mlen)
+{
+	size_t ml = mlen ? mlen - LZ_MIN_MATCH : 0;
+	uint8_t token;
+
+	token = (uint8_t)((nlit < 15u ? nlit : 15u) << 4);
+	token |= (uint8_t)(ml < 15u ? ml : 15u);
+	if (*op >= cap)
+		return false;
+	dst[(*op)++] = token;
+	if (nlit >= 15u && !put_len(dst, op, cap, nlit - 15u))
+		return false;
+
+	if (nlit > cap - *op)
+		return false;
+	memcpy(dst + *op, lits, nlit);
+	*op += nlit;
+	if (!mlen)
+		return true;
+
+	if (cap - *op < 2u)
+		return false;
+	dst[(*op)++] = (uint8_t)(off & 0xffu);
+	dst[(*op)++] = (uint8_t)(off >> 8);
+	if (ml >= 15u && !put_len(dst, op, cap, ml - 15u))
+		return false;
+	return true;
+}
+
+size_t lz_compress(const uint8_t *src, size_t len, uint8_t *dst, size_t cap)
+{
+	uint32_t table[LZ_HASH_SIZE];
+	size_t anchor = 0;
+	size_t misses = 0;
+	size_t ip = 0;
+	size_t op = 0;
+
+	if (!src || !dst)
+		return 0;
+
+	/* Entries are position + 1; 0 is empty. */
+	memset(table, 0, sizeof(table));
+
+	while (len >= LZ_MIN_MATCH && ip <= len - LZ_MIN_MATCH) {
+		uint32_t seq = load32(src + ip);
+		uint32_t h = hash4(seq);
+		size_t ref = table[h];
+		size_t mlen;
+
+		table[h] = (uint32_t)(ip + 1u);
+		if (!ref || ip - (ref - 1u) > LZ_MAX_OFFSET ||
+		    load32(src + ref - 1u) != seq) {
+			/* Stride up through data that will not compress. */
+			ip += 1u + (misses++ >> LZ_SKIP_SHIFT);
+			continue;
+		}
+		ref--;
+		misses = 0;
+
+		mlen = LZ_MIN_MATCH;
+		while (ip + mlen < len && src[ref + mlen] == src[ip + mlen])
+			mlen++;
+
+		if (!put_seq(dst, &op, cap, src + anchor, ip - anchor,
+			     ip - ref, mlen))
+			return 0;
+		ip += mlen;
+		anchor = ip;
+	}
+
+	if (!put_seq(dst, &op, cap, src + anchor, len - anchor, 0, 0))
+		return 0;
+	return op;
+}
+
+static bool get_len(const uint8_t *src, size_t len, size_t *ip, size_t *n)
+{
+	uint8_t b;
+
+	do {
+		if (*ip >= len)
+			return false;
+		b = src[(*ip)++];
+		*n += b;
+	} while (b == 255u);
+	return true;
+}
+
+bool lz_decompress(const uint8_t *src, size_t len, uint8_t *dst,
+		   size_t out_len)
+{
+	size_t ip = 0;
+	size_t op = 0;
+
+	if (!src || !dst)
+		return false;
+
+	while (ip < len) {
+		uint8_t token = src[ip++];
+		size_t nlit = token >> 4;
+		size_t mlen = token & 15u;
+		size_t off;
+
+		if (nlit == 15u && !get_len(src, len, &ip, &nlit))
+			return false;
+		if (nlit > len - ip || nlit > out_len - op)
+			return false;
+		memcpy(dst + op, src + ip, nlit);
+		ip += nlit;
+		op += nlit;
+		if (ip == len)
+			break;
+
+		if (len - ip < 2u)
+			return false;
+		off = (size_t)src[ip] | ((size_t)src[ip + 1] << 8);
+		ip += 2;
+		if (mlen == 15u && !get_len(src, len, &ip, &mlen))
+			return false;
+		mlen += LZ_MIN_MATCH;
+		if (off == 0 || off > op || mlen > out_len - op)
+			return false;
+
+		if (off == 1u) {
+			memset(dst + op, dst[op - 1], mlen);
+		} else if (off >= mlen) {
+			memcpy(dst + op, dst + op - off, mlen);
+		} else {
+			/* Overlapping copy repeats the last off bytes. */
+			for (size_t i = 0; i < mlen; i++)
+				dst[op + i] = dst[op - off + i];
+		}
+		op += mlen;
+	}
+	return op == out_len;
+}
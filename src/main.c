@@ -6,6 +6,7 @@
 #include "log.h"
 #include "stateio.h"
 #include "altaid_hw.h"
+#include "batch.h"
 
 #include <signal.h>
 #include <stdio.h>
@@ -47,6 +48,14 @@ int main(int argc, char **argv)
 		return 0;
 	}
 
+	if (cfg.batch_path) {
+		if (log_open(cfg.log_path, cfg.quiet, cfg.log_flush) < 0) return 1;
+		altaid_hw_set_debug(cfg.debug_panel);
+		rc = batch_run(&cfg);
+		log_close();
+		return rc;
+	}
+
 	if ((cfg.cassette_play || cfg.cassette_rec) && !cfg.cassette_path) {
 		fprintf(stderr, "--cass-play/--cass-rec requires --cass <file>\n");
 		cli_usage(argv[0]);
@@ -85,7 +94,8 @@ int main(int argc, char **argv)
 		if (s->kind == IO_SPEC_STATE)
 			ok = stateio_save_state(&emu.core, s->path, err, sizeof(err));
 		else
-			ok = stateio_save_ram(&emu.core, s->path, err, sizeof(err));
+			ok = stateio_save_ram(&emu.core, s->path, s->packed,
+					      err, sizeof(err));
 
 		if (!ok)
 			log_printf("save failed (%s): %s\n", s->path, err);
@@ -44,7 +44,9 @@ static bool g_split = false;
 static bool g_size_override = false;
 static int  g_override_rows = 0;
 static int  g_override_cols = 0;
-static bool g_layout_ready = false;
+static bool g_layout_ready = false; /* cleared by anything that moves it */
+static int  g_out_tty = -1;         /* isatty(out_fd()), -1 = not probed */
+static bool g_locale_ready = false;
 static int  g_term_rows = 0;
 static int  g_term_cols = 0;
 static int  g_panel_cols = 0;       /* total columns including borders */
@@ -55,6 +57,7 @@ static bool g_serial_ro = false;
 static bool g_statusline = true;
 static bool g_status_override_set;
 static char g_status_override[512];
+static char g_tape_status[64];
 
 /* ----- TUI serial view (deterministic redraw) ----- */
 
@@ -87,7 +90,12 @@ static int  g_last_status_row = 0;
 
 void panel_ansi_set_output(FILE *out)
 {
-	g_out = out ? out : stderr;
+	out = out ? out : stderr;
+	if (out == g_out)
+		return;
+	g_out = out;
+	g_out_tty = -1;
+	g_layout_ready = false;
 }
 
 static FILE *out_stream(void)
@@ -189,7 +197,10 @@ static void recompute_layout(void)
 	int cols;
 
 	/* Ensure locale is initialized so wcwidth() works for UTF-8 glyphs. */
-	(void)setlocale(LC_CTYPE, "");
+	if (!g_locale_ready) {
+		(void)setlocale(LC_CTYPE, "");
+		g_locale_ready = true;
+	}
 
 	probe_term_size(&probe_rows, &probe_cols);
 	rows = probe_rows;
@@ -329,7 +340,9 @@ void panel_ansi_serial_feed(const uint8_t *buf, size_t len)
 
 bool panel_ansi_is_tty(void)
 {
-	return isatty(out_fd()) != 0;
+	if (g_out_tty < 0)
+		g_out_tty = isatty(out_fd()) != 0;
+	return g_out_tty != 0;
 }
 
 static void buf_append(char *buf, size_t cap, size_t *len, const char *fmt, ...)
@@ -531,6 +544,8 @@ void panel_ansi_set_split(bool enable)
 
 void panel_ansi_set_panel_visible(bool enable)
 {
+	if (g_panel_visible != enable)
+		g_layout_ready = false;
 	g_panel_visible = enable;
 }
 
@@ -541,6 +556,8 @@ void panel_ansi_set_serial_ro(bool enable)
 
 void panel_ansi_set_statusline(bool enable)
 {
+	if (g_statusline != enable)
+		g_layout_ready = false;
 	g_statusline = enable;
 }
 
@@ -556,6 +573,12 @@ void panel_ansi_set_status_override(const char *s)
 	g_status_override[sizeof(g_status_override) - 1] = '\0';
 }
 
+void panel_ansi_set_tape_status(const char *s)
+{
+	strncpy(g_tape_status, s ? s : "", sizeof(g_tape_status));
+	g_tape_status[sizeof(g_tape_status) - 1] = '\0';
+}
+
 void panel_ansi_clear_status_override(void)
 {
 	panel_ansi_set_status_override(NULL);
@@ -698,7 +721,9 @@ uint32_t cpu_hz, uint32_t baud)
 	if (!g_active)
 		panel_ansi_begin();
 
-	recompute_layout();
+	/* Probed again only after a resize or a layout setting changed. */
+	if (!g_layout_ready)
+		recompute_layout();
 	layout_changed = (g_panel_effective != g_last_panel_effective) ||
 		(g_serial_top != g_last_serial_top) ||
 		(g_serial_bottom != g_last_serial_bottom) ||
@@ -883,11 +908,13 @@ uint32_t cpu_hz, uint32_t baud)
 			st[sizeof(st) - 1] = '\0';
 		} else {
 			snprintf(st, sizeof(st),
-				"Panel:%s  Serial:%s  PTY:%s  Term:%dx%d  Ctrl-P h help",
+				"Panel:%s  Serial:%s  PTY:%s  Term:%dx%d  %s%s"
+				"Ctrl-P h help",
 				pstate,
 				g_serial_ro ? "RO" : "RW",
 				pty_mode ? "ON" : "OFF",
-				g_term_rows, g_term_cols);
+				g_term_rows, g_term_cols,
+				g_tape_status, g_tape_status[0] ? "  " : "");
 		}
 
 		/*
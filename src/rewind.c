@@ -0,0 +1,146 @@
+/* SPDX-License-Identifier: MIT */
+
+#include "rewind.h"
+
+#include "stateio.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+void rewind_init(struct Rewind *rw, size_t budget)
+{
+	memset(rw, 0, sizeof(*rw));
+	rw->budget = budget;
+	rw->force_full = true;
+}
+
+static void drop_range(struct Rewind *rw, size_t from, size_t to)
+{
+	for (size_t i = from; i < to; i++) {
+		rw->bytes -= rw->snaps[i].len;
+		free(rw->snaps[i].buf);
+	}
+	memmove(&rw->snaps[from], &rw->snaps[to],
+		(rw->count - to) * sizeof(rw->snaps[0]));
+	rw->count -= to - from;
+}
+
+void rewind_free(struct Rewind *rw)
+{
+	if (!rw)
+		return;
+	if (rw->count)
+		drop_range(rw, 0, rw->count);
+	free(rw->snaps);
+	rw->snaps = NULL;
+	rw->cap = 0;
+	rw->since_full = 0;
+	rw->force_full = true;
+}
+
+/* Drop whole full+delta groups from the front until under budget. */
+static void evict(struct Rewind *rw)
+{
+	while (rw->bytes > rw->budget) {
+		size_t next = 1;
+
+		while (next < rw->count && !rw->snaps[next].full)
+			next++;
+		if (next >= rw->count) {
+			/* Only one group left: start a new one to make room. */
+			rw->force_full = true;
+			return;
+		}
+		drop_range(rw, 0, next);
+	}
+}
+
+bool rewind_capture(struct Rewind *rw, struct EmuCore *core)
+{
+	struct RewindSnap *s;
+	bool full;
+
+	if (!rw || !core || !rewind_enabled(rw))
+		return false;
+
+	if (rw->count == rw->cap) {
+		size_t cap = rw->cap ? rw->cap * 2u : 64u;
+		struct RewindSnap *p;
+
+		p = realloc(rw->snaps, cap * sizeof(*p));
+		if (!p)
+			return false;
+		rw->snaps = p;
+		rw->cap = cap;
+	}
+
+	full = rw->force_full || rw->count == 0;
+	s = &rw->snaps[rw->count];
+	if (!stateio_snapshot(core, full, &s->buf, &s->len)) {
+		/* The REWIND dirty bits may be gone; restart from a full. */
+		rw->force_full = true;
+		return false;
+	}
+	s->tick = core->ser.tick;
+	s->full = full;
+	rw->count++;
+	rw->bytes += s->len;
+
+	if (full) {
+		rw->since_full = 0;
+		rw->force_full = false;
+	} else {
+		size_t i = rw->count - 1;
+
+		while (!rw->snaps[i].full)
+			i--;
+		rw->since_full += s->len;
+		rw->force_full = rw->since_full >= rw->snaps[i].len;
+	}
+
+	evict(rw);
+	return true;
+}
+
+bool rewind_to(struct Rewind *rw, struct EmuCore *core, uint64_t tick)
+{
+	size_t target;
+	size_t base;
+
+	if (!rw || !core || rw->count == 0)
+		return false;
+
+	target = rw->count - 1;
+	while (target > 0 && rw->snaps[target].tick > tick)
+		target--;
+	base = target;
+	while (!rw->snaps[base].full)
+		base--;
+
+	for (size_t i = base; i <= target; i++) {
+		struct RewindSnap *s = &rw->snaps[i];
+
+		if (!stateio_restore(core, s->full, s->buf, s->len,
+				     i == target)) {
+			/* The core is now a mix of snapshots; so is the buffer. */
+			rewind_free(rw);
+			return false;
+		}
+	}
+
+	/*
+	 * Everything after target is a future that no longer happens. The
+	 * restored TX buffer holds bytes the host already printed once.
+	 */
+	drop_range(rw, target + 1, rw->count);
+	rw->since_full = 0;
+	for (size_t i = base + 1; i <= target; i++)
+		rw->since_full += rw->snaps[i].len;
+	rw->force_full = false;
+	core->tx_r = core->tx_w;
+
+	/* RAM now differs from what other dirty-map consumers last saw. */
+	altaid_hw_dirty_all(&core->hw);
+	altaid_hw_dirty_clear(&core->hw, ALTAID_DIRTY_REWIND);
+	return true;
+}
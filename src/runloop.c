@@ -17,10 +17,12 @@
 #include "log.h"
 #include "panel_ansi.h"
 #include "panel_text.h"
+#include "runloop_core.h"
 #include "runloop_render.h"
 #include "runloop_time.h"
 #include "serial_routing.h"
 #include "stateio.h"
+#include "timeutil.h"
 
 #include <signal.h>
 #include <stdbool.h>
@@ -30,17 +32,22 @@
 #include <string.h>
 #include <unistd.h>
 
-static FILE *choose_ui_stream(const struct EmuHost *host, int term_fd_hint)
+/* --threaded UI thread wakeups with nothing else to wait for. */
+#define RUNLOOP_SNAPSHOT_POLL_NS	5000000ull
+#define RUNLOOP_IDLE_NS			100000000ull
+
+static FILE *choose_ui_stream(const struct EmuHost *host, int term_fd_hint,
+			      const struct OutputTopology *topo)
 {
 	if (host->ui.ui_mode) {
-		if (term_fd_hint == STDOUT_FILENO && isatty(STDOUT_FILENO))
+		if (term_fd_hint == STDOUT_FILENO && topo->stdout_tty)
 			return stdout;
-		if (term_fd_hint == STDERR_FILENO && isatty(STDERR_FILENO))
+		if (term_fd_hint == STDERR_FILENO && topo->stderr_tty)
 			return stderr;
 		/* Prefer any tty stream for UI output. */
-		if (isatty(STDERR_FILENO))
+		if (topo->stderr_tty)
 			return stderr;
-		if (isatty(STDOUT_FILENO))
+		if (topo->stdout_tty)
 			return stdout;
 	}
 	return stderr;
@@ -64,6 +71,104 @@ int serial_mirror_spec_fd)
 	return -1;
 }
 
+/*
+ * True while the machine is exchanging anything with the host: serial
+ * input queued or on the wire, a panel key held, or a filename prompt
+ * open. Batches stay short until it goes quiet.
+ */
+static bool runloop_machine_busy(const struct EmuHost *host,
+				 const struct EmuCore *core)
+{
+	return host->ui.prompt_active || runloop_core_busy(core);
+}
+
+/*
+ * Host inputs worth waking for. A full RX queue (or, under --threaded, a
+ * full input ring) leaves serial input unread, so don't wake on it. UI
+ * stdin also carries Ctrl-P commands and is always watched, except under
+ * --threaded, where it waits for ring space like the PTY: the core thread
+ * kicks the UI once it makes some.
+ */
+static unsigned runloop_input_mask(const struct EmuHost *host,
+				   const struct EmuCore *core,
+				   struct RunThread *thr)
+{
+	unsigned mask = 0;
+	bool space;
+
+	if (thr) {
+		space = runloop_thread_input_space(thr) != 0;
+		mask |= HOSTEV_WAKE;
+	} else {
+		space = serial_rx_space(&core->ser) != 0;
+	}
+	if (host->cfg.use_pty && space)
+		mask |= HOSTEV_PTY;
+	if ((!host->cfg.headless && !thr) || space)
+		mask |= HOSTEV_STDIN;
+	return mask;
+}
+
+/* Ctrl-P requests that touch the machine, serviced with the core held. */
+static bool runloop_wants_core(const UI *ui)
+{
+	return ui->reset || ui->req_state_save || ui->req_state_load ||
+		ui->req_ram_save || ui->req_ram_load || ui->req_rewind ||
+		ui->req_stats || ui->req_cass_attach || ui->req_cass_save ||
+		ui->req_cass_play || ui->req_cass_rec || ui->req_cass_stop ||
+		ui->req_cass_rewind || ui->req_cass_ff || ui->req_cass_back;
+}
+
+/* What the renderers draw: the core, or the core thread's latest frame. */
+static const struct PanelView *runloop_view(const struct RunThread *thr,
+					    const struct EmuCore *core,
+					    struct PanelView *buf)
+{
+	if (thr)
+		return &thr->view;
+	runloop_panel_view(core, buf);
+	return buf;
+}
+
+/*
+ * True when a refresh is due, scheduling the next one: every period
+ * ticks, or under --threaded every period_ns of wall time, since the UI
+ * thread no longer sees every batch.
+ */
+static bool runloop_panel_due(struct EmuHost *host,
+			      const struct EmuCore *core,
+			      const struct RunThread *thr, uint64_t period,
+			      uint64_t period_ns, uint64_t *next_ns)
+{
+	if (thr) {
+		uint64_t now = monotonic_nsec();
+
+		if (now < *next_ns)
+			return false;
+		*next_ns = now + period_ns;
+		return true;
+	}
+	if (core->ser.tick < host->next_panel_tick)
+		return false;
+	host->next_panel_tick = core->ser.tick + period;
+	return true;
+}
+
+/*
+ * How long the --threaded UI thread may sleep: to the next panel refresh,
+ * briefly while a text snapshot is pending, otherwise until input, TX
+ * bytes or a signal wake it.
+ */
+static uint64_t runloop_ui_sleep(bool refresh, uint64_t next_ns,
+				 bool snapshot_wait)
+{
+	uint64_t now = monotonic_nsec();
+
+	if (refresh)
+		return next_ns > now ? next_ns - now : 0;
+	return snapshot_wait ? RUNLOOP_SNAPSHOT_POLL_NS : RUNLOOP_IDLE_NS;
+}
+
 static void apply_output_streams(FILE *ui_out)
 {
 	panel_ansi_set_output(ui_out);
@@ -71,12 +176,57 @@ static void apply_output_streams(FILE *ui_out)
 	ui_set_output(ui_out);
 }
 
+/*
+ * Probe the terminals and recompute where output goes, then point the
+ * renderers at it. Runs at startup and on UI events only.
+ */
+static void runloop_probe_outputs(const struct EmuHost *host,
+				  struct OutputTopology *topo)
+{
+	int term_fd_hint;
+
+	topo->stdout_tty = isatty(STDOUT_FILENO) != 0;
+	topo->stderr_tty = isatty(STDERR_FILENO) != 0;
+
+	term_fd_hint = ui_term_fd_hint(host, host->serial_out_fd_spec,
+				       host->serial_mirror_fd_spec);
+	topo->ui_out = choose_ui_stream(host, term_fd_hint, topo);
+	topo->ui_fd = fileno(topo->ui_out);
+	topo->ui_tty = topo->ui_fd == STDOUT_FILENO ? topo->stdout_tty
+						     : topo->stderr_tty;
+	apply_output_streams(topo->ui_out);
+
+	/*
+	 * TUI requires an interactive tty. Prefer the chosen UI stream.
+	 * (If both stdout/stderr are redirected, --ui is effectively off.)
+	 */
+	topo->tui_active = host->ui.ui_mode && topo->ui_tty;
+
+	/* Keep renderer state in sync before we (re)start the ANSI UI. */
+	panel_ansi_set_panel_visible(host->ui.show_panel);
+	panel_ansi_set_serial_ro(host->ui.serial_ro);
+	panel_ansi_set_statusline(true);
+	panel_ansi_set_split(true);
+
+	topo->serial_fd = -1;
+	if (!host->cfg.use_pty)
+		runloop_compute_serial_routing(host, topo->ui_out,
+					       topo->tui_active,
+					       &topo->serial_fd);
+
+	topo->ui_mode = host->ui.ui_mode;
+	topo->show_panel = host->ui.show_panel;
+	topo->serial_ro = host->ui.serial_ro;
+	topo->valid = true;
+}
+
 int emu_host_runloop(struct EmuHost *host, struct EmuCore *core,
 volatile sig_atomic_t *stop_flag,
 volatile sig_atomic_t *winch_flag)
 {
 	PtyOut pty_out;
 	FdOut serial_out;
+	struct OutputTopology topo;
 	FILE *ui_out;
 	bool tui_active;
 	bool ansi_live;
@@ -102,27 +252,35 @@ volatile sig_atomic_t *winch_flag)
 	uint32_t snapshot_seq;
 	uint64_t snapshot_tick;
 	uint64_t batch_cycles;
+	uint64_t batch_until;
+	bool batch_busy;
+	uint64_t core_nsec;
+	uint64_t t_host;
+	bool waited;
 	uint64_t key_hold_cycles;
-	uint64_t run_deadline_tick;
-	bool have_run_deadline;
-	int term_fd_hint;
-	int serial_fd;
+	uint64_t rewind_step;
+	uint32_t cpu_hz;
+	struct RunThread thread;
+	struct RunThread *thr;
+	struct PanelView view;
+	const AltaidHW *snap_hw;
+	uint64_t snap_now;
+	uint64_t frame_ns;
+	uint64_t next_frame_ns;
+	bool parked;
 
 	if (!host || !core) return 1;
 
-	have_run_deadline = (host->cfg.max_run_ms > 0);
-	run_deadline_tick = have_run_deadline
-		? (uint64_t)core->cfg.cpu_hz *
-			(uint64_t)host->cfg.max_run_ms / 1000ull
-		: 0;
-
 	memset(&pty_out, 0, sizeof(pty_out));
 	memset(&serial_out, 0, sizeof(serial_out));
+	memset(&topo, 0, sizeof(topo));
 	pty_out.fd = host->pty_fd;
 	pty_out.mirror_fd = -1;
 	serial_out.fd = -1;
 
-	key_hold_cycles = (uint64_t)core->cfg.cpu_hz *
+	/* Fixed for the run; the loop reads it without parking the core. */
+	cpu_hz = core->cfg.cpu_hz;
+	key_hold_cycles = (uint64_t)cpu_hz *
 	(uint64_t)host->cfg.hold_ms / 1000ull;
 	if (key_hold_cycles == 0)
 	key_hold_cycles = 1;
@@ -138,9 +296,13 @@ volatile sig_atomic_t *winch_flag)
 	if (burst_gap == 0)
 		burst_gap = 1;
 
-	batch_cycles = core->cfg.cpu_hz / 2000u; /* ~0.5ms */
-	if (batch_cycles < 32)
-	batch_cycles = 32;
+	runloop_batch_init(&host->batch, core->cfg.cpu_hz,
+			   host->cfg.latency_ms, host->cfg.realtime);
+	tx_bytes = 0;
+
+	runloop_core_init(host, core);
+	rewind_step = (uint64_t)core->cfg.cpu_hz *
+		(uint64_t)host->cfg.rewind_step_ms / 1000ull;
 
 	effective_panel_hz = 0;
 	panel_period = 0;
@@ -169,70 +331,114 @@ volatile sig_atomic_t *winch_flag)
 	snapshot_tick = 0;
 	ansi_live = false;
 
+	/*
+	 * --threaded moves the core onto its own thread. Headless runs keep
+	 * one thread: there is no terminal to stall them, and their input
+	 * stays in step with the batches it arrives between.
+	 */
+	thr = NULL;
+	if (host->cfg.threaded && !host->cfg.headless) {
+		if (runloop_thread_start(&thread, host, core, key_hold_cycles))
+			thr = &thread;
+		else
+			log_printf("--threaded: cannot start the core thread, "
+				   "running on one thread\n");
+	}
+	frame_ns = 0;
+	next_frame_ns = monotonic_nsec();
+
+	waited = false;
+	t_host = monotonic_nsec();
 	for (;;) {
 		if (stop_flag && *stop_flag) break;
 
-		if (have_run_deadline && core->ser.tick >= run_deadline_tick)
+		if (thr ? runloop_thread_done(thr) : runloop_core_done(host, core))
 			break;
 
 		if (winch_flag && *winch_flag) {
 			*winch_flag = 0;
+			topo.valid = false;
 			if (ansi_live)
 			panel_ansi_handle_resize();
 		}
 
-		/* Host inputs. */
-		if (host->cfg.use_pty)
-		serial_routing_pty_poll(host->pty_fd, &core->ser);
-		if (!host->cfg.headless)
-		ui_poll(&host->ui, &core->ser, &core->hw, core->ser.tick,
-		key_hold_cycles);
-		else if (host->serial_in_stdin)
-		serial_routing_stdin_poll_with_panel(&core->ser, &core->hw,
-			core->ser.tick, key_hold_cycles,
-			&host->stdin_panel);
+		/*
+		 * Host inputs: read only what the event loop saw readable. The
+		 * throttle's wait already checked; otherwise take a quick look.
+		 */
+		if (!waited)
+			(void)hostev_wait(&host->ev,
+					  runloop_input_mask(host, core, thr), 0);
+		waited = false;
+		if (host->ev.ready & HOSTEV_WAKE) {
+			host->ev.ready &= ~HOSTEV_WAKE;
+			runloop_thread_woken(thr);
+		}
+		if (host->ev.ready & HOSTEV_PTY) {
+			host->ev.ready &= ~HOSTEV_PTY;
+			if (thr)
+				runloop_thread_pty_poll(thr, host->pty_fd);
+			else
+				serial_routing_pty_poll(host->pty_fd, &core->ser);
+		}
+		if (host->ev.ready & HOSTEV_STDIN) {
+			bool open;
+
+			host->ev.ready &= ~HOSTEV_STDIN;
+			if (thr)
+				open = ui_poll(&host->ui, NULL, thr->view_hw,
+					       thr->view.tick, key_hold_cycles);
+			else if (!host->cfg.headless)
+				open = ui_poll(&host->ui, &core->ser, &core->hw,
+					       core->ser.tick, key_hold_cycles);
+			else
+				open = serial_routing_stdin_poll_with_panel(
+					&core->ser, &core->hw, core->ser.tick,
+					key_hold_cycles, &host->stdin_panel);
+			if (!open)
+				hostev_watch(&host->ev, HOSTEV_STDIN, -1);
+		}
 
 		if (host->ui.quit) break;
 
+		/* Everything below up to the batch may touch the machine. */
+		parked = thr && runloop_wants_core(&host->ui);
+		if (parked)
+			runloop_thread_park(thr);
+
 		if (host->ui.reset) {
 			host->ui.reset = false;
 			emu_core_reset(core);
 			emu_host_epoch_reset(host, core);
+			rewind_free(&host->rewind_buf);
+			host->next_rewind_tick = core->ser.tick;
 			text_snapshot_done = false;
 			burst_pending = false;
 			burst_bytes = 0;
 			burst_had_nl = false;
 				snapshot_pending = false;
+			topo.valid = false;
 		}
 
-			term_fd_hint = ui_term_fd_hint(host,
-				host->serial_out_fd_spec,
-				host->serial_mirror_fd_spec);
-			ui_out = choose_ui_stream(host, term_fd_hint);
-			apply_output_streams(ui_out);
-
-			/*
-			 * TUI requires an interactive tty. Prefer the chosen UI stream.
-			 * (If both stdout/stderr are redirected, --ui is effectively off.)
-			 */
-			tui_active = host->ui.ui_mode && ui_out &&
-				(isatty(fileno(ui_out)) != 0);
-
-			/* Keep renderer state in sync before we (re)start the ANSI UI. */
-			panel_ansi_set_panel_visible(host->ui.show_panel);
-			panel_ansi_set_serial_ro(host->ui.serial_ro);
-			panel_ansi_set_statusline(true);
-			panel_ansi_set_split(true);
+		/* Output topology: re-probed only when the UI state changed. */
+		if (!topo.valid || topo.ui_mode != host->ui.ui_mode ||
+		    topo.show_panel != host->ui.show_panel ||
+		    topo.serial_ro != host->ui.serial_ro)
+			runloop_probe_outputs(host, &topo);
+		ui_out = topo.ui_out;
+		tui_active = topo.tui_active;
 
 		runloop_compute_panel_policy(host, tui_active, &effective_panel_hz,
 		&panel_period, &panel_refresh,
 		&text_snapshot_mode);
 
 		if (panel_refresh) {
-			panel_period = core->cfg.cpu_hz /
+			panel_period = cpu_hz /
 			(uint64_t)(effective_panel_hz ? effective_panel_hz : 1);
 			if (panel_period == 0)
 			panel_period = 1;
+			frame_ns = 1000000000ull /
+				(effective_panel_hz ? effective_panel_hz : 1u);
 		}
 
 			runloop_manage_panel_lifecycle(host, tui_active, &ansi_live);
@@ -336,6 +542,8 @@ volatile sig_atomic_t *winch_flag)
 					}
 				} else {
 					emu_host_epoch_reset(host, core);
+					rewind_free(&host->rewind_buf);
+					host->next_rewind_tick = core->ser.tick;
 					text_snapshot_done = false;
 					burst_pending = false;
 					burst_bytes = 0;
@@ -359,7 +567,8 @@ volatile sig_atomic_t *winch_flag)
 					host->ui.ram_path : "altaid.ram";
 
 				host->ui.req_ram_save = false;
-				if (!stateio_save_ram(core, p, err, sizeof(err))) {
+				if (!stateio_save_ram(core, p, host->ui.ram_packed,
+						      err, sizeof(err))) {
 					if (tui_active) {
 						char msg[600];
 						snprintf(msg, sizeof(msg), "[RAM] save failed: %s\n", err);
@@ -411,6 +620,47 @@ volatile sig_atomic_t *winch_flag)
 				host->ui.event = true;
 			}
 
+			if (host->ui.req_rewind) {
+				char msg[160];
+				uint64_t from = core->ser.tick;
+
+				host->ui.req_rewind = false;
+				if (!rewind_enabled(&host->rewind_buf)) {
+					snprintf(msg, sizeof(msg),
+						 "[REWIND] disabled (--rewind-mb 0)\n");
+				} else if (!rewind_to(&host->rewind_buf, core,
+						      from > rewind_step ?
+						      from - rewind_step : 0)) {
+					snprintf(msg, sizeof(msg),
+						 "[REWIND] nothing to rewind to\n");
+				} else {
+					uint64_t ms = core->ser.tick * 1000ull /
+						core->cfg.cpu_hz;
+
+					emu_host_epoch_reset(host, core);
+					host->next_rewind_tick = core->ser.tick +
+						host->rewind_period;
+					host->next_checkpoint_tick = core->ser.tick +
+						host->checkpoint_period;
+					text_snapshot_done = false;
+					burst_pending = false;
+					burst_bytes = 0;
+					burst_had_nl = false;
+					snapshot_pending = false;
+					snprintf(msg, sizeof(msg),
+						 "[REWIND] Back %llu ms to %llu.%03llu s\n",
+						 (unsigned long long)((from - core->ser.tick) *
+							1000ull / core->cfg.cpu_hz),
+						 (unsigned long long)(ms / 1000ull),
+						 (unsigned long long)(ms % 1000ull));
+				}
+				if (tui_active)
+					panel_ansi_serial_feed((const uint8_t *)msg, strlen(msg));
+				else
+					fputs(msg, ui_out ? ui_out : stderr);
+				host->ui.event = true;
+			}
+
 			if (host->ui.req_cass_attach) {
 				const char *p = host->ui.cass_path;
 
@@ -527,6 +777,25 @@ volatile sig_atomic_t *winch_flag)
 				host->ui.event = true;
 			}
 
+			if (host->ui.req_cass_back) {
+				host->ui.req_cass_back = false;
+				if (!core->cas_attached) {
+					const char *msg = "[CASS] No tape attached\n";
+					if (tui_active)
+						panel_ansi_serial_feed((const uint8_t *)msg, strlen(msg));
+					else
+						fputs(msg, ui_out ? ui_out : stderr);
+				} else {
+					const char *msg = "[CASS] Back 10s\n";
+					cassette_reverse(&core->cas, 10, core->ser.tick);
+					if (tui_active)
+						panel_ansi_serial_feed((const uint8_t *)msg, strlen(msg));
+					else
+						fputs(msg, ui_out ? ui_out : stderr);
+				}
+				host->ui.event = true;
+			}
+
 			if (host->ui.req_cass_save) {
 				host->ui.req_cass_save = false;
 				if (!core->cas_attached) {
@@ -551,6 +820,43 @@ volatile sig_atomic_t *winch_flag)
 				host->ui.event = true;
 			}
 
+			if (host->ui.req_stats) {
+				const struct RunBatch *b = &host->batch;
+				const struct RunPace *pc = &host->pace;
+				char msg[320];
+				unsigned pm = runloop_batch_host_permille(b);
+				uint64_t us = b->last_cycles * 1000000ull /
+					core->cfg.cpu_hz;
+				int n;
+
+				host->ui.req_stats = false;
+				n = snprintf(msg, sizeof(msg),
+					 "[STATS] batch %llu cycles (%llu.%03llu ms), "
+					 "host %u.%u%%\n",
+					 (unsigned long long)b->last_cycles,
+					 (unsigned long long)(us / 1000ull),
+					 (unsigned long long)(us % 1000ull),
+					 pm / 10u, pm % 10u);
+				if (pc->checks && n > 0 && (size_t)n < sizeof(msg))
+					snprintf(msg + n, sizeof(msg) - (size_t)n,
+						 "[STATS] pace lag avg %llu us max %llu us, "
+						 "oversleep avg %llu us max %llu us, "
+						 "%llu slips\n",
+						 (unsigned long long)(runloop_pace_lag_avg_ns(pc) / 1000u),
+						 (unsigned long long)(pc->lag_max_ns / 1000u),
+						 (unsigned long long)(runloop_pace_overshoot_avg_ns(pc) / 1000u),
+						 (unsigned long long)(pc->overshoot_max_ns / 1000u),
+						 (unsigned long long)pc->slips);
+				if (tui_active)
+					panel_ansi_serial_feed((const uint8_t *)msg, strlen(msg));
+				else
+					fputs(msg, ui_out ? ui_out : stderr);
+				host->ui.event = true;
+			}
+
+		if (parked)
+			runloop_thread_resume(thr);
+
 		/* Serial routing (non-PTY) or mirror fd (PTY). */
 		if (host->cfg.use_pty) {
 			if (host->serial_mirror_fd_spec != -2)
@@ -558,12 +864,29 @@ volatile sig_atomic_t *winch_flag)
 				else
 					pty_out.mirror_fd = -1;
 		} else {
-			runloop_compute_serial_routing(host, ui_out, tui_active, &serial_fd);
-			serial_out.fd = serial_fd;
+			serial_out.fd = topo.serial_fd;
 		}
 
-		/* Run core for one batch. */
-		emu_core_run_batch(core, batch_cycles);
+		if (thr) {
+			/* The core thread runs the batches; take its latest. */
+			(void)runloop_thread_sync(thr);
+		} else {
+			/*
+			 * Size the batch: back to the minimum while anything is
+			 * moving, and never past the next panel refresh.
+			 */
+			batch_busy = tx_bytes || burst_pending || snapshot_pending ||
+				(ansi_live && host->ui.event) ||
+				(!ansi_live && host->ui.show_panel && !panel_refresh &&
+				 host->cfg.panel_text_mode == PANEL_TEXT_MODE_CHANGE) ||
+				runloop_machine_busy(host, core);
+			batch_until = UINT64_MAX;
+			if (panel_refresh && (ansi_live || host->ui.show_panel))
+				batch_until = runloop_ticks_until(core->ser.tick,
+						host->next_panel_tick);
+			batch_cycles = runloop_core_step(host, core, batch_busy,
+							 batch_until, &core_nsec);
+		}
 
 			/* Panel rendering. */
 			if (ansi_live) {
@@ -571,42 +894,54 @@ volatile sig_atomic_t *winch_flag)
 			if (host->ui.event) {
 				host->ui.event = false;
 				host->next_panel_tick = 0;
+				next_frame_ns = monotonic_nsec();
 			}
 
 			/* Refresh cadence drives both panel + statusline. */
-			if (panel_refresh && core->ser.tick >= host->next_panel_tick) {
-				host->next_panel_tick = core->ser.tick + panel_period;
-				runloop_panel_render(host, core, true);
-			}
+			if (panel_refresh &&
+			    runloop_panel_due(host, core, thr, panel_period,
+					      frame_ns, &next_frame_ns))
+				runloop_panel_render(host,
+					runloop_view(thr, core, &view), true);
 		} else if (host->ui.show_panel) {
 			if (panel_refresh) {
-				if (core->ser.tick >= host->next_panel_tick) {
-					host->next_panel_tick = core->ser.tick + panel_period;
-					runloop_panel_render(host, core, false);
-				}
+				if (runloop_panel_due(host, core, thr, panel_period,
+						      frame_ns, &next_frame_ns))
+					runloop_panel_render(host,
+						runloop_view(thr, core, &view), false);
 			} else if (host->cfg.panel_text_mode == PANEL_TEXT_MODE_CHANGE) {
-				runloop_panel_render(host, core, false);
+				runloop_panel_render(host,
+					runloop_view(thr, core, &view), false);
 			} else if (text_snapshot_mode) {
 				if (!text_snapshot_done) {
-					runloop_panel_render(host, core, false);
+					runloop_panel_render(host,
+						runloop_view(thr, core, &view), false);
 					text_snapshot_done = true;
 				}
 			}
 		}
 
 			/* Drain decoded TX bytes to host outputs. */
-			tx_bytes = runloop_tx_drain(core, host, &pty_out, &serial_out, ansi_live,
-					   ui_out, &tx_had_nl);
+			if (thr)
+				tx_bytes = runloop_thread_tx_drain(thr, &pty_out,
+						&serial_out, ansi_live, &topo,
+						&tx_had_nl);
+			else
+				tx_bytes = runloop_tx_drain(core, host, &pty_out,
+						&serial_out, ansi_live, &topo,
+						&tx_had_nl);
+			snap_hw = thr ? thr->view_hw : &core->hw;
+			snap_now = thr ? thr->view.tick : core->ser.tick;
 			if (text_snapshot_mode) {
 				if (tx_bytes) {
 					snapshot_pending = false;
 					burst_pending = true;
-					last_burst_tick = core->ser.tick;
+					last_burst_tick = snap_now;
 					burst_bytes += tx_bytes;
 					if (tx_had_nl)
 						burst_had_nl = true;
 				} else if (burst_pending &&
-					   (core->ser.tick - last_burst_tick) > burst_gap) {
+					   (snap_now - last_burst_tick) > burst_gap) {
 					bool emit;
 
 					emit = host->cfg.panel_echo_chars;
@@ -622,8 +957,8 @@ volatile sig_atomic_t *winch_flag)
 						 * wait for a stable latched value (two consecutive identical
 						 * latches) before printing a snapshot.
 						 */
-						snapshot_seq = core->hw.panel_latched_seq;
-						snapshot_tick = core->ser.tick;
+						snapshot_seq = snap_hw->panel_latched_seq;
+						snapshot_tick = snap_now;
 						snapshot_seen = false;
 						snapshot_stable = 0;
 					}
@@ -639,15 +974,15 @@ volatile sig_atomic_t *winch_flag)
 						 * burst, then require two consecutive identical latches. This
 						 * filters transient mixed-nibble values during LED multiplexing.
 						 */
-						if (core->hw.panel_latched_seq != snapshot_seq) {
+						if (snap_hw->panel_latched_seq != snapshot_seq) {
 							uint16_t a;
 							uint8_t d;
 							uint8_t s;
 
-							snapshot_seq = core->hw.panel_latched_seq;
-							a = core->hw.panel_latched_addr;
-							d = core->hw.panel_latched_data;
-							s = core->hw.panel_latched_stat;
+							snapshot_seq = snap_hw->panel_latched_seq;
+							a = snap_hw->panel_latched_addr;
+							d = snap_hw->panel_latched_data;
+							s = snap_hw->panel_latched_stat;
 
 							if (!snapshot_seen) {
 								snapshot_last_addr = a;
@@ -668,16 +1003,45 @@ volatile sig_atomic_t *winch_flag)
 						}
 
 						if ((snapshot_seen && snapshot_stable >= 2) ||
-						    (core->ser.tick - snapshot_tick) > snapshot_settle) {
-							runloop_text_snapshot_emit(host, core,
-								  ui_out ? ui_out : stderr);
+						    (snap_now - snapshot_tick) > snapshot_settle) {
+							runloop_text_snapshot_emit(host,
+								runloop_view(thr, core, &view),
+								&topo);
 							snapshot_pending = false;
 						}
 					}
 			}
 
 
-		runloop_realtime_throttle(host, core);
+		if (thr) {
+			/* Pacing is the core thread's; wait for work or a frame. */
+			(void)hostev_wait(&host->ev,
+					  runloop_input_mask(host, core, thr),
+					  runloop_ui_sleep(panel_refresh &&
+						(ansi_live || host->ui.show_panel),
+						next_frame_ns,
+						burst_pending || snapshot_pending));
+			waited = true;
+		} else {
+			runloop_batch_account(&host->batch, batch_cycles, core_nsec,
+					      monotonic_nsec() - t_host - core_nsec);
+			waited = runloop_realtime_throttle(host, core, &host->ev,
+					runloop_input_mask(host, core, NULL));
+		}
+		t_host = monotonic_nsec();
+	}
+
+	if (thr) {
+		/* Hold the core, then flush what it already decoded. */
+		runloop_thread_park(thr);
+		while (topo.valid &&
+		       runloop_thread_tx_drain(thr, &pty_out, &serial_out,
+					       ansi_live, &topo, &tx_had_nl))
+			;
+		runloop_thread_stop(thr);
+		if (topo.valid)
+			(void)runloop_tx_drain(core, host, &pty_out, &serial_out,
+					       ansi_live, &topo, &tx_had_nl);
 	}
 
 	return 0;
@@ -0,0 +1,78 @@
+/* SPDX-License-Identifier: MIT */
+
+#include "runloop_batch.h"
+
+#include <string.h>
+
+void runloop_batch_init(struct RunBatch *b, uint32_t cpu_hz,
+			uint32_t budget_ms, bool realtime)
+{
+	memset(b, 0, sizeof(*b));
+
+	b->min_cycles = cpu_hz / 2000u; /* ~0.5ms */
+	if (b->min_cycles < 32)
+		b->min_cycles = 32;
+
+	b->budget_nsec = (uint64_t)budget_ms * 1000000u;
+	if (!b->budget_nsec)
+		b->max_cycles = b->min_cycles;
+	else if (realtime)
+		b->max_cycles = (uint64_t)cpu_hz * budget_ms / 1000u;
+	else
+		b->max_cycles = cpu_hz; /* one emulated second */
+	if (b->max_cycles < b->min_cycles)
+		b->max_cycles = b->min_cycles;
+
+	b->cycles = b->min_cycles;
+}
+
+uint64_t runloop_batch_next(struct RunBatch *b, bool busy, uint64_t until_due)
+{
+	uint64_t n;
+
+	if (busy)
+		b->cycles = b->min_cycles;
+	n = b->cycles;
+	/* Already overdue: it is serviced after this batch either way. */
+	if (!until_due && n > b->min_cycles)
+		n = b->min_cycles;
+	else if (until_due && until_due < n)
+		n = until_due;
+	return n;
+}
+
+void runloop_batch_account(struct RunBatch *b, uint64_t cycles,
+			   uint64_t core_nsec, uint64_t host_nsec)
+{
+	uint64_t est;
+
+	b->last_cycles = cycles;
+	b->batches++;
+	b->cycles_run += cycles;
+	b->core_nsec += core_nsec;
+	b->host_nsec += host_nsec;
+
+	if (!b->budget_nsec || !cycles) return;
+
+	/* Wall time a full idle batch would take at this batch's speed. */
+	est = core_nsec / cycles * b->cycles +
+	      core_nsec % cycles * b->cycles / cycles;
+	if (est > b->budget_nsec) {
+		b->cycles /= 2;
+		if (b->cycles < b->min_cycles)
+			b->cycles = b->min_cycles;
+	} else if (est * 2u <= b->budget_nsec) {
+		b->cycles *= 2;
+		if (b->cycles > b->max_cycles)
+			b->cycles = b->max_cycles;
+	}
+}
+
+unsigned runloop_batch_host_permille(const struct RunBatch *b)
+{
+	uint64_t total = b->core_nsec + b->host_nsec;
+
+	if (!total) return 0;
+	/* Divide total down rather than multiply: a long run would overflow. */
+	return (unsigned)(b->host_nsec / ((total + 999u) / 1000u));
+}
@@ -0,0 +1,572 @@
+/* SPDX-License-Identifier: MIT */
+
+/* For pthreads and pthread_sigmask() in strict C99 builds. */
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "runloop_core.h"
+
+#include "io_sys.h"
+#include "log.h"
+#include "runloop_time.h"
+#include "stateio.h"
+#include "timeutil.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Deltas appended before --checkpoint rewrites the file as a fresh base. */
+#define RUNLOOP_CHECKPOINT_REBASE 256u
+
+/* Ring sizes for --threaded. */
+#define RUN_TX_RING	(64u * 1024u)	/* absorbs a stalled terminal */
+#define RUN_FRAME_RING	(64u * sizeof(struct EmuFrame))
+#define RUN_INPUT_RING	(2u * SERIAL_RX_QUEUE_SIZE)
+
+/* How long a core stuck on a full TX ring sleeps between looks. */
+#define RUN_TX_STALL_NS 10000000ull
+
+/* Atomic flags shared between the two threads. */
+#define RUN_LOAD(p)		__atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define RUN_STORE(p, v)		__atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define RUN_XCHG(p, v)		__atomic_exchange_n((p), (v), __ATOMIC_ACQ_REL)
+
+/* Write the next --checkpoint record: a full base or a dirty-page delta. */
+static void runloop_checkpoint(struct EmuHost *host, struct EmuCore *core)
+{
+	char err[256];
+	bool base = host->checkpoint_deltas == 0 ||
+		host->checkpoint_deltas > RUNLOOP_CHECKPOINT_REBASE;
+
+	if (!stateio_checkpoint(core, host->cfg.checkpoint_path, base,
+				err, sizeof(err))) {
+		log_printf("checkpoint failed (%s): %s\n",
+			   host->cfg.checkpoint_path, err);
+		/* Start over from a base next time. */
+		host->checkpoint_deltas = 0;
+		return;
+	}
+	host->checkpoint_deltas = base ? 1u : host->checkpoint_deltas + 1u;
+}
+
+void runloop_core_init(struct EmuHost *host, struct EmuCore *core)
+{
+	uint64_t hz = core->cfg.cpu_hz;
+
+	host->run_deadline_tick = host->cfg.max_run_ms > 0
+		? hz * (uint64_t)host->cfg.max_run_ms / 1000ull
+		: EMU_EV_NEVER;
+
+	host->checkpoint_period = hz * (uint64_t)host->cfg.checkpoint_ms /
+		1000ull;
+	if (host->checkpoint_period == 0)
+		host->checkpoint_period = 1;
+	host->next_checkpoint_tick = core->ser.tick + host->checkpoint_period;
+	host->checkpoint_deltas = 0;
+	if (host->cfg.checkpoint_path)
+		runloop_checkpoint(host, core);
+
+	host->rewind_period = hz * (uint64_t)host->cfg.rewind_ms / 1000ull;
+	if (host->rewind_period == 0)
+		host->rewind_period = 1;
+	host->next_rewind_tick = core->ser.tick;
+}
+
+bool runloop_core_busy(const struct EmuCore *core)
+{
+	if (core->ser.rx_qh != core->ser.rx_qt || core->ser.rx_active)
+		return true;
+	for (size_t i = 0; i < sizeof(core->hw.fp_key_down) /
+			       sizeof(core->hw.fp_key_down[0]); i++) {
+		if (core->hw.fp_key_down[i])
+			return true;
+	}
+	return false;
+}
+
+bool runloop_core_done(const struct EmuHost *host, const struct EmuCore *core)
+{
+	return core->ser.tick >= host->run_deadline_tick;
+}
+
+uint64_t runloop_core_step(struct EmuHost *host, struct EmuCore *core,
+			   bool busy, uint64_t until, uint64_t *core_nsec)
+{
+	uint64_t now = core->ser.tick;
+	uint64_t cycles;
+	uint64_t t0;
+
+	if (host->cfg.checkpoint_path &&
+	    runloop_ticks_until(now, host->next_checkpoint_tick) < until)
+		until = runloop_ticks_until(now, host->next_checkpoint_tick);
+	if (rewind_enabled(&host->rewind_buf) &&
+	    runloop_ticks_until(now, host->next_rewind_tick) < until)
+		until = runloop_ticks_until(now, host->next_rewind_tick);
+	if (runloop_ticks_until(now, host->run_deadline_tick) < until)
+		until = runloop_ticks_until(now, host->run_deadline_tick);
+	cycles = runloop_batch_next(&host->batch, busy, until);
+
+	t0 = monotonic_nsec();
+	emu_core_run_batch(core, cycles);
+	*core_nsec = monotonic_nsec() - t0;
+
+	if (host->cfg.checkpoint_path &&
+	    core->ser.tick >= host->next_checkpoint_tick) {
+		host->next_checkpoint_tick = core->ser.tick +
+			host->checkpoint_period;
+		runloop_checkpoint(host, core);
+	}
+
+	if (rewind_enabled(&host->rewind_buf) &&
+	    core->ser.tick >= host->next_rewind_tick) {
+		host->next_rewind_tick = core->ser.tick + host->rewind_period;
+		if (!rewind_capture(&host->rewind_buf, core))
+			log_printf("rewind snapshot failed (out of memory)\n");
+	}
+
+	return cycles;
+}
+
+/* Write one byte to a kick pipe unless one is already waiting there. */
+static void run_kick(int fd, bool *kicked)
+{
+	if (RUN_XCHG(kicked, true))
+		return;
+	if (write(fd, "", 1) < 0)
+		return;	/* EAGAIN: the pipe is full of kicks anyway */
+}
+
+/* Empty a kick pipe, then allow the next kick. */
+static void run_unkick(int fd, bool *kicked)
+{
+	uint8_t buf[64];
+
+	while (read(fd, buf, sizeof(buf)) == (ssize_t)sizeof(buf))
+		;
+	RUN_STORE(kicked, false);
+}
+
+static bool run_pipe(int fd[2])
+{
+	if (pipe(fd) != 0)
+		return false;
+	for (int i = 0; i < 2; i++) {
+		int fl = fcntl(fd[i], F_GETFL, 0);
+
+		if (fl >= 0)
+			(void)fcntl(fd[i], F_SETFL, fl | O_NONBLOCK);
+		(void)fcntl(fd[i], F_SETFD, FD_CLOEXEC);
+	}
+	return true;
+}
+
+static void run_close_pipe(int fd[2])
+{
+	for (int i = 0; i < 2; i++) {
+		if (fd[i] >= 0)
+			close(fd[i]);
+		fd[i] = -1;
+	}
+}
+
+/*
+ * Core thread: move queued input into the machine while it has room, and
+ * wake a UI that left input unread for want of ring space.
+ */
+static void run_apply_input(struct RunThread *t)
+{
+	struct EmuCore *core = t->core;
+	bool popped = false;
+
+	for (;;) {
+		if (!t->holding) {
+			if (!spsc_pop(&t->input, t->held, 2u))
+				break;
+			t->holding = true;
+			popped = true;
+		}
+		if (t->held[0] == RUN_INPUT_SERIAL) {
+			if (!serial_rx_space(&core->ser))
+				break;
+			serial_host_enqueue(&core->ser, t->held[1]);
+		} else {
+			altaid_hw_panel_tick(&core->hw, core->ser.tick);
+			altaid_hw_panel_press_key(&core->hw, t->held[1],
+						  core->ser.tick,
+						  t->key_hold_cycles);
+		}
+		t->holding = false;
+	}
+	if (popped && RUN_XCHG(&t->input_stalled, false))
+		run_kick(t->ui_pipe[1], &t->ui_kicked);
+}
+
+static void run_frame_fill(const struct EmuCore *core, struct EmuFrame *f)
+{
+	const AltaidHW *hw = &core->hw;
+
+	memset(f, 0, sizeof(*f));
+	f->tick = core->ser.tick;
+	f->latched_seq = hw->panel_latched_seq;
+	f->latched_addr = hw->panel_latched_addr;
+	f->latched_data = hw->panel_latched_data;
+	f->latched_stat = hw->panel_latched_stat;
+	f->latched_valid = hw->panel_latched_valid;
+	memcpy(f->led_row_nibble, hw->led_row_nibble,
+	       sizeof(f->led_row_nibble));
+	memcpy(f->key_down, hw->fp_key_down, sizeof(f->key_down));
+	f->ram_bank = hw->ram_bank;
+	f->rom_half = hw->rom_half;
+	f->rom_low_mapped = hw->rom_low_mapped;
+	f->rom_hi_mapped = hw->rom_hi_mapped;
+	f->timer_en = hw->timer_en;
+	runloop_tape_status(core, f->tape, sizeof(f->tape));
+}
+
+/* UI side: copy a frame into the view the renderers draw from. */
+static void run_frame_apply(struct RunThread *t, const struct EmuFrame *f)
+{
+	AltaidHW *hw = t->view_hw;
+
+	hw->panel_latched_seq = f->latched_seq;
+	hw->panel_latched_addr = f->latched_addr;
+	hw->panel_latched_data = f->latched_data;
+	hw->panel_latched_stat = f->latched_stat;
+	hw->panel_latched_valid = f->latched_valid;
+	memcpy(hw->led_row_nibble, f->led_row_nibble,
+	       sizeof(f->led_row_nibble));
+	memcpy(hw->fp_key_down, f->key_down, sizeof(f->key_down));
+	hw->ram_bank = f->ram_bank;
+	hw->rom_half = f->rom_half;
+	hw->rom_low_mapped = f->rom_low_mapped;
+	hw->rom_hi_mapped = f->rom_hi_mapped;
+	hw->timer_en = f->timer_en;
+	t->view.hw = hw;
+	t->view.tick = f->tick;
+	memcpy(t->view.tape, f->tape, sizeof(t->view.tape));
+}
+
+/*
+ * Core thread: hand the batch's TX bytes and a frame to the UI. Returns
+ * false if TX bytes are left in the core because the ring is full.
+ */
+static bool run_publish(struct RunThread *t, bool *tx_moved)
+{
+	struct EmuCore *core = t->core;
+	struct EmuTxSpan span[2];
+	struct EmuFrame f;
+	size_t n = emu_core_tx_peek(core, span);
+	uint32_t w = 0;
+
+	*tx_moved = false;
+	if (n) {
+		w = spsc_write(&t->tx, span[0].data, (uint32_t)span[0].len);
+		if (w == span[0].len && span[1].len)
+			w += spsc_write(&t->tx, span[1].data,
+					(uint32_t)span[1].len);
+		emu_core_tx_commit(core, w);
+		if (w) {
+			*tx_moved = true;
+			run_kick(t->ui_pipe[1], &t->ui_kicked);
+		}
+	}
+
+	run_frame_fill(core, &f);
+	/* A UI that is behind just misses this one. */
+	(void)spsc_push(&t->frames, &f, sizeof(f));
+
+	return w == n;
+}
+
+/* Core thread: wait out a park request. */
+static void run_park_wait(struct RunThread *t)
+{
+	pthread_mutex_lock(&t->lock);
+	t->parked = true;
+	pthread_cond_broadcast(&t->cond);
+	while (t->park && !t->stop)
+		pthread_cond_wait(&t->cond, &t->lock);
+	t->parked = false;
+	pthread_mutex_unlock(&t->lock);
+}
+
+static void *run_thread_main(void *arg)
+{
+	struct RunThread *t = arg;
+	struct EmuHost *host = t->host;
+	struct EmuCore *core = t->core;
+	uint64_t t_host = monotonic_nsec();
+	bool tx_moved = false;
+
+	for (;;) {
+		uint64_t cycles;
+		uint64_t core_nsec;
+		bool busy;
+		bool stalled;
+
+		if (RUN_LOAD(&t->park))
+			run_park_wait(t);
+		if (RUN_LOAD(&t->stop))
+			break;
+		if (runloop_core_done(host, core)) {
+			pthread_mutex_lock(&t->lock);
+			RUN_STORE(&t->done, true);
+			pthread_cond_broadcast(&t->cond);
+			pthread_mutex_unlock(&t->lock);
+			run_kick(t->ui_pipe[1], &t->ui_kicked);
+			break;
+		}
+
+		run_apply_input(t);
+
+		/* The UI renders on its own, so only the machine sets busy. */
+		busy = tx_moved || t->holding || runloop_core_busy(core);
+		cycles = runloop_core_step(host, core, busy, UINT64_MAX,
+					   &core_nsec);
+
+		stalled = !run_publish(t, &tx_moved);
+		runloop_batch_account(&host->batch, cycles, core_nsec,
+				      monotonic_nsec() - t_host - core_nsec);
+
+		if (stalled) {
+			/* Let the UI catch up; it kicks once it drains some. */
+			RUN_STORE(&t->tx_stalled, true);
+			if (!spsc_space(&t->tx))
+				(void)hostev_wait(&t->ev, HOSTEV_WAKE,
+						  RUN_TX_STALL_NS);
+		} else {
+			(void)runloop_realtime_throttle(host, core, &t->ev,
+							HOSTEV_WAKE);
+		}
+		if (t->ev.ready & HOSTEV_WAKE) {
+			t->ev.ready &= ~HOSTEV_WAKE;
+			run_unkick(t->core_pipe[0], &t->core_kicked);
+		}
+		t_host = monotonic_nsec();
+	}
+	return NULL;
+}
+
+static void run_input_serial(void *ctx, uint8_t ch)
+{
+	struct RunThread *t = ctx;
+	uint8_t rec[2] = { RUN_INPUT_SERIAL, ch };
+
+	/* ui_poll() reads no more than runloop_thread_input_space() allows. */
+	if (spsc_push(&t->input, rec, 2u))
+		run_kick(t->core_pipe[1], &t->core_kicked);
+}
+
+static void run_input_key(void *ctx, uint8_t key)
+{
+	struct RunThread *t = ctx;
+	uint8_t rec[2] = { RUN_INPUT_KEY, key };
+
+	if (spsc_push(&t->input, rec, 2u))
+		run_kick(t->core_pipe[1], &t->core_kicked);
+}
+
+static uint32_t run_input_space(void *ctx)
+{
+	return runloop_thread_input_space(ctx);
+}
+
+static void run_free(struct RunThread *t)
+{
+	spsc_free(&t->tx);
+	spsc_free(&t->frames);
+	spsc_free(&t->input);
+	run_close_pipe(t->ui_pipe);
+	run_close_pipe(t->core_pipe);
+	hostev_close(&t->ev);
+	free(t->view_hw);
+	t->view_hw = NULL;
+}
+
+bool runloop_thread_start(struct RunThread *t, struct EmuHost *host,
+			  struct EmuCore *core, uint64_t key_hold_cycles)
+{
+	struct EmuFrame f;
+	sigset_t all;
+	sigset_t old;
+	int rc;
+
+	memset(t, 0, sizeof(*t));
+	t->host = host;
+	t->core = core;
+	t->key_hold_cycles = key_hold_cycles;
+	t->ui_pipe[0] = t->ui_pipe[1] = -1;
+	t->core_pipe[0] = t->core_pipe[1] = -1;
+	hostev_init(&t->ev);
+
+	t->view_hw = calloc(1, sizeof(*t->view_hw));
+	if (!t->view_hw || !spsc_init(&t->tx, RUN_TX_RING) ||
+	    !spsc_init(&t->frames, RUN_FRAME_RING) ||
+	    !spsc_init(&t->input, RUN_INPUT_RING) ||
+	    !run_pipe(t->ui_pipe) || !run_pipe(t->core_pipe)) {
+		run_free(t);
+		return false;
+	}
+	hostev_watch(&t->ev, HOSTEV_WAKE, t->core_pipe[0]);
+
+	run_frame_fill(core, &f);
+	run_frame_apply(t, &f);
+
+	t->sink.ctx = t;
+	t->sink.serial = run_input_serial;
+	t->sink.key = run_input_key;
+	t->sink.space = run_input_space;
+
+	pthread_mutex_init(&t->lock, NULL);
+	pthread_cond_init(&t->cond, NULL);
+
+	/* Signals (SIGWINCH, SIGINT) must wake the UI thread's wait. */
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+	rc = pthread_create(&t->tid, NULL, run_thread_main, t);
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	if (rc != 0) {
+		pthread_cond_destroy(&t->cond);
+		pthread_mutex_destroy(&t->lock);
+		run_free(t);
+		return false;
+	}
+
+	host->ui.sink = &t->sink;
+	hostev_watch(&host->ev, HOSTEV_WAKE, t->ui_pipe[0]);
+	return true;
+}
+
+void runloop_thread_stop(struct RunThread *t)
+{
+	pthread_mutex_lock(&t->lock);
+	RUN_STORE(&t->stop, true);
+	pthread_cond_broadcast(&t->cond);
+	pthread_mutex_unlock(&t->lock);
+	run_kick(t->core_pipe[1], &t->core_kicked);
+	pthread_join(t->tid, NULL);
+
+	t->host->ui.sink = NULL;
+	hostev_watch(&t->host->ev, HOSTEV_WAKE, -1);
+	pthread_cond_destroy(&t->cond);
+	pthread_mutex_destroy(&t->lock);
+	run_free(t);
+}
+
+void runloop_thread_park(struct RunThread *t)
+{
+	pthread_mutex_lock(&t->lock);
+	RUN_STORE(&t->park, true);
+	pthread_mutex_unlock(&t->lock);
+	run_kick(t->core_pipe[1], &t->core_kicked);
+
+	pthread_mutex_lock(&t->lock);
+	while (!t->parked && !RUN_LOAD(&t->done))
+		pthread_cond_wait(&t->cond, &t->lock);
+	pthread_mutex_unlock(&t->lock);
+}
+
+void runloop_thread_resume(struct RunThread *t)
+{
+	pthread_mutex_lock(&t->lock);
+	RUN_STORE(&t->park, false);
+	pthread_cond_broadcast(&t->cond);
+	pthread_mutex_unlock(&t->lock);
+}
+
+bool runloop_thread_done(const struct RunThread *t)
+{
+	return RUN_LOAD(&t->done);
+}
+
+void runloop_thread_woken(struct RunThread *t)
+{
+	run_unkick(t->ui_pipe[0], &t->ui_kicked);
+}
+
+bool runloop_thread_sync(struct RunThread *t)
+{
+	struct EmuFrame f;
+	bool any = false;
+
+	/* Only the latest matters; older ones were missed between draws. */
+	while (spsc_pop(&t->frames, &f, sizeof(f)))
+		any = true;
+	if (any)
+		run_frame_apply(t, &f);
+	return any;
+}
+
+size_t runloop_thread_tx_drain(struct RunThread *t, const PtyOut *pty_out,
+			       const FdOut *serial_out, bool tui_active,
+			       const struct OutputTopology *topo,
+			       bool *had_nl)
+{
+	const uint8_t *data[2];
+	uint32_t len[2];
+	struct EmuTxSpan span[2];
+	size_t n;
+
+	if (had_nl)
+		*had_nl = false;
+	if (!spsc_peek(&t->tx, data, len))
+		return 0;
+	for (int i = 0; i < 2; i++) {
+		span[i].data = data[i];
+		span[i].len = len[i];
+	}
+	n = runloop_tx_write(t->host, span, pty_out, serial_out, tui_active,
+			     topo, had_nl);
+	spsc_commit(&t->tx, (uint32_t)n);
+	if (RUN_XCHG(&t->tx_stalled, false))
+		run_kick(t->core_pipe[1], &t->core_kicked);
+	return n;
+}
+
+uint32_t runloop_thread_input_space(struct RunThread *t)
+{
+	uint32_t n = spsc_space(&t->input) / 2u;
+
+	if (!n) {
+		RUN_STORE(&t->input_stalled, true);
+		/* The core may have made room before it saw the flag. */
+		n = spsc_space(&t->input) / 2u;
+	}
+	return n;
+}
+
+void runloop_thread_pty_poll(struct RunThread *t, int pty_fd)
+{
+	uint8_t buf[256];
+
+	if (pty_fd < 0)
+		return;
+
+	for (;;) {
+		size_t cap = runloop_thread_input_space(t);
+		ssize_t n;
+
+		if (cap > sizeof(buf))
+			cap = sizeof(buf);
+		if (!cap)
+			break;
+		n = ALTAID_IO_READ(pty_fd, buf, cap);
+		if (n <= 0)
+			break;
+		for (ssize_t i = 0; i < n; i++) {
+			uint8_t rec[2] = { RUN_INPUT_SERIAL, buf[i] };
+
+			(void)spsc_push(&t->input, rec, 2u);
+		}
+		/* A short read drained the master; skip the EAGAIN read. */
+		if ((size_t)n < cap)
+			break;
+	}
+	if (spsc_avail(&t->input))
+		run_kick(t->core_pipe[1], &t->core_kicked);
+}
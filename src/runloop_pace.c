@@ -0,0 +1,82 @@
+/* SPDX-License-Identifier: MIT */
+
+#include "runloop_pace.h"
+
+#include "timeutil.h"
+
+#include <string.h>
+
+void runloop_pace_init(struct RunPace *p, uint32_t cpu_hz)
+{
+	memset(p, 0, sizeof(*p));
+	p->cpu_hz = cpu_hz;
+}
+
+void runloop_pace_rebase(struct RunPace *p, uint64_t tick, uint64_t now_ns)
+{
+	p->base_tick = tick;
+	p->base_ns = now_ns;
+	p->last_emu_ns = 0;
+	p->slew_ns = 0;
+}
+
+uint64_t runloop_pace_check(struct RunPace *p, uint64_t tick, uint64_t now_ns)
+{
+	uint64_t emu_ns;
+	uint64_t wall_ns;
+	uint64_t cut;
+	uint64_t lag;
+	int64_t err;
+
+	emu_ns = emu_tick_to_nsec(tick - p->base_tick, p->cpu_hz);
+	wall_ns = now_ns - p->base_ns;
+
+	/* Catch up on the lag at a bounded rate. */
+	cut = (emu_ns - p->last_emu_ns) / RUNLOOP_PACE_CATCHUP;
+	p->slew_ns = p->slew_ns > cut ? p->slew_ns - cut : 0;
+	p->last_emu_ns = emu_ns;
+
+	p->err_ns = (int64_t)(emu_ns - wall_ns);
+	lag = p->err_ns < 0 ? (uint64_t)-p->err_ns : 0;
+	p->lag_ns += lag;
+	if (lag > p->lag_max_ns)
+		p->lag_max_ns = lag;
+	p->checks++;
+
+	/* Ahead (> 0) or behind the target, wall time less the slew. */
+	err = p->err_ns + (int64_t)p->slew_ns;
+	if (err >= 0)
+		return (uint64_t)err;
+
+	/* Behind: take the new lag into the slew instead of bursting. */
+	p->slew_ns += (uint64_t)-err;
+	if (p->slew_ns > RUNLOOP_PACE_MAX_SLEW_NS) {
+		uint64_t drop = p->slew_ns - RUNLOOP_PACE_MAX_SLEW_NS;
+
+		p->base_ns += drop;
+		p->slew_ns = RUNLOOP_PACE_MAX_SLEW_NS;
+		p->slips++;
+		p->slipped_ns += drop;
+	}
+	return 0;
+}
+
+void runloop_pace_woke(struct RunPace *p, uint64_t due_ns, uint64_t now_ns)
+{
+	uint64_t over = now_ns > due_ns ? now_ns - due_ns : 0;
+
+	p->waits++;
+	p->overshoot_ns += over;
+	if (over > p->overshoot_max_ns)
+		p->overshoot_max_ns = over;
+}
+
+uint64_t runloop_pace_lag_avg_ns(const struct RunPace *p)
+{
+	return p->checks ? p->lag_ns / p->checks : 0;
+}
+
+uint64_t runloop_pace_overshoot_avg_ns(const struct RunPace *p)
+{
+	return p->waits ? p->overshoot_ns / p->waits : 0;
+}
@@ -18,8 +18,10 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
 /*
@@ -29,13 +31,22 @@
  */
 static bool g_tty_at_bol = true;
 
-static void tty_bol_update_fd(int fd, const uint8_t *buf, size_t n)
+/* True if fd is stdout or stderr and, per topo, a terminal. */
+static bool std_tty(const struct OutputTopology *topo, int fd)
+{
+	if (fd == STDOUT_FILENO)
+		return topo->stdout_tty;
+	if (fd == STDERR_FILENO)
+		return topo->stderr_tty;
+	return false;
+}
+
+static void tty_bol_update_fd(const struct OutputTopology *topo, int fd,
+			      const uint8_t *buf, size_t n)
 {
 	if (n == 0)
 		return;
-	if (fd != STDOUT_FILENO && fd != STDERR_FILENO)
-		return;
-	if (isatty(fd) == 0)
+	if (!std_tty(topo, fd))
 		return;
 	g_tty_at_bol = (buf[n - 1] == (uint8_t)'\n');
 }
@@ -56,110 +67,173 @@ static bool same_tty(int a, int b)
 	return (sa.st_dev == sb.st_dev && sa.st_ino == sb.st_ino);
 }
 
-size_t runloop_tx_drain(struct EmuCore *core, const struct EmuHost *host,
-			const PtyOut *pty_out, const FdOut *serial_out,
-			bool tui_active, FILE *ui_out, bool *had_nl)
+static bool spans_have_nl(const struct EmuTxSpan *span)
+{
+	for (int i = 0; i < 2; i++) {
+		if (memchr(span[i].data, '\n', span[i].len) ||
+		    memchr(span[i].data, '\r', span[i].len))
+			return true;
+	}
+	return false;
+}
+
+static void tty_bol_update_spans(const struct OutputTopology *topo, int fd,
+				 const struct EmuTxSpan *span)
+{
+	if (span[1].len)
+		tty_bol_update_fd(topo, fd, span[1].data, span[1].len);
+	else
+		tty_bol_update_fd(topo, fd, span[0].data, span[0].len);
+}
+
+size_t runloop_tx_write(const struct EmuHost *host,
+			const struct EmuTxSpan span[2], const PtyOut *pty_out,
+			const FdOut *serial_out, bool tui_active,
+			const struct OutputTopology *topo, bool *had_nl)
 {
 	int ui_fd;
-	uint8_t tmp[512];
+	struct iovec iov[2];
 	size_t n;
-	bool need_goto;
 	bool have_tui;
-	size_t drained;
 
-	if (!core || !host)
+	if (had_nl)
+		*had_nl = false;
+	if (!host || !topo)
 		return 0;
 
-	ui_fd = -1;
-	if (ui_out)
-		ui_fd = fileno(ui_out);
+	n = span[0].len + span[1].len;
+	if (!n)
+		return 0;
 
-	have_tui = tui_active && ui_out && ui_fd >= 0 && (isatty(ui_fd) != 0);
+	ui_fd = topo->ui_fd;
+	have_tui = tui_active && ui_fd >= 0 && topo->ui_tty;
 
-	drained = 0;
-	if (had_nl)
-		*had_nl = false;
+	for (int i = 0; i < 2; i++) {
+		iov[i].iov_base = (void *)span[i].data;
+		iov[i].iov_len = span[i].len;
+	}
+
+	if (had_nl && spans_have_nl(span))
+		*had_nl = true;
 
 	/*
-	 * Drain TX once. If TUI is active, feed the serial buffer for deterministic
-	 * redraw. Raw serial bytes are still written to non-UI destinations.
+	 * If TUI is active, feed the serial buffer for deterministic redraw.
+	 * Raw serial bytes are still written to non-UI destinations.
 	 */
-	need_goto = have_tui;
-	for (;;) {
-		n = emu_core_tx_pop(core, tmp, sizeof(tmp));
-		if (!n)
-			break;
-
-		drained += n;
-		if (had_nl) {
-			if (memchr(tmp, '\n', n) || memchr(tmp, '\r', n))
-				*had_nl = true;
-		}
+	if (have_tui) {
+		panel_ansi_serial_feed(span[0].data, span[0].len);
+		if (span[1].len)
+			panel_ansi_serial_feed(span[1].data, span[1].len);
+	}
 
-		if (have_tui)
-			panel_ansi_serial_feed(tmp, n);
-
-		if (host->cfg.use_pty) {
-			if (pty_out && pty_out->fd >= 0)
-				(void)write_full(pty_out->fd, tmp, n);
-			if (pty_out && pty_out->mirror_fd >= 0) {
-				if (need_goto) {
-					panel_ansi_goto_serial();
-					need_goto = false;
-				}
-				(void)write_full(pty_out->mirror_fd, tmp, n);
-				tty_bol_update_fd(pty_out->mirror_fd, tmp, n);
-			}
-			continue;
+	if (host->cfg.use_pty) {
+		if (pty_out && pty_out->fd >= 0)
+			(void)writev_full(pty_out->fd, iov, 2);
+		if (pty_out && pty_out->mirror_fd >= 0) {
+			if (have_tui)
+				panel_ansi_goto_serial();
+			(void)writev_full(pty_out->mirror_fd, iov, 2);
+			tty_bol_update_spans(topo, pty_out->mirror_fd, span);
 		}
-
-		if (serial_out && serial_out->fd >= 0) {
-			/* Don't spew raw serial into the TUI's own output stream. */
-			if (!have_tui || serial_out->fd != ui_fd) {
-				if (need_goto) {
-					panel_ansi_goto_serial();
-					need_goto = false;
-				}
-				(void)write_full(serial_out->fd, tmp, n);
-				tty_bol_update_fd(serial_out->fd, tmp, n);
-			}
+	} else if (serial_out && serial_out->fd >= 0) {
+		/* Don't spew raw serial into the TUI's own output stream. */
+		if (!have_tui || serial_out->fd != ui_fd) {
+			if (have_tui)
+				panel_ansi_goto_serial();
+			(void)writev_full(serial_out->fd, iov, 2);
+			tty_bol_update_spans(topo, serial_out->fd, span);
 		}
 	}
-	return drained;
+
+	return n;
 }
 
-void runloop_text_snapshot_emit(const struct EmuHost *host,
-				const struct EmuCore *core, FILE *ui_out)
+size_t runloop_tx_drain(struct EmuCore *core, const struct EmuHost *host,
+			const PtyOut *pty_out, const FdOut *serial_out,
+			bool tui_active, const struct OutputTopology *topo,
+			bool *had_nl)
 {
-	int ui_fd;
+	struct EmuTxSpan span[2];
+	size_t n;
+
+	if (had_nl)
+		*had_nl = false;
+	if (!core || !host || !topo)
+		return 0;
+
+	/* Drain TX once, straight from the core's ring (two spans on wrap). */
+	if (!emu_core_tx_peek(core, span))
+		return 0;
+	n = runloop_tx_write(host, span, pty_out, serial_out, tui_active,
+			     topo, had_nl);
+	emu_core_tx_commit(core, n);
+	return n;
+}
 
-	if (!host || !core || !ui_out)
+void runloop_text_snapshot_emit(const struct EmuHost *host,
+				const struct PanelView *view,
+				const struct OutputTopology *topo)
+{
+	if (!host || !view || !topo)
 		return;
 	if (!host->ui.show_panel)
 		return;
 
-	ui_fd = fileno(ui_out);
-	if (ui_fd == STDOUT_FILENO || ui_fd == STDERR_FILENO) {
-		if (isatty(ui_fd) != 0 && !g_tty_at_bol) {
-			(void)write_full(ui_fd, "\n", 1);
-			g_tty_at_bol = true;
-		}
+	if (std_tty(topo, topo->ui_fd) && !g_tty_at_bol) {
+		(void)write_full(topo->ui_fd, "\n", 1);
+		g_tty_at_bol = true;
 	}
-	runloop_panel_render(host, core, false);
+	runloop_panel_render(host, view, false);
 	g_tty_at_bol = true;
 }
 
+void runloop_tape_status(const struct EmuCore *core, char *buf, size_t cap)
+{
+	const Cassette *c = &core->cas;
+	uint64_t hz = c->cpu_hz ? c->cpu_hz : 1u;
+	unsigned long long len = (unsigned long long)(c->tape_ticks / hz);
+	unsigned long long pos;
+
+	if (!core->cas_attached) {
+		buf[0] = '\0';
+		return;
+	}
+	pos = (unsigned long long)(cassette_position(c, core->ser.tick) / hz);
+	switch (c->state) {
+	case CASSETTE_PLAYING:
+		snprintf(buf, cap, "Tape:PLAY %llu:%02llu/%llu:%02llu",
+			 pos / 60u, pos % 60u, len / 60u, len % 60u);
+		break;
+	case CASSETTE_RECORDING:
+		snprintf(buf, cap, "Tape:REC %llu:%02llu", pos / 60u, pos % 60u);
+		break;
+	case CASSETTE_STOPPED:
+	default:
+		snprintf(buf, cap, "Tape:STOP %llu:%02llu", len / 60u, len % 60u);
+		break;
+	}
+}
+
+void runloop_panel_view(const struct EmuCore *core, struct PanelView *view)
+{
+	view->hw = &core->hw;
+	view->tick = core->ser.tick;
+	runloop_tape_status(core, view->tape, sizeof(view->tape));
+}
+
 void runloop_panel_render(const struct EmuHost *host,
-			  const struct EmuCore *core, bool tui_active)
+			  const struct PanelView *view, bool tui_active)
 {
-	if (tui_active)
-		panel_ansi_render(&core->hw, host->pty_name, host->cfg.use_pty,
-			host->ui.pty_input, core->ser.tick, core->cfg.cpu_hz,
-			core->cfg.baud);
-	else
-		panel_text_render(&core->hw, host->pty_name, host->cfg.use_pty,
-			host->ui.pty_input, core->ser.tick, core->cfg.cpu_hz,
-			core->cfg.baud);
+	if (tui_active) {
+		panel_ansi_set_tape_status(view->tape);
+		panel_ansi_render(view->hw, host->pty_name, host->cfg.use_pty,
+			host->ui.pty_input, view->tick, host->cfg.cpu_hz,
+			host->cfg.baud);
+	} else {
+		panel_text_render(view->hw, host->pty_name, host->cfg.use_pty,
+			host->ui.pty_input, view->tick, host->cfg.cpu_hz,
+			host->cfg.baud);
+	}
 }
 
 void runloop_compute_panel_policy(const struct EmuHost *host, bool tui_active,
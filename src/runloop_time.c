@@ -2,28 +2,35 @@
 
 #include "runloop_time.h"
 
-#include "io.h"
+#include "hostev.h"
+#include "log.h"
 #include "timeutil.h"
 
 #include <stdint.h>
 
-void runloop_realtime_throttle(const struct EmuHost *host,
-			       const struct EmuCore *core)
+bool runloop_realtime_throttle(struct EmuHost *host,
+			       const struct EmuCore *core,
+			       struct HostEv *ev, unsigned mask)
 {
-	uint32_t now_wall;
-	uint32_t emu_usec;
-	uint32_t wall_elapsed;
-	uint32_t delta;
-
-	if (!host->cfg.realtime) return;
-
-	now_wall = monotonic_usec();
-	wall_elapsed = now_wall - host->wall_start_usec;
-	emu_usec = emu_tick_to_usec(core->ser.tick - host->emu_start_tick,
-				    core->cfg.cpu_hz);
-	if (emu_usec <= wall_elapsed) return;
-
-	delta = emu_usec - wall_elapsed;
-	sleep_or_wait_input_usec(delta, host->cfg.use_pty, host->pty_fd,
-		host->cfg.headless);
+	uint64_t now;
+	uint64_t due;
+	uint64_t wait;
+
+	if (!host->cfg.realtime) return false;
+
+	now = monotonic_nsec();
+	wait = runloop_pace_check(&host->pace, core->ser.tick, now);
+	if (!wait) return false;
+	due = now + wait;
+
+	log_flush();
+	now = monotonic_nsec();
+	if (hostev_wait(ev, mask, now < due ? due - now : 0) & mask)
+		return true;
+
+	/* Timed out, not cut short by input or a signal: time the wakeup. */
+	now = monotonic_nsec();
+	if (now >= due)
+		runloop_pace_woke(&host->pace, due, now);
+	return true;
 }
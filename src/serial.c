@@ -15,6 +15,7 @@ void serial_init(SerialDev *s, uint32_t cpu_hz, uint32_t baud)
 	uint32_t tpb = (s->cpu_hz + (s->baud/2u)) / s->baud;
 	if (tpb == 0) tpb = 1;
 	s->ticks_per_bit = tpb;
+	s->rx_ticks_per_bit = tpb;
 
 	s->last_tx = 1;
 	s->tx_active = false;
@@ -23,6 +24,49 @@ void serial_init(SerialDev *s, uint32_t cpu_hz, uint32_t baud)
 	s->rx_irq_latched = false;
 }
 
+/*
+ * Work out when the active frame's line changes: the start bit is low
+ * from rx_frame_start, then each bit boundary whose level differs from
+ * the bit before, then the end of the stop bit.
+ */
+static void rx_plan(SerialDev *s)
+{
+	uint64_t tpb = s->rx_ticks_per_bit;
+	uint8_t prev = 0;
+	uint8_t n = 0;
+
+	for (unsigned k = 1; k <= 9u; k++) {
+		uint8_t lv = k <= 8u ? (uint8_t)((s->rx_byte >> (k - 1u)) & 1u) : 1u;
+
+		if (lv != prev) {
+			s->rx_edge_tick[n] = s->rx_frame_start + k * tpb;
+			s->rx_edge_level[n] = lv;
+			n++;
+			prev = lv;
+		}
+	}
+	s->rx_edge_tick[n] = s->rx_frame_start + 10u * tpb;
+	s->rx_edge_level[n] = 1;
+	s->rx_edge_n = (uint8_t)(n + 1u);
+	s->rx_edge_i = 0;
+	s->rx_level = 0;
+}
+
+void serial_set_rx_baud(SerialDev *s, uint32_t baud)
+{
+	uint32_t tpb;
+
+	if (!baud) {
+		tpb = s->ticks_per_bit;
+	} else {
+		tpb = (s->cpu_hz + (baud/2u)) / baud;
+		if (!tpb) tpb = 1u;
+	}
+	s->rx_ticks_per_bit = tpb;
+	if (s->rx_active)
+		rx_plan(s);
+}
+
 void serial_host_enqueue(SerialDev *s, uint8_t ch)
 {
 	uint32_t n = q_next(s->rx_qt);
@@ -59,6 +103,7 @@ static void rx_start_frame_if_needed(SerialDev *s)
 	s->rx_active = true;
 	s->rx_frame_start = s->tick;
 	s->rx_byte = (uint8_t)ch;
+	rx_plan(s);
 
 	/* Edge-trigger the RX interrupt latch at start bit. */
 	s->rx_irq_latched = true;
@@ -70,24 +115,16 @@ uint8_t serial_current_rx_level(SerialDev *s)
 
 	if (!s->rx_active) return 1; /* idle */
 
-	uint64_t dt = s->tick - s->rx_frame_start;
-	uint64_t tpb = s->ticks_per_bit;
-
-	/* 1 start + 8 data + 1 stop = 10 bits */
-	uint64_t total = tpb * 10u;
-	if (dt >= total) {
-		/* end frame */
-		s->rx_active = false;
-		return 1;
-	}
-
-	uint64_t bit = dt / tpb; /* 0..9 */
-	if (bit == 0) return 0;   /* start */
-	if (bit >= 1 && bit <= 8) {
-		uint8_t data_bit = (s->rx_byte >> (uint8_t)(bit-1)) & 1u;
-		return data_bit;
+	/* Usually a single compare: nothing has changed yet. */
+	while (s->tick >= s->rx_edge_tick[s->rx_edge_i]) {
+		s->rx_level = s->rx_edge_level[s->rx_edge_i];
+		if (++s->rx_edge_i == s->rx_edge_n) {
+			/* end frame */
+			s->rx_active = false;
+			return 1;
+		}
 	}
-	return 1; /* stop */
+	return s->rx_level;
 }
 
 int serial_tick_tx(SerialDev *s, uint8_t tx_level, void (*putch)(int ch, void *u), void *u)
@@ -12,8 +12,6 @@
 #include <errno.h>
 #include <stddef.h>
 #include <stdint.h>
-#include <sys/select.h>
-#include <sys/time.h>
 #include <sys/types.h>
 #include <unistd.h>
 
@@ -57,52 +55,50 @@ int serial_routing_fd(int ui_fd, bool tui_active, bool panel_visible,
 	return STDOUT_FILENO;
 }
 
+/*
+ * Bytes to read from a host input this round: never more than the RX
+ * queue can take, so a fast paste waits in the kernel buffer (and the
+ * writer blocks) instead of overflowing the queue.
+ */
+static size_t rx_read_cap(const SerialDev *ser, size_t buf_len)
+{
+	uint32_t space = serial_rx_space(ser);
+
+	return space < buf_len ? (size_t)space : buf_len;
+}
+
 void serial_routing_pty_poll(int pty_fd, SerialDev *ser)
 {
-	fd_set rfds;
-	struct timeval tv;
 	uint8_t buf[256];
-	int r;
 
 	if (pty_fd < 0 || !ser) return;
 
-	FD_ZERO(&rfds);
-	FD_SET(pty_fd, &rfds);
-	tv.tv_sec = 0;
-	tv.tv_usec = 0;
-
-	r = select(pty_fd + 1, &rfds, NULL, NULL, &tv);
-	if (r <= 0) return;
-
 	for (;;) {
-		ssize_t n = ALTAID_IO_READ(pty_fd, buf, sizeof(buf));
-		if (n > 0) {
-			ssize_t i;
-			for (i = 0; i < n; i++)
-			serial_host_enqueue(ser, buf[i]);
+		size_t cap = rx_read_cap(ser, sizeof(buf));
+		ssize_t n;
 
-			FD_ZERO(&rfds);
-			FD_SET(pty_fd, &rfds);
-			tv.tv_sec = 0;
-			tv.tv_usec = 0;
-			r = select(pty_fd + 1, &rfds, NULL, NULL, &tv);
-			if (r <= 0) return;
-			continue;
-		}
-		if (n == 0) return;
-		if (errno == EAGAIN || errno == EWOULDBLOCK) return;
-		return;
+		if (!cap) return;
+		n = ALTAID_IO_READ(pty_fd, buf, cap);
+		if (n <= 0) return;
+		for (ssize_t i = 0; i < n; i++)
+			serial_host_enqueue(ser, buf[i]);
+		/* A short read drained the master; skip the EAGAIN read. */
+		if ((size_t)n < cap) return;
 	}
 }
 
-void serial_routing_stdin_poll(SerialDev *ser)
+bool serial_routing_stdin_poll(SerialDev *ser)
 {
 	uint8_t buf[256];
 
-	if (!ser) return;
+	if (!ser) return true;
 
 	for (;;) {
-		ssize_t n = ALTAID_IO_READ(STDIN_FILENO, buf, sizeof(buf));
+		size_t cap = rx_read_cap(ser, sizeof(buf));
+		ssize_t n;
+
+		if (!cap) return true;
+		n = ALTAID_IO_READ(STDIN_FILENO, buf, cap);
 		if (n > 0) {
 			ssize_t i;
 			for (i = 0; i < n; i++) {
@@ -113,9 +109,8 @@ void serial_routing_stdin_poll(SerialDev *ser)
 			}
 			continue;
 		}
-		if (n == 0) return;
-		if (errno == EAGAIN || errno == EWOULDBLOCK) return;
-		return;
+		if (n == 0) return false;
+		return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
 	}
 }
 
@@ -193,25 +188,29 @@ void serial_routing_stdin_dispatch(const uint8_t *buf, size_t n,
 	}
 }
 
-void serial_routing_stdin_poll_with_panel(SerialDev *ser, AltaidHW *hw,
+bool serial_routing_stdin_poll_with_panel(SerialDev *ser, AltaidHW *hw,
 					  uint64_t now_tick,
 					  uint64_t hold_cycles,
 					  struct StdinPanelState *state)
 {
 	uint8_t buf[256];
 
-	if (!state) return;
+	if (!state) return true;
 
 	for (;;) {
-		ssize_t n = ALTAID_IO_READ(STDIN_FILENO, buf, sizeof(buf));
+		/* Chord bytes never reach the queue, so this cap is safe. */
+		size_t cap = ser ? rx_read_cap(ser, sizeof(buf)) : sizeof(buf);
+		ssize_t n;
+
+		if (!cap) return true;
+		n = ALTAID_IO_READ(STDIN_FILENO, buf, cap);
 		if (n > 0) {
 			serial_routing_stdin_dispatch(buf, (size_t)n, ser, hw,
 						      now_tick, hold_cycles,
 						      state);
 			continue;
 		}
-		if (n == 0) return;
-		if (errno == EAGAIN || errno == EWOULDBLOCK) return;
-		return;
+		if (n == 0) return false;
+		return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
 	}
 }
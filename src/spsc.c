@@ -0,0 +1,113 @@
+/* SPDX-License-Identifier: MIT */
+
+#include "spsc.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * C99 has no <stdatomic.h>; the GCC/Clang builtins give the same
+ * acquire/release ordering on every compiler the Makefile supports.
+ */
+#define SPSC_LOAD(p)		__atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define SPSC_STORE(p, v)	__atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define SPSC_OWN(p)		__atomic_load_n((p), __ATOMIC_RELAXED)
+
+bool spsc_init(struct Spsc *r, uint32_t size)
+{
+	uint32_t n = 1;
+
+	memset(r, 0, sizeof(*r));
+	while (n < size && n < 0x80000000u)
+		n <<= 1;
+	r->buf = malloc(n);
+	if (!r->buf)
+		return false;
+	r->size = n;
+	return true;
+}
+
+void spsc_free(struct Spsc *r)
+{
+	free(r->buf);
+	memset(r, 0, sizeof(*r));
+}
+
+uint32_t spsc_space(const struct Spsc *r)
+{
+	return r->size - (SPSC_OWN(&r->head) - SPSC_LOAD(&r->tail));
+}
+
+uint32_t spsc_avail(const struct Spsc *r)
+{
+	return SPSC_LOAD(&r->head) - SPSC_OWN(&r->tail);
+}
+
+uint32_t spsc_write(struct Spsc *r, const void *src, uint32_t n)
+{
+	uint32_t head = SPSC_OWN(&r->head);
+	uint32_t space = r->size - (head - SPSC_LOAD(&r->tail));
+	uint32_t off = head & (r->size - 1u);
+	uint32_t first;
+
+	if (n > space)
+		n = space;
+	first = r->size - off < n ? r->size - off : n;
+	memcpy(r->buf + off, src, first);
+	memcpy(r->buf, (const uint8_t *)src + first, n - first);
+	SPSC_STORE(&r->head, head + n);
+	return n;
+}
+
+bool spsc_push(struct Spsc *r, const void *rec, uint32_t n)
+{
+	if (spsc_space(r) < n)
+		return false;
+	(void)spsc_write(r, rec, n);
+	return true;
+}
+
+uint32_t spsc_peek(const struct Spsc *r, const uint8_t *data[2],
+		   uint32_t len[2])
+{
+	uint32_t tail = SPSC_OWN(&r->tail);
+	uint32_t n = SPSC_LOAD(&r->head) - tail;
+	uint32_t off = tail & (r->size - 1u);
+
+	len[0] = r->size - off < n ? r->size - off : n;
+	len[1] = n - len[0];
+	data[0] = r->buf + off;
+	data[1] = r->buf;
+	return n;
+}
+
+void spsc_commit(struct Spsc *r, uint32_t n)
+{
+	SPSC_STORE(&r->tail, SPSC_OWN(&r->tail) + n);
+}
+
+uint32_t spsc_read(struct Spsc *r, void *dst, uint32_t n)
+{
+	const uint8_t *data[2];
+	uint32_t len[2];
+	uint32_t avail = spsc_peek(r, data, len);
+
+	if (n > avail)
+		n = avail;
+	if (n <= len[0]) {
+		memcpy(dst, data[0], n);
+	} else {
+		memcpy(dst, data[0], len[0]);
+		memcpy((uint8_t *)dst + len[0], data[1], n - len[0]);
+	}
+	spsc_commit(r, n);
+	return n;
+}
+
+bool spsc_pop(struct Spsc *r, void *rec, uint32_t n)
+{
+	if (spsc_avail(r) < n)
+		return false;
+	(void)spsc_read(r, rec, n);
+	return true;
+}
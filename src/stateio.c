@@ -1,27 +1,79 @@
 /* SPDX-License-Identifier: MIT */
 
+/* For mmap(), pread(), fsync() and ftruncate() in strict C99 builds. */
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+
 #include "stateio.h"
 
 #include "cassette.h"
+#include "io.h"
+#include "lz.h"
 
 #include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
 
 /*
  * File formats:
  *
- *   STATE: magic "ALTAIDST" + u32 version + body
- *   RAM:   raw bytes
+ *   STATE: magic "ALTAIDST" + u32 version + body [+ delta records]
+ *          version 1 stores the RAM raw, later versions packed;
+ *          before version 3 the body also holds the cassette edges,
+ *          from version 4 the tape length and hash up to the edge
+ *          count
+ *   DELTA: magic "ALTAIDDL" + u32 version + u32 payload length + payload
+ *          payload = body without the RAM (version 1: with the edges;
+ *          from version 3: with the tape length and hash)
+ *                    + u32 line count + count * (u32 line + 256 bytes)
+ *   RAM:   raw bytes, or magic "ALTAIDRM" + u32 version + packed RAM
+ *
+ * Packed RAM is one record per 64 KiB bank: u8 method + u32 length +
+ * data, where the method is zero (no data), raw or LZ (see lz.h).
+ *
+ * A checkpoint file is one STATE followed by any number of DELTA records,
+ * each holding the RAM lines stored to since the record before it.
+ * Loading applies them in order; a torn final record is ignored.
  *
  * All multi-byte fields are little-endian.
  */
 
-enum { STATEIO_VER = 1 };
+enum { STATEIO_VER = 4 };
+enum { STATEIO_DELTA_VER = 3 };
+enum { STATEIO_RAM_VER = 1 };
+
+enum ram_mode {
+	RAM_NONE = 0,	/* delta payloads */
+	RAM_RAW,	/* version 1 state files, rewind snapshots */
+	RAM_PACKED,
+};
+
+enum tape_mode {
+	TAPE_INLINE = 0,	/* state < 3, delta 1: the edges themselves */
+	TAPE_COUNT,		/* state 3, delta 2: path + edge count */
+	TAPE_IDENT,		/* path + edge count + tape length and hash */
+};
+
+enum {
+	RAM_BANK_ZERO = 0,
+	RAM_BANK_RAW = 1,
+	RAM_BANK_LZ = 2,
+};
 
 static const unsigned char k_state_magic[8] =
 	{ 'A', 'L', 'T', 'A', 'I', 'D', 'S', 'T' };
+static const unsigned char k_delta_magic[8] =
+	{ 'A', 'L', 'T', 'A', 'I', 'D', 'D', 'L' };
+static const unsigned char k_ram_magic[8] =
+	{ 'A', 'L', 'T', 'A', 'I', 'D', 'R', 'M' };
 
 static void err_set(char *err, unsigned cap, const char *msg)
 {
@@ -42,23 +94,109 @@ static void err_set_errno(char *err, unsigned cap, const char *prefix)
 	err_set(err, cap, buf);
 }
 
-static bool write_u8(FILE *f, uint8_t v)
+/*
+ * Files are built in one contiguous buffer and written with a single
+ * system call; they are read back from a mapping of the whole file. A
+ * failed allocation sticks in .err so a long chain of writes needs one
+ * check.
+ */
+struct StBuf {
+	uint8_t	*p;
+	size_t	len;
+	size_t	cap;
+	bool	err;
+};
+
+struct StIn {
+	const uint8_t	*p;
+	size_t		len;
+	size_t		pos;
+};
+
+/*
+ * The cassette fields of a body. Only the position read last matters, so
+ * a chain of records (a checkpoint base and its deltas, a rewind full and
+ * its deltas) checks the tape and applies it once, for the last record.
+ */
+struct StCas {
+	char		path[sizeof(((Cassette *)0)->path)];
+	bool		attached;
+	uint32_t	cpu_hz;
+	bool		idle_level;
+	bool		in_level;
+	bool		playing;
+	bool		play_level;
+	uint64_t	play_index;
+	uint64_t	play_next_edge_tick;
+	bool		recording;
+	uint64_t	rec_last_edge_tick;
+	bool		rec_last_level;
+	uint64_t	dur_count;
+	uint64_t	tape_ticks;	/* TAPE_IDENT */
+	uint64_t	tape_hash;	/* TAPE_IDENT: cassette_hash() */
+	enum tape_mode	mode;
+	bool		pending;	/* read, not applied yet */
+};
+
+/* Room for a full state: RAM plus the rest of the body with headroom. */
+#define STATEIO_STATE_RESERVE	(sizeof(((AltaidHW *)0)->ram) + 65536u)
+#define STATEIO_RAM_BANKS \
+	(sizeof(((AltaidHW *)0)->ram) / sizeof(((AltaidHW *)0)->ram[0]))
+
+static bool buf_reserve(struct StBuf *b, size_t need)
 {
-	return (fwrite(&v, 1, 1, f) == 1);
+	size_t cap;
+	uint8_t *p;
+
+	if (b->err)
+		return false;
+	if (need <= b->cap - b->len)
+		return true;
+
+	cap = b->cap ? b->cap : 4096u;
+	while (cap - b->len < need)
+		cap *= 2u;
+	p = realloc(b->p, cap);
+	if (!p) {
+		b->err = true;
+		return false;
+	}
+	b->p = p;
+	b->cap = cap;
+	return true;
 }
 
-static bool write_u32le(FILE *f, uint32_t v)
+static bool put_bytes(struct StBuf *b, const void *src, size_t n)
 {
-	unsigned char b[4];
+	if (!buf_reserve(b, n))
+		return false;
+	memcpy(b->p + b->len, src, n);
+	b->len += n;
+	return true;
+}
 
-	b[0] = (unsigned char)(v & 0xffu);
-	b[1] = (unsigned char)((v >> 8) & 0xffu);
-	b[2] = (unsigned char)((v >> 16) & 0xffu);
-	b[3] = (unsigned char)((v >> 24) & 0xffu);
-	return (fwrite(b, 1, sizeof(b), f) == sizeof(b));
+static bool write_u8(struct StBuf *out, uint8_t v)
+{
+	return put_bytes(out, &v, 1);
+}
+
+static void store_u32le(uint8_t *b, uint32_t v)
+{
+	b[0] = (uint8_t)(v & 0xffu);
+	b[1] = (uint8_t)((v >> 8) & 0xffu);
+	b[2] = (uint8_t)((v >> 16) & 0xffu);
+	b[3] = (uint8_t)((v >> 24) & 0xffu);
+}
+
+static bool write_u32le(struct StBuf *out, uint32_t v)
+{
+	uint8_t b[4];
+
+	store_u32le(b, v);
+	return put_bytes(out, b, sizeof(b));
 }
 
-static bool write_u64le(FILE *f, uint64_t v)
+static bool write_u64le(struct StBuf *out, uint64_t v)
 {
 	unsigned char b[8];
 
@@ -70,38 +208,42 @@ static bool write_u64le(FILE *f, uint64_t v)
 	b[5] = (unsigned char)((v >> 40) & 0xffu);
 	b[6] = (unsigned char)((v >> 48) & 0xffu);
 	b[7] = (unsigned char)((v >> 56) & 0xffu);
-	return (fwrite(b, 1, sizeof(b), f) == sizeof(b));
+	return put_bytes(out, b, sizeof(b));
 }
 
-static bool write_bool(FILE *f, bool v)
+static bool write_bool(struct StBuf *out, bool v)
 {
-	return write_u8(f, v ? 1u : 0u);
+	return write_u8(out, v ? 1u : 0u);
 }
 
-static bool read_exact(FILE *f, void *dst, size_t n)
+static bool read_exact(struct StIn *in, void *dst, size_t n)
 {
-	return (fread(dst, 1, n, f) == n);
+	if (n > in->len - in->pos)
+		return false;
+	memcpy(dst, in->p + in->pos, n);
+	in->pos += n;
+	return true;
 }
 
-static bool read_u8(FILE *f, uint8_t *out)
+static bool read_u8(struct StIn *in, uint8_t *out)
 {
 	unsigned char v;
 
 	if (!out)
 		return false;
-	if (!read_exact(f, &v, 1))
+	if (!read_exact(in, &v, 1))
 		return false;
 	*out = (uint8_t)v;
 	return true;
 }
 
-static bool read_u32le(FILE *f, uint32_t *out)
+static bool read_u32le(struct StIn *in, uint32_t *out)
 {
 	unsigned char b[4];
 
 	if (!out)
 		return false;
-	if (!read_exact(f, b, sizeof(b)))
+	if (!read_exact(in, b, sizeof(b)))
 		return false;
 	*out = ((uint32_t)b[0]) |
 		((uint32_t)b[1] << 8) |
@@ -110,13 +252,13 @@ static bool read_u32le(FILE *f, uint32_t *out)
 	return true;
 }
 
-static bool read_u64le(FILE *f, uint64_t *out)
+static bool read_u64le(struct StIn *in, uint64_t *out)
 {
 	unsigned char b[8];
 
 	if (!out)
 		return false;
-	if (!read_exact(f, b, sizeof(b)))
+	if (!read_exact(in, b, sizeof(b)))
 		return false;
 	*out = ((uint64_t)b[0]) |
 		((uint64_t)b[1] << 8) |
@@ -129,43 +271,44 @@ static bool read_u64le(FILE *f, uint64_t *out)
 	return true;
 }
 
-static bool read_bool(FILE *f, bool *out)
+static bool read_bool(struct StIn *in, bool *out)
 {
 	uint8_t v;
 
 	if (!out)
 		return false;
-	if (!read_u8(f, &v))
+	if (!read_u8(in, &v))
 		return false;
 	*out = (v != 0);
 	return true;
 }
 
 
-static bool write_header(FILE *f, const unsigned char magic[8], uint32_t ver)
+static bool write_header(struct StBuf *out, const unsigned char magic[8],
+			 uint32_t ver)
 {
-	if (fwrite(magic, 1, 8, f) != 8)
+	if (!put_bytes(out, magic, 8))
 		return false;
-	if (!write_u32le(f, ver))
+	if (!write_u32le(out, ver))
 		return false;
 	return true;
 }
 
-static bool read_header(FILE *f, const unsigned char magic[8],
+static bool read_header(struct StIn *in, const unsigned char magic[8],
 			uint32_t *out_ver)
 {
 	unsigned char m[8];
 
-	if (!read_exact(f, m, 8))
+	if (!read_exact(in, m, 8))
 		return false;
 	if (memcmp(m, magic, 8) != 0)
 		return false;
-	if (!read_u32le(f, out_ver))
+	if (!read_u32le(in, out_ver))
 		return false;
 	return true;
 }
 
-static bool write_i8080(FILE *f, const I8080 *cpu)
+static bool write_i8080(struct StBuf *out, const I8080 *cpu)
 {
 	uint8_t flags;
 
@@ -173,15 +316,15 @@ static bool write_i8080(FILE *f, const I8080 *cpu)
 		return false;
 
 	flags = 0;
-	if (cpu->z)
+	if (i8080_flag(cpu, I8080_FLAG_Z))
 		flags |= 1u << 0;
-	if (cpu->s)
+	if (i8080_flag(cpu, I8080_FLAG_S))
 		flags |= 1u << 1;
-	if (cpu->p)
+	if (i8080_flag(cpu, I8080_FLAG_P))
 		flags |= 1u << 2;
-	if (cpu->cy)
+	if (i8080_flag(cpu, I8080_FLAG_CY))
 		flags |= 1u << 3;
-	if (cpu->ac)
+	if (i8080_flag(cpu, I8080_FLAG_AC))
 		flags |= 1u << 4;
 	if (cpu->inte)
 		flags |= 1u << 5;
@@ -190,19 +333,19 @@ static bool write_i8080(FILE *f, const I8080 *cpu)
 	if (cpu->halted)
 		flags |= 1u << 7;
 
-	return write_u8(f, cpu->a) &&
-		write_u8(f, cpu->b) &&
-		write_u8(f, cpu->c) &&
-		write_u8(f, cpu->d) &&
-		write_u8(f, cpu->e) &&
-		write_u8(f, cpu->h) &&
-		write_u8(f, cpu->l) &&
-		write_u32le(f, cpu->pc) &&
-		write_u32le(f, cpu->sp) &&
-		write_u8(f, flags);
+	return write_u8(out, cpu->a) &&
+		write_u8(out, cpu->b) &&
+		write_u8(out, cpu->c) &&
+		write_u8(out, cpu->d) &&
+		write_u8(out, cpu->e) &&
+		write_u8(out, cpu->h) &&
+		write_u8(out, cpu->l) &&
+		write_u32le(out, cpu->pc) &&
+		write_u32le(out, cpu->sp) &&
+		write_u8(out, flags);
 }
 
-static bool read_i8080(FILE *f, I8080 *cpu)
+static bool read_i8080(struct StIn *in, I8080 *cpu)
 {
 	uint8_t flags;
 	uint32_t pc;
@@ -211,26 +354,27 @@ static bool read_i8080(FILE *f, I8080 *cpu)
 	if (!cpu)
 		return false;
 
-	if (!read_u8(f, &cpu->a) ||
-	    !read_u8(f, &cpu->b) ||
-	    !read_u8(f, &cpu->c) ||
-	    !read_u8(f, &cpu->d) ||
-	    !read_u8(f, &cpu->e) ||
-	    !read_u8(f, &cpu->h) ||
-	    !read_u8(f, &cpu->l))
+	if (!read_u8(in, &cpu->a) ||
+	    !read_u8(in, &cpu->b) ||
+	    !read_u8(in, &cpu->c) ||
+	    !read_u8(in, &cpu->d) ||
+	    !read_u8(in, &cpu->e) ||
+	    !read_u8(in, &cpu->h) ||
+	    !read_u8(in, &cpu->l))
 		return false;
-	if (!read_u32le(f, &pc) || !read_u32le(f, &sp))
+	if (!read_u32le(in, &pc) || !read_u32le(in, &sp))
 		return false;
-	if (!read_u8(f, &flags))
+	if (!read_u8(in, &flags))
 		return false;
 
 	cpu->pc = (uint16_t)pc;
 	cpu->sp = (uint16_t)sp;
-	cpu->z = ((flags >> 0) & 1u) != 0;
-	cpu->s = ((flags >> 1) & 1u) != 0;
-	cpu->p = ((flags >> 2) & 1u) != 0;
-	cpu->cy = ((flags >> 3) & 1u) != 0;
-	cpu->ac = ((flags >> 4) & 1u) != 0;
+	cpu->f = I8080_FLAG_FIXED;
+	i8080_set_flag(cpu, I8080_FLAG_Z, ((flags >> 0) & 1u) != 0);
+	i8080_set_flag(cpu, I8080_FLAG_S, ((flags >> 1) & 1u) != 0);
+	i8080_set_flag(cpu, I8080_FLAG_P, ((flags >> 2) & 1u) != 0);
+	i8080_set_flag(cpu, I8080_FLAG_CY, ((flags >> 3) & 1u) != 0);
+	i8080_set_flag(cpu, I8080_FLAG_AC, ((flags >> 4) & 1u) != 0);
 	cpu->inte = ((flags >> 5) & 1u) != 0;
 	cpu->ei_pending = ((flags >> 6) & 1u) != 0;
 	cpu->halted = ((flags >> 7) & 1u) != 0;
@@ -238,34 +382,34 @@ static bool read_i8080(FILE *f, I8080 *cpu)
 	return true;
 }
 
-static bool write_serial(FILE *f, const SerialDev *s)
+static bool write_serial(struct StBuf *out, const SerialDev *s)
 {
 	if (!s)
 		return false;
 
-	if (!write_u32le(f, s->cpu_hz) ||
-	    !write_u32le(f, s->baud) ||
-	    !write_u32le(f, s->ticks_per_bit) ||
-	    !write_u64le(f, s->tick) ||
-	    !write_u8(f, s->last_tx) ||
-	    !write_bool(f, s->tx_active) ||
-	    !write_u64le(f, s->tx_next_sample) ||
-	    !write_u8(f, s->tx_bit_index) ||
-	    !write_u8(f, s->tx_byte) ||
-	    !write_u32le(f, s->rx_qh) ||
-	    !write_u32le(f, s->rx_qt) ||
-	    !write_bool(f, s->rx_active) ||
-	    !write_u64le(f, s->rx_frame_start) ||
-	    !write_u8(f, s->rx_byte) ||
-	    !write_bool(f, s->rx_irq_latched))
+	if (!write_u32le(out, s->cpu_hz) ||
+	    !write_u32le(out, s->baud) ||
+	    !write_u32le(out, s->ticks_per_bit) ||
+	    !write_u64le(out, s->tick) ||
+	    !write_u8(out, s->last_tx) ||
+	    !write_bool(out, s->tx_active) ||
+	    !write_u64le(out, s->tx_next_sample) ||
+	    !write_u8(out, s->tx_bit_index) ||
+	    !write_u8(out, s->tx_byte) ||
+	    !write_u32le(out, s->rx_qh) ||
+	    !write_u32le(out, s->rx_qt) ||
+	    !write_bool(out, s->rx_active) ||
+	    !write_u64le(out, s->rx_frame_start) ||
+	    !write_u8(out, s->rx_byte) ||
+	    !write_bool(out, s->rx_irq_latched))
 		return false;
 
-	if (fwrite(s->rx_q, 1, sizeof(s->rx_q), f) != sizeof(s->rx_q))
+	if (!put_bytes(out, s->rx_q, sizeof(s->rx_q)))
 		return false;
 	return true;
 }
 
-static bool read_serial(FILE *f, SerialDev *s)
+static bool read_serial(struct StIn *in, SerialDev *s)
 {
 	uint32_t cpu_hz;
 	uint32_t baud;
@@ -276,24 +420,24 @@ static bool read_serial(FILE *f, SerialDev *s)
 	if (!s)
 		return false;
 
-	if (!read_u32le(f, &cpu_hz) ||
-	    !read_u32le(f, &baud) ||
-	    !read_u32le(f, &ticks_per_bit) ||
-	    !read_u64le(f, &s->tick) ||
-	    !read_u8(f, &s->last_tx) ||
-	    !read_bool(f, &s->tx_active) ||
-	    !read_u64le(f, &s->tx_next_sample) ||
-	    !read_u8(f, &s->tx_bit_index) ||
-	    !read_u8(f, &s->tx_byte) ||
-	    !read_u32le(f, &rx_qh) ||
-	    !read_u32le(f, &rx_qt) ||
-	    !read_bool(f, &s->rx_active) ||
-	    !read_u64le(f, &s->rx_frame_start) ||
-	    !read_u8(f, &s->rx_byte) ||
-	    !read_bool(f, &s->rx_irq_latched))
+	if (!read_u32le(in, &cpu_hz) ||
+	    !read_u32le(in, &baud) ||
+	    !read_u32le(in, &ticks_per_bit) ||
+	    !read_u64le(in, &s->tick) ||
+	    !read_u8(in, &s->last_tx) ||
+	    !read_bool(in, &s->tx_active) ||
+	    !read_u64le(in, &s->tx_next_sample) ||
+	    !read_u8(in, &s->tx_bit_index) ||
+	    !read_u8(in, &s->tx_byte) ||
+	    !read_u32le(in, &rx_qh) ||
+	    !read_u32le(in, &rx_qt) ||
+	    !read_bool(in, &s->rx_active) ||
+	    !read_u64le(in, &s->rx_frame_start) ||
+	    !read_u8(in, &s->rx_byte) ||
+	    !read_bool(in, &s->rx_irq_latched))
 		return false;
 
-	if (!read_exact(f, s->rx_q, sizeof(s->rx_q)))
+	if (!read_exact(in, s->rx_q, sizeof(s->rx_q)))
 		return false;
 
 	s->cpu_hz = cpu_hz;
@@ -304,54 +448,143 @@ static bool read_serial(FILE *f, SerialDev *s)
 	return true;
 }
 
-static bool write_hw(FILE *f, const AltaidHW *hw)
+static bool bank_is_zero(const uint8_t *bank, size_t len)
+{
+	for (size_t i = 0; i < len; i += ALTAID_DIRTY_LINE) {
+		uint8_t any = 0;
+
+		/* Branch-free per line so the compiler can vectorise it. */
+		for (size_t j = 0; j < ALTAID_DIRTY_LINE; j++)
+			any |= bank[i + j];
+		if (any)
+			return false;
+	}
+	return true;
+}
+
+/*
+ * Packed RAM: untouched banks cost 5 bytes, the rest are LZ compressed,
+ * or stored raw if that does not make them smaller.
+ */
+static bool write_ram_packed(struct StBuf *out, const AltaidHW *hw)
+{
+	const size_t n = sizeof(hw->ram[0]);
+
+	for (size_t b = 0; b < STATEIO_RAM_BANKS; b++) {
+		const uint8_t *bank = hw->ram[b];
+		size_t z;
+
+		if (bank_is_zero(bank, n)) {
+			if (!write_u8(out, RAM_BANK_ZERO) || !write_u32le(out, 0))
+				return false;
+			continue;
+		}
+
+		if (!buf_reserve(out, 5u + n))
+			return false;
+		z = lz_compress(bank, n, out->p + out->len + 5u, n - 1u);
+		if (!z) {
+			if (!write_u8(out, RAM_BANK_RAW) ||
+			    !write_u32le(out, (uint32_t)n) ||
+			    !put_bytes(out, bank, n))
+				return false;
+			continue;
+		}
+		out->p[out->len] = RAM_BANK_LZ;
+		store_u32le(out->p + out->len + 1u, (uint32_t)z);
+		out->len += 5u + z;
+	}
+	return true;
+}
+
+static bool read_ram_packed(struct StIn *in, AltaidHW *hw)
+{
+	const size_t n = sizeof(hw->ram[0]);
+
+	for (size_t b = 0; b < STATEIO_RAM_BANKS; b++) {
+		uint8_t *bank = hw->ram[b];
+		const uint8_t *data;
+		uint8_t method;
+		uint32_t len;
+
+		if (!read_u8(in, &method) || !read_u32le(in, &len) ||
+		    len > in->len - in->pos)
+			return false;
+		data = in->p + in->pos;
+		in->pos += len;
+
+		switch (method) {
+		case RAM_BANK_ZERO:
+			if (len != 0)
+				return false;
+			memset(bank, 0, n);
+			break;
+		case RAM_BANK_RAW:
+			if (len != n)
+				return false;
+			memcpy(bank, data, n);
+			break;
+		case RAM_BANK_LZ:
+			if (!lz_decompress(data, len, bank, n))
+				return false;
+			break;
+		default:
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool write_hw(struct StBuf *out, const AltaidHW *hw,
+		     enum ram_mode ram)
 {
 	if (!hw)
 		return false;
 
-	/* RAM contents. */
-	if (fwrite(hw->ram, 1, sizeof(hw->ram), f) != sizeof(hw->ram))
+	/* RAM contents (delta records carry dirty lines instead). */
+	if (ram == RAM_RAW && !put_bytes(out, hw->ram, sizeof(hw->ram)))
+		return false;
+	if (ram == RAM_PACKED && !write_ram_packed(out, hw))
 		return false;
 
-	if (!write_u8(f, hw->ram_a16) ||
-	    !write_u8(f, hw->ram_a17) ||
-	    !write_u8(f, hw->ram_a18) ||
-	    !write_u8(f, hw->ram_bank) ||
-	    !write_u8(f, hw->rom_half) ||
-	    !write_bool(f, hw->rom_low_mapped) ||
-	    !write_bool(f, hw->rom_hi_mapped) ||
-	    !write_u8(f, hw->out_c0) ||
-	    !write_bool(f, hw->tx_line) ||
-	    !write_bool(f, hw->rx_level) ||
-	    !write_bool(f, hw->timer_en) ||
-	    !write_bool(f, hw->timer_level) ||
-	    !write_bool(f, hw->cassette_out_level) ||
-	    !write_bool(f, hw->cassette_out_dirty) ||
-	    !write_bool(f, hw->cassette_in_level) ||
-	    !write_u8(f, hw->scan_row) ||
-	    !write_u8(f, hw->led_row_mask) ||
-	    !write_bool(f, hw->panel_latched_valid) ||
-	    !write_u32le(f, hw->panel_latched_seq) ||
-	    !write_u32le(f, hw->panel_latched_addr) ||
-	    !write_u8(f, hw->panel_latched_data) ||
-	    !write_u8(f, hw->panel_latched_stat))
+	if (!write_u8(out, hw->ram_a16) ||
+	    !write_u8(out, hw->ram_a17) ||
+	    !write_u8(out, hw->ram_a18) ||
+	    !write_u8(out, hw->ram_bank) ||
+	    !write_u8(out, hw->rom_half) ||
+	    !write_bool(out, hw->rom_low_mapped) ||
+	    !write_bool(out, hw->rom_hi_mapped) ||
+	    !write_u8(out, hw->out_c0) ||
+	    !write_bool(out, hw->tx_line) ||
+	    !write_bool(out, hw->rx_level) ||
+	    !write_bool(out, hw->timer_en) ||
+	    !write_bool(out, hw->timer_level) ||
+	    !write_bool(out, hw->cassette_out_level) ||
+	    !write_bool(out, hw->cassette_out_dirty) ||
+	    !write_bool(out, hw->cassette_in_level) ||
+	    !write_u8(out, hw->scan_row) ||
+	    !write_u8(out, hw->led_row_mask) ||
+	    !write_bool(out, hw->panel_latched_valid) ||
+	    !write_u32le(out, hw->panel_latched_seq) ||
+	    !write_u32le(out, hw->panel_latched_addr) ||
+	    !write_u8(out, hw->panel_latched_data) ||
+	    !write_u8(out, hw->panel_latched_stat))
 		return false;
 
-	if (fwrite(hw->led_row_nibble, 1, sizeof(hw->led_row_nibble), f) !=
-	    sizeof(hw->led_row_nibble))
+	if (!put_bytes(out, hw->led_row_nibble, sizeof(hw->led_row_nibble)))
 		return false;
 
 	for (size_t i = 0; i < 11; i++) {
-		if (!write_bool(f, hw->fp_key_down[i]))
+		if (!write_bool(out, hw->fp_key_down[i]))
 			return false;
-		if (!write_u64le(f, hw->fp_key_until[i]))
+		if (!write_u64le(out, hw->fp_key_until[i]))
 			return false;
 	}
 
 	return true;
 }
 
-static bool read_hw(FILE *f, AltaidHW *hw)
+static bool read_hw(struct StIn *in, AltaidHW *hw, enum ram_mode ram)
 {
 	uint32_t seq;
 	uint32_t addr;
@@ -359,176 +592,388 @@ static bool read_hw(FILE *f, AltaidHW *hw)
 	if (!hw)
 		return false;
 
-	if (!read_exact(f, hw->ram, sizeof(hw->ram)))
-		return false;
-
-	if (!read_u8(f, &hw->ram_a16) ||
-	    !read_u8(f, &hw->ram_a17) ||
-	    !read_u8(f, &hw->ram_a18) ||
-	    !read_u8(f, &hw->ram_bank) ||
-	    !read_u8(f, &hw->rom_half) ||
-	    !read_bool(f, &hw->rom_low_mapped) ||
-	    !read_bool(f, &hw->rom_hi_mapped) ||
-	    !read_u8(f, &hw->out_c0) ||
-	    !read_bool(f, &hw->tx_line) ||
-	    !read_bool(f, &hw->rx_level) ||
-	    !read_bool(f, &hw->timer_en) ||
-	    !read_bool(f, &hw->timer_level) ||
-	    !read_bool(f, &hw->cassette_out_level) ||
-	    !read_bool(f, &hw->cassette_out_dirty) ||
-	    !read_bool(f, &hw->cassette_in_level) ||
-	    !read_u8(f, &hw->scan_row) ||
-	    !read_u8(f, &hw->led_row_mask) ||
-	    !read_bool(f, &hw->panel_latched_valid) ||
-	    !read_u32le(f, &seq) ||
-	    !read_u32le(f, &addr) ||
-	    !read_u8(f, &hw->panel_latched_data) ||
-	    !read_u8(f, &hw->panel_latched_stat))
+	if (ram == RAM_RAW && !read_exact(in, hw->ram, sizeof(hw->ram)))
+		return false;
+	if (ram == RAM_PACKED && !read_ram_packed(in, hw))
+		return false;
+
+	if (!read_u8(in, &hw->ram_a16) ||
+	    !read_u8(in, &hw->ram_a17) ||
+	    !read_u8(in, &hw->ram_a18) ||
+	    !read_u8(in, &hw->ram_bank) ||
+	    !read_u8(in, &hw->rom_half) ||
+	    !read_bool(in, &hw->rom_low_mapped) ||
+	    !read_bool(in, &hw->rom_hi_mapped) ||
+	    !read_u8(in, &hw->out_c0) ||
+	    !read_bool(in, &hw->tx_line) ||
+	    !read_bool(in, &hw->rx_level) ||
+	    !read_bool(in, &hw->timer_en) ||
+	    !read_bool(in, &hw->timer_level) ||
+	    !read_bool(in, &hw->cassette_out_level) ||
+	    !read_bool(in, &hw->cassette_out_dirty) ||
+	    !read_bool(in, &hw->cassette_in_level) ||
+	    !read_u8(in, &hw->scan_row) ||
+	    !read_u8(in, &hw->led_row_mask) ||
+	    !read_bool(in, &hw->panel_latched_valid) ||
+	    !read_u32le(in, &seq) ||
+	    !read_u32le(in, &addr) ||
+	    !read_u8(in, &hw->panel_latched_data) ||
+	    !read_u8(in, &hw->panel_latched_stat))
 		return false;
 
 	hw->panel_latched_seq = seq;
 	hw->panel_latched_addr = (uint16_t)addr;
 
-	if (!read_exact(f, hw->led_row_nibble, sizeof(hw->led_row_nibble)))
+	if (!read_exact(in, hw->led_row_nibble, sizeof(hw->led_row_nibble)))
 		return false;
 
 	for (size_t i = 0; i < 11; i++) {
-		if (!read_bool(f, &hw->fp_key_down[i]))
+		if (!read_bool(in, &hw->fp_key_down[i]))
 			return false;
-		if (!read_u64le(f, &hw->fp_key_until[i]))
+		if (!read_u64le(in, &hw->fp_key_until[i]))
 			return false;
 	}
 
+	/* Mapping latches were restored directly; rebuild the page tables. */
+	altaid_hw_remap(hw);
 	return true;
 }
 
-static bool write_cassette(FILE *f, const Cassette *c)
+static bool write_cassette(struct StBuf *out, Cassette *c)
 {
 	if (!c)
 		return false;
 
-	if (!write_bool(f, c->attached))
+	if (!write_bool(out, c->attached))
 		return false;
-	if (fwrite(c->path, 1, sizeof(c->path), f) != sizeof(c->path))
+	if (!put_bytes(out, c->path, sizeof(c->path)))
 		return false;
 	/*
 	 * On-disk layout kept identical to the pre-enum format: two bools
 	 * derived from state (playing, recording). Never both true.
 	 */
-	if (!write_u32le(f, c->cpu_hz) ||
-	    !write_bool(f, c->idle_level) ||
-	    !write_bool(f, c->in_level) ||
-	    !write_bool(f, c->state == CASSETTE_PLAYING) ||
-	    !write_bool(f, c->play_level) ||
-	    !write_u64le(f, c->play_index) ||
-	    !write_u64le(f, c->play_next_edge_tick) ||
-	    !write_bool(f, c->state == CASSETTE_RECORDING) ||
-	    !write_u64le(f, c->rec_last_edge_tick) ||
-	    !write_bool(f, c->rec_last_level) ||
-	    !write_u64le(f, c->dur_count))
-		return false;
-
-	for (size_t i = 0; i < c->dur_count; i++) {
-		if (!write_u32le(f, c->durations[i]))
-			return false;
-	}
-
+	if (!write_u32le(out, c->cpu_hz) ||
+	    !write_bool(out, c->idle_level) ||
+	    !write_bool(out, c->in_level) ||
+	    !write_bool(out, c->state == CASSETTE_PLAYING) ||
+	    !write_bool(out, c->play_level) ||
+	    !write_u64le(out, c->play_index) ||
+	    !write_u64le(out, c->play_next_edge_tick) ||
+	    !write_bool(out, c->state == CASSETTE_RECORDING) ||
+	    !write_u64le(out, c->rec_last_edge_tick) ||
+	    !write_bool(out, c->rec_last_level) ||
+	    !write_u64le(out, c->dur_count) ||
+	    !write_u64le(out, c->tape_ticks) ||
+	    !write_u64le(out, cassette_hash(c, c->dur_count)))
+		return false;
+
+	/* The edges themselves stay in the tape file (see cassette_flush()). */
 	return true;
 }
 
-static bool read_cassette(FILE *f, Cassette *c)
+/*
+ * Put the cassette fields of a body into c. Unless the edges were inline,
+ * the tape is reopened from its file, which is never cut: the position is
+ * set within it. That fails if the file now holds fewer edges than saved
+ * (lost in a crash, or another tape) or, where the body has them, its
+ * first edges differ in length or hash. A WAV is decoded afresh, to the
+ * sample, so only its edge count is checked. A recording resumes on a
+ * copy of the edges saved (see cassette_fork()).
+ */
+static bool apply_cassette(Cassette *c, const struct StCas *rc)
 {
-	uint64_t play_index;
-	uint64_t dur_count;
+	size_t n = (size_t)rc->dur_count;
+
+	if (rc->mode == TAPE_INLINE)
+		memcpy(c->path, rc->path, sizeof(c->path));
+	else if (!cassette_reattach(c, rc->path, n) ||
+		 (rc->mode == TAPE_IDENT && !c->wav &&
+		  (cassette_tick_at(c, n) != rc->tape_ticks ||
+		   cassette_hash(c, n) != rc->tape_hash)))
+		return false;
+	if (rc->recording && !cassette_fork(c, n))
+		return false;
 
+	c->attached = rc->attached;
+	c->cpu_hz = rc->cpu_hz;
+	c->idle_level = rc->idle_level;
+	c->in_level = rc->in_level;
+	/* Reconstruct state from the two legacy bools. Recording takes
+	 * precedence if both were somehow true (should not occur). */
+	c->state = rc->recording ? CASSETTE_RECORDING :
+		   (rc->playing ? CASSETTE_PLAYING : CASSETTE_STOPPED);
+	c->play_level = rc->play_level;
+	c->play_index = rc->play_index < c->dur_count ?
+		(size_t)rc->play_index : c->dur_count;
+	c->play_next_edge_tick = rc->play_next_edge_tick;
+	/* Derived: tape time of the next edge, from the checkpoints. */
+	c->play_tape_tick = cassette_tick_at(c, c->play_index + 1u);
+	c->rec_last_edge_tick = rc->rec_last_edge_tick;
+	c->rec_last_level = rc->rec_last_level;
+	return true;
+}
+
+/*
+ * The tape itself is not in the state: the body names its file, and the
+ * caller applies the last body read with apply_cassette(). Layouts before
+ * state version 3 and delta version 2 carry the edges inline instead;
+ * those are replayed into a temp-backed tape (Ctrl-P V copies it to the
+ * path) and applied at once.
+ */
+static bool read_cassette(struct StIn *in, Cassette *c, enum tape_mode mode,
+			  struct StCas *rc)
+{
 	if (!c)
 		return false;
 
-	cassette_free(c);
-	cassette_init(c, c->cpu_hz);
+	rc->mode = mode;
+	rc->tape_ticks = 0;
+	rc->tape_hash = 0;
+	if (!read_bool(in, &rc->attached))
+		return false;
+	if (!read_exact(in, rc->path, sizeof(rc->path)))
+		return false;
+	rc->path[sizeof(rc->path) - 1] = '\0';
+
+	if (!read_u32le(in, &rc->cpu_hz) ||
+	    !read_bool(in, &rc->idle_level) ||
+	    !read_bool(in, &rc->in_level) ||
+	    !read_bool(in, &rc->playing) ||
+	    !read_bool(in, &rc->play_level) ||
+	    !read_u64le(in, &rc->play_index) ||
+	    !read_u64le(in, &rc->play_next_edge_tick) ||
+	    !read_bool(in, &rc->recording) ||
+	    !read_u64le(in, &rc->rec_last_edge_tick) ||
+	    !read_bool(in, &rc->rec_last_level) ||
+	    !read_u64le(in, &rc->dur_count))
+		return false;
+	if (mode == TAPE_IDENT && (!read_u64le(in, &rc->tape_ticks) ||
+				   !read_u64le(in, &rc->tape_hash)))
+		return false;
+
+	rc->pending = mode != TAPE_INLINE;
+	if (mode == TAPE_INLINE) {
+		uint32_t wav_rate = c->wav_rate;
+
+		if (rc->dur_count > (in->len - in->pos) / 4u)
+			return false;
+		cassette_free(c);
+		cassette_init(c, rc->cpu_hz);
+		c->wav_rate = wav_rate;
+		for (uint64_t i = 0; i < rc->dur_count; i++) {
+			uint32_t d;
+
+			if (!read_u32le(in, &d) || !cassette_append(c, d))
+				return false;
+		}
+		return apply_cassette(c, rc);
+	}
+	return true;
+}
 
-	if (!read_bool(f, &c->attached))
+/*
+ * Replace path with the iov bytes in one writev(): they go to a temp file
+ * in the same directory, which is fsync()ed and renamed over path, so a
+ * crash leaves either the old file or the new one, never a torn one.
+ */
+static bool write_file_atomic(const char *path, const struct iovec *iov,
+			      int iovcnt, const char *what,
+			      char *err, unsigned err_cap)
+{
+	char tmp[PATH_MAX];
+	char msg[64];
+	int fd;
+	int n;
+
+	n = snprintf(tmp, sizeof(tmp), "%s.%ld.tmp", path, (long)getpid());
+	if (n < 0 || (size_t)n >= sizeof(tmp)) {
+		err_set(err, err_cap, "path too long");
 		return false;
-	if (!read_exact(f, c->path, sizeof(c->path)))
+	}
+
+	fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	if (fd < 0) {
+		snprintf(msg, sizeof(msg), "open %s for write", what);
+		err_set_errno(err, err_cap, msg);
 		return false;
-	c->path[sizeof(c->path) - 1] = '\0';
+	}
 
-	bool playing;
-	bool recording;
+	if (writev_full(fd, iov, iovcnt) != 0 || fsync(fd) != 0) {
+		snprintf(msg, sizeof(msg), "write %s", what);
+		err_set_errno(err, err_cap, msg);
+		close(fd);
+		unlink(tmp);
+		return false;
+	}
+	if (close(fd) != 0) {
+		snprintf(msg, sizeof(msg), "close %s", what);
+		err_set_errno(err, err_cap, msg);
+		unlink(tmp);
+		return false;
+	}
 
-	if (!read_u32le(f, &c->cpu_hz) ||
-	    !read_bool(f, &c->idle_level) ||
-	    !read_bool(f, &c->in_level) ||
-	    !read_bool(f, &playing) ||
-	    !read_bool(f, &c->play_level) ||
-	    !read_u64le(f, &play_index) ||
-	    !read_u64le(f, &c->play_next_edge_tick) ||
-	    !read_bool(f, &recording) ||
-	    !read_u64le(f, &c->rec_last_edge_tick) ||
-	    !read_bool(f, &c->rec_last_level) ||
-	    !read_u64le(f, &dur_count))
+	if (rename(tmp, path) != 0) {
+		snprintf(msg, sizeof(msg), "rename %s", what);
+		err_set_errno(err, err_cap, msg);
+		unlink(tmp);
 		return false;
+	}
+	return true;
+}
 
-	/* Reconstruct state from the two legacy bools. Recording takes
-	 * precedence if both were somehow true (should not occur). */
-	c->state = recording ? CASSETTE_RECORDING :
-		   (playing ? CASSETTE_PLAYING : CASSETTE_STOPPED);
-
-	c->play_index = (size_t)play_index;
-	c->dur_count = (size_t)dur_count;
-	c->dur_cap = c->dur_count;
-	if (c->dur_count) {
-		c->durations = (uint32_t *)calloc(c->dur_count, sizeof(uint32_t));
-		if (!c->durations)
+/* pread() exactly len bytes at off, retrying short reads and EINTR. */
+static bool pread_full(int fd, void *dst, size_t len, off_t off)
+{
+	uint8_t *p = dst;
+
+	while (len) {
+		ssize_t n = pread(fd, p, len, off);
+
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
 			return false;
-		for (size_t i = 0; i < c->dur_count; i++) {
-			if (!read_u32le(f, &c->durations[i]))
+		p += n;
+		len -= (size_t)n;
+		off += n;
+	}
+	return true;
+}
+
+/*
+ * Whole-file input: mmap()ed when possible, otherwise read into a heap
+ * buffer (e.g. for files mmap() refuses).
+ */
+struct StFile {
+	struct StIn	in;
+	void		*map;
+	size_t		map_len;
+	uint8_t		*heap;
+};
+
+static bool file_open_in(struct StFile *sf, const char *path,
+			 const char *what, char *err, unsigned err_cap)
+{
+	struct stat st;
+	char msg[64];
+	size_t len;
+	int fd;
+
+	memset(sf, 0, sizeof(*sf));
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		snprintf(msg, sizeof(msg), "open %s for read", what);
+		err_set_errno(err, err_cap, msg);
+		return false;
+	}
+	if (fstat(fd, &st) != 0 || st.st_size < 0) {
+		snprintf(msg, sizeof(msg), "stat %s", what);
+		err_set_errno(err, err_cap, msg);
+		close(fd);
+		return false;
+	}
+	len = (size_t)st.st_size;
+
+	if (len) {
+		void *m = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+
+		if (m != MAP_FAILED) {
+			sf->map = m;
+			sf->map_len = len;
+			sf->in.p = m;
+		} else {
+			sf->heap = malloc(len);
+			if (!sf->heap || !pread_full(fd, sf->heap, len, 0)) {
+				snprintf(msg, sizeof(msg), "read %s", what);
+				err_set_errno(err, err_cap, msg);
+				free(sf->heap);
+				close(fd);
 				return false;
+			}
+			sf->in.p = sf->heap;
 		}
 	}
-
+	sf->in.len = len;
+	close(fd);
 	return true;
 }
 
+static void file_close_in(struct StFile *sf)
+{
+	if (sf->map)
+		munmap(sf->map, sf->map_len);
+	free(sf->heap);
+	memset(sf, 0, sizeof(*sf));
+}
+
 bool stateio_save_ram(const struct EmuCore *core, const char *path,
-			char *err, unsigned err_cap)
+			bool packed, char *err, unsigned err_cap)
 {
-	FILE *f;
+	struct StBuf out = { 0 };
+	struct iovec iov;
+	bool ok;
 
 	if (!core || !path || !*path) {
 		err_set(err, err_cap, "invalid arguments");
 		return false;
 	}
 
-	f = fopen(path, "wb");
-	if (!f) {
-		err_set_errno(err, err_cap, "open ram for write");
-		return false;
+	if (!packed) {
+		iov.iov_base = (void *)core->hw.ram;
+		iov.iov_len = sizeof(core->hw.ram);
+		return write_file_atomic(path, &iov, 1, "ram", err, err_cap);
 	}
 
-	if (fwrite(core->hw.ram, 1, sizeof(core->hw.ram), f) != sizeof(core->hw.ram)) {
-		err_set_errno(err, err_cap, "write ram");
-		fclose(f);
+	if (!write_header(&out, k_ram_magic, STATEIO_RAM_VER) ||
+	    !write_ram_packed(&out, &core->hw)) {
+		err_set(err, err_cap, "out of memory");
+		free(out.p);
 		return false;
 	}
+	iov.iov_base = out.p;
+	iov.iov_len = out.len;
+	ok = write_file_atomic(path, &iov, 1, "ram", err, err_cap);
+	free(out.p);
+	return ok;
+}
+
+/* A packed RAM image always covers all of RAM. */
+static bool load_ram_packed(struct EmuCore *core, const char *path,
+			    char *err, unsigned err_cap)
+{
+	struct StFile sf;
+	uint32_t ver;
+	bool ok = false;
 
-	if (fclose(f) != 0) {
-		err_set_errno(err, err_cap, "close ram");
+	if (!file_open_in(&sf, path, "ram", err, err_cap))
 		return false;
-	}
 
-	return true;
+	emu_core_mem_changed(core);
+	altaid_hw_dirty_all(&core->hw);
+	if (!read_header(&sf.in, k_ram_magic, &ver))
+		err_set(err, err_cap, "bad ram image (magic/header)");
+	else if (ver != STATEIO_RAM_VER)
+		err_set(err, err_cap, "unsupported ram image version");
+	else if (!read_ram_packed(&sf.in, &core->hw))
+		err_set(err, err_cap, "corrupt ram image");
+	else
+		ok = true;
+
+	file_close_in(&sf);
+	return ok;
 }
 
 bool stateio_load_ram(struct EmuCore *core, const char *path,
 			uint32_t flat_offset,
 			char *err, unsigned err_cap)
 {
-	FILE *f;
-	long file_size;
+	unsigned char magic[8];
+	struct stat st;
 	size_t total_ram;
 	size_t cap;
 	uint8_t *dst;
+	int fd;
 
 	if (!core || !path || !*path) {
 		err_set(err, err_cap, "invalid arguments");
@@ -542,150 +987,372 @@ bool stateio_load_ram(struct EmuCore *core, const char *path,
 	}
 	cap = total_ram - flat_offset;
 
-	f = fopen(path, "rb");
-	if (!f) {
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
 		err_set_errno(err, err_cap, "open ram for read");
 		return false;
 	}
 
-	if (fseek(f, 0, SEEK_END) != 0 ||
-	    (file_size = ftell(f)) < 0 ||
-	    fseek(f, 0, SEEK_SET) != 0) {
+	if (fstat(fd, &st) != 0 || st.st_size < 0) {
 		err_set_errno(err, err_cap, "stat ram");
-		fclose(f);
+		close(fd);
 		return false;
 	}
-	if ((size_t)file_size > cap) {
+	if (st.st_size >= (off_t)sizeof(magic) &&
+	    pread_full(fd, magic, sizeof(magic), 0) &&
+	    memcmp(magic, k_ram_magic, sizeof(magic)) == 0) {
+		close(fd);
+		if (flat_offset != 0) {
+			err_set(err, err_cap,
+				"packed ram image must be loaded as ram:<file>");
+			return false;
+		}
+		return load_ram_packed(core, path, err, err_cap);
+	}
+	if ((uint64_t)st.st_size > cap) {
 		err_set(err, err_cap, "ram file too large for destination");
-		fclose(f);
+		close(fd);
 		return false;
 	}
 
+	/* Straight into the banks: no intermediate buffer. */
 	dst = (uint8_t *)core->hw.ram + flat_offset;
-	if (file_size > 0 && !read_exact(f, dst, (size_t)file_size)) {
+	emu_core_mem_changed(core);
+	altaid_hw_dirty_all(&core->hw);
+	if (!pread_full(fd, dst, (size_t)st.st_size, 0)) {
+		if (errno == 0)
+			errno = EIO;
 		err_set_errno(err, err_cap, "read ram");
-		fclose(f);
+		close(fd);
 		return false;
 	}
 
-	fclose(f);
+	close(fd);
+	return true;
+}
+
+/* Everything after the STATE header; delta payloads omit the RAM. */
+static bool write_machine(struct StBuf *out, struct EmuCore *core,
+			  enum ram_mode ram)
+{
+	if (!write_u64le(out, core->timer_period) ||
+	    !write_u64le(out, core->next_timer_tick) ||
+	    !write_u32le(out, core->tx_r) ||
+	    !write_u32le(out, core->tx_w))
+		return false;
+	if (!put_bytes(out, core->tx_buf, sizeof(core->tx_buf)))
+		return false;
+
+	return write_i8080(out, &core->cpu) &&
+		write_serial(out, &core->ser) &&
+		write_hw(out, &core->hw, ram) &&
+		write_bool(out, core->cas_attached) &&
+		write_cassette(out, &core->cas);
+}
+
+static bool read_machine(struct StIn *in, struct EmuCore *core,
+			 enum ram_mode ram, enum tape_mode mode,
+			 struct StCas *rc)
+{
+	uint32_t tx_r;
+	uint32_t tx_w;
+	bool cas_attached;
+
+	if (!read_u64le(in, &core->timer_period) ||
+	    !read_u64le(in, &core->next_timer_tick) ||
+	    !read_u32le(in, &tx_r) ||
+	    !read_u32le(in, &tx_w))
+		return false;
+	core->tx_r = tx_r & EMU_TXBUF_MASK;
+	core->tx_w = tx_w & EMU_TXBUF_MASK;
+
+	if (!read_exact(in, core->tx_buf, sizeof(core->tx_buf)))
+		return false;
+
+	emu_core_mem_changed(core);
+	if (!read_i8080(in, &core->cpu) ||
+	    !read_serial(in, &core->ser) ||
+	    !read_hw(in, &core->hw, ram) ||
+	    !read_bool(in, &cas_attached) ||
+	    !read_cassette(in, &core->cas, mode, rc))
+		return false;
+
+	core->cas_attached = cas_attached;
+	/* The RX line rate is host configuration, not machine state. */
+	serial_set_rx_baud(&core->ser, core->cfg.rx_baud);
 	return true;
 }
 
-bool stateio_save_state(const struct EmuCore *core, const char *path,
+bool stateio_save_state(struct EmuCore *core, const char *path,
 			char *err, unsigned err_cap)
 {
-	FILE *f;
+	struct StBuf out = { 0 };
+	struct iovec iov;
+	bool ok;
 
 	if (!core || !path || !*path) {
 		err_set(err, err_cap, "invalid arguments");
 		return false;
 	}
 
-	f = fopen(path, "wb");
-	if (!f) {
-		err_set_errno(err, err_cap, "open state for write");
+	if (!cassette_flush(&core->cas)) {
+		err_set_errno(err, err_cap, "flush cassette tape");
 		return false;
 	}
 
-	if (!write_header(f, k_state_magic, STATEIO_VER)) {
-		err_set_errno(err, err_cap, "write state header");
-		fclose(f);
+	if (!buf_reserve(&out, STATEIO_STATE_RESERVE) ||
+	    !write_header(&out, k_state_magic, STATEIO_VER) ||
+	    !write_machine(&out, core, RAM_PACKED)) {
+		err_set(err, err_cap, "out of memory");
+		free(out.p);
 		return false;
 	}
 
-	if (!write_u64le(f, core->timer_period) ||
-	    !write_u64le(f, core->next_timer_tick) ||
-	    !write_u32le(f, core->tx_r) ||
-	    !write_u32le(f, core->tx_w)) {
-		err_set_errno(err, err_cap, "write state core fields");
-		fclose(f);
-		return false;
+	iov.iov_base = out.p;
+	iov.iov_len = out.len;
+	ok = write_file_atomic(path, &iov, 1, "state", err, err_cap);
+	free(out.p);
+	return ok;
+}
+
+/*
+ * Apply one delta record payload. Returns false if it is malformed; the
+ * machine may then be partly updated.
+ */
+static bool apply_delta(struct EmuCore *core, uint32_t ver,
+			const uint8_t *payload, size_t len,
+			struct StCas *rc)
+{
+	struct StIn in = { payload, len, 0 };
+	enum tape_mode mode;
+	uint32_t count;
+	bool ok;
+
+	mode = ver < 2 ? TAPE_INLINE : (ver < 3 ? TAPE_COUNT : TAPE_IDENT);
+	ok = read_machine(&in, core, RAM_NONE, mode, rc) &&
+		read_u32le(&in, &count);
+	for (uint32_t i = 0; ok && i < count; i++) {
+		uint32_t line;
+
+		ok = read_u32le(&in, &line) && line < ALTAID_DIRTY_LINES &&
+			read_exact(&in, (uint8_t *)core->hw.ram +
+				   (size_t)line * ALTAID_DIRTY_LINE,
+				   ALTAID_DIRTY_LINE);
+	}
+	return ok;
+}
+
+/*
+ * Apply the delta records that follow a STATE body. Stops quietly at end
+ * of file or at a torn final record (a crash mid-append), so the machine
+ * is left at the last complete checkpoint.
+ */
+static bool load_deltas(struct StIn *in, struct EmuCore *core,
+			struct StCas *rc, char *err, unsigned err_cap)
+{
+	while (in->pos < in->len) {
+		uint32_t ver;
+		uint32_t len;
+
+		if (in->len - in->pos < 16u)
+			return true;
+		if (!read_header(in, k_delta_magic, &ver)) {
+			err_set(err, err_cap, "bad checkpoint record (magic)");
+			return false;
+		}
+		if (ver < 1 || ver > STATEIO_DELTA_VER) {
+			err_set(err, err_cap, "unsupported checkpoint record version");
+			return false;
+		}
+		if (!read_u32le(in, &len) || len > in->len - in->pos)
+			return true;
+
+		if (!apply_delta(core, ver, in->p + in->pos, len, rc)) {
+			err_set(err, err_cap, "corrupt checkpoint record");
+			return false;
+		}
+		in->pos += len;
 	}
-	if (fwrite(core->tx_buf, 1, sizeof(core->tx_buf), f) != sizeof(core->tx_buf)) {
-		err_set_errno(err, err_cap, "write state txbuf");
-		fclose(f);
+	return true;
+}
+
+bool stateio_load_state(struct EmuCore *core, const char *path,
+			char *err, unsigned err_cap)
+{
+	struct StFile sf;
+	struct StCas cas = { 0 };
+	enum tape_mode mode;
+	uint32_t ver;
+	bool ok = false;
+
+	if (!core || !path || !*path) {
+		err_set(err, err_cap, "invalid arguments");
 		return false;
 	}
 
-	if (!write_i8080(f, &core->cpu) ||
-	    !write_serial(f, &core->ser) ||
-	    !write_hw(f, &core->hw) ||
-	    !write_bool(f, core->cas_attached) ||
-	    !write_cassette(f, &core->cas)) {
-		err_set_errno(err, err_cap, "write state body");
-		fclose(f);
+	if (!file_open_in(&sf, path, "state", err, err_cap))
 		return false;
+
+	if (!read_header(&sf.in, k_state_magic, &ver)) {
+		err_set(err, err_cap, "bad state file (magic/header)");
+	} else if (ver < 1 || ver > STATEIO_VER) {
+		err_set(err, err_cap, "unsupported state file version");
+	} else {
+		mode = ver < 3 ? TAPE_INLINE :
+			(ver < 4 ? TAPE_COUNT : TAPE_IDENT);
+		if (!read_machine(&sf.in, core,
+				  ver == 1 ? RAM_RAW : RAM_PACKED, mode, &cas))
+			err_set(err, err_cap, "read state body");
+		else
+			ok = load_deltas(&sf.in, core, &cas, err, err_cap);
 	}
 
-	if (fclose(f) != 0) {
-		err_set_errno(err, err_cap, "close state");
+	file_close_in(&sf);
+	if (!ok)
+		return false;
+
+	if (cas.pending && !apply_cassette(&core->cas, &cas)) {
+		err_set(err, err_cap,
+			"cassette tape is short or not the one saved");
 		return false;
 	}
 
+	/* RAM no longer matches any checkpoint chain the core was writing. */
+	altaid_hw_dirty_all(&core->hw);
 	return true;
 }
 
-bool stateio_load_state(struct EmuCore *core, const char *path,
+/* Delta payload holding the RAM lines with any of the given dirty bits. */
+static bool write_delta_payload(struct StBuf *out, struct EmuCore *core,
+				uint8_t bits)
+{
+	const AltaidHW *hw = &core->hw;
+	uint32_t count = 0;
+
+	for (uint32_t i = 0; i < ALTAID_DIRTY_LINES; i++)
+		count += (hw->ram_dirty[i] & bits) ? 1u : 0u;
+
+	if (!write_machine(out, core, RAM_NONE) || !write_u32le(out, count))
+		return false;
+
+	for (uint32_t i = 0; i < ALTAID_DIRTY_LINES; i++) {
+		if (!(hw->ram_dirty[i] & bits))
+			continue;
+		if (!write_u32le(out, i) ||
+		    !put_bytes(out, (const uint8_t *)hw->ram +
+			       (size_t)i * ALTAID_DIRTY_LINE, ALTAID_DIRTY_LINE))
+			return false;
+	}
+	return true;
+}
+
+bool stateio_checkpoint(struct EmuCore *core, const char *path, bool base,
 			char *err, unsigned err_cap)
 {
-	FILE *f;
-	uint32_t ver;
-	uint32_t tx_r;
-	uint32_t tx_w;
-	bool cas_attached;
+	struct StBuf out = { 0 };
+	struct stat st;
+	int fd;
 
 	if (!core || !path || !*path) {
 		err_set(err, err_cap, "invalid arguments");
 		return false;
 	}
 
-	f = fopen(path, "rb");
-	if (!f) {
-		err_set_errno(err, err_cap, "open state for read");
-		return false;
+	if (base) {
+		if (!stateio_save_state(core, path, err, err_cap))
+			return false;
+		altaid_hw_dirty_clear(&core->hw, ALTAID_DIRTY_CHECKPOINT);
+		return true;
 	}
 
-	if (!read_header(f, k_state_magic, &ver)) {
-		err_set(err, err_cap, "bad state file (magic/header)");
-		fclose(f);
+	if (!cassette_flush(&core->cas)) {
+		err_set_errno(err, err_cap, "flush cassette tape");
 		return false;
 	}
-	if (ver != STATEIO_VER) {
-		err_set(err, err_cap, "unsupported state file version");
-		fclose(f);
+
+	/* Whole record in memory first; the length is patched in after. */
+	if (!write_header(&out, k_delta_magic, STATEIO_DELTA_VER) ||
+	    !write_u32le(&out, 0) ||
+	    !write_delta_payload(&out, core, ALTAID_DIRTY_CHECKPOINT)) {
+		err_set(err, err_cap, "out of memory");
+		free(out.p);
 		return false;
 	}
+	store_u32le(out.p + 12, (uint32_t)(out.len - 16u));
 
-	if (!read_u64le(f, &core->timer_period) ||
-	    !read_u64le(f, &core->next_timer_tick) ||
-	    !read_u32le(f, &tx_r) ||
-	    !read_u32le(f, &tx_w)) {
-		err_set(err, err_cap, "read state core fields");
-		fclose(f);
+	fd = open(path, O_WRONLY | O_APPEND);
+	if (fd < 0) {
+		err_set_errno(err, err_cap, "open checkpoint for append");
+		free(out.p);
 		return false;
 	}
-	core->tx_r = tx_r % EMU_TXBUF_SIZE;
-	core->tx_w = tx_w % EMU_TXBUF_SIZE;
 
-	if (!read_exact(f, core->tx_buf, sizeof(core->tx_buf))) {
-		err_set(err, err_cap, "read state txbuf");
-		fclose(f);
+	/*
+	 * No fsync() here: a delta lost or torn by a crash only costs one
+	 * period, since the loader stops at the last complete record.
+	 */
+	if (fstat(fd, &st) != 0) {
+		err_set_errno(err, err_cap, "stat checkpoint");
+		close(fd);
+		free(out.p);
+		return false;
+	}
+	if (write_full(fd, out.p, out.len) != 0) {
+		err_set_errno(err, err_cap, "write checkpoint record");
+		/* Drop the partial record so later appends stay readable. */
+		(void)ftruncate(fd, st.st_size);
+		close(fd);
+		free(out.p);
 		return false;
 	}
+	free(out.p);
 
-	if (!read_i8080(f, &core->cpu) ||
-	    !read_serial(f, &core->ser) ||
-	    !read_hw(f, &core->hw) ||
-	    !read_bool(f, &cas_attached) ||
-	    !read_cassette(f, &core->cas)) {
-		err_set(err, err_cap, "read state body");
-		fclose(f);
+	if (close(fd) != 0) {
+		err_set_errno(err, err_cap, "close checkpoint");
 		return false;
 	}
 
-	core->cas_attached = cas_attached;
+	altaid_hw_dirty_clear(&core->hw, ALTAID_DIRTY_CHECKPOINT);
+	return true;
+}
+
+bool stateio_snapshot(struct EmuCore *core, bool full,
+		      uint8_t **out, size_t *out_len)
+{
+	struct StBuf b = { 0 };
+	bool ok;
+
+	if (!core || !out || !out_len)
+		return false;
 
-	fclose(f);
+	if (full)
+		ok = buf_reserve(&b, STATEIO_STATE_RESERVE) &&
+			write_machine(&b, core, RAM_RAW);
+	else
+		ok = write_delta_payload(&b, core, ALTAID_DIRTY_REWIND);
+	if (!ok) {
+		free(b.p);
+		return false;
+	}
+
+	altaid_hw_dirty_clear(&core->hw, ALTAID_DIRTY_REWIND);
+	*out = b.p;
+	*out_len = b.len;
 	return true;
 }
+
+bool stateio_restore(struct EmuCore *core, bool full,
+		     const uint8_t *buf, size_t len, bool tape)
+{
+	struct StIn in = { buf, len, 0 };
+	struct StCas cas = { 0 };
+	bool ok;
+
+	if (!core || !buf)
+		return false;
+	if (!full)
+		ok = apply_delta(core, STATEIO_DELTA_VER, buf, len, &cas);
+	else
+		ok = read_machine(&in, core, RAM_RAW, TAPE_IDENT, &cas);
+	return ok && (!tape || !cas.pending || apply_cassette(&core->cas, &cas));
+}
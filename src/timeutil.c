@@ -11,7 +11,7 @@
 #include <stdint.h>
 #include <time.h>
 
-static uint32_t monotonic_now_usec(void)
+static uint64_t monotonic_now_nsec(void)
 {
 	struct timespec ts;
 
@@ -19,57 +19,77 @@ static uint32_t monotonic_now_usec(void)
 		return 0;
 	}
 
-	return (uint32_t)((uint64_t)ts.tv_sec * 1000000ull + (uint64_t)ts.tv_nsec / 1000ull);
+	return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
 }
 
-uint32_t monotonic_usec(void)
+uint64_t monotonic_nsec(void)
 {
-	static uint32_t base_usec;
+	static uint64_t base_nsec;
 	static bool base_init = false;
-	uint32_t now_usec;
+	uint64_t now_nsec;
 
-	now_usec = monotonic_now_usec();
-	if (!base_init && now_usec != 0) {
-		base_usec = now_usec;
+	now_nsec = monotonic_now_nsec();
+	if (!base_init && now_nsec != 0) {
+		base_nsec = now_nsec;
 		base_init = true;
 	}
 	if (!base_init) {
 		return 0;
 	}
 
-	return now_usec - base_usec;
+	return now_nsec - base_nsec;
 }
 
-uint32_t emu_tick_to_usec(uint64_t tick, uint32_t hz)
+uint32_t monotonic_usec(void)
+{
+	return (uint32_t)(monotonic_nsec() / 1000ull);
+}
+
+/*
+ * tick is in CPU cycles (t-states). Avoid overflowing tick*unit in 64-bit
+ * by splitting into quotient and remainder: (tick/hz)*unit +
+ * (tick%hz)*unit/hz.
+ */
+static uint64_t emu_tick_to_unit(uint64_t tick, uint32_t hz, uint64_t unit)
 {
 	uint64_t q;
 	uint64_t r;
 
-	/* tick is in CPU cycles (t-states). */
 	if (hz == 0) {
 		return 0;
 	}
 
-	/*
-	 * Avoid overflowing tick*1e6 in 64-bit by splitting into quotient and
-	 * remainder: (tick/hz)*1e6 + (tick%hz)*1e6/hz.
-	 */
 	q = tick / (uint64_t)hz;
 	r = tick % (uint64_t)hz;
 
-	return (uint32_t)(q * 1000000ull + (r * 1000000ull) / (uint64_t)hz);
+	return q * unit + (r * unit) / (uint64_t)hz;
+}
+
+uint64_t emu_tick_to_usec(uint64_t tick, uint32_t hz)
+{
+	return emu_tick_to_unit(tick, hz, 1000000ull);
+}
+
+uint64_t emu_tick_to_nsec(uint64_t tick, uint32_t hz)
+{
+	return emu_tick_to_unit(tick, hz, 1000000000ull);
 }
 
 void sleep_usec(uint32_t usec)
+{
+	sleep_nsec((uint64_t)usec * 1000ull);
+}
+
+void sleep_nsec(uint64_t nsec)
 {
 	struct timespec req;
 
-	if (usec == 0) {
+	if (nsec == 0) {
 		return;
 	}
 
-	req.tv_sec = (time_t)(usec / 1000000u);
-	req.tv_nsec = (long)((usec % 1000000u) * 1000u);
+	req.tv_sec = (time_t)(nsec / 1000000000ull);
+	req.tv_nsec = (long)(nsec % 1000000000ull);
 
 	while (nanosleep(&req, &req) == -1 && errno == EINTR)
 	;
@@ -4,6 +4,7 @@
 
 #include "io_sys.h"
 
+#include <errno.h>
 #include <fcntl.h>
 #include <stdio.h>
 #include <termios.h>
@@ -45,6 +46,7 @@ static const char g_help_prefixed[] =
 	"  b     save RAM banks to current RAM file\n"
 	"  g     load RAM banks from current RAM file\n"
 	"  M     set RAM filename (prompts)\n"
+	"  B     rewind the machine by --rewind-step ms (repeatable)\n"
 	"\n"
 	"Cassette transport:\n"
 	"  a     set/attach cassette filename (prompts)\n"
@@ -53,8 +55,10 @@ static const char g_help_prefixed[] =
 	"  K     stop\n"
 	"  W     rewind\n"
 	"  J     fast-forward 10s\n"
+	"  j     back 10s\n"
 	"  V     save tape image now\n"
 	"  d     dump panel snapshot\n"
+	"  S     show batch size and host overhead\n"
 	"  Ctrl-P <key>  prefix form of the above\n"
 	"  Ctrl-P Ctrl-P  alias for Ctrl-P i\n"
 	"  Ctrl-P Ctrl-R  reset emulated machine\n"
@@ -276,6 +280,8 @@ void ui_init(UI *ui)
 	ui->req_state_load = false;
 	ui->req_ram_save = false;
 	ui->req_ram_load = false;
+	ui->req_rewind = false;
+	ui->req_stats = false;
 	ui->req_cass_attach = false;
 	ui->req_cass_save = false;
 	ui->req_cass_play = false;
@@ -283,6 +289,7 @@ void ui_init(UI *ui)
 	ui->req_cass_stop = false;
 	ui->req_cass_rewind = false;
 	ui->req_cass_ff = false;
+	ui->req_cass_back = false;
 	strncpy(ui->state_path, state_path, sizeof(ui->state_path));
 	ui->state_path[sizeof(ui->state_path) - 1] = '\0';
 	strncpy(ui->ram_path, ram_path, sizeof(ui->ram_path));
@@ -398,36 +405,45 @@ static void ui_toggle_pty_input(UI *ui)
 		fflush(out_stream());
 }
 
+static void ui_press_key(UI *ui, AltaidHW *hw, uint8_t key,
+			 uint64_t now_tick, uint64_t key_hold_cycles)
+{
+	if (ui->sink)
+		ui->sink->key(ui->sink->ctx, key);
+	else
+		altaid_hw_panel_press_key(hw, key, now_tick, key_hold_cycles);
+}
+
 static bool ui_handle_panel_key(UI *ui, AltaidHW *hw, int ch,
 uint64_t now_tick, uint64_t key_hold_cycles,
 bool direct_help)
 {
 	if (ch >= '1' && ch <= '8') {
 		uint8_t key = (uint8_t)(ch - '1');
-		altaid_hw_panel_press_key(hw, key, now_tick, key_hold_cycles);
+		ui_press_key(ui, hw, key, now_tick, key_hold_cycles);
 		ui->event = true;
 		return true;
 	}
 
 	if (ch == 'r') {
-		altaid_hw_panel_press_key(hw, 8, now_tick, key_hold_cycles);
+		ui_press_key(ui, hw, 8, now_tick, key_hold_cycles);
 		ui->event = true;
 		return true;
 	}
 	if (ch == 'm') {
-		altaid_hw_panel_press_key(hw, 9, now_tick, key_hold_cycles);
+		ui_press_key(ui, hw, 9, now_tick, key_hold_cycles);
 		ui->event = true;
 		return true;
 	}
 	if (ch == 'n') {
-		altaid_hw_panel_press_key(hw, 10, now_tick, key_hold_cycles);
+		ui_press_key(ui, hw, 10, now_tick, key_hold_cycles);
 		ui->event = true;
 		return true;
 	}
 	if (ch == 'N') {
 		/* Chord: D7 + NEXT */
-		altaid_hw_panel_press_key(hw, 7, now_tick, key_hold_cycles);
-		altaid_hw_panel_press_key(hw, 10, now_tick, key_hold_cycles);
+		ui_press_key(ui, hw, 7, now_tick, key_hold_cycles);
+		ui_press_key(ui, hw, 10, now_tick, key_hold_cycles);
 		ui->event = true;
 		return true;
 	}
@@ -506,6 +522,16 @@ uint64_t now_tick, uint64_t key_hold_cycles)
 		prompt_begin(ui, UI_PROMPT_RAM_FILE, "RAM", ui->ram_path);
 		return;
 	}
+	if (ch == 'B') {
+		ui->req_rewind = true;
+		ui->event = true;
+		return;
+	}
+	if (ch == 'S') {
+		ui->req_stats = true;
+		ui->event = true;
+		return;
+	}
 	if (ch == 'a' || ch == 'A') {
 		prompt_begin(ui, UI_PROMPT_CASS_FILE, "CASS", ui->cass_path);
 		return;
@@ -535,6 +561,11 @@ uint64_t now_tick, uint64_t key_hold_cycles)
 		ui->event = true;
 		return;
 	}
+	if (ch == 'j') {
+		ui->req_cass_back = true;
+		ui->event = true;
+		return;
+	}
 	if (ch == 'V') {
 		ui->req_cass_save = true;
 		ui->event = true;
@@ -556,39 +587,56 @@ uint64_t now_tick, uint64_t key_hold_cycles)
 
 static void ui_handle_normal_char(UI *ui, SerialDev *ser, int ch)
 {
-	if (!ser)
+	if (!ser && !ui->sink)
 		return;
-	if (ui && ui->serial_ro)
+	if (ui->serial_ro)
 		return;
 
 	if (ch == '\n')
 		ch = '\r';
-	serial_host_enqueue(ser, (uint8_t)ch);
+	if (ui->sink)
+		ui->sink->serial(ui->sink->ctx, (uint8_t)ch);
+	else
+		serial_host_enqueue(ser, (uint8_t)ch);
 	ui->event = true;
 }
 
 
-void ui_poll(UI *ui, SerialDev *ser, AltaidHW *hw, uint64_t now_tick,
+bool ui_poll(UI *ui, SerialDev *ser, AltaidHW *hw, uint64_t now_tick,
 uint64_t key_hold_cycles)
 {
 	uint8_t buf[64];
 	ssize_t n;
 	bool direct_panel;
 
-	if (!ui || !hw) return;
+	if (!ui || !hw) return true;
 
 	direct_panel = (ui->pty_mode && !ui->pty_input);
-	altaid_hw_panel_tick(hw, now_tick);
+	if (!ui->sink)
+		altaid_hw_panel_tick(hw, now_tick);
 
 	for (;;) {
-		n = ALTAID_IO_READ(STDIN_FILENO, buf, sizeof(buf));
-		if (n <= 0) break;
+		size_t cap = sizeof(buf);
+
+		if (ui->sink && ui->sink->space) {
+			uint32_t room = ui->sink->space(ui->sink->ctx) / 2u;
+
+			if (room < cap)
+				cap = room;
+			if (!cap)
+				return true;
+		}
+		n = ALTAID_IO_READ(STDIN_FILENO, buf, cap);
+		if (n == 0) return false;
+		if (n < 0)
+			return errno == EAGAIN || errno == EWOULDBLOCK ||
+				errno == EINTR;
 		for (ssize_t i = 0; i < n; i++) {
 			int ch = buf[i];
 
 			if (ch == KEY_CTRL('C')) {
 				ui->quit = true;
-				return;
+				return true;
 			}
 
 			if (ui->prompt_active) {
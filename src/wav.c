@@ -0,0 +1,285 @@
+/* SPDX-License-Identifier: MIT */
+
+/* For pread() and pwrite() in strict C99 builds. */
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "wav.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define WAV_BLOCK	4096u	/* frames per read or write */
+#define WAV_HDR_LEN	44u
+#define WAV_LEVEL	12000	/* export amplitude */
+#define WAV_MIN_THRESH	512	/* hysteresis floor, so hiss is not edges */
+#define WAV_DC_SHIFT	10	/* DC tracker time constant: 2^n samples */
+#define WAV_ENV_SHIFT	12	/* envelope decay time constant: 2^n samples */
+
+struct wav_fmt {
+	uint16_t	channels;
+	uint16_t	bits;
+	uint32_t	rate;
+	uint16_t	align;		/* bytes per frame */
+	uint64_t	data_off;
+	uint64_t	data_len;
+};
+
+/* Comparator state carried across blocks. */
+struct wav_cmp {
+	int64_t		dc;		/* DC estimate << WAV_DC_SHIFT */
+	int32_t		env;		/* peak envelope of |x - dc| */
+	bool		level;
+	uint64_t	last_tick;	/* tick of the previous edge */
+};
+
+static uint32_t wav_get16(const uint8_t *p)
+{
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8);
+}
+
+static uint32_t wav_get32(const uint8_t *p)
+{
+	return wav_get16(p) | (wav_get16(p + 2) << 16);
+}
+
+static void wav_put16(uint8_t *p, uint32_t v)
+{
+	p[0] = (uint8_t)v;
+	p[1] = (uint8_t)(v >> 8);
+}
+
+static void wav_put32(uint8_t *p, uint32_t v)
+{
+	wav_put16(p, v);
+	wav_put16(p + 2, v >> 16);
+}
+
+static size_t wav_read(int fd, void *dst, size_t len, off_t off)
+{
+	uint8_t *p = dst;
+	size_t got = 0;
+
+	while (got < len) {
+		ssize_t n = pread(fd, p + got, len - got, off + (off_t)got);
+		if (n < 0 && errno == EINTR) continue;
+		if (n <= 0) break;
+		got += (size_t)n;
+	}
+	return got;
+}
+
+static bool wav_write(int fd, const void *src, size_t len, off_t off)
+{
+	const uint8_t *p = src;
+
+	while (len) {
+		ssize_t n = pwrite(fd, p, len, off);
+		if (n < 0 && errno == EINTR) continue;
+		if (n <= 0) return false;
+		p += n;
+		len -= (size_t)n;
+		off += n;
+	}
+	return true;
+}
+
+bool wav_sniff(int fd)
+{
+	uint8_t h[12];
+
+	return wav_read(fd, h, sizeof(h), 0) == sizeof(h) &&
+	       memcmp(h, "RIFF", 4) == 0 && memcmp(h + 8, "WAVE", 4) == 0;
+}
+
+/*
+ * Walk the RIFF chunks for "fmt " and "data". A data length past the end
+ * of the file (a streaming writer that never patched it) is clamped.
+ */
+static bool wav_parse(int fd, struct wav_fmt *f)
+{
+	struct stat st;
+	uint8_t ch[8];
+	uint8_t fmt[40];
+	uint64_t off = 12;
+	bool have_fmt = false;
+
+	if (!wav_sniff(fd) || fstat(fd, &st) != 0) return false;
+
+	while (wav_read(fd, ch, sizeof(ch), (off_t)off) == sizeof(ch)) {
+		uint64_t len = wav_get32(ch + 4);
+		uint32_t tag;
+
+		off += sizeof(ch);
+		if (memcmp(ch, "fmt ", 4) == 0) {
+			size_t k = len < sizeof(fmt) ? (size_t)len : sizeof(fmt);
+
+			if (k < 16 || wav_read(fd, fmt, k, (off_t)off) != k)
+				return false;
+			tag = wav_get16(fmt);
+			/* WAVE_FORMAT_EXTENSIBLE: the subformat GUID starts with it. */
+			if (tag == 0xFFFEu && k >= 26)
+				tag = wav_get16(fmt + 24);
+			f->channels = (uint16_t)wav_get16(fmt + 2);
+			f->rate = wav_get32(fmt + 4);
+			f->align = (uint16_t)wav_get16(fmt + 12);
+			f->bits = (uint16_t)wav_get16(fmt + 14);
+			if (tag != 1 || !f->channels || !f->rate ||
+			    (f->bits != 8 && f->bits != 16) ||
+			    f->align != f->channels * (f->bits / 8u))
+				return false;
+			have_fmt = true;
+		} else if (memcmp(ch, "data", 4) == 0) {
+			if (!have_fmt) return false;
+			f->data_off = off;
+			f->data_len = (uint64_t)st.st_size - off;
+			if (len < f->data_len) f->data_len = len;
+			return true;
+		}
+		off += len + (len & 1u);
+	}
+	return false;
+}
+
+/*
+ * First channel of n frames, widened to 16-bit signed. Kept free of
+ * branches on the data so the compiler can vectorise it.
+ */
+static void wav_widen(const uint8_t *src, int32_t *x, size_t n,
+		      const struct wav_fmt *f)
+{
+	size_t step = f->align;
+
+	if (f->bits == 8) {
+		for (size_t i = 0; i < n; i++)
+			x[i] = ((int32_t)src[i * step] - 128) * 256;
+	} else {
+		for (size_t i = 0; i < n; i++)
+			x[i] = (int16_t)(uint16_t)(src[i * step] |
+						  (src[i * step + 1] << 8));
+	}
+}
+
+bool wav_import(int fd, Cassette *c)
+{
+	struct wav_fmt f;
+	struct wav_cmp cmp;
+	uint8_t *raw;
+	int32_t *x;
+	uint32_t *dur;
+	uint64_t frames;
+	uint64_t k = 0;
+	bool ok = true;
+
+	memset(&f, 0, sizeof(f));
+	if (!wav_parse(fd, &f)) return false;
+
+	raw = malloc((size_t)WAV_BLOCK * f.align);
+	x = malloc(WAV_BLOCK * sizeof(*x));
+	dur = malloc(WAV_BLOCK * sizeof(*dur));
+	if (!raw || !x || !dur) {
+		free(raw);
+		free(x);
+		free(dur);
+		return false;
+	}
+
+	memset(&cmp, 0, sizeof(cmp));
+	cmp.level = c->idle_level;
+	frames = f.data_len / f.align;
+
+	while (ok && k < frames) {
+		size_t n = frames - k < WAV_BLOCK ? (size_t)(frames - k) : WAV_BLOCK;
+		size_t edges = 0;
+
+		if (wav_read(fd, raw, n * f.align,
+			       (off_t)(f.data_off + k * f.align)) != n * f.align)
+			break;
+		wav_widen(raw, x, n, &f);
+
+		for (size_t i = 0; i < n; i++) {
+			int32_t dc = (int32_t)(cmp.dc / (1 << WAV_DC_SHIFT));
+			int32_t v = x[i] - dc;
+			int32_t a = v < 0 ? -v : v;
+			int32_t th;
+
+			cmp.dc += x[i] - dc;
+			cmp.env = a > cmp.env ? a
+				: cmp.env - (cmp.env >> WAV_ENV_SHIFT);
+			th = cmp.env / 4 > WAV_MIN_THRESH ? cmp.env / 4
+							  : WAV_MIN_THRESH;
+
+			if (cmp.level ? v < -th : v > th) {
+				/* Absolute sample time: no rounding drift. */
+				uint64_t t = (k + i) * (uint64_t)c->cpu_hz / f.rate;
+				uint64_t d = t - cmp.last_tick;
+
+				cmp.level = !cmp.level;
+				cmp.last_tick = t;
+				dur[edges++] = d > UINT32_MAX ? UINT32_MAX : (uint32_t)d;
+			}
+		}
+		/* At most one edge per sample, so a block's edges fit. */
+		ok = cassette_append_n(c, dur, edges);
+		k += n;
+	}
+
+	free(raw);
+	free(x);
+	free(dur);
+	return ok;
+}
+
+bool wav_export(Cassette *c, int fd, uint32_t rate)
+{
+	uint8_t hdr[WAV_HDR_LEN];
+	uint8_t buf[WAV_BLOCK * 2];
+	uint64_t hz = c->cpu_hz ? c->cpu_hz : 1u;
+	uint64_t frames;
+	uint64_t next_edge;
+	size_t edge = 0;
+	bool level = c->idle_level;
+	size_t n = 0;
+	off_t off = WAV_HDR_LEN;
+
+	if (!rate) return false;
+	/* One sample past the last edge, so it is heard. */
+	frames = (c->tape_ticks * rate + hz - 1u) / hz + 1u;
+	if (frames * 2u > UINT32_MAX - 36u) return false;
+
+	next_edge = c->dur_count ? cassette_duration(c, 0) : UINT64_MAX;
+	for (uint64_t k = 0; k < frames; k++) {
+		/* Apply every edge at or before this sample's time. */
+		while (edge < c->dur_count && next_edge * rate <= k * hz) {
+			level = !level;
+			if (++edge < c->dur_count)
+				next_edge += cassette_duration(c, edge);
+		}
+		wav_put16(buf + n, (uint32_t)(level ? WAV_LEVEL : -WAV_LEVEL));
+		n += 2;
+		if (n == sizeof(buf)) {
+			if (!wav_write(fd, buf, n, off)) return false;
+			off += (off_t)n;
+			n = 0;
+		}
+	}
+	if (n && !wav_write(fd, buf, n, off)) return false;
+
+	memcpy(hdr, "RIFF", 4);
+	wav_put32(hdr + 4, (uint32_t)(36u + frames * 2u));
+	memcpy(hdr + 8, "WAVEfmt ", 8);
+	wav_put32(hdr + 16, 16);
+	wav_put16(hdr + 20, 1);		/* PCM */
+	wav_put16(hdr + 22, 1);		/* mono */
+	wav_put32(hdr + 24, rate);
+	wav_put32(hdr + 28, rate * 2u);
+	wav_put16(hdr + 32, 2);
+	wav_put16(hdr + 34, 16);
+	memcpy(hdr + 36, "data", 4);
+	wav_put32(hdr + 40, (uint32_t)(frames * 2u));
+	return wav_write(fd, hdr, sizeof(hdr), 0);
+}
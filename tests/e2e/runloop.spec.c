@@ -91,6 +91,35 @@ static char *test_runloop_run_ms_exits_cleanly(void)
 	return NULL;
 }
 
+static char *test_runloop_threaded_run_ms_exits_cleanly(void)
+{
+	char rom_path[64];
+	char cmd[512];
+	int rc;
+
+	if (make_temp_rom(rom_path, sizeof(rom_path)) != 0)
+		return "failed to create temp ROM";
+
+	/*
+	 * Not headless, so --threaded takes effect: the core thread must
+	 * notice the deadline and the UI thread must join it and exit.
+	 */
+	snprintf(cmd, sizeof(cmd),
+		"./altaid-emu %s --threaded --run-ms 100 --turbo "
+		"</dev/null >/dev/null 2>&1",
+		rom_path);
+
+	rc = helper_system_status(cmd);
+	unlink(rom_path);
+
+	_it_should(
+		"exit 0 after --run-ms elapses on the core thread",
+		0 == rc
+	);
+
+	return NULL;
+}
+
 static char *test_runloop_run_ms_zero_treated_as_unlimited(void)
 {
 	char rom_path[64];
@@ -275,6 +304,7 @@ static char *test_stdin_ctrl_p_chord_passes_through_emu(void)
 static char *run_tests(void)
 {
 	_run_test(test_runloop_run_ms_exits_cleanly);
+	_run_test(test_runloop_threaded_run_ms_exits_cleanly);
 	_run_test(test_runloop_run_ms_zero_treated_as_unlimited);
 	_run_test(test_load_ram_at_offset_and_save_round_trip);
 	_run_test(test_load_bad_spec_fails_at_startup);
@@ -152,6 +152,29 @@ static char *test_altaid_hw_altaid_mem_read(void)
 
 static char *test_altaid_hw_altaid_mem_write(void)
 {
+	static AltaidHW hw;
+	I8080Bus bus;
+
+	altaid_hw_init(&hw);
+	altaid_hw_attach_bus(&hw, &bus);
+	altaid_hw_dirty_clear(&hw, ALTAID_DIRTY_ALL);
+	hw.ram_bank = 3;
+	altaid_mem_write(&bus, 0x1234, 0x5A);
+
+	_it_should(
+		"store to RAM and flag the line for every consumer",
+		0x5Au == hw.ram[3][0x1234]
+		&& ALTAID_DIRTY_ALL == hw.ram_dirty[(3u << 8) | 0x12u]
+		&& 0u == hw.ram_dirty[(3u << 8) | 0x13u]
+	);
+
+	altaid_hw_dirty_clear(&hw, ALTAID_DIRTY_CHECKPOINT);
+	_it_should(
+		"clear one consumer's bit without the others",
+		ALTAID_DIRTY_REWIND & hw.ram_dirty[(3u << 8) | 0x12u]
+		&& !(ALTAID_DIRTY_CHECKPOINT & hw.ram_dirty[(3u << 8) | 0x12u])
+	);
+
 	return NULL;
 }
 
@@ -165,6 +188,63 @@ static char *test_altaid_hw_altaid_io_out(void)
 	return NULL;
 }
 
+static char *test_altaid_hw_altaid_hw_remap(void)
+{
+	static AltaidHW hw;
+	I8080Bus bus;
+	unsigned mismatches = 0;
+
+	altaid_hw_init(&hw);
+	memset(&bus, 0, sizeof(bus));
+	altaid_hw_attach_bus(&hw, &bus);
+
+	for (size_t i = 0; i < sizeof(hw.rom); i++)
+		((uint8_t *)hw.rom)[i] = (uint8_t)(i * 7u + 1u);
+	for (size_t i = 0; i < sizeof(hw.ram); i++)
+		((uint8_t *)hw.ram)[i] = (uint8_t)(i * 13u + (i >> 16));
+
+	/* Walk every ROM_LOW/ROM_HI/B15/bank combination via OUT. */
+	for (unsigned combo = 0; combo < 64u; combo++) {
+		altaid_io_out(&bus, ALTAID_PORT_ROM_LOW, (uint8_t)(combo & 1u));
+		altaid_io_out(&bus, ALTAID_PORT_ROM_HI, (uint8_t)((combo >> 1) & 1u));
+		altaid_io_out(&bus, ALTAID_PORT_B15, (uint8_t)((combo >> 2) & 1u));
+		altaid_io_out(&bus, ALTAID_PORT_B16, (uint8_t)((combo >> 3) & 1u));
+		altaid_io_out(&bus, ALTAID_PORT_B17, (uint8_t)((combo >> 4) & 1u));
+		altaid_io_out(&bus, ALTAID_PORT_B18, (uint8_t)((combo >> 5) & 1u));
+
+		for (uint32_t a = 0; a < 0x10000u; a += 0x00FBu) {
+			uint16_t addr = (uint16_t)a;
+			const uint8_t *rp = bus.rd_page[addr >> I8080_PAGE_SHIFT];
+			uint8_t *wp = bus.wr_page[addr >> I8080_PAGE_SHIFT];
+
+			if (rp[addr & I8080_PAGE_MASK] != altaid_mem_read(&bus, addr))
+				mismatches++;
+			if (&wp[addr & I8080_PAGE_MASK] != &hw.ram[hw.ram_bank][addr])
+				mismatches++;
+			if (&bus.wr_dirty[addr >> I8080_PAGE_SHIFT]
+				[(addr & I8080_PAGE_MASK) >> 8] !=
+			    &hw.ram_dirty[((uint32_t)hw.ram_bank << 8) | (addr >> 8)])
+				mismatches++;
+		}
+	}
+
+	_it_should(
+		"page tables match mem_read/mem_write for every bank mapping",
+		0u == mismatches
+	);
+
+	/* Restoring mapping fields directly needs an explicit remap. */
+	hw.rom_low_mapped = true;
+	hw.rom_half = 1;
+	altaid_hw_remap(&hw);
+	_it_should(
+		"remap follows directly restored mapping fields",
+		hw.rom[1] == hw.rd_page[0]
+	);
+
+	return NULL;
+}
+
 static char *test_altaid_hw_altaid_hw_panel_press_key(void)
 {
 	AltaidHW hw;
@@ -282,6 +362,7 @@ static char *run_tests(void)
 	_run_test(test_altaid_hw_altaid_mem_write);
 	_run_test(test_altaid_hw_altaid_io_in);
 	_run_test(test_altaid_hw_altaid_io_out);
+	_run_test(test_altaid_hw_altaid_hw_remap);
 	_run_test(test_altaid_hw_altaid_hw_panel_press_key);
 	_run_test(test_altaid_hw_altaid_hw_panel_tick);
 	_run_test(test_altaid_hw_altaid_hw_panel_addr16);
@@ -0,0 +1,308 @@
+/* SPDX-License-Identifier: MIT */
+
+/*
+ * batch.spec.c
+ *
+ * Unit tests for the --batch manifest parser and job runner.
+ */
+
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "i8080.c"
+#include "serial.c"
+#include "cassette.c"
+#include "wav.c"
+#include "altaid_hw.c"
+#include "emu_core.c"
+#include "serial_routing.c"
+#include "timeutil.c"
+#include "batch.c"
+
+#include "test-runner.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Stub log_printf: altaid_hw.c's debug path is never triggered in tests. */
+void log_printf(const char *fmt, ...)
+{
+	(void)fmt;
+}
+
+/* Bit-bang 'A', 'B', 'C', ... on OUT 0xC0 at 9600 baud (2 MHz). */
+static const uint8_t k_tx_prog[] = {
+	0x31, 0x00, 0xF0,	/* 0000 LXI SP,F000 */
+	0x0E, 0x41,		/* 0003 MVI C,'A' */
+	0x3E, 0x00,		/* 0005 MVI A,0 (start bit) */
+	0xD3, 0xC0,		/* 0007 OUT C0 */
+	0xCD, 0x24, 0x00,	/* 0009 CALL delay */
+	0x06, 0x08,		/* 000C MVI B,8 */
+	0x79,			/* 000E MOV A,C */
+	0x0F,			/* 000F RRC (data bit -> bit7) */
+	0xD3, 0xC0,		/* 0010 OUT C0 */
+	0xCD, 0x24, 0x00,	/* 0012 CALL delay */
+	0x05,			/* 0015 DCR B */
+	0xC2, 0x0F, 0x00,	/* 0016 JNZ bit */
+	0x3E, 0x80,		/* 0019 MVI A,80 (stop bit) */
+	0xD3, 0xC0,		/* 001B OUT C0 */
+	0xCD, 0x24, 0x00,	/* 001D CALL delay */
+	0x0C,			/* 0020 INR C */
+	0xC3, 0x05, 0x00,	/* 0021 JMP char */
+	0x16, 0x0A,		/* 0024 MVI D,10 */
+	0x15,			/* 0026 DCR D */
+	0xC2, 0x26, 0x00,	/* 0027 JNZ dl */
+	0xC9,			/* 002A RET */
+};
+
+static int make_temp_path(char *out, size_t cap)
+{
+	int fd;
+
+	if (!out || cap < 32)
+		return -1;
+
+	snprintf(out, cap, "/tmp/altaid-test-XXXXXX");
+	fd = mkstemp(out);
+	if (fd < 0)
+		return -1;
+	close(fd);
+	return 0;
+}
+
+static int write_tx_rom(const char *path)
+{
+	static uint8_t rom[0x10000];
+	FILE *f;
+	size_t n;
+
+	memset(rom, 0, sizeof(rom));
+	memcpy(rom, k_tx_prog, sizeof(k_tx_prog));
+
+	f = fopen(path, "wb");
+	if (!f)
+		return -1;
+	n = fwrite(rom, 1, sizeof(rom), f);
+	fclose(f);
+	return n == sizeof(rom) ? 0 : -1;
+}
+
+static void job_defaults(struct BatchJob *d)
+{
+	memset(d, 0, sizeof(*d));
+	d->rom_path = "default.rom";
+	d->cpu_hz = 2000000u;
+	d->baud = 9600u;
+	d->run_ms = BATCH_DEFAULT_RUN_MS;
+	d->hold_ms = 300u;
+}
+
+static char *test_parse_line_inherits_defaults(void)
+{
+	struct BatchJob d;
+	struct BatchJob job;
+	char err[128];
+
+	job_defaults(&d);
+
+	_it_should(
+		"blank and comment lines yield no job",
+		0 == batch_parse_line("   \n", &d, &job, err, sizeof(err))
+		&& 0 == batch_parse_line("# all comment\n", &d, &job,
+					 err, sizeof(err))
+	);
+
+	_it_should(
+		"parse a job that overrides some fields",
+		1 == batch_parse_line("boot in=a.txt run-ms=50 hz=4000000 # x\n",
+				      &d, &job, err, sizeof(err))
+		&& 0 == strcmp("boot", job.name)
+		&& 0 == strcmp("default.rom", job.rom_path)
+		&& 0 == strcmp("a.txt", job.in_path)
+		&& NULL == job.out_path
+		&& 50u == job.run_ms
+		&& 4000000u == job.cpu_hz
+		&& 9600u == job.baud
+	);
+	job_free(&job);
+
+	return NULL;
+}
+
+static char *test_parse_line_rejects_bad_fields(void)
+{
+	struct BatchJob d;
+	struct BatchJob job;
+	char err[128];
+
+	job_defaults(&d);
+
+	_it_should(
+		"reject unknown keys",
+		-1 == batch_parse_line("j color=red", &d, &job, err, sizeof(err))
+	);
+
+	_it_should(
+		"reject zero run-ms",
+		-1 == batch_parse_line("j run-ms=0", &d, &job, err, sizeof(err))
+	);
+
+	_it_should(
+		"reject a missing job name",
+		-1 == batch_parse_line("rom=x.rom", &d, &job, err, sizeof(err))
+	);
+
+	d.rom_path = NULL;
+	_it_should(
+		"reject a job with no ROM",
+		-1 == batch_parse_line("j run-ms=5", &d, &job, err, sizeof(err))
+	);
+
+	return NULL;
+}
+
+static char *test_manifest_load(void)
+{
+	struct BatchManifest m;
+	struct BatchJob d;
+	char path[64];
+	char err[256];
+	FILE *f;
+	bool ok;
+
+	if (make_temp_path(path, sizeof(path)) != 0)
+		return "mkstemp() failed";
+	f = fopen(path, "w");
+	if (!f)
+		return "fopen() failed";
+	fputs("# regression jobs\n\none rom=a.rom\ntwo out=two.txt\n", f);
+	fclose(f);
+
+	job_defaults(&d);
+	ok = batch_manifest_load(&m, path, &d, err, sizeof(err));
+
+	_it_should(
+		"load every job in order",
+		ok && 2u == m.count
+		&& 0 == strcmp("one", m.jobs[0].name)
+		&& 0 == strcmp("a.rom", m.jobs[0].rom_path)
+		&& 0 == strcmp("two", m.jobs[1].name)
+		&& 0 == strcmp("default.rom", m.jobs[1].rom_path)
+		&& 0 == strcmp("two.txt", m.jobs[1].out_path)
+	);
+	batch_manifest_free(&m);
+
+	f = fopen(path, "w");
+	if (!f)
+		return "fopen() failed";
+	fputs("one\nbroken run-ms=x\n", f);
+	fclose(f);
+
+	_it_should(
+		"report the failing line",
+		!batch_manifest_load(&m, path, &d, err, sizeof(err))
+		&& NULL != strstr(err, ":2: ")
+		&& 0u == m.count
+	);
+
+	remove(path);
+	return NULL;
+}
+
+static char *test_pool_runs_jobs(void)
+{
+	struct BatchManifest m;
+	struct BatchPool pool;
+	pthread_t tid;
+	char rom[64];
+	char out[64];
+	char buf[8];
+	size_t n = 0;
+	FILE *f;
+
+	if (make_temp_path(rom, sizeof(rom)) != 0 ||
+	    make_temp_path(out, sizeof(out)) != 0)
+		return "mkstemp() failed";
+	if (write_tx_rom(rom) != 0)
+		return "write rom failed";
+
+	memset(&m, 0, sizeof(m));
+	m.count = 3;
+	m.jobs = calloc(m.count, sizeof(*m.jobs));
+	if (!m.jobs)
+		return "calloc() failed";
+	for (size_t i = 0; i < m.count; i++) {
+		job_defaults(&m.jobs[i]);
+		m.jobs[i].rom_path = str_dup(rom);
+		m.jobs[i].run_ms = 20u;
+	}
+	m.jobs[0].out_path = str_dup(out);
+	free(m.jobs[2].rom_path);
+	m.jobs[2].rom_path = str_dup("/nonexistent/altaid.rom");
+
+	pool.m = &m;
+	pool.next = 0;
+	pthread_mutex_init(&pool.lock, NULL);
+	if (pthread_create(&tid, NULL, batch_worker, &pool) != 0)
+		return "pthread_create() failed";
+	batch_worker(&pool);
+	pthread_join(tid, NULL);
+	pthread_mutex_destroy(&pool.lock);
+
+	f = fopen(out, "rb");
+	if (f) {
+		n = fread(buf, 1, sizeof(buf), f);
+		fclose(f);
+	}
+
+	_it_should(
+		"jobs run to their deadline",
+		m.jobs[0].ok && m.jobs[1].ok
+		&& 40000u <= m.jobs[0].ticks
+		&& m.jobs[0].ticks == m.jobs[1].ticks
+	);
+
+	_it_should(
+		"TX is captured to the out file",
+		0u < m.jobs[0].tx_bytes
+		&& m.jobs[0].tx_bytes == m.jobs[1].tx_bytes
+		&& 3u <= n && 0 == memcmp(buf, "ABC", 3)
+	);
+
+	_it_should(
+		"a bad ROM fails only its own job",
+		!m.jobs[2].ok && NULL != strstr(m.jobs[2].err, "ROM")
+	);
+
+	batch_manifest_free(&m);
+	remove(rom);
+	remove(out);
+	return NULL;
+}
+
+static char *test_rates_past_usec_wrap(void)
+{
+	/* Two hours: past where a 32-bit usec clock wraps (~71 min). */
+	uint64_t wall_nsec = 7200ull * 1000000000ull;
+
+	_it_should("rate long runs without wrapping",
+		   10.0 == per_usec(72000ull * 1000000ull, wall_nsec));
+	_it_should("rate an untimed run as zero", 0.0 == per_usec(5u, 0u));
+
+	return NULL;
+}
+
+static char *run_tests(void)
+{
+	_run_test(test_parse_line_inherits_defaults);
+	_run_test(test_parse_line_rejects_bad_fields);
+	_run_test(test_manifest_load);
+	_run_test(test_pool_runs_jobs);
+	_run_test(test_rates_past_usec_wrap);
+
+	return NULL;
+}
@@ -3,7 +3,7 @@
 /*
  * cassette.spec.c
  *
- * Unit tests for cassette helpers (no file I/O).
+ * Unit tests for cassette transport and tape files.
  */
 
 #ifndef _GNU_SOURCE
@@ -15,6 +15,7 @@
 #endif
 
 #include "cassette.c"
+#include "wav.c"
 
 #include "test-runner.h"
 
@@ -92,8 +93,8 @@ static char *test_cassette_record_stop_status(void)
 	_it_should(
 		"record pushes durations",
 		2u == c.dur_count
-		&& 10u == c.durations[0]
-		&& 30u == c.durations[1]
+		&& 10u == cassette_duration(&c, 0)
+		&& 30u == cassette_duration(&c, 1)
 	);
 
 	cassette_stop(&c);
@@ -156,12 +157,14 @@ static char *test_cassette_ff_skips_edges(void)
 
 	cassette_ff(&c, 1u, 0u);
 
+	/* 15 ticks in lands inside the second edge, which ends at 20. */
 	_it_should(
 		"ff advances play index",
 		1u == c.play_index
 		&& false == c.play_level
-		&& 20u == c.play_next_edge_tick
+		&& 5u == c.play_next_edge_tick
 		&& false == c.in_level
+		&& 15u == cassette_position(&c, 0u)
 	);
 
 	cassette_free(&c);
@@ -184,9 +187,9 @@ static char *test_cassette_round_trip_playback(void)
 	_it_should(
 		"recorded transcript has three durations",
 		3u == c.dur_count
-		&& 5u == c.durations[0]
-		&& 10u == c.durations[1]
-		&& 15u == c.durations[2]
+		&& 5u == cassette_duration(&c, 0)
+		&& 10u == cassette_duration(&c, 1)
+		&& 15u == cassette_duration(&c, 2)
 	);
 
 	cassette_start_play(&c, 100u);
@@ -376,8 +379,8 @@ static char *test_cassette_open_truncated_durations_loads_partial(void)
 		true == ok
 		&& true == c.attached
 		&& 2u == c.dur_count
-		&& 42u == c.durations[0]
-		&& 99u == c.durations[1]
+		&& 42u == cassette_duration(&c, 0)
+		&& 99u == cassette_duration(&c, 1)
 	);
 
 	unlink(path);
@@ -419,9 +422,9 @@ static char *test_cassette_file_round_trip(void)
 		true == ok
 		&& true == dst.attached
 		&& 3u == dst.dur_count
-		&& 4u == dst.durations[0]
-		&& 5u == dst.durations[1]
-		&& 11u == dst.durations[2]
+		&& 4u == cassette_duration(&dst, 0)
+		&& 5u == cassette_duration(&dst, 1)
+		&& 11u == cassette_duration(&dst, 2)
 	);
 
 	unlink(path);
@@ -430,6 +433,455 @@ static char *test_cassette_file_round_trip(void)
 	return NULL;
 }
 
+static char *test_cassette_streams_to_disk(void)
+{
+	static Cassette rec;
+	static Cassette peek;
+	char path[64];
+	uint64_t t = 0;
+	bool ok = true;
+	size_t n = 3u * CASSETTE_WINDOW + 5u;
+	uint64_t h;
+
+	if (make_temp_path(path, sizeof(path)) != 0)
+		return "mkstemp() failed";
+
+	cassette_init(&rec, 2000000u);
+	cassette_open(&rec, path);
+	cassette_start_record(&rec, 0u);
+	for (size_t i = 0; i < CASSETTE_WINDOW + 1u; i++) {
+		t += 100u + i % 7u;
+		cassette_on_out_change(&rec, t, (i & 1u) == 0);
+	}
+
+	/* A second reader sees the flushed window before the recording ends. */
+	cassette_init(&peek, 0u);
+	cassette_open(&peek, path);
+	_it_should(
+		"write full buffers through to the file while recording",
+		CASSETTE_WINDOW == peek.dur_count
+		&& 100u == cassette_duration(&peek, 0)
+		&& 100u + (CASSETTE_WINDOW - 1u) % 7u
+			== cassette_duration(&peek, CASSETTE_WINDOW - 1u)
+	);
+	cassette_free(&peek);
+
+	for (size_t i = CASSETTE_WINDOW + 1u; i < n; i++) {
+		t += 100u + i % 7u;
+		cassette_on_out_change(&rec, t, (i & 1u) == 0);
+	}
+	cassette_stop(&rec);
+	cassette_free(&rec);
+
+	cassette_init(&peek, 0u);
+	cassette_open(&peek, path);
+	for (size_t i = n; i-- > 0;)
+		ok = ok && 100u + i % 7u == cassette_duration(&peek, i);
+	_it_should(
+		"play back every edge across windows, in any order",
+		n == peek.dur_count && ok
+		&& 0u == cassette_duration(&peek, n)
+	);
+
+	_it_should(
+		"reattach for a state's edge count without cutting the tape",
+		cassette_reattach(&peek, path, 10u) && n == peek.dur_count
+		&& !cassette_reattach(&peek, path, n + 1u)
+	);
+
+	h = cassette_hash(&peek, 10u);
+	_it_should(
+		"fork a temp-backed copy ending at that count",
+		cassette_fork(&peek, 10u) && peek.fd_temp
+		&& h == cassette_hash(&peek, 10u)
+		&& h != cassette_hash(&peek, 9u)
+		&& 10u == peek.dur_count
+		&& 0u == cassette_duration(&peek, 10u)
+		&& 100u + 9u % 7u == cassette_duration(&peek, 9u)
+	);
+	cassette_free(&peek);
+
+	cassette_init(&peek, 0u);
+	cassette_open(&peek, path);
+	_it_should(
+		"leave the file with every edge",
+		n == peek.dur_count
+	);
+	cassette_free(&peek);
+	unlink(path);
+	return NULL;
+}
+
+static off_t file_size(const char *path)
+{
+	struct stat st;
+
+	return stat(path, &st) == 0 ? st.st_size : -1;
+}
+
+/* Record n edges of a 1200/2400 Hz style pulse train at path. */
+static void record_pulse_train(const char *path, size_t n)
+{
+	static Cassette rec;
+	uint64_t t = 0;
+
+	cassette_init(&rec, 2000000u);
+	cassette_open(&rec, path);
+	cassette_start_record(&rec, 0u);
+	for (size_t i = 0; i < n; i++) {
+		t += (i / 64u) % 2u ? 833u : 417u;
+		cassette_on_out_change(&rec, t, (i & 1u) == 0);
+	}
+	cassette_stop(&rec);
+	cassette_free(&rec);
+}
+
+static char *test_cassette_block_codec(void)
+{
+	static uint32_t d[CASSETTE_WINDOW];
+	static uint32_t out[CASSETTE_WINDOW];
+	static uint8_t buf[CAS_BLK_MAX];
+	static const uint8_t bad_run[] = { 0x03 };
+	uint32_t x = 777u;
+	size_t len;
+
+	for (size_t i = 0; i < CASSETTE_WINDOW; i++)
+		d[i] = (i / 16u) % 2u ? 833u : 417u;
+	len = blk_encode(d, CASSETTE_WINDOW, buf);
+	_it_should(
+		"code runs of equal half-cycles in well under a byte an edge",
+		len < CASSETTE_WINDOW / 2u && blk_decode(buf, len, out, CASSETTE_WINDOW)
+		&& 0 == memcmp(d, out, sizeof(d))
+	);
+
+	for (size_t i = 0; i < CASSETTE_WINDOW; i++) {
+		x = x * 1103515245u + 12345u;
+		d[i] = i % 5u ? x : (i % 2u ? 0u : UINT32_MAX);
+	}
+	len = blk_encode(d, CASSETTE_WINDOW, buf);
+	_it_should(
+		"round-trip arbitrary durations within the block bound",
+		len <= CAS_BLK_MAX && blk_decode(buf, len, out, CASSETTE_WINDOW)
+		&& 0 == memcmp(d, out, sizeof(d))
+	);
+
+	_it_should(
+		"reject truncated payloads and runs with nothing to repeat",
+		!blk_decode(buf, len - 1u, out, CASSETTE_WINDOW)
+		&& !blk_decode(buf, len, out, CASSETTE_WINDOW - 1u)
+		&& !blk_decode(bad_run, sizeof(bad_run), out, 2u)
+	);
+
+	return NULL;
+}
+
+static char *test_cassette_convert_formats(void)
+{
+	static Cassette a;
+	static Cassette b;
+	char p2[64], p1[64], p3[64];
+	size_t n = 3u * CASSETTE_WINDOW + 5u;
+	bool same = true;
+	int fd;
+
+	if (make_temp_path(p2, sizeof(p2)) != 0 ||
+	    make_temp_path(p1, sizeof(p1)) != 0 ||
+	    make_temp_path(p3, sizeof(p3)) != 0)
+		return "mkstemp() failed";
+
+	record_pulse_train(p2, n);
+	_it_should(
+		"record new tapes as compact ALTAP002",
+		file_size(p2) < (off_t)(n * sizeof(uint32_t)) / 8
+	);
+
+	_it_should(
+		"convert to ALTAP001 and back",
+		cassette_convert(p2, p1, 1u, 2000000u, CASSETTE_WAV_RATE)
+		&& file_size(p1) == (off_t)(sizeof(CassFileHdr) + 4u * n)
+		&& cassette_convert(p1, p3, 2u, 2000000u, CASSETTE_WAV_RATE)
+		&& file_size(p3) == file_size(p2)
+		&& !cassette_convert(p1, p1, 2u, 2000000u, CASSETTE_WAV_RATE)
+	);
+
+	cassette_init(&a, 0u);
+	cassette_init(&b, 0u);
+	cassette_open(&a, p1);
+	cassette_open(&b, p3);
+	for (size_t i = 0; i < n; i++)
+		same = same && cassette_duration(&a, i) == cassette_duration(&b, i);
+	_it_should(
+		"keep every edge and the header fields",
+		1u == a.version && 2u == b.version
+		&& n == a.dur_count && n == b.dur_count && same
+		&& 2000000u == b.cpu_hz && 417u == cassette_duration(&b, 0)
+	);
+	cassette_free(&a);
+	cassette_free(&b);
+
+	/* A crash before the index was written: header index_off is 0. */
+	fd = open(p3, O_RDWR);
+	if (fd < 0 || !pwrite_all(fd, "\0\0\0\0\0\0\0\0", 8, 24)) {
+		if (fd >= 0)
+			close(fd);
+		return "pwrite() failed";
+	}
+	close(fd);
+	cassette_open(&b, p3);
+	_it_should(
+		"rebuild the block index from the blocks when it is missing",
+		n == b.dur_count && 4u == b.nblocks
+		&& 417u == cassette_duration(&b, n - 1u)
+	);
+	cassette_free(&b);
+
+	unlink(p1);
+	unlink(p2);
+	unlink(p3);
+	return NULL;
+}
+
+static char *test_cassette_seek_by_time(void)
+{
+	static Cassette c;
+	char path[64];
+	size_t n = 5u * CASSETTE_WINDOW + 3u;
+	uint64_t t = 0;
+	size_t want = 0;
+
+	if (make_temp_path(path, sizeof(path)) != 0)
+		return "mkstemp() failed";
+	record_pulse_train(path, n);
+
+	cassette_init(&c, 0u);
+	cassette_open(&c, path);
+	_it_should(
+		"know the tape length on open",
+		c.tape_ticks == cassette_tick_at(&c, n)
+		&& 6u == c.nblocks
+		&& 417u == cassette_tick_at(&c, 1u)
+	);
+
+	/* The edge under the head 1 s in, by walking every edge. */
+	while (t + cassette_duration(&c, want) <= 2000000u)
+		t += cassette_duration(&c, want++);
+
+	cassette_start_play(&c, 100u);
+	cassette_ff(&c, 1u, 100u);
+	_it_should(
+		"fast-forward to the edge under the new position",
+		want > 2u * CASSETTE_WINDOW && want == c.play_index
+		&& (want % 2u ? !c.idle_level : c.idle_level) == c.play_level
+		&& 100u + t + cassette_duration(&c, want) - 2000000u
+			== c.play_next_edge_tick
+		&& 2000000u == cassette_position(&c, 100u)
+	);
+
+	cassette_in_level_at(&c, 100u + 5000u);
+	cassette_reverse(&c, 1u, 100u + 5000u);
+	_it_should(
+		"reverse by the same amount from the current position",
+		5000u == cassette_position(&c, 100u + 5000u)
+		&& cassette_tick_at(&c, c.play_index) <= 5000u
+		&& cassette_tick_at(&c, c.play_index + 1u) > 5000u
+	);
+
+	cassette_seek(&c, c.tape_ticks + 1u, 0u);
+	_it_should(
+		"clamp a seek past the end to the end of the tape",
+		n == c.play_index && c.tape_ticks == cassette_position(&c, 0u)
+	);
+
+	cassette_free(&c);
+	unlink(path);
+	return NULL;
+}
+
+static char *test_cassette_index_while_recording(void)
+{
+	static Cassette c;
+	char p1[64], p2[64];
+	size_t n = 2u * CASSETTE_WINDOW + 10u;
+	uint64_t len;
+
+	if (make_temp_path(p2, sizeof(p2)) != 0 ||
+	    make_temp_path(p1, sizeof(p1)) != 0)
+		return "mkstemp() failed";
+	record_pulse_train(p2, n);
+	if (!cassette_convert(p2, p1, 1u, 2000000u, CASSETTE_WAV_RATE))
+		return "cassette_convert() failed";
+
+	/* Extend an ALTAP001 tape: its checkpoints come from the scan. */
+	cassette_init(&c, 0u);
+	cassette_open(&c, p1);
+	len = c.tape_ticks;
+	for (size_t i = 0; i < CASSETTE_WINDOW; i++)
+		cassette_append(&c, 1000u);
+	_it_should(
+		"keep checkpoints and length current as edges are appended",
+		4u == c.nblocks && len + 1000u * CASSETTE_WINDOW == c.tape_ticks
+		&& cassette_tick_at(&c, 3u * CASSETTE_WINDOW)
+			== c.blocks[3].tick
+		&& len + 1000u * (3u * CASSETTE_WINDOW - n)
+			== c.blocks[3].tick
+	);
+
+	cassette_fork(&c, CASSETTE_WINDOW + 1u);
+	_it_should(
+		"shorten the index of a forked copy",
+		2u == c.nblocks
+		&& cassette_tick_at(&c, CASSETTE_WINDOW) + 417u == c.tape_ticks
+	);
+
+	cassette_free(&c);
+	unlink(p1);
+	unlink(p2);
+	return NULL;
+}
+
+/* Write a canonical 44-byte-header WAV file around len bytes of data. */
+static bool write_wav(const char *path, unsigned tag, unsigned channels,
+		      unsigned bits, uint32_t rate, const uint8_t *data,
+		      uint32_t len)
+{
+	uint8_t h[44];
+	unsigned align = channels * bits / 8u;
+	bool ok;
+	int fd;
+
+	memcpy(h, "RIFF", 4);
+	wav_put32(h + 4, 36u + len);
+	memcpy(h + 8, "WAVEfmt ", 8);
+	wav_put32(h + 16, 16u);
+	wav_put16(h + 20, tag);
+	wav_put16(h + 22, channels);
+	wav_put32(h + 24, rate);
+	wav_put32(h + 28, rate * align);
+	wav_put16(h + 32, align);
+	wav_put16(h + 34, bits);
+	memcpy(h + 36, "data", 4);
+	wav_put32(h + 40, len);
+
+	fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0666);
+	if (fd < 0)
+		return false;
+	ok = wav_write(fd, h, sizeof(h), 0) && wav_write(fd, data, len, 44);
+	close(fd);
+	return ok;
+}
+
+static char *test_cassette_wav_round_trip(void)
+{
+	static Cassette ref;
+	static Cassette c;
+	char base[64], pw[80], p2[64];
+	size_t n = 2u * CASSETTE_WINDOW + 7u;
+	uint64_t slop = 2000000u / CASSETTE_WAV_RATE + 1u;
+	uint64_t frames;
+	bool close_enough = true;
+	uint8_t magic[4] = { 0 };
+	int fd;
+
+	if (make_temp_path(base, sizeof(base)) != 0 ||
+	    make_temp_path(p2, sizeof(p2)) != 0)
+		return "mkstemp() failed";
+	unlink(base);
+	snprintf(pw, sizeof(pw), "%s.WAV", base);
+
+	/* The .wav name picks the format for a tape that does not exist yet. */
+	record_pulse_train(pw, n);
+	if (!cassette_convert(pw, p2, 2u, 2000000u, CASSETTE_WAV_RATE))
+		return "cassette_convert() failed";
+	fd = open(pw, O_RDONLY);
+	if (fd >= 0) {
+		(void)wav_read(fd, magic, sizeof(magic), 0);
+		close(fd);
+	}
+	cassette_init(&ref, 0u);
+	cassette_init(&c, 2000000u);
+	cassette_open(&c, pw);
+	for (uint64_t t = 0, i = 0; i < n; i++) {
+		t += (i / 64u) % 2u ? 833u : 417u;
+		close_enough = close_enough && i < c.dur_count
+			&& cassette_tick_at(&c, i + 1u) + slop > t
+			&& cassette_tick_at(&c, i + 1u) < t + slop;
+	}
+	frames = (c.tape_ticks * CASSETTE_WAV_RATE + 1999999u) / 2000000u;
+	_it_should(
+		"record to a .wav path as 16-bit PCM audio",
+		0 == memcmp(magic, "RIFF", 4) && c.wav
+		&& file_size(pw) >= (off_t)(44u + 2u * frames)
+		&& file_size(pw) <= (off_t)(44u + 2u * (frames + 2u))
+	);
+	_it_should(
+		"decode every edge back to within one sample period",
+		n == c.dur_count && close_enough
+	);
+
+	cassette_open(&ref, p2);
+	_it_should(
+		"convert a WAV to ALTAP002 with the same edges",
+		2u == ref.version && n == ref.dur_count
+		&& 2000000u == ref.cpu_hz
+		&& cassette_tick_at(&ref, n) == c.tape_ticks
+	);
+
+	cassette_free(&c);
+	cassette_free(&ref);
+	unlink(pw);
+	unlink(p2);
+	return NULL;
+}
+
+static char *test_cassette_wav_import_formats(void)
+{
+	static Cassette c;
+	static uint8_t pcm[2u * 400u];
+	char p[64];
+	bool even = true;
+
+	if (make_temp_path(p, sizeof(p)) != 0)
+		return "mkstemp() failed";
+
+	/*
+	 * 8-bit stereo at 8 kHz: a square wave of 10 samples per half cycle
+	 * on the left, riding 22 LSBs of DC with one LSB of hiss; the right
+	 * channel is noise the decoder must ignore.
+	 */
+	for (size_t i = 0; i < 400u; i++) {
+		int v = 150 + ((i / 10u) % 2u ? -100 : 100) + (int)(i & 1u);
+
+		pcm[2u * i] = (uint8_t)v;
+		pcm[2u * i + 1u] = (uint8_t)(i * 37u);
+	}
+	if (!write_wav(p, 1u, 2u, 8u, 8000u, pcm, sizeof(pcm)))
+		return "write_wav() failed";
+
+	/* No .wav suffix: the RIFF header identifies it. */
+	cassette_init(&c, 2000000u);
+	cassette_open(&c, p);
+	for (size_t i = 0; i < c.dur_count; i++)
+		even = even && 2500u == cassette_duration(&c, i);
+	_it_should(
+		"decode 8-bit multichannel PCM from the first channel",
+		c.wav && 39u == c.dur_count && even
+	);
+	cassette_free(&c);
+
+	if (!write_wav(p, 3u, 1u, 16u, 8000u, pcm, sizeof(pcm)))
+		return "write_wav() failed";
+	cassette_init(&c, 2000000u);
+	cassette_open(&c, p);
+	_it_should(
+		"attach an empty tape for WAV encodings it cannot read",
+		c.attached && 0u == c.dur_count && c.fd < 0
+	);
+	cassette_free(&c);
+
+	unlink(p);
+	return NULL;
+}
+
 static char *run_tests(void)
 {
 	_run_test(test_cassette_init_defaults);
@@ -443,6 +895,13 @@ static char *run_tests(void)
 	_run_test(test_cassette_open_wrong_version_attaches_empty);
 	_run_test(test_cassette_open_truncated_durations_loads_partial);
 	_run_test(test_cassette_file_round_trip);
+	_run_test(test_cassette_streams_to_disk);
+	_run_test(test_cassette_block_codec);
+	_run_test(test_cassette_convert_formats);
+	_run_test(test_cassette_seek_by_time);
+	_run_test(test_cassette_index_while_recording);
+	_run_test(test_cassette_wav_round_trip);
+	_run_test(test_cassette_wav_import_formats);
 
 	return NULL;
 }
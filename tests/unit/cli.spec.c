@@ -165,6 +165,8 @@ static char *test_parse_args_more_flags(void)
 		"--panel-hz", "60",
 		"--hz", "123456",
 		"--baud", "19200",
+		"--tx-overflow", "block",
+		"--rx-baud", "38400",
 		"--hold", "10",
 		"--pty-input",
 		"--serial-out", "none",
@@ -176,7 +178,7 @@ static char *test_parse_args_more_flags(void)
 		"rom.bin",
 		NULL
 	};
-	int argc = 24;
+	int argc = 28;
 
 	reset_getopt();
 	_it_should(
@@ -190,6 +192,8 @@ static char *test_parse_args_more_flags(void)
 		&& 60u == cfg.panel_hz
 		&& 123456u == cfg.cpu_hz
 		&& 19200u == cfg.baud
+		&& true == cfg.tx_block
+		&& 38400u == cfg.rx_baud
 		&& 10u == cfg.hold_ms
 		&& true == cfg.use_pty
 		&& true == cfg.pty_input
@@ -288,11 +292,12 @@ static char *test_parse_args_sets_cassette_and_persistence_specs(void)
 		"--load", "ram@0x0100:test.bin",
 		"--load", "ram@2.0x2000:lib.bin",
 		"--save", "ram:snapshot.ram",
+		"--save", "ramz:snapshot.ramz",
 		"--default", "ram@1.0x0000:altaid.ram",
 		"rom.bin",
 		NULL
 	};
-	int argc = 19;
+	int argc = 21;
 
 	reset_getopt();
 	_it_should(
@@ -312,12 +317,16 @@ static char *test_parse_args_sets_cassette_and_persistence_specs(void)
 		&& IO_SPEC_RAM == cfg.load_specs[2].kind
 		&& 2u == cfg.load_specs[2].bank
 		&& 0x2000u == cfg.load_specs[2].addr
-		&& 2u == cfg.save_count
+		&& 3u == cfg.save_count
 		&& IO_SPEC_STATE == cfg.save_specs[0].kind
 		&& 0 == strcmp(cfg.save_specs[0].path, "save.state")
 		&& IO_SPEC_RAM == cfg.save_specs[1].kind
 		&& false == cfg.save_specs[1].has_addr
 		&& 0 == strcmp(cfg.save_specs[1].path, "snapshot.ram")
+		&& false == cfg.save_specs[1].packed
+		&& IO_SPEC_RAM == cfg.save_specs[2].kind
+		&& true == cfg.save_specs[2].packed
+		&& 0 == strcmp(cfg.save_specs[2].path, "snapshot.ramz")
 		&& 2u == cfg.default_count
 		&& IO_SPEC_STATE == cfg.default_specs[0].kind
 		&& 0 == strcmp(cfg.default_specs[0].path, "altaid.state")
@@ -458,6 +467,177 @@ static char *test_parse_args_help_version_without_rom(void)
 	return NULL;
 }
 
+static char *test_parse_args_batch(void)
+{
+	struct Config cfg;
+	char *argv[] = { "prog", "--batch", "jobs.txt", "--jobs", "4", NULL };
+	char *argv_bad[] = { "prog", "--batch", "jobs.txt", "--jobs", "x", NULL };
+
+	reset_getopt();
+	_it_should(
+		"--batch parses without ROM positional arg",
+		0 == cli_parse_args(5, argv, &cfg)
+		&& 0 == strcmp("jobs.txt", cfg.batch_path)
+		&& 4u == cfg.batch_threads
+		&& NULL == cfg.rom_path
+	);
+
+	reset_getopt();
+	_it_should(
+		"--jobs rejects non-numeric values",
+		-2 == cli_parse_args(5, argv_bad, &cfg)
+	);
+
+	return NULL;
+}
+
+static char *test_parse_args_checkpoint(void)
+{
+	struct Config cfg;
+	char *argv[] = { "prog", "rom.bin", "--checkpoint", "run.ckpt",
+			 "--checkpoint-ms", "250", NULL };
+	char *argv_bad[] = { "prog", "rom.bin", "--checkpoint-ms", "0", NULL };
+
+	reset_getopt();
+	_it_should(
+		"--checkpoint sets path and period",
+		0 == cli_parse_args(6, argv, &cfg)
+		&& 0 == strcmp("run.ckpt", cfg.checkpoint_path)
+		&& 250u == cfg.checkpoint_ms
+	);
+
+	reset_getopt();
+	_it_should(
+		"--checkpoint-ms rejects zero",
+		-2 == cli_parse_args(4, argv_bad, &cfg)
+	);
+
+	return NULL;
+}
+
+static char *test_parse_args_rewind(void)
+{
+	struct Config cfg;
+	char *argv_def[] = { "prog", "rom.bin", NULL };
+	char *argv[] = { "prog", "rom.bin", "--rewind-mb", "0",
+			 "--rewind-ms", "20", "--rewind-step", "500", NULL };
+	char *argv_bad[] = { "prog", "rom.bin", "--rewind-step", "0", NULL };
+	char *argv_small[] = { "prog", "rom.bin", "--rewind-mb", "1", NULL };
+
+	reset_getopt();
+	_it_should(
+		"rewind buffer defaults to 16 MiB, 100 ms, 1 s steps",
+		0 == cli_parse_args(2, argv_def, &cfg)
+		&& 16u == cfg.rewind_mb && 100u == cfg.rewind_ms
+		&& 1000u == cfg.rewind_step_ms
+	);
+
+	reset_getopt();
+	_it_should(
+		"--rewind-* options set budget, interval and step",
+		0 == cli_parse_args(8, argv, &cfg)
+		&& 0u == cfg.rewind_mb && 20u == cfg.rewind_ms
+		&& 500u == cfg.rewind_step_ms
+	);
+
+	reset_getopt();
+	_it_should(
+		"--rewind-step rejects zero",
+		-2 == cli_parse_args(4, argv_bad, &cfg)
+	);
+
+	reset_getopt();
+	_it_should(
+		"--rewind-mb rejects budgets below one snapshot group",
+		-2 == cli_parse_args(4, argv_small, &cfg)
+	);
+
+	return NULL;
+}
+
+static char *test_parse_args_cass_rate(void)
+{
+	struct Config cfg;
+	char *argv_def[] = { "prog", "rom.bin", NULL };
+	char *argv[] = { "prog", "rom.bin", "--cass-rate", "22050", NULL };
+	char *argv_bad[] = { "prog", "rom.bin", "--cass-rate", "0", NULL };
+
+	reset_getopt();
+	_it_should(
+		"WAV tapes save at 44100 Hz by default",
+		0 == cli_parse_args(2, argv_def, &cfg)
+		&& 44100u == cfg.cassette_wav_rate
+	);
+
+	reset_getopt();
+	_it_should(
+		"--cass-rate sets the WAV sample rate",
+		0 == cli_parse_args(4, argv, &cfg)
+		&& 22050u == cfg.cassette_wav_rate
+	);
+
+	reset_getopt();
+	_it_should(
+		"--cass-rate rejects zero",
+		-2 == cli_parse_args(4, argv_bad, &cfg)
+	);
+
+	return NULL;
+}
+
+static char *test_parse_args_latency(void)
+{
+	struct Config cfg;
+	char *argv_def[] = { "prog", "rom.bin", NULL };
+	char *argv[] = { "prog", "rom.bin", "--latency-ms", "0", NULL };
+	char *argv_bad[] = { "prog", "rom.bin", "--latency-ms", "x", NULL };
+
+	reset_getopt();
+	_it_should(
+		"batches grow toward a 10 ms budget by default",
+		0 == cli_parse_args(2, argv_def, &cfg)
+		&& 10u == cfg.latency_ms
+	);
+
+	reset_getopt();
+	_it_should(
+		"--latency-ms 0 selects fixed batches",
+		0 == cli_parse_args(4, argv, &cfg)
+		&& 0u == cfg.latency_ms
+	);
+
+	reset_getopt();
+	_it_should(
+		"--latency-ms rejects a non-number",
+		-2 == cli_parse_args(4, argv_bad, &cfg)
+	);
+
+	return NULL;
+}
+
+static char *test_parse_args_threaded(void)
+{
+	struct Config cfg;
+	char *argv_def[] = { "prog", "rom.bin", NULL };
+	char *argv[] = { "prog", "rom.bin", "--threaded", NULL };
+
+	reset_getopt();
+	_it_should(
+		"run the core on the UI thread by default",
+		0 == cli_parse_args(2, argv_def, &cfg)
+		&& !cfg.threaded
+	);
+
+	reset_getopt();
+	_it_should(
+		"--threaded moves the core to its own thread",
+		0 == cli_parse_args(3, argv, &cfg)
+		&& cfg.threaded
+	);
+
+	return NULL;
+}
+
 static char *test_parse_args_rejects_extra_arg(void)
 {
 	struct Config cfg;
@@ -509,6 +689,8 @@ static char *test_parse_args_rejects_bad_values(void)
 	struct Config cfg;
 	char *argv_bad_mode[] = { "prog", "--panel-mode", "nope", "rom.bin", NULL };
 	char *argv_bad_flush[] = { "prog", "--log-flush", "2", "rom.bin", NULL };
+	char *argv_bad_tx[] = { "prog", "--tx-overflow", "wait", "rom.bin", NULL };
+	char *argv_bad_rx[] = { "prog", "--rx-baud", "0", "rom.bin", NULL };
 
 	reset_getopt();
 	_it_should(
@@ -522,6 +704,18 @@ static char *test_parse_args_rejects_bad_values(void)
 		-2 == cli_parse_args(4, argv_bad_flush, &cfg)
 	);
 
+	reset_getopt();
+	_it_should(
+		"reject bad tx overflow mode",
+		-2 == cli_parse_args(4, argv_bad_tx, &cfg)
+	);
+
+	reset_getopt();
+	_it_should(
+		"reject zero rx baud",
+		-2 == cli_parse_args(4, argv_bad_rx, &cfg)
+	);
+
 	return NULL;
 }
 
@@ -579,6 +773,12 @@ static char *run_tests(void)
 	_run_test(test_parse_args_serial_in);
 	_run_test(test_parse_args_defaults_serial_in_unset);
 	_run_test(test_parse_args_help_version_without_rom);
+	_run_test(test_parse_args_batch);
+	_run_test(test_parse_args_checkpoint);
+	_run_test(test_parse_args_rewind);
+	_run_test(test_parse_args_cass_rate);
+	_run_test(test_parse_args_latency);
+	_run_test(test_parse_args_threaded);
 	_run_test(test_parse_args_rejects_extra_arg);
 	_run_test(test_parse_args_rejects_bad_values);
 	_run_test(test_usage_emits_usage);
@@ -3,11 +3,163 @@
 /*
  * emu_core.spec.c
  *
- * Incomplete tests for emu_core.c functions.
+ * Tests for emu_core.c functions.
  */
 
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "i8080.c"
+#include "serial.c"
+#include "cassette.c"
+#include "wav.c"
+#include "altaid_hw.c"
+#include "emu_core.c"
+
 #include "test-runner.h"
-#include "emu_core.h"
+
+#include <string.h>
+
+/* Stub log_printf: altaid_hw.c's debug path is never triggered in tests. */
+void log_printf(const char *fmt, ...)
+{
+	(void)fmt;
+}
+
+/*
+ * Reference batch loop: every device serviced after every instruction.
+ * The scheduled emu_core_run_batch() must match it cycle for cycle.
+ */
+static void ref_run_batch(struct EmuCore *core, uint64_t batch_cycles)
+{
+	uint64_t batch_end = core->ser.tick + batch_cycles;
+
+	while (core->ser.tick < batch_end) {
+		int t;
+
+		core->ser.gate_inte = core->cpu.inte;
+		set_hw_lines(core);
+
+		t = i8080_step(&core->cpu, &core->bus);
+		serial_advance(&core->ser, (uint32_t)t);
+
+		if (core->ser.rx_irq_latched && core->cpu.inte) {
+			core->ser.rx_irq_latched = false;
+			i8080_intr_service(&core->cpu, &core->bus, 7);
+		}
+
+		serial_tick_tx(&core->ser, altaid_hw_tx_level(&core->hw),
+		txbuf_putch_cb, core);
+
+		if (core->cas_attached && core->hw.cassette_out_dirty) {
+			core->hw.cassette_out_dirty = false;
+			cassette_on_out_change(&core->cas, core->ser.tick,
+			core->hw.cassette_out_level);
+		}
+
+		altaid_hw_panel_tick(&core->hw, core->ser.tick);
+	}
+}
+
+/*
+ * Busy ROM: timer on, EI, then loop sampling IN 0x40 into RAM and echoing
+ * it rotated to OUT 0xC0 (TX + panel rows) and OUT 0x44 (cassette out).
+ * RST7 stores the input port at 0xC000.
+ */
+static const uint8_t k_busy_rom[] = {
+	0x31, 0x00, 0xF0,	/* 0000 LXI SP,F000 */
+	0x21, 0x00, 0xD0,	/* 0003 LXI H,D000 */
+	0x3E, 0x01,		/* 0006 MVI A,1 */
+	0xD3, 0x46,		/* 0008 OUT 46 */
+	0xFB,			/* 000A EI */
+	0xDB, 0x40,		/* 000B IN 40 */
+	0x77,			/* 000D MOV M,A */
+	0x23,			/* 000E INX H */
+	0x07,			/* 000F RLC */
+	0xD3, 0xC0,		/* 0010 OUT C0 */
+	0xD3, 0x44,		/* 0012 OUT 44 */
+	0xC3, 0x0B, 0x00,	/* 0014 JMP 000B */
+};
+
+static const uint8_t k_busy_isr[] = {
+	0xF5,			/* 0038 PUSH PSW */
+	0xDB, 0x40,		/* 0039 IN 40 */
+	0x32, 0x00, 0xC0,	/* 003B STA C000 */
+	0xF1,			/* 003E POP PSW */
+	0xFB,			/* 003F EI */
+	0xC9,			/* 0040 RET */
+};
+
+static void busy_core_init(struct EmuCore *core)
+{
+	emu_core_init(core, 2000000u, 9600u);
+	memcpy(core->hw.rom[0], k_busy_rom, sizeof(k_busy_rom));
+	memcpy(core->hw.rom[0] + 0x38, k_busy_isr, sizeof(k_busy_isr));
+
+	/* Attach a temp-backed tape and start playback. */
+	core->cas.attached = true;
+	for (uint32_t i = 0; i < 64u; i++)
+		cassette_append(&core->cas, 150u + (i * 37u) % 900u);
+	core->cas_attached = true;
+	cassette_start_play(&core->cas, 0);
+}
+
+static bool busy_core_equal(struct EmuCore *a, struct EmuCore *b)
+{
+	uint8_t ta[EMU_TXBUF_SIZE];
+	uint8_t tb[EMU_TXBUF_SIZE];
+	size_t na = emu_core_tx_pop(a, ta, sizeof(ta));
+	size_t nb = emu_core_tx_pop(b, tb, sizeof(tb));
+
+	return na == nb && 0 == memcmp(ta, tb, na)
+		&& a->ser.tick == b->ser.tick
+		&& a->cpu.pc == b->cpu.pc && a->cpu.a == b->cpu.a
+		&& a->cpu.f == b->cpu.f && a->cpu.inte == b->cpu.inte
+		&& a->cpu.h == b->cpu.h && a->cpu.l == b->cpu.l
+		&& a->ser.rx_qh == b->ser.rx_qh
+		&& a->ser.rx_active == b->ser.rx_active
+		&& a->ser.tx_active == b->ser.tx_active
+		&& a->next_timer_tick == b->next_timer_tick
+		&& a->hw.timer_level == b->hw.timer_level
+		&& a->hw.rx_level == b->hw.rx_level
+		&& a->hw.cassette_in_level == b->hw.cassette_in_level
+		&& a->cas.play_index == b->cas.play_index
+		&& 0 == memcmp(a->hw.fp_key_down, b->hw.fp_key_down,
+			sizeof(a->hw.fp_key_down))
+		&& 0 == memcmp(a->hw.ram[0], b->hw.ram[0], sizeof(a->hw.ram[0]));
+}
+
+/*
+* Idle ROM: timer on, EI, then poll IN 0x40 for a timer pulse. Each pulse
+* bumps a RAM pointer and echoes it to OUT 0xC0; every fourth one HALTs
+* until the next RX interrupt. The ISR is the busy ROM's.
+*/
+static const uint8_t k_idle_rom[] = {
+	0x31, 0x00, 0xF0,	/* 0000 LXI SP,F000 */
+	0x3E, 0x01,		/* 0003 MVI A,1 */
+	0xD3, 0x46,		/* 0005 OUT 46 */
+	0x21, 0x00, 0xD0,	/* 0007 LXI H,D000 */
+	0xFB,			/* 000A EI */
+	0xDB, 0x40,		/* 000B IN 40 */
+	0xE6, 0x20,		/* 000D ANI 20 */
+	0xC2, 0x0B, 0x00,	/* 000F JNZ 000B */
+	0x23,			/* 0012 INX H */
+	0x75,			/* 0013 MOV M,L */
+	0x7D,			/* 0014 MOV A,L */
+	0xD3, 0xC0,		/* 0015 OUT C0 */
+	0xE6, 0x03,		/* 0017 ANI 03 */
+	0xC2, 0x0B, 0x00,	/* 0019 JNZ 000B */
+	0x76,			/* 001C HLT */
+	0xC3, 0x0B, 0x00,	/* 001D JMP 000B */
+};
+
+static void idle_core_init(struct EmuCore *core)
+{
+	emu_core_init(core, 2000000u, 9600u);
+	memcpy(core->hw.rom[0], k_idle_rom, sizeof(k_idle_rom));
+	memcpy(core->hw.rom[0] + 0x38, k_busy_isr, sizeof(k_busy_isr));
+}
 
 static char *test_emu_core_txbuf_clear(void)
 {
@@ -24,6 +176,65 @@ static char *test_emu_core_emu_core_tx_pop(void)
 	return NULL;
 }
 
+static char *test_emu_core_tx_peek_commit(void)
+{
+	static struct EmuCore core;
+	struct EmuTxSpan span[2];
+	uint8_t out[8];
+	size_t n;
+
+	emu_core_init(&core, 2000000u, 9600u);
+
+	/* Start near the end of the ring so six bytes wrap. */
+	core.tx_r = EMU_TXBUF_SIZE - 2u;
+	core.tx_w = EMU_TXBUF_SIZE - 2u;
+	for (int i = 0; i < 6; i++)
+		txbuf_putch_cb('a' + i, &core);
+
+	n = emu_core_tx_peek(&core, span);
+	_it_should("peek sees every pending byte", 6u == n);
+	_it_should("peek splits at the ring end",
+		2u == span[0].len && 4u == span[1].len
+		&& 0 == memcmp(span[0].data, "ab", 2)
+		&& 0 == memcmp(span[1].data, "cdef", 4));
+
+	emu_core_tx_commit(&core, 3u);
+	n = emu_core_tx_pop(&core, out, sizeof(out));
+	_it_should("commit consumes from the front",
+		3u == n && 0 == memcmp(out, "def", 3));
+	_it_should("ring is empty after pop", 0u == emu_core_tx_peek(&core, span));
+
+	return NULL;
+}
+
+static char *test_emu_core_tx_overflow(void)
+{
+	static struct EmuCore core;
+	struct EmuTxSpan span[2];
+	uint64_t tick;
+
+	emu_core_init(&core, 2000000u, 9600u);
+	for (uint32_t i = 0; i < EMU_TXBUF_SIZE + 9u; i++)
+		txbuf_putch_cb('x', &core);
+
+	_it_should("full ring holds size - 1 bytes",
+		EMU_TXBUF_SIZE - 1u == emu_core_tx_peek(&core, span));
+	_it_should("drop mode counts lost bytes", 10u == core.tx_dropped);
+
+	core.cfg.tx_overflow = EMU_TX_BLOCK;
+	tick = core.ser.tick;
+	emu_core_run_batch(&core, 1000u);
+	_it_should("block mode stalls while the ring is full",
+		tick == core.ser.tick);
+
+	emu_core_tx_commit(&core, 1u);
+	emu_core_run_batch(&core, 1000u);
+	_it_should("block mode resumes once the host drains",
+		tick + 1000u <= core.ser.tick);
+
+	return NULL;
+}
+
 static char *test_emu_core_emu_core_init(void)
 {
 	return NULL;
@@ -44,8 +255,136 @@ static char *test_emu_core_set_hw_lines(void)
 	return NULL;
 }
 
+/*
+* Drive both cores through the same random batch sizes and host events.
+* Returns 0 if they stayed identical, else the 1-based failing batch.
+*/
+static unsigned run_against_ref(struct EmuCore *sched, struct EmuCore *ref,
+	unsigned batches)
+{
+	uint32_t rng = 12345u;
+
+	for (unsigned batch = 0; batch < batches; batch++) {
+		uint64_t cycles;
+
+		rng = rng * 1103515245u + 12345u;
+		cycles = 1u + ((rng >> 8) % 3000u);
+
+		/* Host-side events between batches, identical for both cores. */
+		if ((batch % 7u) == 0) {
+			serial_host_enqueue(&sched->ser, (uint8_t)batch);
+			serial_host_enqueue(&ref->ser, (uint8_t)batch);
+		}
+		if ((batch % 11u) == 0) {
+			altaid_hw_panel_press_key(&sched->hw, (uint8_t)(batch % 11u),
+				sched->ser.tick, 5000u);
+			altaid_hw_panel_press_key(&ref->hw, (uint8_t)(batch % 11u),
+				ref->ser.tick, 5000u);
+		}
+
+		emu_core_run_batch(sched, cycles);
+		ref_run_batch(ref, cycles);
+
+		if (!busy_core_equal(sched, ref))
+			return batch + 1u;
+	}
+	return 0;
+}
+
 static char *test_emu_core_emu_core_run_batch(void)
 {
+	static struct EmuCore sched;
+	static struct EmuCore ref;
+
+	busy_core_init(&sched);
+	busy_core_init(&ref);
+
+	_it_should(
+		"scheduled batch loop matches per-instruction reference",
+		0u == run_against_ref(&sched, &ref, 400u)
+	);
+
+	cassette_free(&sched.cas);
+	cassette_free(&ref.cas);
+	return NULL;
+}
+
+static char *test_emu_core_cassette_record(void)
+{
+	static struct EmuCore sched;
+	static struct EmuCore ref;
+	bool same = true;
+
+	busy_core_init(&sched);
+	busy_core_init(&ref);
+	cassette_start_record(&sched.cas, 0);
+	cassette_start_record(&ref.cas, 0);
+
+	_it_should(
+		"recording through the batch loop matches the reference",
+		0u == run_against_ref(&sched, &ref, 200u)
+	);
+	for (size_t i = 0; same && i < ref.cas.dur_count; i++)
+		same = cassette_duration(&sched.cas, i) ==
+			cassette_duration(&ref.cas, i);
+	_it_should(
+		"buffered OUT 0x44 edges reach the tape by the end of each batch",
+		0u == sched.cas_rec_len
+		&& EMU_CAS_REC_BATCH < ref.cas.dur_count
+		&& sched.cas.dur_count == ref.cas.dur_count && same
+		&& sched.cas.rec_last_edge_tick == ref.cas.rec_last_edge_tick
+		&& sched.cas.rec_last_level == ref.cas.rec_last_level
+	);
+
+	cassette_free(&sched.cas);
+	cassette_free(&ref.cas);
+	return NULL;
+}
+
+static char *test_emu_core_idle_halt(void)
+{
+	static struct EmuCore core;
+	static const uint8_t rom[] = {
+		0x76,			/* 0000 HLT */
+	};
+
+	emu_core_init(&core, 2000000u, 9600u);
+	memcpy(core.hw.rom[0], rom, sizeof(rom));
+	emu_core_run_batch(&core, 100000u);
+
+	_it_should("HALT runs to the end of the batch", 100000u <= core.ser.tick);
+	_it_should("HALT steps are fast-forwarded", 99000u < core.idle_ticks);
+
+	return NULL;
+}
+
+static char *test_emu_core_idle_on_input(void)
+{
+	static struct EmuCore sched;
+	static struct EmuCore ref;
+	static const uint8_t rom[] = {
+		0xDB, 0x40,		/* 0000 IN 40 */
+		0xE6, 0x20,		/* 0002 ANI 20 */
+		0xC2, 0x00, 0x00,	/* 0004 JNZ 0000 */
+	};
+
+	/* Timer disabled: bit 5 stays high and the loop never exits. */
+	emu_core_init(&sched, 2000000u, 9600u);
+	memcpy(sched.hw.rom[0], rom, sizeof(rom));
+	emu_core_run_batch(&sched, 100000u);
+
+	_it_should("polling loop is fast-forwarded", 90000u < sched.idle_ticks);
+	_it_should("polling loop stays in the loop", sched.cpu.pc < sizeof(rom));
+
+	idle_core_init(&sched);
+	idle_core_init(&ref);
+
+	_it_should(
+		"idle fast-forward matches per-instruction reference",
+		0u == run_against_ref(&sched, &ref, 600u)
+	);
+	_it_should("HALT and polling time is skipped", 0u < sched.idle_ticks);
+
 	return NULL;
 }
 
@@ -54,10 +393,15 @@ static char *run_tests(void)
 	_run_test(test_emu_core_txbuf_clear);
 	_run_test(test_emu_core_txbuf_putch_cb);
 	_run_test(test_emu_core_emu_core_tx_pop);
+	_run_test(test_emu_core_tx_peek_commit);
+	_run_test(test_emu_core_tx_overflow);
 	_run_test(test_emu_core_emu_core_init);
 	_run_test(test_emu_core_emu_core_load_rom64k);
 	_run_test(test_emu_core_emu_core_reset);
 	_run_test(test_emu_core_set_hw_lines);
 	_run_test(test_emu_core_emu_core_run_batch);
+	_run_test(test_emu_core_cassette_record);
+	_run_test(test_emu_core_idle_halt);
+	_run_test(test_emu_core_idle_on_input);
 	return NULL;
 }
@@ -0,0 +1,146 @@
+/* SPDX-License-Identifier: MIT */
+
+/*
+ * hostev.spec.c
+ *
+ * Unit tests for the host event loop.
+ */
+
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "hostev.c"
+#include "timeutil.c"
+
+#include "test-runner.h"
+
+#include <fcntl.h>
+
+static char *test_hostev_zero_timeout(void)
+{
+	struct HostEv ev;
+	uint64_t start;
+	uint64_t end;
+
+	hostev_init(&ev);
+	start = monotonic_nsec();
+	(void)hostev_wait(&ev, HOSTEV_STDIN | HOSTEV_PTY, 0);
+	end = monotonic_nsec();
+	hostev_close(&ev);
+
+	_it_should("return at once with a zero timeout", 20000000u >= end - start);
+
+	return NULL;
+}
+
+static char *test_hostev_timeout(void)
+{
+	struct HostEv ev;
+	int p[2];
+	uint64_t start;
+	uint64_t took;
+	unsigned ready;
+
+	if (pipe(p) != 0) return "pipe failed";
+	hostev_init(&ev);
+	hostev_watch(&ev, HOSTEV_PTY, p[0]);
+
+	start = monotonic_nsec();
+	ready = hostev_wait(&ev, HOSTEV_PTY, 3000000u);
+	took = monotonic_nsec() - start;
+	_it_should("sleep out the whole timeout when idle", took >= 3000000u);
+	_it_should("not oversleep a short timeout badly", took < 200000000u);
+	_it_should("report nothing ready after a timeout", 0u == ready);
+
+	hostev_close(&ev);
+	close(p[0]);
+	close(p[1]);
+	return NULL;
+}
+
+static char *test_hostev_input_wakes(void)
+{
+	struct HostEv ev;
+	int p[2];
+	uint64_t start;
+	uint64_t took;
+	unsigned ready;
+
+	if (pipe(p) != 0) return "pipe failed";
+	hostev_init(&ev);
+	hostev_watch(&ev, HOSTEV_PTY, p[0]);
+	if (write(p[1], "x", 1) != 1) return "write failed";
+
+	start = monotonic_nsec();
+	ready = hostev_wait(&ev, HOSTEV_PTY, 2000000000u);
+	took = monotonic_nsec() - start;
+	_it_should("wake early on input", took < 1000000000u);
+	_it_should("mark the source ready", HOSTEV_PTY == ready);
+
+	_it_should("keep readiness until the caller clears it",
+		   HOSTEV_PTY == hostev_wait(&ev, HOSTEV_STDIN, 0));
+	ev.ready = 0;
+	hostev_watch(&ev, HOSTEV_PTY, -1);
+	_it_should("ignore an unwatched source",
+		   0u == hostev_wait(&ev, HOSTEV_PTY, 1000000u));
+
+	hostev_close(&ev);
+	close(p[0]);
+	close(p[1]);
+	return NULL;
+}
+
+static char *test_hostev_poll_fallback(void)
+{
+	struct HostEv ev;
+	int p[2];
+	uint64_t start;
+	uint64_t took;
+
+	if (pipe(p) != 0) return "pipe failed";
+	hostev_init(&ev);
+	hostev_close(&ev);	/* drop epoll: use poll() */
+	hostev_watch(&ev, HOSTEV_PTY, p[0]);
+
+	start = monotonic_nsec();
+	_it_should("time out with poll()",
+		   0u == hostev_wait(&ev, HOSTEV_PTY, 1500500u));
+	took = monotonic_nsec() - start;
+	_it_should("sleep out the sub-millisecond rest", took >= 1500500u);
+
+	if (write(p[1], "x", 1) != 1) return "write failed";
+	_it_should("see input with poll()",
+		   HOSTEV_PTY == hostev_wait(&ev, HOSTEV_PTY, 2000000000u));
+
+	close(p[0]);
+	close(p[1]);
+	return NULL;
+}
+
+static char *test_hostev_unpollable_fd(void)
+{
+	struct HostEv ev;
+	int fd = open("/dev/null", O_RDONLY);
+
+	if (fd < 0) return "open /dev/null failed";
+	hostev_init(&ev);
+	hostev_watch(&ev, HOSTEV_STDIN, fd);
+	_it_should("count /dev/null as readable",
+		   HOSTEV_STDIN == hostev_wait(&ev, HOSTEV_STDIN, 2000000000u));
+
+	hostev_close(&ev);
+	close(fd);
+	return NULL;
+}
+
+static char *run_tests(void)
+{
+	_run_test(test_hostev_zero_timeout);
+	_run_test(test_hostev_timeout);
+	_run_test(test_hostev_input_wakes);
+	_run_test(test_hostev_poll_fallback);
+	_run_test(test_hostev_unpollable_fd);
+
+	return NULL;
+}
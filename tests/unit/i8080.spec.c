@@ -111,7 +111,7 @@ static char *test_inr_preserves_cy(void)
 	init_bus(&bus, &tb);
 
 	cpu.b = 0x0f;
-	cpu.cy = true;
+	i8080_set_flag(&cpu, I8080_FLAG_CY, true);
 	tb.mem[0x0000] = 0x04; /* INR B */
 
 	(void)i8080_step(&cpu, &bus);
@@ -119,11 +119,11 @@ static char *test_inr_preserves_cy(void)
 	_it_should(
 		"inr sets flags and preserves cy",
 		0x10 == cpu.b
-		&& true == cpu.ac
-		&& false == cpu.z
-		&& false == cpu.s
-		&& false == cpu.p
-		&& true == cpu.cy
+		&& true == i8080_flag(&cpu, I8080_FLAG_AC)
+		&& false == i8080_flag(&cpu, I8080_FLAG_Z)
+		&& false == i8080_flag(&cpu, I8080_FLAG_S)
+		&& false == i8080_flag(&cpu, I8080_FLAG_P)
+		&& true == i8080_flag(&cpu, I8080_FLAG_CY)
 	);
 
 	return NULL;
@@ -139,7 +139,7 @@ static char *test_dcr_sets_flags(void)
 	init_bus(&bus, &tb);
 
 	cpu.b = 0x10;
-	cpu.cy = false;
+	i8080_set_flag(&cpu, I8080_FLAG_CY, false);
 	tb.mem[0x0000] = 0x05; /* DCR B */
 
 	(void)i8080_step(&cpu, &bus);
@@ -147,11 +147,11 @@ static char *test_dcr_sets_flags(void)
 	_it_should(
 		"dcr updates flags",
 		0x0f == cpu.b
-		&& true == cpu.ac
-		&& false == cpu.z
-		&& false == cpu.s
-		&& true == cpu.p
-		&& false == cpu.cy
+		&& true == i8080_flag(&cpu, I8080_FLAG_AC)
+		&& false == i8080_flag(&cpu, I8080_FLAG_Z)
+		&& false == i8080_flag(&cpu, I8080_FLAG_S)
+		&& true == i8080_flag(&cpu, I8080_FLAG_P)
+		&& false == i8080_flag(&cpu, I8080_FLAG_CY)
 	);
 
 	return NULL;
@@ -175,11 +175,11 @@ static char *test_add_b_updates_accumulator(void)
 	_it_should(
 		"add b updates a and flags",
 		0x32 == cpu.a
-		&& false == cpu.cy
-		&& false == cpu.ac
-		&& false == cpu.z
-		&& false == cpu.s
-		&& false == cpu.p
+		&& false == i8080_flag(&cpu, I8080_FLAG_CY)
+		&& false == i8080_flag(&cpu, I8080_FLAG_AC)
+		&& false == i8080_flag(&cpu, I8080_FLAG_Z)
+		&& false == i8080_flag(&cpu, I8080_FLAG_S)
+		&& false == i8080_flag(&cpu, I8080_FLAG_P)
 	);
 
 	return NULL;
@@ -264,7 +264,7 @@ static char *test_adc_b_with_carry(void)
 
 	cpu.a = 0x0f;
 	cpu.b = 0x01;
-	cpu.cy = true;
+	i8080_set_flag(&cpu, I8080_FLAG_CY, true);
 	tb.mem[0x0000] = 0x88; /* ADC B */
 
 	(void)i8080_step(&cpu, &bus);
@@ -272,11 +272,11 @@ static char *test_adc_b_with_carry(void)
 	_it_should(
 		"adc b uses carry and updates flags",
 		0x11 == cpu.a
-		&& false == cpu.cy
-		&& true == cpu.ac
-		&& false == cpu.z
-		&& false == cpu.s
-		&& true == cpu.p
+		&& false == i8080_flag(&cpu, I8080_FLAG_CY)
+		&& true == i8080_flag(&cpu, I8080_FLAG_AC)
+		&& false == i8080_flag(&cpu, I8080_FLAG_Z)
+		&& false == i8080_flag(&cpu, I8080_FLAG_S)
+		&& true == i8080_flag(&cpu, I8080_FLAG_P)
 	);
 
 	return NULL;
@@ -293,7 +293,7 @@ static char *test_sbb_b_with_borrow(void)
 
 	cpu.a = 0x10;
 	cpu.b = 0x01;
-	cpu.cy = true;
+	i8080_set_flag(&cpu, I8080_FLAG_CY, true);
 	tb.mem[0x0000] = 0x98; /* SBB B */
 
 	(void)i8080_step(&cpu, &bus);
@@ -301,11 +301,11 @@ static char *test_sbb_b_with_borrow(void)
 	_it_should(
 		"sbb b uses borrow and updates flags",
 		0x0e == cpu.a
-		&& false == cpu.cy
-		&& true == cpu.ac
-		&& false == cpu.z
-		&& false == cpu.s
-		&& false == cpu.p
+		&& false == i8080_flag(&cpu, I8080_FLAG_CY)
+		&& true == i8080_flag(&cpu, I8080_FLAG_AC)
+		&& false == i8080_flag(&cpu, I8080_FLAG_Z)
+		&& false == i8080_flag(&cpu, I8080_FLAG_S)
+		&& false == i8080_flag(&cpu, I8080_FLAG_P)
 	);
 
 	return NULL;
@@ -329,11 +329,11 @@ static char *test_cmp_b_sets_flags(void)
 	_it_should(
 		"cmp b sets flags without changing a",
 		0x20 == cpu.a
-		&& true == cpu.z
-		&& false == cpu.cy
-		&& false == cpu.s
-		&& true == cpu.p
-		&& false == cpu.ac
+		&& true == i8080_flag(&cpu, I8080_FLAG_Z)
+		&& false == i8080_flag(&cpu, I8080_FLAG_CY)
+		&& false == i8080_flag(&cpu, I8080_FLAG_S)
+		&& true == i8080_flag(&cpu, I8080_FLAG_P)
+		&& false == i8080_flag(&cpu, I8080_FLAG_AC)
 	);
 
 	return NULL;
@@ -349,8 +349,8 @@ static char *test_daa_adjusts_bcd(void)
 	init_bus(&bus, &tb);
 
 	cpu.a = 0x9b;
-	cpu.cy = false;
-	cpu.ac = false;
+	i8080_set_flag(&cpu, I8080_FLAG_CY, false);
+	i8080_set_flag(&cpu, I8080_FLAG_AC, false);
 	tb.mem[0x0000] = 0x27; /* DAA */
 
 	(void)i8080_step(&cpu, &bus);
@@ -358,11 +358,241 @@ static char *test_daa_adjusts_bcd(void)
 	_it_should(
 		"daa adjusts and sets carry",
 		0x01 == cpu.a
-		&& true == cpu.cy
-		&& true == cpu.ac
-		&& false == cpu.z
-		&& false == cpu.s
-		&& false == cpu.p
+		&& true == i8080_flag(&cpu, I8080_FLAG_CY)
+		&& true == i8080_flag(&cpu, I8080_FLAG_AC)
+		&& false == i8080_flag(&cpu, I8080_FLAG_Z)
+		&& false == i8080_flag(&cpu, I8080_FLAG_S)
+		&& false == i8080_flag(&cpu, I8080_FLAG_P)
+	);
+
+	return NULL;
+}
+
+static uint32_t diff_rng_next(uint32_t *state)
+{
+	*state = *state * 1103515245u + 12345u;
+	return *state >> 8;
+}
+
+/* Bias register values toward carry/borrow edges so wraps get exercised. */
+static uint8_t diff_rng_reg(uint32_t *state)
+{
+	static const uint8_t edges[] = { 0x00, 0x01, 0x0F, 0x10, 0x7F, 0x80, 0x99, 0xFF };
+	uint32_t r = diff_rng_next(state);
+
+	if (r & 1u)
+		return edges[(r >> 1) & 7u];
+	return (uint8_t)(r >> 4);
+}
+
+static void diff_random_cpu(I8080 *cpu, uint32_t *rng)
+{
+	i8080_reset(cpu);
+	cpu->a = diff_rng_reg(rng);
+	cpu->b = diff_rng_reg(rng);
+	cpu->c = diff_rng_reg(rng);
+	cpu->d = diff_rng_reg(rng);
+	cpu->e = diff_rng_reg(rng);
+	cpu->h = diff_rng_reg(rng);
+	cpu->l = diff_rng_reg(rng);
+	cpu->sp = (uint16_t)diff_rng_next(rng);
+	cpu->pc = (uint16_t)diff_rng_next(rng);
+	cpu->f = (uint8_t)((diff_rng_next(rng) & 0xD5u) | I8080_FLAG_FIXED);
+	cpu->inte = (diff_rng_next(rng) & 1u) != 0;
+	cpu->ei_pending = (diff_rng_next(rng) & 3u) == 0;
+}
+
+static bool diff_cpu_equal(const I8080 *x, const I8080 *y)
+{
+	return x->a == y->a && x->b == y->b && x->c == y->c
+		&& x->d == y->d && x->e == y->e && x->h == y->h
+		&& x->l == y->l && x->pc == y->pc && x->sp == y->sp
+		&& x->f == y->f && x->inte == y->inte
+		&& x->ei_pending == y->ei_pending && x->halted == y->halted;
+}
+
+static char *test_table_engine_matches_switch_engine(void)
+{
+	static TestBus tb1;
+	static TestBus tb2;
+	I8080Bus bus1;
+	I8080Bus bus2;
+	I8080 cpu1;
+	I8080 cpu2;
+	uint32_t rng = 0x8080u;
+	unsigned mismatches = 0;
+
+	for (unsigned op = 0; op < 256u; op++) {
+		for (unsigned trial = 0; trial < 32u; trial++) {
+			init_bus(&bus1, &tb1);
+			init_bus(&bus2, &tb2);
+			for (size_t i = 0; i < sizeof(tb1.mem); i++)
+				tb1.mem[i] = (uint8_t)diff_rng_next(&rng);
+
+			diff_random_cpu(&cpu1, &rng);
+			tb1.mem[cpu1.pc] = (uint8_t)op;
+			memcpy(tb2.mem, tb1.mem, sizeof(tb1.mem));
+			cpu2 = cpu1;
+
+			int t1 = i8080_step_switch(&cpu1, &bus1);
+			int t2 = i8080_step_table(&cpu2, &bus2);
+
+			if (t1 != t2 || !diff_cpu_equal(&cpu1, &cpu2)
+				|| tb1.out_seen != tb2.out_seen
+				|| tb1.last_out_port != tb2.last_out_port
+				|| tb1.last_out_val != tb2.last_out_val
+				|| 0 != memcmp(tb1.mem, tb2.mem, sizeof(tb1.mem)))
+				mismatches++;
+		}
+	}
+
+	_it_should(
+		"table engine matches switch engine for every opcode",
+		0u == mismatches
+	);
+
+	return NULL;
+}
+
+static void init_paged_bus(I8080Bus *bus, TestBus *tb, const uint8_t **rd,
+	uint8_t **wr, I8080BlockCache *bc)
+{
+	for (unsigned p = 0; p < I8080_PAGE_COUNT; p++) {
+		wr[p] = tb->mem + p * I8080_PAGE_SIZE;
+		rd[p] = wr[p];
+	}
+	bus->rd_page = rd;
+	bus->wr_page = wr;
+	bus->bcache = bc;
+	i8080_bcache_flush(bc);
+}
+
+static char *test_block_run_matches_step(void)
+{
+	static TestBus tb1;
+	static TestBus tb2;
+	static I8080BlockCache bc;
+	const uint8_t *rd[I8080_PAGE_COUNT];
+	uint8_t *wr[I8080_PAGE_COUNT];
+	I8080Bus bus1;
+	I8080Bus bus2;
+	I8080 cpu1;
+	I8080 cpu2;
+	uint32_t rng = 0xB10Cu;
+	unsigned mismatches = 0;
+	unsigned over_bound = 0;
+	unsigned blocks = 0;
+
+	for (unsigned trial = 0; trial < 64u; trial++) {
+		init_bus(&bus1, &tb1);
+		init_bus(&bus2, &tb2);
+		init_paged_bus(&bus1, &tb1, rd, wr, &bc);
+		for (size_t i = 0; i < sizeof(tb1.mem); i++)
+			tb1.mem[i] = (uint8_t)diff_rng_next(&rng);
+		memcpy(tb2.mem, tb1.mem, sizeof(tb1.mem));
+
+		diff_random_cpu(&cpu1, &rng);
+		cpu1.ei_pending = false;
+		cpu2 = cpu1;
+
+		for (unsigned iter = 0; iter < 400u; iter++) {
+			const I8080Block *blk = NULL;
+			unsigned n = 1;
+			int t1;
+			int t2 = 0;
+
+			/* The caller owns EI and HLT; blocks never see them. */
+			if (!cpu1.halted && !cpu1.ei_pending)
+				blk = i8080_block_lookup(&cpu1, &bus1);
+
+			if (blk && blk->n_ops) {
+				uint16_t bound = blk->max_cycles;
+
+				t1 = i8080_block_run(&cpu1, &bus1, blk, &n);
+				if (t1 > (int)bound)
+					over_bound++;
+				blocks++;
+			} else {
+				t1 = i8080_step_table(&cpu1, &bus1);
+			}
+			for (unsigned i = 0; i < n; i++)
+				t2 += i8080_step_table(&cpu2, &bus2);
+
+			if (t1 != t2 || !diff_cpu_equal(&cpu1, &cpu2))
+				mismatches++;
+		}
+		if (0 != memcmp(tb1.mem, tb2.mem, sizeof(tb1.mem)))
+			mismatches++;
+	}
+
+	_it_should("block runs were exercised", 1000u < blocks);
+	_it_should("block cycles stay within max_cycles", 0u == over_bound);
+	_it_should("block execution matches single steps", 0u == mismatches);
+
+	return NULL;
+}
+
+static char *test_block_invalidated_by_store_into_itself(void)
+{
+	static TestBus tb;
+	static I8080BlockCache bc;
+	const uint8_t *rd[I8080_PAGE_COUNT];
+	uint8_t *wr[I8080_PAGE_COUNT];
+	I8080Bus bus;
+	I8080 cpu;
+	const I8080Block *blk;
+	unsigned n = 0;
+	static const uint8_t prog[] = {
+		0x21, 0x06, 0x00,	/* 0000 LXI H,0006 */
+		0x36, 0x3C,		/* 0003 MVI M,3C (INR A) */
+		0x00,			/* 0005 NOP */
+		0x00,			/* 0006 NOP, patched to INR A */
+		0x76,			/* 0007 HLT */
+	};
+
+	i8080_reset(&cpu);
+	init_bus(&bus, &tb);
+	init_paged_bus(&bus, &tb, rd, wr, &bc);
+	memcpy(tb.mem, prog, sizeof(prog));
+
+	blk = i8080_block_lookup(&cpu, &bus);
+	_it_should("block spans up to HLT", 4u == blk->n_ops);
+
+	(void)i8080_block_run(&cpu, &bus, blk, &n);
+	_it_should("store into the block stops it", 2u == n && 0x0005 == cpu.pc);
+
+	blk = i8080_block_lookup(&cpu, &bus);
+	(void)i8080_block_run(&cpu, &bus, blk, &n);
+	_it_should("re-decoded block runs the patched opcode", 1u == cpu.a);
+
+	return NULL;
+}
+
+static char *test_push_pop_psw_keeps_fixed_bits(void)
+{
+	I8080 cpu;
+	I8080Bus bus;
+	TestBus tb;
+
+	i8080_reset(&cpu);
+	init_bus(&bus, &tb);
+
+	tb.mem[0x1FFE] = 0xFF; /* flags byte with every bit set */
+	tb.mem[0x1FFF] = 0x12;
+	cpu.sp = 0x1FFE;
+	tb.mem[0x0000] = 0xF1; /* POP PSW */
+	tb.mem[0x0001] = 0xF5; /* PUSH PSW */
+
+	(void)i8080_step(&cpu, &bus);
+	(void)i8080_step(&cpu, &bus);
+
+	_it_should(
+		"pop/push psw masks bits 3 and 5 and forces bit 1",
+		0x12 == cpu.a
+		&& 0xD7 == cpu.f
+		&& 0xD7 == tb.mem[0x1FFE]
+		&& true == i8080_flag(&cpu, I8080_FLAG_S)
+		&& true == i8080_flag(&cpu, I8080_FLAG_CY)
 	);
 
 	return NULL;
@@ -382,6 +612,10 @@ static char *run_tests(void)
 	_run_test(test_sbb_b_with_borrow);
 	_run_test(test_cmp_b_sets_flags);
 	_run_test(test_daa_adjusts_bcd);
+	_run_test(test_push_pop_psw_keeps_fixed_bits);
+	_run_test(test_table_engine_matches_switch_engine);
+	_run_test(test_block_run_matches_step);
+	_run_test(test_block_invalidated_by_store_into_itself);
 
 	return NULL;
 }
@@ -28,6 +28,29 @@
 
 #define ALTAID_IO_READ  helper_file_read
 #define ALTAID_IO_WRITE helper_file_write
+#define ALTAID_IO_WRITEV short_writev
+
+#include <sys/uio.h>
+
+/* writev() stand-in that accepts at most three bytes per call. */
+static char short_writev_buf[32];
+static size_t short_writev_len;
+static int short_writev_calls;
+
+static ssize_t short_writev(int fd, const struct iovec *iov, int iovcnt)
+{
+	size_t n = 0;
+
+	(void)fd;
+	short_writev_calls++;
+	for (int i = 0; i < iovcnt && n < 3u; i++) {
+		const char *p = iov[i].iov_base;
+
+		for (size_t j = 0; j < iov[i].iov_len && n < 3u; j++, n++)
+			short_writev_buf[short_writev_len++] = p[j];
+	}
+	return (ssize_t)n;
+}
 
 #include "timeutil.c"
 #include "io.c"
@@ -80,18 +103,34 @@ static char *test_write_full_in_memory_success(void)
 	return NULL;
 }
 
-static char *test_sleep_or_wait_input_usec_zero_noop(void)
+static char *test_writev_full_resumes_short_writes(void)
 {
-	uint32_t start;
-	uint32_t end;
+	struct iovec iov[3];
 
-	start = monotonic_usec();
-	sleep_or_wait_input_usec(0, false, -1, true);
-	end = monotonic_usec();
+	iov[0].iov_base = "hello";
+	iov[0].iov_len = 5;
+	iov[1].iov_base = "";
+	iov[1].iov_len = 0;
+	iov[2].iov_base = ", tape";
+	iov[2].iov_len = 6;
+
+	short_writev_len = 0;
+	short_writev_calls = 0;
+	_it_should(
+		"writev_full writes every entry",
+		0 == writev_full(1, iov, 3)
+	);
+
+	_it_should(
+		"writev_full resumes after short writes in order",
+		11u == short_writev_len
+		&& 0 == memcmp(short_writev_buf, "hello, tape", 11)
+		&& 4 == short_writev_calls
+	);
 
 	_it_should(
-		"sleep_or_wait_input_usec(0) returns quickly",
-		20000ull >= (end - start)
+		"writev_full rejects an invalid fd",
+		-1 == writev_full(-1, iov, 3)
 	);
 
 	return NULL;
@@ -101,7 +140,7 @@ static char *run_tests(void)
 {
 	_run_test(test_write_full_invalid_args);
 	_run_test(test_write_full_in_memory_success);
-	_run_test(test_sleep_or_wait_input_usec_zero_noop);
+	_run_test(test_writev_full_resumes_short_writes);
 
 	return NULL;
 }
@@ -0,0 +1,100 @@
+/* SPDX-License-Identifier: MIT */
+
+/*
+ * lz.spec.c
+ *
+ * Unit tests for the RAM image LZ codec.
+ */
+
+#include "lz.c"
+
+#include "test-runner.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static uint8_t g_src[0x10000];
+static uint8_t g_packed[0x10000];
+static uint8_t g_out[0x10000];
+
+static bool roundtrip(size_t len, size_t *packed_len)
+{
+	size_t n = lz_compress(g_src, len, g_packed, sizeof(g_packed));
+
+	*packed_len = n;
+	memset(g_out, 0xA5, sizeof(g_out));
+	return n && lz_decompress(g_packed, n, g_out, len) &&
+		0 == memcmp(g_src, g_out, len);
+}
+
+static char *test_lz_roundtrip(void)
+{
+	uint32_t x = 12345u;
+	size_t n;
+
+	memset(g_src, 0, sizeof(g_src));
+	_it_should(
+		"shrink a zero bank to a few hundred bytes",
+		roundtrip(sizeof(g_src), &n) && n < 300u
+	);
+
+	for (size_t i = 0; i < sizeof(g_src); i++)
+		g_src[i] = (uint8_t)("LXI SP,F000; CALL 0x0123; RET\n"[i % 30u]);
+	_it_should(
+		"compress repeated text",
+		roundtrip(sizeof(g_src), &n) && n < sizeof(g_src) / 20u
+	);
+
+	for (size_t i = 0; i < sizeof(g_src); i++) {
+		x = x * 1103515245u + 12345u;
+		g_src[i] = (uint8_t)(x >> 24);
+	}
+	_it_should(
+		"round-trip short and odd-sized inputs",
+		roundtrip(0, &n) && roundtrip(1, &n) && roundtrip(3, &n)
+		&& roundtrip(4, &n) && roundtrip(17, &n) && roundtrip(300, &n)
+	);
+
+	_it_should(
+		"give up on noise that does not fit the cap",
+		0 == lz_compress(g_src, sizeof(g_src), g_packed,
+				 sizeof(g_src) - 1u)
+	);
+
+	return NULL;
+}
+
+static char *test_lz_rejects_bad_streams(void)
+{
+	static const uint8_t far_back[] = { 0x10, 'A', 0x02, 0x00 };
+	static const uint8_t short_lits[] = { 0x30, 'A', 'B' };
+	size_t n;
+
+	memset(g_src, 0, sizeof(g_src));
+	memcpy(g_src + 100, "some data", 9);
+	n = lz_compress(g_src, 4096u, g_packed, sizeof(g_packed));
+
+	_it_should(
+		"reject a stream that decodes to the wrong length",
+		0u < n
+		&& !lz_decompress(g_packed, n, g_out, 4095u)
+		&& !lz_decompress(g_packed, n, g_out, 4097u)
+		&& !lz_decompress(g_packed, n / 2u, g_out, 4096u)
+	);
+
+	_it_should(
+		"reject offsets before the start and truncated literals",
+		!lz_decompress(far_back, sizeof(far_back), g_out, 8u)
+		&& !lz_decompress(short_lits, sizeof(short_lits), g_out, 3u)
+	);
+
+	return NULL;
+}
+
+static char *run_tests(void)
+{
+	_run_test(test_lz_roundtrip);
+	_run_test(test_lz_rejects_bad_streams);
+
+	return NULL;
+}
@@ -0,0 +1,201 @@
+/* SPDX-License-Identifier: MIT */
+
+/*
+ * rewind.spec.c
+ *
+ * Unit tests for the in-memory rewind buffer.
+ */
+
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "i8080.c"
+#include "serial.c"
+#include "cassette.c"
+#include "wav.c"
+#include "altaid_hw.c"
+#include "emu_core.c"
+#include "timeutil.c"
+#include "io.c"
+#include "lz.c"
+#include "stateio.c"
+#include "rewind.c"
+
+#include "test-runner.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Stub log_printf: altaid_hw.c's debug path is never triggered in tests. */
+void log_printf(const char *fmt, ...)
+{
+	(void)fmt;
+}
+
+/* Count up at 0x9000 forever, touching the stack on every pass. */
+static const uint8_t k_count_prog[] = {
+	0x31, 0x00, 0xF0,	/* 0000 LXI SP,F000 */
+	0x21, 0x00, 0x90,	/* 0003 LXI H,9000 */
+	0x34,			/* 0006 INR M */
+	0xE5,			/* 0007 PUSH H */
+	0xE1,			/* 0008 POP H */
+	0xC3, 0x06, 0x00,	/* 0009 JMP 0006 */
+};
+
+static void core_setup(struct EmuCore *core)
+{
+	emu_core_init(core, 2000000u, 9600u);
+	memset(core->hw.rom, 0, sizeof(core->hw.rom));
+	memcpy(core->hw.rom[0], k_count_prog, sizeof(k_count_prog));
+	emu_core_mem_changed(core);
+}
+
+static char *test_rewind_restores_past_snapshot(void)
+{
+	static struct EmuCore core;
+	static uint8_t ram7[8][0x10000];
+	struct Rewind rw;
+	uint64_t tick[20];
+	uint16_t pc8 = 0;
+	uint8_t count8 = 0;
+
+	core_setup(&core);
+	rewind_init(&rw, 4u << 20);
+
+	for (int i = 0; i < 20; i++) {
+		emu_core_run_batch(&core, 10000u);
+		if (!rewind_capture(&rw, &core))
+			return "rewind_capture() failed";
+		tick[i] = core.ser.tick;
+		if (i == 7)
+			memcpy(ram7, core.hw.ram, sizeof(ram7));
+		if (i == 8) {
+			pc8 = core.cpu.pc;
+			count8 = core.hw.ram[0][0x9000];
+		}
+	}
+
+	_it_should(
+		"start with one full snapshot followed by deltas",
+		20u == rw.count && rw.snaps[0].full && !rw.snaps[1].full
+		&& rw.snaps[1].len < rw.snaps[0].len / 16u
+	);
+
+	_it_should(
+		"restore the newest snapshot at or before the target",
+		rewind_to(&rw, &core, tick[7] + 5u)
+		&& tick[7] == core.ser.tick
+		&& 0 == memcmp(ram7, core.hw.ram, sizeof(ram7))
+		&& 8u == rw.count
+	);
+
+	emu_core_run_batch(&core, 10000u);
+	_it_should(
+		"replay deterministically from the restored state",
+		tick[8] == core.ser.tick
+		&& pc8 == core.cpu.pc
+		&& count8 == core.hw.ram[0][0x9000]
+		&& rewind_capture(&rw, &core) && 9u == rw.count
+	);
+
+	_it_should(
+		"clamp to the oldest snapshot",
+		rewind_to(&rw, &core, 0) && tick[0] == core.ser.tick
+		&& 1u == rw.count
+	);
+
+	rewind_free(&rw);
+	_it_should(
+		"fail on an empty buffer",
+		!rewind_to(&rw, &core, 0)
+	);
+
+	return NULL;
+}
+
+static char *test_rewind_respects_budget(void)
+{
+	static struct EmuCore core;
+	struct Rewind rw;
+	uint64_t first_tick;
+	size_t fulls = 0;
+
+	core_setup(&core);
+	rewind_init(&rw, 1u << 20);
+
+	emu_core_run_batch(&core, 10000u);
+	first_tick = core.ser.tick;
+	for (int i = 0; i < 300; i++) {
+		if (!rewind_capture(&rw, &core))
+			return "rewind_capture() failed";
+		emu_core_run_batch(&core, 10000u);
+	}
+
+	for (size_t i = 0; i < rw.count; i++)
+		fulls += rw.snaps[i].full ? 1u : 0u;
+
+	_it_should(
+		"evict whole groups from the front to stay in budget",
+		rw.bytes <= rw.budget && rw.snaps[0].full
+		&& first_tick < rw.snaps[0].tick && 1u <= fulls
+	);
+
+	_it_should(
+		"still restore the oldest kept snapshot",
+		rewind_to(&rw, &core, 0) && rw.snaps[0].tick == core.ser.tick
+	);
+
+	rewind_free(&rw);
+	return NULL;
+}
+
+static char *test_rewind_keeps_tape_recorded_across_deltas(void)
+{
+	static struct EmuCore core;
+	struct Rewind rw;
+	uint64_t t = 0;
+	uint64_t tick2;
+	uint64_t len2;
+
+	core_setup(&core);
+	rewind_init(&rw, 4u << 20);
+	core.cas.attached = true;
+	core.cas_attached = true;
+	cassette_start_record(&core.cas, 0u);
+
+	/* A full snapshot, then deltas with more and more tape behind them. */
+	for (int i = 0; i < 3; i++) {
+		for (int j = 0; j < 30; j++) {
+			t += 40u;
+			cassette_on_out_change(&core.cas, t, (j & 1) == 0);
+		}
+		emu_core_run_batch(&core, 10000u);
+		if (!rewind_capture(&rw, &core))
+			return "rewind_capture() failed";
+	}
+	tick2 = rw.snaps[1].tick;
+	len2 = core.cas.tape_ticks - 30u * 40u;
+
+	_it_should(
+		"restore the tape of the target, not of its full snapshot",
+		!rw.snaps[1].full && rewind_to(&rw, &core, tick2)
+		&& 60u == core.cas.dur_count && len2 == core.cas.tape_ticks
+		&& CASSETTE_RECORDING == core.cas.state
+	);
+
+	cassette_free(&core.cas);
+	rewind_free(&rw);
+	return NULL;
+}
+
+static char *run_tests(void)
+{
+	_run_test(test_rewind_restores_past_snapshot);
+	_run_test(test_rewind_respects_budget);
+	_run_test(test_rewind_keeps_tape_recorded_across_deltas);
+
+	return NULL;
+}
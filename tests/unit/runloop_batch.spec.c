@@ -0,0 +1,104 @@
+/* SPDX-License-Identifier: MIT */
+
+/*
+ * runloop_batch.spec.c
+ *
+ * Unit tests for the adaptive runloop batch size.
+ */
+
+#include "runloop_batch.c"
+
+#include "test-runner.h"
+
+static char *test_runloop_batch_grows_when_idle(void)
+{
+	struct RunBatch b;
+	uint64_t n = 0;
+
+	runloop_batch_init(&b, 2000000u, 10u, true);
+	_it_should("start at ~0.5 ms", 1000u == b.min_cycles);
+	_it_should("cap realtime at the budget", 20000u == b.max_cycles);
+
+	for (int i = 0; i < 16; i++) {
+		n = runloop_batch_next(&b, false, UINT64_MAX);
+		runloop_batch_account(&b, n, 10000u, 5000u);
+	}
+	_it_should("grow to the cap while idle and cheap", 20000u == n);
+
+	n = runloop_batch_next(&b, true, UINT64_MAX);
+	_it_should("drop to the minimum when busy", 1000u == n);
+	_it_should("forget the idle size when busy", 1000u == b.cycles);
+
+	return NULL;
+}
+
+static char *test_runloop_batch_wall_budget(void)
+{
+	struct RunBatch b;
+	uint64_t n;
+
+	runloop_batch_init(&b, 2000000u, 10u, false);
+	_it_should("let turbo grow past the budget", 2000000u == b.max_cycles);
+
+	b.cycles = 64000u;
+	n = runloop_batch_next(&b, false, UINT64_MAX);
+	runloop_batch_account(&b, n, 30000000u, 100000u);
+	_it_should("halve a batch over the wall budget", 32000u == b.cycles);
+
+	runloop_batch_account(&b, 8000u, 1000000u, 100000u);
+	_it_should("scale a short batch to the idle size", 64000u == b.cycles);
+
+	runloop_batch_account(&b, 32000u, 3000000u, 100000u);
+	_it_should("hold a batch within the budget", 64000u == b.cycles);
+
+	/* Past 2^32 ns, where a 32-bit clock would have wrapped. */
+	runloop_batch_account(&b, 64000u, 5000000000ull, 100000u);
+	_it_should("halve a batch that took seconds", 32000u == b.cycles);
+
+	return NULL;
+}
+
+static char *test_runloop_batch_deadlines(void)
+{
+	struct RunBatch b;
+
+	runloop_batch_init(&b, 2000000u, 10u, true);
+	b.cycles = 16000u;
+	_it_should("stop at the next deadline",
+		   300u == runloop_batch_next(&b, false, 300u));
+	_it_should("run a minimum batch when overdue",
+		   1000u == runloop_batch_next(&b, false, 0));
+
+	runloop_batch_init(&b, 2000000u, 0, false);
+	runloop_batch_account(&b, 1000u, 1000u, 1000u);
+	_it_should("keep fixed batches with no budget",
+		   1000u == runloop_batch_next(&b, false, UINT64_MAX));
+
+	return NULL;
+}
+
+static char *test_runloop_batch_host_permille(void)
+{
+	struct RunBatch b;
+
+	runloop_batch_init(&b, 2000000u, 10u, true);
+	_it_should("report 0 before any batch",
+		   0u == runloop_batch_host_permille(&b));
+
+	runloop_batch_account(&b, 1000u, 750000u, 250000u);
+	_it_should("report the host share in tenths of a percent",
+		   250u == runloop_batch_host_permille(&b));
+	_it_should("remember the latest batch", 1000u == b.last_cycles);
+
+	return NULL;
+}
+
+static char *run_tests(void)
+{
+	_run_test(test_runloop_batch_grows_when_idle);
+	_run_test(test_runloop_batch_wall_budget);
+	_run_test(test_runloop_batch_deadlines);
+	_run_test(test_runloop_batch_host_permille);
+
+	return NULL;
+}
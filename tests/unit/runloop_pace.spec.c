@@ -0,0 +1,171 @@
+/* SPDX-License-Identifier: MIT */
+
+/*
+ * runloop_pace.spec.c
+ *
+ * Unit tests for realtime pacing, run against a simulated clock so that
+ * days of uptime take milliseconds.
+ */
+
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "runloop_pace.c"
+#include "timeutil.c"
+
+#include "test-runner.h"
+
+#define PACE_HZ		2000000u
+#define PACE_SEC	1000000000ull
+#define PACE_DAY	(86400ull * PACE_SEC)
+
+/*
+ * A host that runs batch ticks in core_ns of wall time, then waits as
+ * told and wakes overshoot_ns late.
+ */
+struct PaceSim {
+	struct RunPace	pace;
+	uint64_t	tick;
+	uint64_t	now;
+	uint64_t	batch;
+	uint64_t	core_ns;
+	uint64_t	overshoot_ns;
+};
+
+static void pace_sim_init(struct PaceSim *s, uint64_t boot_ns)
+{
+	memset(s, 0, sizeof(*s));
+	runloop_pace_init(&s->pace, PACE_HZ);
+	s->now = boot_ns;
+	s->batch = PACE_HZ / 100u;	/* 10 ms */
+	s->core_ns = PACE_SEC / 1000u;	/* 1 ms */
+	runloop_pace_rebase(&s->pace, s->tick, s->now);
+}
+
+/* One runloop pass; returns the wait the pacer asked for. */
+static uint64_t pace_sim_step(struct PaceSim *s)
+{
+	uint64_t wait;
+
+	s->tick += s->batch;
+	s->now += s->core_ns;
+	wait = runloop_pace_check(&s->pace, s->tick, s->now);
+	if (wait) {
+		uint64_t due = s->now + wait;
+
+		s->now = due + s->overshoot_ns;
+		runloop_pace_woke(&s->pace, due, s->now);
+	}
+	return wait;
+}
+
+/* Emulated minus wall time since boot_ns, in ns. */
+static int64_t pace_sim_phase(const struct PaceSim *s, uint64_t boot_ns)
+{
+	return (int64_t)emu_tick_to_nsec(s->tick, PACE_HZ) -
+		(int64_t)(s->now - boot_ns);
+}
+
+static char *test_runloop_pace_multi_day(void)
+{
+	struct PaceSim s;
+	uint64_t boot = 3u * PACE_DAY;	/* host already up three days */
+	int64_t phase;
+
+	pace_sim_init(&s, boot);
+	s.overshoot_ns = 60000u;	/* every sleep wakes 60 us late */
+	s.batch = PACE_HZ / 10u;	/* 100 ms batches keep this quick */
+	while (s.now - boot < 5u * PACE_DAY)
+		(void)pace_sim_step(&s);
+
+	phase = pace_sim_phase(&s, boot);
+	_it_should("run five days past the 32-bit usec wrap",
+		   emu_tick_to_usec(s.tick, PACE_HZ) > UINT32_MAX);
+	_it_should("not drift from wall time over five days",
+		   phase < 1000000 && phase > -1000000);
+	_it_should("report the oversleep",
+		   60000u == runloop_pace_overshoot_avg_ns(&s.pace) &&
+		   60000u == s.pace.overshoot_max_ns);
+	_it_should("only lag by the oversleep",
+		   s.pace.lag_max_ns <= 60000u && 0u == s.pace.slips);
+
+	return NULL;
+}
+
+static char *test_runloop_pace_catches_up_gradually(void)
+{
+	struct PaceSim s;
+	uint64_t boot = 40u * PACE_DAY;
+	uint64_t tick0;
+	uint64_t now0;
+	uint64_t emu_ns;
+	uint64_t wall_ns;
+	int steps = 0;
+
+	pace_sim_init(&s, boot);
+	for (int i = 0; i < 1000; i++)
+		(void)pace_sim_step(&s);
+
+	/* The host stalls for 400 ms. */
+	s.now += 400000000u;
+	tick0 = s.tick;
+	now0 = s.now;
+	_it_should("run on at once when behind", 0u == pace_sim_step(&s));
+	_it_should("report the stall as lag",
+		   s.pace.err_ns <= -390000000 &&
+		   s.pace.lag_max_ns >= 390000000u);
+
+	while (s.pace.slew_ns && steps < 100000) {
+		(void)pace_sim_step(&s);
+		steps++;
+	}
+	emu_ns = emu_tick_to_nsec(s.tick - tick0, PACE_HZ);
+	wall_ns = s.now - now0;
+	_it_should("catch up completely", 0u == s.pace.slew_ns &&
+		   pace_sim_phase(&s, boot) >= 0);
+	_it_should("run no faster than the catch-up rate",
+		   emu_ns * (RUNLOOP_PACE_CATCHUP - 1u) <=
+		   (wall_ns + 10000000u) * RUNLOOP_PACE_CATCHUP);
+	_it_should("not crawl either",
+		   wall_ns < 400000000ull * (RUNLOOP_PACE_CATCHUP + 2u));
+
+	return NULL;
+}
+
+static char *test_runloop_pace_drops_long_stalls(void)
+{
+	struct PaceSim s;
+	uint64_t boot = 7u * PACE_DAY;
+
+	pace_sim_init(&s, boot);
+	(void)pace_sim_step(&s);
+
+	/* Suspended for an hour. */
+	s.now += 3600u * PACE_SEC;
+	(void)pace_sim_step(&s);
+	_it_should("count a slip", 1u == s.pace.slips);
+	_it_should("keep only the catch-up window of lag",
+		   RUNLOOP_PACE_MAX_SLEW_NS == s.pace.slew_ns &&
+		   s.pace.slipped_ns > 3598u * PACE_SEC);
+
+	for (int i = 0; i < 10000 && s.pace.slew_ns; i++)
+		(void)pace_sim_step(&s);
+	_it_should("settle back to real time", 0u == s.pace.slew_ns &&
+		   0u != pace_sim_step(&s));
+
+	runloop_pace_rebase(&s.pace, s.tick, s.now);
+	_it_should("keep its metrics across a rebase",
+		   1u == s.pace.slips && s.pace.checks > 0u);
+
+	return NULL;
+}
+
+static char *run_tests(void)
+{
+	_run_test(test_runloop_pace_multi_day);
+	_run_test(test_runloop_pace_catches_up_gradually);
+	_run_test(test_runloop_pace_drops_long_stalls);
+
+	return NULL;
+}
@@ -232,6 +232,68 @@ static char *test_serial_rx_queue_drop_when_full(void)
 	_it_should(
 		"queue drops when full",
 		qt_before == s.rx_qt
+		&& 0u == serial_rx_space(&s)
+	);
+
+	return NULL;
+}
+
+static char *test_serial_rx_space(void)
+{
+	SerialDev s;
+
+	serial_init(&s, 2000000u, 9600u);
+	_it_should(
+		"empty queue has capacity-1 free slots",
+		SERIAL_RX_QUEUE_MASK == serial_rx_space(&s)
+	);
+
+	/* Wrap the indices: head and tail both near the end. */
+	s.rx_qh = SERIAL_RX_QUEUE_SIZE - 2u;
+	s.rx_qt = SERIAL_RX_QUEUE_SIZE - 2u;
+	serial_host_enqueue(&s, 1u);
+	serial_host_enqueue(&s, 2u);
+	serial_host_enqueue(&s, 3u);
+	_it_should(
+		"free slots shrink across the wrap",
+		SERIAL_RX_QUEUE_MASK - 3u == serial_rx_space(&s)
+	);
+
+	return NULL;
+}
+
+static char *test_serial_rx_baud_override(void)
+{
+	SerialDev s;
+
+	serial_init(&s, 2000000u, 9600u);
+	serial_set_rx_baud(&s, 38400u);
+	s.gate_inte = true;
+	serial_host_enqueue(&s, 0x01u);
+
+	s.tick = 0;
+	(void)serial_current_rx_level(&s);
+	_it_should(
+		"rx line uses its own bit time",
+		52u == s.rx_ticks_per_bit && 208u == s.ticks_per_bit
+	);
+
+	s.tick = 52u;
+	_it_should(
+		"bit0 arrives after one rx bit time",
+		1 == serial_current_rx_level(&s)
+	);
+
+	s.tick = 520u;
+	_it_should(
+		"frame ends after ten rx bit times",
+		1 == serial_current_rx_level(&s) && false == s.rx_active
+	);
+
+	serial_set_rx_baud(&s, 0);
+	_it_should(
+		"zero restores the tx rate",
+		s.ticks_per_bit == s.rx_ticks_per_bit
 	);
 
 	return NULL;
@@ -301,6 +363,55 @@ static char *test_serial_tx_multi_sample_step(void)
 	return NULL;
 }
 
+static char *test_serial_rx_next_change(void)
+{
+	SerialDev s;
+	uint64_t tpb;
+	bool same = true;
+
+	serial_init(&s, 2000000u, 9600u);
+	tpb = s.rx_ticks_per_bit;
+	_it_should(
+		"idle line has no change scheduled",
+		SERIAL_NEVER == serial_rx_next_change(&s)
+	);
+
+	s.gate_inte = true;
+	serial_host_enqueue(&s, 0xF0u);	/* start 0, 0000 1111, stop 1 */
+	(void)serial_current_rx_level(&s);
+	_it_should(
+		"equal bits merge: the first change is at bit 5",
+		5u * tpb == serial_rx_next_change(&s)
+	);
+
+	s.tick = 5u * tpb;
+	_it_should(
+		"after it the next change is the frame end",
+		1 == serial_current_rx_level(&s)
+		&& 10u * tpb == serial_rx_next_change(&s)
+	);
+
+	/* Between changes the level is the one the plan said. */
+	for (s.tick = 5u * tpb; s.tick < 10u * tpb; s.tick += 7u)
+		same = same && 1 == serial_current_rx_level(&s);
+	_it_should("level holds until the next change", same);
+
+	/* A state load lands mid-frame: the frame is re-planned. */
+	serial_init(&s, 2000000u, 9600u);
+	s.rx_active = true;
+	s.rx_frame_start = 1000u;
+	s.rx_byte = 0x01u;
+	s.tick = 1000u + 3u * tpb;
+	serial_set_rx_baud(&s, 0);
+	_it_should(
+		"re-plan a restored frame",
+		0 == serial_current_rx_level(&s)
+		&& 1000u + 9u * tpb == serial_rx_next_change(&s)
+	);
+
+	return NULL;
+}
+
 static char *run_tests(void)
 {
 	_run_test(test_serial_init_defaults);
@@ -310,8 +421,11 @@ static char *run_tests(void)
 	_run_test(test_serial_tx_decode_emits_byte);
 	_run_test(test_serial_tx_stop_bit_low_no_emit);
 	_run_test(test_serial_rx_queue_drop_when_full);
+	_run_test(test_serial_rx_space);
+	_run_test(test_serial_rx_baud_override);
 	_run_test(test_serial_rx_inte_gate_holds_queue);
 	_run_test(test_serial_tx_multi_sample_step);
+	_run_test(test_serial_rx_next_change);
 
 	return NULL;
 }
@@ -8,6 +8,29 @@
  * UART RX.
  */
 
+#include <stddef.h>
+#include <sys/types.h>
+
+/* Feed stdin/PTY reads from an in-memory "paste" buffer. */
+#define ALTAID_IO_READ paste_read
+
+static const char *paste_data;
+static size_t paste_len;
+static size_t paste_pos;
+
+static ssize_t paste_read(int fd, void *buf, size_t count)
+{
+	size_t n = paste_len - paste_pos;
+
+	(void)fd;
+	if (n > count)
+		n = count;
+	for (size_t i = 0; i < n; i++)
+		((char *)buf)[i] = paste_data[paste_pos + i];
+	paste_pos += n;
+	return (ssize_t)n;
+}
+
 #include "serial.c"
 #include "altaid_hw.c"
 #include "serial_routing.c"
@@ -255,6 +278,39 @@ static char *test_stdin_dispatch_newline_translated_to_cr(void)
 	return NULL;
 }
 
+static char *test_stdin_poll_backpressure_when_queue_full(void)
+{
+	static char paste[SERIAL_RX_QUEUE_SIZE + 100u];
+	SerialDev ser;
+	struct StdinPanelState state = { false };
+
+	memset(paste, 'x', sizeof(paste));
+	paste_data = paste;
+	paste_len = sizeof(paste);
+	paste_pos = 0;
+
+	serial_init(&ser, 2000000u, 9600u);
+	serial_routing_stdin_poll_with_panel(&ser, NULL, 0, 0, &state);
+
+	_it_should(
+		"stdin poll stops reading when the rx queue is full",
+		0u == serial_rx_space(&ser)
+		&& SERIAL_RX_QUEUE_MASK == paste_pos
+	);
+
+	/* Drain a few bytes; the next poll picks up exactly that many. */
+	ser.rx_qh = 10u;
+	serial_routing_stdin_poll(&ser);
+
+	_it_should(
+		"stdin poll resumes as the queue drains",
+		0u == serial_rx_space(&ser)
+		&& SERIAL_RX_QUEUE_MASK + 10u == paste_pos
+	);
+
+	return NULL;
+}
+
 static char *run_tests(void)
 {
 	_run_test(test_tui_routes_to_ui_fd);
@@ -266,6 +322,7 @@ static char *run_tests(void)
 	_run_test(test_stdin_dispatch_unknown_chord_is_dropped);
 	_run_test(test_stdin_dispatch_prefix_spans_two_polls);
 	_run_test(test_stdin_dispatch_newline_translated_to_cr);
+	_run_test(test_stdin_poll_backpressure_when_queue_full);
 
 	return NULL;
 }
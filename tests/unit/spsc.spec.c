@@ -0,0 +1,164 @@
+/* SPDX-License-Identifier: MIT */
+
+/*
+ * spsc.spec.c
+ *
+ * Unit tests for the lock-free SPSC ring.
+ */
+
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "spsc.c"
+
+#include "test-runner.h"
+
+#include <pthread.h>
+#include <sched.h>
+
+static char *test_spsc_init(void)
+{
+	struct Spsc r;
+
+	_it_should("allocate", spsc_init(&r, 100u));
+	_it_should("round the size up to a power of two", 128u == r.size);
+	_it_should("start empty", 0u == spsc_avail(&r));
+	_it_should("start with all of it free", 128u == spsc_space(&r));
+	spsc_free(&r);
+	_it_should("forget the buffer", NULL == r.buf);
+
+	return NULL;
+}
+
+static char *test_spsc_wrap(void)
+{
+	struct Spsc r;
+	uint8_t in[12];
+	uint8_t out[12];
+	const uint8_t *data[2];
+	uint32_t len[2];
+
+	for (unsigned i = 0; i < sizeof(in); i++)
+		in[i] = (uint8_t)(i + 1u);
+	if (!spsc_init(&r, 16u)) return "spsc_init failed";
+
+	_it_should("take a partial write when nearly full",
+		   12u == spsc_write(&r, in, 12u) &&
+		   4u == spsc_write(&r, in, 12u));
+	_it_should("refuse a write when full", 0u == spsc_write(&r, in, 1u));
+	_it_should("read back in order",
+		   12u == spsc_read(&r, out, 12u) &&
+		   0 == memcmp(in, out, 12u));
+	_it_should("read the short tail", 4u == spsc_read(&r, out, 12u) &&
+		   0 == memcmp(in, out, 4u));
+
+	/* Start mid-buffer so the next write wraps after 8 bytes. */
+	r.head = r.tail = 24u;
+	(void)spsc_write(&r, in, 12u);
+	_it_should("peek a wrapped run as two spans",
+		   12u == spsc_peek(&r, data, len) && 8u == len[0] &&
+		   4u == len[1] && 0 == memcmp(data[0], in, 8u) &&
+		   0 == memcmp(data[1], in + 8, 4u));
+	spsc_commit(&r, 10u);
+	_it_should("free what was committed", 2u == spsc_avail(&r) &&
+		   14u == spsc_space(&r));
+
+	/* Counters wrap at 2^32 without losing the fill level. */
+	r.head = r.tail = UINT32_MAX - 3u;
+	(void)spsc_write(&r, in, 12u);
+	_it_should("survive counter wrap", 12u == spsc_avail(&r) &&
+		   12u == spsc_read(&r, out, 12u) &&
+		   0 == memcmp(in, out, 12u));
+
+	spsc_free(&r);
+	return NULL;
+}
+
+static char *test_spsc_records(void)
+{
+	struct Spsc r;
+	uint8_t rec[6] = { 1, 2, 3, 4, 5, 6 };
+	uint8_t out[6];
+
+	if (!spsc_init(&r, 16u)) return "spsc_init failed";
+	_it_should("push whole records", spsc_push(&r, rec, 6u) &&
+		   spsc_push(&r, rec, 6u));
+	_it_should("refuse a record that does not fit",
+		   !spsc_push(&r, rec, 6u) && 12u == spsc_avail(&r));
+	_it_should("pop a whole record", spsc_pop(&r, out, 6u) &&
+		   0 == memcmp(rec, out, 6u));
+	_it_should("push a record across the end", spsc_push(&r, rec, 6u));
+	_it_should("pop it back intact", spsc_pop(&r, out, 6u) &&
+		   spsc_pop(&r, out, 6u) && 0 == memcmp(rec, out, 6u));
+	_it_should("refuse to pop a partial record",
+		   1u == spsc_write(&r, rec, 1u) && !spsc_pop(&r, out, 6u));
+
+	spsc_free(&r);
+	return NULL;
+}
+
+#define SPSC_STRESS_BYTES	(1u << 20)
+
+static void *spsc_stress_producer(void *arg)
+{
+	struct Spsc *r = arg;
+	uint8_t buf[61];
+	uint32_t sent = 0;
+
+	while (sent < SPSC_STRESS_BYTES) {
+		uint32_t n = SPSC_STRESS_BYTES - sent;
+
+		if (n > sizeof(buf))
+			n = sizeof(buf);
+		for (uint32_t i = 0; i < n; i++)
+			buf[i] = (uint8_t)((sent + i) * 7u);
+		n = spsc_write(r, buf, n);
+		if (!n)
+			sched_yield();
+		sent += n;
+	}
+	return NULL;
+}
+
+static char *test_spsc_threads(void)
+{
+	struct Spsc r;
+	pthread_t tid;
+	uint8_t buf[97];
+	uint32_t got = 0;
+	bool ok = true;
+
+	if (!spsc_init(&r, 1024u)) return "spsc_init failed";
+	if (pthread_create(&tid, NULL, spsc_stress_producer, &r) != 0)
+		return "pthread_create failed";
+
+	while (got < SPSC_STRESS_BYTES) {
+		uint32_t n = spsc_read(&r, buf, sizeof(buf));
+
+		if (!n)
+			sched_yield();
+		for (uint32_t i = 0; i < n; i++) {
+			if (buf[i] != (uint8_t)((got + i) * 7u))
+				ok = false;
+		}
+		got += n;
+	}
+	pthread_join(tid, NULL);
+
+	_it_should("pass every byte between threads in order", ok);
+	_it_should("end empty", 0u == spsc_avail(&r));
+
+	spsc_free(&r);
+	return NULL;
+}
+
+static char *run_tests(void)
+{
+	_run_test(test_spsc_init);
+	_run_test(test_spsc_wrap);
+	_run_test(test_spsc_records);
+	_run_test(test_spsc_threads);
+
+	return NULL;
+}
@@ -17,8 +17,12 @@
 #include "i8080.c"
 #include "serial.c"
 #include "cassette.c"
+#include "wav.c"
 #include "altaid_hw.c"
 #include "emu_core.c"
+#include "timeutil.c"
+#include "io.c"
+#include "lz.c"
 #include "stateio.c"
 
 #include "test-runner.h"
@@ -64,27 +68,17 @@ static void write_u32le_buf(unsigned char *dst, uint32_t v)
 	dst[3] = (unsigned char)((v >> 24) & 0xffu);
 }
 
-static FILE *mem_open(unsigned char *buf, size_t len)
-{
-	return fmemopen(buf, len, "rb");
-}
-
 static char *test_state_header_bad_magic(void)
 {
 	unsigned char buf[8 + 4];
+	struct StIn in = { buf, sizeof(buf), 0 };
 	uint32_t ver = 0;
-	FILE *f;
 	bool ok;
 
 	memset(buf, 0, sizeof(buf));
 	memcpy(buf, "BADSIGN!", 8);
 
-	f = mem_open(buf, sizeof(buf));
-	if (!f)
-		return "fmemopen() failed";
-
-	ok = read_header(f, k_state_magic, &ver);
-	fclose(f);
+	ok = read_header(&in, k_state_magic, &ver);
 
 	_it_should(
 		"reject bad state magic",
@@ -97,8 +91,8 @@ static char *test_state_header_bad_magic(void)
 static char *test_state_header_bad_version(void)
 {
 	unsigned char buf[8 + 4];
+	struct StIn in = { buf, sizeof(buf), 0 };
 	uint32_t ver = 0;
-	FILE *f;
 	bool ok;
 	bool version_ok;
 
@@ -106,12 +100,7 @@ static char *test_state_header_bad_version(void)
 	memcpy(buf, k_state_magic, 8);
 	write_u32le_buf(buf + 8, STATEIO_VER + 1u);
 
-	f = mem_open(buf, sizeof(buf));
-	if (!f)
-		return "fmemopen() failed";
-
-	ok = read_header(f, k_state_magic, &ver);
-	fclose(f);
+	ok = read_header(&in, k_state_magic, &ver);
 
 	version_ok = ok && (ver == STATEIO_VER);
 
@@ -303,11 +292,11 @@ static char *test_stateio_state_roundtrip(void)
 	core1.cpu.b = 0x34;
 	core1.cpu.pc = 0x5678;
 	core1.cpu.sp = 0x9abcu;
-	core1.cpu.z = true;
-	core1.cpu.s = true;
-	core1.cpu.p = false;
-	core1.cpu.cy = true;
-	core1.cpu.ac = true;
+	i8080_set_flag(&core1.cpu, I8080_FLAG_Z, true);
+	i8080_set_flag(&core1.cpu, I8080_FLAG_S, true);
+	i8080_set_flag(&core1.cpu, I8080_FLAG_P, false);
+	i8080_set_flag(&core1.cpu, I8080_FLAG_CY, true);
+	i8080_set_flag(&core1.cpu, I8080_FLAG_AC, true);
 	core1.cpu.inte = true;
 	core1.cpu.ei_pending = true;
 	core1.cpu.halted = true;
@@ -344,11 +333,11 @@ static char *test_stateio_state_roundtrip(void)
 		&& 0x34 == core2.cpu.b
 		&& 0x5678 == core2.cpu.pc
 		&& 0x9abcu == core2.cpu.sp
-		&& true == core2.cpu.z
-		&& true == core2.cpu.s
-		&& false == core2.cpu.p
-		&& true == core2.cpu.cy
-		&& true == core2.cpu.ac
+		&& true == i8080_flag(&core2.cpu, I8080_FLAG_Z)
+		&& true == i8080_flag(&core2.cpu, I8080_FLAG_S)
+		&& false == i8080_flag(&core2.cpu, I8080_FLAG_P)
+		&& true == i8080_flag(&core2.cpu, I8080_FLAG_CY)
+		&& true == i8080_flag(&core2.cpu, I8080_FLAG_AC)
 		&& true == core2.cpu.inte
 		&& true == core2.cpu.ei_pending
 		&& true == core2.cpu.halted
@@ -382,7 +371,7 @@ static char *test_stateio_ram_full_roundtrip(void)
 
 	_it_should(
 		"save ram to temp file",
-		true == stateio_save_ram(&core1, path, err, sizeof(err))
+		true == stateio_save_ram(&core1, path, false, err, sizeof(err))
 	);
 
 	emu_core_init(&core2, 2000000u, 9600u);
@@ -450,6 +439,454 @@ static char *test_stateio_ram_partial_load_at_offset(void)
 	return NULL;
 }
 
+static long file_size(const char *path)
+{
+	FILE *f = fopen(path, "rb");
+	long n = -1;
+
+	if (f && fseek(f, 0, SEEK_END) == 0)
+		n = ftell(f);
+	if (f)
+		fclose(f);
+	return n;
+}
+
+static unsigned dirty_count(const AltaidHW *hw)
+{
+	unsigned n = 0;
+
+	for (size_t i = 0; i < sizeof(hw->ram_dirty); i++)
+		n += (hw->ram_dirty[i] & ALTAID_DIRTY_CHECKPOINT) ? 1u : 0u;
+	return n;
+}
+
+static char *test_stateio_checkpoint_deltas(void)
+{
+	static struct EmuCore core1;
+	static struct EmuCore core2;
+	static const uint8_t prog[] = {
+		0x31, 0x00, 0xF0,	/* 0000 LXI SP,F000 */
+		0x21, 0x00, 0x90,	/* 0003 LXI H,9000 */
+		0x34,			/* 0006 INR M */
+		0xE5,			/* 0007 PUSH H */
+		0xE1,			/* 0008 POP H */
+		0xC3, 0x06, 0x00,	/* 0009 JMP 0006 */
+	};
+	char path[64];
+	char err[256];
+	long base_size;
+	long delta_size;
+	uint64_t tick1;
+	uint8_t count1;
+
+	emu_core_init(&core1, 2000000u, 9600u);
+	fill_rom(&core1.hw);
+	memcpy(core1.hw.rom[0], prog, sizeof(prog));
+	core1.hw.ram[5][0x2345] = 0xA5u;
+
+	if (make_temp_path(path, sizeof(path)) != 0)
+		return "mkstemp() failed";
+
+	_it_should(
+		"write a checkpoint base",
+		stateio_checkpoint(&core1, path, true, err, sizeof(err))
+		&& 0u == dirty_count(&core1.hw)
+	);
+	base_size = file_size(path);
+
+	emu_core_run_batch(&core1, 10000u);
+	_it_should(
+		"CPU stores flag only the lines they touch",
+		2u == dirty_count(&core1.hw)
+		&& core1.hw.ram_dirty[0x90] && core1.hw.ram_dirty[0xEF]
+	);
+
+	_it_should(
+		"append a small delta record",
+		stateio_checkpoint(&core1, path, false, err, sizeof(err))
+		&& 0u == dirty_count(&core1.hw)
+	);
+	delta_size = file_size(path) - base_size;
+	_it_should("delta holds a few KB, not the RAM", delta_size < 16384);
+
+	tick1 = core1.ser.tick;
+	count1 = core1.hw.ram[0][0x9000];
+	emu_core_run_batch(&core1, 10000u);
+	_it_should(
+		"append a second delta",
+		stateio_checkpoint(&core1, path, false, err, sizeof(err))
+	);
+
+	emu_core_init(&core2, 2000000u, 9600u);
+	_it_should(
+		"load base plus every delta",
+		stateio_load_state(&core2, path, err, sizeof(err))
+		&& core2.ser.tick == core1.ser.tick
+		&& core2.cpu.pc == core1.cpu.pc
+		&& 0 == memcmp(core2.hw.ram, core1.hw.ram, sizeof(core1.hw.ram))
+	);
+
+	/* A crash mid-append leaves a torn record: fall back to the one before. */
+	if (truncate(path, (off_t)(base_size + delta_size + 100)) != 0)
+		return "truncate() failed";
+	emu_core_init(&core2, 2000000u, 9600u);
+	_it_should(
+		"ignore a torn final record",
+		stateio_load_state(&core2, path, err, sizeof(err))
+		&& core2.ser.tick == tick1
+		&& core2.hw.ram[0][0x9000] == count1
+		&& 0xA5u == core2.hw.ram[5][0x2345]
+	);
+
+	unlink(path);
+	return NULL;
+}
+
+static char *test_stateio_save_replaces_atomically(void)
+{
+	static struct EmuCore core;
+	char path[64];
+	char tmp[96];
+	char err[256];
+	long size;
+
+	emu_core_init(&core, 2000000u, 9600u);
+	core.hw.ram[7][0xFFFF] = 0xC3u;
+
+	if (make_temp_path(path, sizeof(path)) != 0)
+		return "mkstemp() failed";
+	if (write_file(path, "old contents, longer than nothing", 33) != 0)
+		return "write_file() failed";
+
+	_it_should(
+		"replace an existing file",
+		stateio_save_state(&core, path, err, sizeof(err))
+	);
+
+	snprintf(tmp, sizeof(tmp), "%s.%ld.tmp", path, (long)getpid());
+	size = file_size(path);
+	_it_should(
+		"leave no temp file behind",
+		0 == access(path, F_OK) && 0 != access(tmp, F_OK)
+	);
+
+	core.hw.ram[7][0xFFFF] = 0;
+	_it_should(
+		"load the new contents through the mapping",
+		size > 33
+		&& stateio_load_state(&core, path, err, sizeof(err))
+		&& 0xC3u == core.hw.ram[7][0xFFFF]
+	);
+
+	unlink(path);
+	return NULL;
+}
+
+static char *test_stateio_state_packs_ram(void)
+{
+	static struct EmuCore core;
+	struct StBuf v1 = { 0 };
+	char path[64];
+	char err[256];
+	long size;
+
+	emu_core_init(&core, 2000000u, 9600u);
+	for (size_t i = 0; i < 0x3000; i++)
+		core.hw.ram[0][i] = (uint8_t)(i * 7u);
+	memset(core.hw.ram[2] + 0x8000, 0xE5, 0x1000);
+	core.hw.ram[5][0x4321] = 0x42u;
+
+	if (make_temp_path(path, sizeof(path)) != 0)
+		return "mkstemp() failed";
+
+	_it_should(
+		"save a version 2 state with the RAM compressed",
+		stateio_save_state(&core, path, err, sizeof(err))
+		&& (size = file_size(path)) > 0
+		&& size < (long)sizeof(core.hw.ram[0])
+	);
+
+	memset(core.hw.ram, 0x99, sizeof(core.hw.ram));
+	_it_should(
+		"restore every bank from a version 2 state",
+		stateio_load_state(&core, path, err, sizeof(err))
+		&& (uint8_t)(0x2FFFu * 7u) == core.hw.ram[0][0x2FFF]
+		&& 0 == core.hw.ram[0][0x3000]
+		&& 0xE5 == core.hw.ram[2][0x8FFF]
+		&& 0 == core.hw.ram[2][0x9000]
+		&& 0x42u == core.hw.ram[5][0x4321]
+		&& 0 == core.hw.ram[7][0xFFFF]
+	);
+
+	/* A version 1 file as the previous release wrote it. */
+	if (!write_header(&v1, k_state_magic, 1) ||
+	    !write_machine(&v1, &core, RAM_RAW))
+		return "building a version 1 state failed";
+	/* Version 1 has no tape length or hash, and no edges on this tape. */
+	v1.len -= 16;
+	if (write_file(path, v1.p, v1.len) != 0)
+		return "write_file() failed";
+	free(v1.p);
+
+	memset(core.hw.ram, 0x99, sizeof(core.hw.ram));
+	_it_should(
+		"still load a version 1 state with raw RAM",
+		stateio_load_state(&core, path, err, sizeof(err))
+		&& 0x42u == core.hw.ram[5][0x4321]
+		&& 0 == core.hw.ram[7][0xFFFF]
+	);
+
+	unlink(path);
+	return NULL;
+}
+
+static char *test_stateio_ram_packed_roundtrip(void)
+{
+	static struct EmuCore core;
+	char path[64];
+	char err[256];
+
+	emu_core_init(&core, 2000000u, 9600u);
+	memcpy(core.hw.ram[1], "HELLO, WORLD", 12);
+	core.hw.ram[7][0xFFFF] = 0x77u;
+
+	if (make_temp_path(path, sizeof(path)) != 0)
+		return "mkstemp() failed";
+
+	_it_should(
+		"save a compressed RAM image",
+		stateio_save_ram(&core, path, true, err, sizeof(err))
+		&& file_size(path) < 1024
+	);
+
+	memset(core.hw.ram, 0x99, sizeof(core.hw.ram));
+	_it_should(
+		"load it over all of RAM",
+		stateio_load_ram(&core, path, 0, err, sizeof(err))
+		&& 0 == memcmp(core.hw.ram[1], "HELLO, WORLD", 12)
+		&& 0 == core.hw.ram[1][12]
+		&& 0x77u == core.hw.ram[7][0xFFFF]
+		&& 0 == core.hw.ram[3][0]
+	);
+
+	_it_should(
+		"refuse to load it at an offset",
+		!stateio_load_ram(&core, path, 0x10000u, err, sizeof(err))
+		&& NULL != strstr(err, "packed")
+	);
+
+	unlink(path);
+	return NULL;
+}
+
+static char *test_stateio_state_reopens_tape(void)
+{
+	static struct EmuCore core1;
+	static struct EmuCore core2;
+	char tape[64];
+	char path[64];
+	char err[256];
+
+	if (make_temp_path(tape, sizeof(tape)) != 0 ||
+	    make_temp_path(path, sizeof(path)) != 0)
+		return "mkstemp() failed";
+	unlink(tape);
+
+	emu_core_init(&core1, 2000000u, 9600u);
+	cassette_open(&core1.cas, tape);
+	core1.cas_attached = true;
+	cassette_start_record(&core1.cas, 0u);
+	for (uint32_t i = 1; i <= 5u; i++)
+		cassette_on_out_change(&core1.cas, i * 10u, (i & 1u) != 0);
+	cassette_stop(&core1.cas);
+	cassette_start_play(&core1.cas, 100u);
+	(void)cassette_in_level_at(&core1.cas, 125u);
+
+	emu_core_init(&core2, 2000000u, 9600u);
+	_it_should(
+		"keep the tape out of the state and reopen it on load",
+		stateio_save_state(&core1, path, err, sizeof(err))
+		&& stateio_load_state(&core2, path, err, sizeof(err))
+		&& 0 == strcmp(tape, core2.cas.path)
+		&& 5u == core2.cas.dur_count
+		&& 2u == core2.cas.play_index
+		&& CASSETTE_PLAYING == core2.cas.state
+		&& 10u == cassette_duration(&core2.cas, 4u)
+	);
+
+	cassette_free(&core1.cas);
+	cassette_free(&core2.cas);
+	unlink(tape);
+	unlink(path);
+	return NULL;
+}
+
+/* Record n edges, one every step ticks, from tick *t on. */
+static void record_edges(Cassette *c, uint64_t *t, uint32_t step, size_t n)
+{
+	for (size_t i = 0; i < n; i++) {
+		*t += step;
+		cassette_on_out_change(c, *t, !c->rec_last_level);
+	}
+}
+
+static char *test_stateio_checkpoint_flushes_tape(void)
+{
+	static struct EmuCore core1;
+	static struct EmuCore core2;
+	char tape[64];
+	char path[64];
+	char err[256];
+	uint64_t t = 0;
+
+	if (make_temp_path(tape, sizeof(tape)) != 0 ||
+	    make_temp_path(path, sizeof(path)) != 0)
+		return "mkstemp() failed";
+	unlink(tape);
+
+	emu_core_init(&core1, 2000000u, 9600u);
+	cassette_open(&core1.cas, tape);
+	core1.cas_attached = true;
+	cassette_start_record(&core1.cas, 0u);
+	record_edges(&core1.cas, &t, 10u, 5u);
+
+	/* Still recording: the edges are only buffered until a checkpoint. */
+	_it_should(
+		"checkpoint while recording",
+		stateio_checkpoint(&core1, path, true, err, sizeof(err))
+	);
+	record_edges(&core1.cas, &t, 20u, CASSETTE_WINDOW + 7u);
+	_it_should(
+		"append a delta while recording",
+		stateio_checkpoint(&core1, path, false, err, sizeof(err))
+	);
+
+	/* Crash: core1 never stops the tape or saves it. */
+	emu_core_init(&core2, 2000000u, 9600u);
+	_it_should(
+		"find every checkpointed edge in the tape file",
+		stateio_load_state(&core2, path, err, sizeof(err))
+		&& CASSETTE_WINDOW + 12u == core2.cas.dur_count
+		&& core1.cas.tape_ticks == core2.cas.tape_ticks
+		&& 10u == cassette_duration(&core2.cas, 4u)
+		&& 20u == cassette_duration(&core2.cas, CASSETTE_WINDOW + 11u)
+		&& CASSETTE_RECORDING == core2.cas.state
+	);
+
+	cassette_free(&core1.cas);
+	cassette_free(&core2.cas);
+	unlink(tape);
+	unlink(path);
+	return NULL;
+}
+
+/*
+ * Replace the tape at path with n edges of dur ticks, but for the first
+ * two, which are skew shorter and longer: the same length either way.
+ */
+static bool rewrite_tape(const char *path, uint32_t dur, size_t n,
+			 uint32_t skew)
+{
+	Cassette c;
+	bool ok = true;
+
+	unlink(path);
+	cassette_init(&c, 2000000u);
+	ok = cassette_open(&c, path);
+	for (size_t i = 0; ok && i < n; i++)
+		ok = cassette_append(&c, i > 1 ? dur :
+					 (i ? dur + skew : dur - skew));
+	ok = ok && cassette_save(&c);
+	cassette_free(&c);
+	return ok;
+}
+
+static char *test_stateio_state_rejects_other_tape(void)
+{
+	static struct EmuCore core1;
+	static struct EmuCore core2;
+	char tape[64];
+	char path[64];
+	char err[256];
+	Cassette c;
+	long size;
+
+	if (make_temp_path(tape, sizeof(tape)) != 0 ||
+	    make_temp_path(path, sizeof(path)) != 0)
+		return "mkstemp() failed";
+	if (!rewrite_tape(tape, 10u, 40u, 0u))
+		return "tape write failed";
+
+	emu_core_init(&core1, 2000000u, 9600u);
+	cassette_open(&core1.cas, tape);
+	core1.cas_attached = true;
+	if (!stateio_save_state(&core1, path, err, sizeof(err)))
+		return "state save failed";
+
+	emu_core_init(&core2, 2000000u, 9600u);
+	_it_should(
+		"load with the tape it was saved with",
+		stateio_load_state(&core2, path, err, sizeof(err))
+		&& 40u == core2.cas.dur_count
+	);
+	cassette_free(&core2.cas);
+
+	if (!rewrite_tape(tape, 10u, 39u, 0u))
+		return "tape write failed";
+	emu_core_init(&core2, 2000000u, 9600u);
+	err[0] = '\0';
+	_it_should(
+		"fail when the tape is short",
+		!stateio_load_state(&core2, path, err, sizeof(err))
+		&& NULL != strstr(err, "cassette")
+	);
+	cassette_free(&core2.cas);
+
+	if (!rewrite_tape(tape, 11u, 40u, 0u))
+		return "tape write failed";
+	emu_core_init(&core2, 2000000u, 9600u);
+	_it_should(
+		"fail when the tape has other timing",
+		!stateio_load_state(&core2, path, err, sizeof(err))
+	);
+	cassette_free(&core2.cas);
+
+	/* Same edge count and length, but the first two edges differ. */
+	if (!rewrite_tape(tape, 10u, 40u, 5u))
+		return "tape write failed";
+	emu_core_init(&core2, 2000000u, 9600u);
+	_it_should(
+		"fail when the tape has other edges of the same length",
+		!stateio_load_state(&core2, path, err, sizeof(err))
+	);
+	cassette_free(&core2.cas);
+
+	/* Edges recorded after the save are kept, in memory and on disk. */
+	if (!rewrite_tape(tape, 10u, 45u, 0u))
+		return "tape write failed";
+	size = file_size(tape);
+	emu_core_init(&core2, 2000000u, 9600u);
+	_it_should(
+		"load from a tape that has grown since, leaving it whole",
+		stateio_load_state(&core2, path, err, sizeof(err))
+		&& 45u == core2.cas.dur_count
+	);
+	cassette_free(&core2.cas);
+	cassette_init(&c, 2000000u);
+	cassette_open(&c, tape);
+	_it_should(
+		"never cut the tape file",
+		size == file_size(tape) && 45u == c.dur_count
+	);
+	cassette_free(&c);
+
+	cassette_free(&core1.cas);
+	cassette_free(&core2.cas);
+	unlink(tape);
+	unlink(path);
+	return NULL;
+}
+
 static char *run_tests(void)
 {
 	_run_test(test_state_header_bad_magic);
@@ -462,6 +899,13 @@ static char *run_tests(void)
 	_run_test(test_stateio_state_roundtrip);
 	_run_test(test_stateio_ram_full_roundtrip);
 	_run_test(test_stateio_ram_partial_load_at_offset);
+	_run_test(test_stateio_checkpoint_deltas);
+	_run_test(test_stateio_save_replaces_atomically);
+	_run_test(test_stateio_state_packs_ram);
+	_run_test(test_stateio_ram_packed_roundtrip);
+	_run_test(test_stateio_state_reopens_tape);
+	_run_test(test_stateio_checkpoint_flushes_tape);
+	_run_test(test_stateio_state_rejects_other_tape);
 
 	return NULL;
 }
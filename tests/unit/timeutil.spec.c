@@ -39,6 +39,39 @@ static char *test_emu_tick_to_usec_rounding(void)
 	return NULL;
 }
 
+static char *test_emu_tick_to_usec_wide(void)
+{
+	/* Five days at 2 MHz: well past what 32 bits of usec can hold. */
+	uint64_t tick = 5ull * 86400ull * 2000000ull;
+
+	_it_should(
+		"not wrap past 2^32 usec",
+		5ull * 86400ull * 1000000ull == emu_tick_to_usec(tick, 2000000u)
+	);
+
+	_it_should(
+		"convert days of ticks to exact nsec",
+		5ull * 86400ull * 1000000000ull == emu_tick_to_nsec(tick, 2000000u)
+		&& 1500000000ull == emu_tick_to_nsec(3, 2)
+		&& 0 == emu_tick_to_nsec(123, 0)
+	);
+
+	return NULL;
+}
+
+static char *test_monotonic_nsec_non_decreasing(void)
+{
+	uint64_t a = monotonic_nsec();
+	uint64_t b = monotonic_nsec();
+
+	_it_should(
+		"return non-decreasing values",
+		b >= a
+	);
+
+	return NULL;
+}
+
 static char *test_monotonic_usec_non_decreasing(void)
 {
 	uint32_t a = monotonic_usec();
@@ -73,6 +106,8 @@ static char *run_tests(void)
 {
 	_run_test(test_emu_tick_to_usec_basic);
 	_run_test(test_emu_tick_to_usec_rounding);
+	_run_test(test_emu_tick_to_usec_wide);
+	_run_test(test_monotonic_nsec_non_decreasing);
 	_run_test(test_monotonic_usec_non_decreasing);
 	_run_test(test_sleep_usec_zero_noop);
 
@@ -0,0 +1,78 @@
+/* SPDX-License-Identifier: MIT */
+
+/*
+ * altap_convert.c
+ *
+ * Convert cassette tapes between ALTAP001 (one raw 32-bit duration per
+ * edge, as older emulator builds write), ALTAP002 (block-coded, the
+ * current default) and PCM WAV audio. The input format is detected from
+ * its header. The output is a WAV if its name ends in ".wav", else
+ * ALTAP002 unless -1 is given. Tapes are streamed, so any length converts
+ * in constant memory.
+ *
+ * Options:
+ *   -1, -2      ALTAP version to write (default 2)
+ *   -C <hz>     tick rate for edges decoded from a WAV (default 2000000,
+ *               the emulator's default --hz)
+ *   -r <hz>     sample rate of a WAV output (default 44100)
+ *
+ * Usage: tools/altap-convert [-1|-2] [-C hz] [-r hz] <in> <out>
+ */
+
+#include "cassette.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void usage(const char *argv0)
+{
+	fprintf(stderr, "usage: %s [-1|-2] [-C hz] [-r hz] <in> <out>\n",
+		argv0);
+}
+
+static bool parse_hz(const char *s, uint32_t *out)
+{
+	char *end;
+	unsigned long v = strtoul(s, &end, 10);
+
+	if (!*s || *end || v == 0 || v > 0xFFFFFFFFul)
+		return false;
+	*out = (uint32_t)v;
+	return true;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned version = 2;
+	uint32_t cpu_hz = 2000000u;
+	uint32_t rate = CASSETTE_WAV_RATE;
+	int i = 1;
+
+	while (i < argc && argv[i][0] == '-' && argv[i][1]) {
+		if (strcmp(argv[i], "-1") == 0 || strcmp(argv[i], "-2") == 0) {
+			version = (unsigned)(argv[i][1] - '0');
+			i++;
+		} else if (strcmp(argv[i], "-C") == 0 && i + 1 < argc &&
+			   parse_hz(argv[i + 1], &cpu_hz)) {
+			i += 2;
+		} else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc &&
+			   parse_hz(argv[i + 1], &rate)) {
+			i += 2;
+		} else {
+			usage(argv[0]);
+			return 2;
+		}
+	}
+	if (argc - i != 2) {
+		usage(argv[0]);
+		return 2;
+	}
+
+	if (!cassette_convert(argv[i], argv[i + 1], version, cpu_hz, rate)) {
+		fprintf(stderr, "altap-convert: cannot convert %s to %s\n",
+			argv[i], argv[i + 1]);
+		return 1;
+	}
+	return 0;
+}
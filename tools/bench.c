@@ -0,0 +1,707 @@
+/* SPDX-License-Identifier: MIT */
+
+/*
+ * bench.c
+ *
+ * Headless throughput benchmark.
+ *
+ * Micro section: runs a synthetic 8080 loop against a flat 64K RAM bus with
+ * each dispatch engine, then against the Altaid memory map through the
+ * mem_read/mem_write callbacks and through the direct page tables.
+ *
+ * Workload section: drives emu_core_run_batch() with every device attached,
+ * as the runloop does, over a set of synthetic programs (ALU loop, block
+ * copy, CALL/RET, bank switching, bit-banged serial TX, tape load, idle
+ * IN 0x40 poll). Each workload is run at the runloop batch size and again
+ * at a small batch size over the same emulated ticks; the difference gives
+ * the fixed cost per batch. The tape load plays a generated tape to its
+ * end as fast as the host allows, as --turbo does, and also reports edges
+ * per second.
+ *
+ * Persistence section: times stateio_save_state() and stateio_load_state()
+ * of a full machine to a temp file ($TMPDIR or /tmp), including the
+ * fsync() a save makes, and reports how far the RAM compressed. It is run
+ * on the machine the workloads left behind and again with every RAM bank
+ * full of noise, the worst case for the compressor.
+ *
+ * Reports MIPS, ns/instruction and emulated clock rate as a text table or,
+ * with --json, as a single JSON object. No host I/O is performed inside the
+ * timed regions, apart from the persistence section.
+ *
+ * Usage: tools/bench [--json] [million-instructions]
+ */
+
+/* For clock_gettime() in strict C99 builds. */
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "altaid_hw.h"
+#include "emu_core.h"
+#include "i8080.h"
+#include "stateio.h"
+#include "version.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_CPU_HZ		2000000u
+#define BENCH_BAUD		9600u
+/* 0.5 ms of emulated time, matching the runloop's batch size. */
+#define BENCH_BATCH		(BENCH_CPU_HZ / 2000u)
+/* Small batch used to expose the fixed per-batch cost. */
+#define BENCH_BATCH_SMALL	50u
+/* Save/load round trips timed by the persistence section. */
+#define BENCH_STATE_ITERS	20u
+/* Edges on the tape-load workload's tape: about a minute at 2 MHz. */
+#define BENCH_TAPE_EDGES	200000u
+
+typedef int (*bench_step_fn)(I8080 *cpu, I8080Bus *bus);
+
+static uint8_t g_mem[65536];
+static AltaidHW g_hw;
+static struct EmuCore g_core;
+
+static uint8_t bench_mem_read(I8080Bus *bus, uint16_t addr)
+{
+	(void)bus;
+	return g_mem[addr];
+}
+
+static void bench_mem_write(I8080Bus *bus, uint16_t addr, uint8_t v)
+{
+	(void)bus;
+	g_mem[addr] = v;
+}
+
+static uint8_t bench_io_in(I8080Bus *bus, uint8_t port)
+{
+	(void)bus;
+	(void)port;
+	return 0xFF;
+}
+
+static void bench_io_out(I8080Bus *bus, uint8_t port, uint8_t v)
+{
+	(void)bus;
+	(void)port;
+	(void)v;
+}
+
+/*
+ * Mixed workload: load/modify/store through HL, pair increments, an
+ * immediate ALU op, a CALL/RET pair and an unconditional jump per pass.
+ */
+static const uint8_t k_program[] = {
+	0x31, 0x00, 0xF0,	/* 0000 LXI SP,F000 */
+	0x21, 0x00, 0x80,	/* 0003 LXI H,8000 */
+	0x01, 0x00, 0x00,	/* 0006 LXI B,0000 */
+	0x7E,			/* 0009 MOV A,M */
+	0x80,			/* 000A ADD B */
+	0x77,			/* 000B MOV M,A */
+	0x23,			/* 000C INX H */
+	0x03,			/* 000D INX B */
+	0x78,			/* 000E MOV A,B */
+	0xE6, 0x0F,		/* 000F ANI 0F */
+	0xC2, 0x09, 0x00,	/* 0011 JNZ 0009 */
+	0xCD, 0x20, 0x00,	/* 0014 CALL 0020 */
+	0xC3, 0x09, 0x00,	/* 0017 JMP 0009 */
+};
+
+static const uint8_t k_subroutine[] = {
+	0x7C,			/* 0020 MOV A,H */
+	0xF6, 0x80,		/* 0021 ORI 80 */
+	0x67,			/* 0023 MOV H,A */
+	0xC9,			/* 0024 RET */
+};
+
+/*
+ * Core workloads. Each program starts at 0x0000 and loops forever. RAM
+ * programs run from bank 0 with ROM_LOW unmapped; ROM programs run from the
+ * low ROM half so they keep executing while the RAM bank changes.
+ */
+
+/* Register-only arithmetic and logic. */
+static const uint8_t k_prog_alu[] = {
+	0x31, 0x00, 0xF0,	/* 0000 LXI SP,F000 */
+	0x01, 0x34, 0x12,	/* 0003 LXI B,1234 */
+	0x11, 0x78, 0x56,	/* 0006 LXI D,5678 */
+	0x21, 0xBC, 0x9A,	/* 0009 LXI H,9ABC */
+	0x80,			/* 000C ADD B */
+	0x89,			/* 000D ADC C */
+	0x92,			/* 000E SUB D */
+	0xAB,			/* 000F XRA E */
+	0xB4,			/* 0010 ORA H */
+	0xA5,			/* 0011 ANA L */
+	0x3C,			/* 0012 INR A */
+	0x05,			/* 0013 DCR B */
+	0x0C,			/* 0014 INR C */
+	0xFE, 0x11,		/* 0015 CPI 11 */
+	0xC3, 0x0C, 0x00,	/* 0017 JMP loop */
+};
+
+/* 4K block copy 4000 -> 8000 through HL/DE. */
+static const uint8_t k_prog_memcpy[] = {
+	0x31, 0x00, 0xF0,	/* 0000 LXI SP,F000 */
+	0x21, 0x00, 0x40,	/* 0003 LXI H,4000 */
+	0x11, 0x00, 0x80,	/* 0006 LXI D,8000 */
+	0x01, 0x00, 0x10,	/* 0009 LXI B,1000 */
+	0x7E,			/* 000C MOV A,M */
+	0x12,			/* 000D STAX D */
+	0x23,			/* 000E INX H */
+	0x13,			/* 000F INX D */
+	0x0B,			/* 0010 DCX B */
+	0x78,			/* 0011 MOV A,B */
+	0xB1,			/* 0012 ORA C */
+	0xC2, 0x0C, 0x00,	/* 0013 JNZ copy */
+	0xC3, 0x03, 0x00,	/* 0016 JMP outer */
+};
+
+/* Nested CALL/RET with stack pushes and pops. */
+static const uint8_t k_prog_callret[] = {
+	0x31, 0x00, 0xF0,	/* 0000 LXI SP,F000 */
+	0xCD, 0x0C, 0x00,	/* 0003 CALL sub1 */
+	0xCD, 0x0C, 0x00,	/* 0006 CALL sub1 */
+	0xC3, 0x03, 0x00,	/* 0009 JMP loop */
+	0xC5,			/* 000C PUSH B */
+	0xCD, 0x12, 0x00,	/* 000D CALL sub2 */
+	0xC1,			/* 0010 POP B */
+	0xC9,			/* 0011 RET */
+	0xE5,			/* 0012 PUSH H */
+	0xE1,			/* 0013 POP H */
+	0xC9,			/* 0014 RET */
+};
+
+/* RAM bank and ROM_HI latch changes around a store and load (ROM). */
+static const uint8_t k_prog_bank[] = {
+	0x31, 0x00, 0xF0,	/* 0000 LXI SP,F000 */
+	0x3E, 0x01,		/* 0003 MVI A,1 */
+	0xD3, 0x42,		/* 0005 OUT 42 (B16) */
+	0x32, 0x00, 0xC0,	/* 0007 STA C000 */
+	0xD3, 0x47,		/* 000A OUT 47 (B17) */
+	0x3A, 0x00, 0xC0,	/* 000C LDA C000 */
+	0xD3, 0x40,		/* 000F OUT 40 (ROM_HI on) */
+	0xAF,			/* 0011 XRA A */
+	0xD3, 0x42,		/* 0012 OUT 42 */
+	0xD3, 0x47,		/* 0014 OUT 47 */
+	0xD3, 0x40,		/* 0016 OUT 40 (ROM_HI off) */
+	0xC3, 0x03, 0x00,	/* 0018 JMP loop */
+};
+
+/*
+ * Bit-banged 8N1 transmit on OUT C0 bit 7: ~213 cycles per bit, 9600 baud
+ * at 2 MHz. Sends an incrementing byte stream.
+ */
+static const uint8_t k_prog_serial_tx[] = {
+	0x31, 0x00, 0xF0,	/* 0000 LXI SP,F000 */
+	0x0E, 0x41,		/* 0003 MVI C,'A' */
+	0x3E, 0x00,		/* 0005 MVI A,0 (start bit) */
+	0xD3, 0xC0,		/* 0007 OUT C0 */
+	0xCD, 0x24, 0x00,	/* 0009 CALL delay */
+	0x06, 0x08,		/* 000C MVI B,8 */
+	0x79,			/* 000E MOV A,C */
+	0x0F,			/* 000F RRC (data bit -> bit7) */
+	0xD3, 0xC0,		/* 0010 OUT C0 */
+	0xCD, 0x24, 0x00,	/* 0012 CALL delay */
+	0x05,			/* 0015 DCR B */
+	0xC2, 0x0F, 0x00,	/* 0016 JNZ bit */
+	0x3E, 0x80,		/* 0019 MVI A,80 (stop bit) */
+	0xD3, 0xC0,		/* 001B OUT C0 */
+	0xCD, 0x24, 0x00,	/* 001D CALL delay */
+	0x0C,			/* 0020 INR C */
+	0xC3, 0x05, 0x00,	/* 0021 JMP char */
+	0x16, 0x0A,		/* 0024 MVI D,10 */
+	0x15,			/* 0026 DCR D */
+	0xC2, 0x26, 0x00,	/* 0027 JNZ dl */
+	0xC9,			/* 002A RET */
+};
+
+/*
+ * Tape load: poll IN 0x40 bit 6 and count level changes in HL, as a ROM
+ * loader's edge-wait loop does.
+ */
+static const uint8_t k_prog_tape_load[] = {
+	0x21, 0x00, 0x00,	/* 0000 LXI H,0 */
+	0x06, 0x40,		/* 0003 MVI B,40 (idle high) */
+	0xDB, 0x40,		/* 0005 IN 40 */
+	0xE6, 0x40,		/* 0007 ANI 40 */
+	0xB8,			/* 0009 CMP B */
+	0xCA, 0x05, 0x00,	/* 000A JZ 0005 */
+	0x47,			/* 000D MOV B,A */
+	0x23,			/* 000E INX H */
+	0xC3, 0x05, 0x00,	/* 000F JMP 0005 */
+};
+
+/* Timer enabled, polling IN 0x40 forever: exercises idle fast-forward. */
+static const uint8_t k_prog_idle_poll[] = {
+	0x3E, 0x01,		/* 0000 MVI A,1 */
+	0xD3, 0x46,		/* 0002 OUT 46 (timer on) */
+	0xDB, 0x40,		/* 0004 IN 40 */
+	0xE6, 0x20,		/* 0006 ANI 20 */
+	0xC3, 0x04, 0x00,	/* 0008 JMP 0004 */
+};
+
+struct bench_workload {
+	const char	*name;
+	const uint8_t	*prog;
+	size_t		len;
+	bool		in_rom;
+	bool		tape;		/* play a tape to its end */
+};
+
+static const struct bench_workload k_workloads[] = {
+	{ "alu",	k_prog_alu,	sizeof(k_prog_alu),		false, false },
+	{ "memcpy",	k_prog_memcpy,	sizeof(k_prog_memcpy),		false, false },
+	{ "callret",	k_prog_callret,	sizeof(k_prog_callret),		false, false },
+	{ "bankswitch",	k_prog_bank,	sizeof(k_prog_bank),		true, false },
+	{ "serial_tx",	k_prog_serial_tx, sizeof(k_prog_serial_tx),	false, false },
+	{ "tape_load",	k_prog_tape_load, sizeof(k_prog_tape_load),	false, true },
+	{ "idle_poll",	k_prog_idle_poll, sizeof(k_prog_idle_poll),	false, false },
+};
+
+#define BENCH_WORKLOAD_COUNT (sizeof(k_workloads) / sizeof(k_workloads[0]))
+
+struct bench_result {
+	const char	*name;
+	uint64_t	insns;
+	uint64_t	ticks;
+	uint64_t	batches;
+	uint64_t	tx_bytes;
+	uint64_t	tape_edges;
+	double		sec;
+	double		batch_overhead_ns;
+};
+
+static double now_sec(void)
+{
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0)
+		return 0.0;
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static double run_engine(bench_step_fn step, uint64_t insns, uint64_t *cycles_out)
+{
+	I8080 cpu;
+	I8080Bus bus;
+	uint64_t cycles = 0;
+	double t0;
+	double t1;
+
+	memset(g_mem, 0, sizeof(g_mem));
+	memcpy(g_mem, k_program, sizeof(k_program));
+	memcpy(g_mem + 0x20, k_subroutine, sizeof(k_subroutine));
+
+	memset(&bus, 0, sizeof(bus));
+	bus.mem_read = bench_mem_read;
+	bus.mem_write = bench_mem_write;
+	bus.io_in = bench_io_in;
+	bus.io_out = bench_io_out;
+	i8080_reset(&cpu);
+
+	t0 = now_sec();
+	for (uint64_t i = 0; i < insns; i++)
+		cycles += (uint64_t)step(&cpu, &bus);
+	t1 = now_sec();
+
+	*cycles_out = cycles;
+	return t1 - t0;
+}
+
+static double run_altaid(bool use_pages, uint64_t insns, uint64_t *cycles_out)
+{
+	I8080 cpu;
+	I8080Bus bus;
+	uint64_t cycles = 0;
+	double t0;
+	double t1;
+
+	altaid_hw_init(&g_hw);
+	memset(&bus, 0, sizeof(bus));
+	altaid_hw_attach_bus(&g_hw, &bus);
+
+	/* Run from RAM bank 0 with ROM unmapped. */
+	altaid_io_out(&bus, ALTAID_PORT_ROM_LOW, 1);
+	memcpy(g_hw.ram[0], k_program, sizeof(k_program));
+	memcpy(g_hw.ram[0] + 0x20, k_subroutine, sizeof(k_subroutine));
+
+	if (!use_pages) {
+		bus.rd_page = NULL;
+		bus.wr_page = NULL;
+	}
+	i8080_reset(&cpu);
+
+	t0 = now_sec();
+	for (uint64_t i = 0; i < insns; i++)
+		cycles += (uint64_t)i8080_step(&cpu, &bus);
+	t1 = now_sec();
+
+	*cycles_out = cycles;
+	return t1 - t0;
+}
+
+/*
+ * Attach a temp-backed tape of 1200/2400 Hz half-cycles in runs of 16,
+ * like a Kansas City style recording, and start it playing.
+ */
+static void core_load_tape(void)
+{
+	static uint32_t dur[BENCH_TAPE_EDGES];
+
+	for (size_t i = 0; i < BENCH_TAPE_EDGES; i++)
+		dur[i] = (i / 16u) % 2u ? 833u : 417u;
+	g_core.cas.attached = true;
+	(void)cassette_append_n(&g_core.cas, dur, BENCH_TAPE_EDGES);
+	g_core.cas_attached = true;
+	cassette_start_play(&g_core.cas, 0);
+}
+
+static void core_load(const struct bench_workload *wl)
+{
+	emu_core_init(&g_core, BENCH_CPU_HZ, BENCH_BAUD);
+	if (wl->in_rom) {
+		memcpy(g_core.hw.rom[0], wl->prog, wl->len);
+	} else {
+		altaid_io_out(&g_core.bus, ALTAID_PORT_ROM_LOW, 1);
+		memcpy(g_core.hw.ram[0], wl->prog, wl->len);
+	}
+	if (wl->tape)
+		core_load_tape();
+}
+
+static void core_unload(void)
+{
+	if (g_core.cas_attached)
+		cassette_free(&g_core.cas);
+	g_core.cas_attached = false;
+}
+
+/*
+ * Run a loaded core in batch_cycles batches until it has executed insns
+ * instructions (ticks == 0) or reached ticks emulated cycles. TX output is
+ * drained into a scratch buffer after each batch, standing in for the PTY.
+ */
+static double run_core(uint64_t batch_cycles, uint64_t insns, uint64_t ticks,
+	struct bench_result *res)
+{
+	uint8_t txb[EMU_TXBUF_SIZE];
+	uint64_t batches = 0;
+	uint64_t tx_bytes = 0;
+	double t0;
+	double t1;
+
+	t0 = now_sec();
+	for (;;) {
+		if (ticks ? g_core.ser.tick >= ticks : g_core.insn_count >= insns)
+			break;
+		emu_core_run_batch(&g_core, batch_cycles);
+		tx_bytes += emu_core_tx_pop(&g_core, txb, sizeof(txb));
+		batches++;
+	}
+	t1 = now_sec();
+
+	res->insns = g_core.insn_count;
+	res->ticks = g_core.ser.tick;
+	res->batches = batches;
+	res->tx_bytes = tx_bytes;
+	res->tape_edges = g_core.cas_attached ? g_core.cas.play_index : 0;
+	res->sec = t1 - t0;
+	return res->sec;
+}
+
+static void run_workload(const struct bench_workload *wl, uint64_t insns,
+	struct bench_result *res)
+{
+	struct bench_result small;
+
+	core_load(wl);
+	/* A tape runs to its end rather than for a number of instructions. */
+	(void)run_core(BENCH_BATCH, insns,
+		wl->tape ? g_core.cas.tape_ticks : 0, res);
+	res->name = wl->name;
+	core_unload();
+
+	/* Same emulated span in small batches; the core is deterministic. */
+	core_load(wl);
+	(void)run_core(BENCH_BATCH_SMALL, 0, res->ticks, &small);
+	core_unload();
+
+	res->batch_overhead_ns = 0.0;
+	if (small.batches > res->batches)
+		res->batch_overhead_ns = (small.sec - res->sec) * 1e9 /
+			(double)(small.batches - res->batches);
+}
+
+struct bench_state {
+	long	bytes;
+	long	ram_bytes;	/* packed RAM image */
+	double	ratio;		/* RAM size / ram_bytes */
+	double	save_us;
+	double	load_us;
+};
+
+static long file_bytes(const char *path)
+{
+	FILE *f = fopen(path, "rb");
+	long n = -1;
+
+	if (f && fseek(f, 0, SEEK_END) == 0)
+		n = ftell(f);
+	if (f)
+		fclose(f);
+	return n;
+}
+
+/* Average save and load latency of the core's current state. */
+static bool run_stateio(struct bench_state *r)
+{
+	const char *dir = getenv("TMPDIR");
+	char path[512];
+	char err[256];
+	double t0;
+	int fd;
+
+	memset(r, 0, sizeof(*r));
+	snprintf(path, sizeof(path), "%s/altaid-bench-XXXXXX",
+		 dir && *dir ? dir : "/tmp");
+	fd = mkstemp(path);
+	if (fd < 0)
+		return false;
+	close(fd);
+
+	t0 = now_sec();
+	for (unsigned i = 0; i < BENCH_STATE_ITERS; i++) {
+		if (!stateio_save_state(&g_core, path, err, sizeof(err))) {
+			fprintf(stderr, "bench: save: %s\n", err);
+			remove(path);
+			return false;
+		}
+	}
+	r->save_us = (now_sec() - t0) * 1e6 / BENCH_STATE_ITERS;
+
+	t0 = now_sec();
+	for (unsigned i = 0; i < BENCH_STATE_ITERS; i++) {
+		if (!stateio_load_state(&g_core, path, err, sizeof(err))) {
+			fprintf(stderr, "bench: load: %s\n", err);
+			remove(path);
+			return false;
+		}
+	}
+	r->load_us = (now_sec() - t0) * 1e6 / BENCH_STATE_ITERS;
+
+	r->bytes = file_bytes(path);
+
+	if (!stateio_save_ram(&g_core, path, true, err, sizeof(err))) {
+		fprintf(stderr, "bench: save ram: %s\n", err);
+		remove(path);
+		return false;
+	}
+	r->ram_bytes = file_bytes(path);
+	if (r->ram_bytes > 0)
+		r->ratio = (double)sizeof(g_core.hw.ram) / (double)r->ram_bytes;
+
+	remove(path);
+	return true;
+}
+
+static double safe_sec(double sec)
+{
+	return sec > 0.0 ? sec : 1e-9;
+}
+
+static void report_micro(const char *name, uint64_t insns, uint64_t cycles,
+	double sec, bool json, bool last)
+{
+	sec = safe_sec(sec);
+	if (json) {
+		printf("    { \"name\": \"%s\", \"instructions\": %llu, "
+			"\"seconds\": %.6f, \"mips\": %.3f, "
+			"\"ns_per_insn\": %.3f, \"emulated_mhz\": %.3f }%s\n",
+			name, (unsigned long long)insns, sec,
+			(double)insns / sec / 1e6,
+			sec * 1e9 / (double)insns,
+			(double)cycles / sec / 1e6,
+			last ? "" : ",");
+		return;
+	}
+	printf("%-10s %10.2f MIPS  %8.2f ns/insn  %8.2f emulated MHz\n",
+		name,
+		(double)insns / sec / 1e6,
+		sec * 1e9 / (double)insns,
+		(double)cycles / sec / 1e6);
+}
+
+static void report_workload(const struct bench_result *r, bool json, bool last)
+{
+	double sec = safe_sec(r->sec);
+	uint64_t insns = r->insns ? r->insns : 1u;
+
+	if (json) {
+		printf("    { \"name\": \"%s\", \"instructions\": %llu, "
+			"\"ticks\": %llu, \"batches\": %llu, "
+			"\"seconds\": %.6f, \"mips\": %.3f, "
+			"\"ns_per_insn\": %.3f, \"emulated_mhz\": %.3f, "
+			"\"batch_overhead_ns\": %.1f, \"tx_bytes\": %llu, "
+			"\"tape_edges\": %llu, \"tape_edges_per_sec\": %.0f }%s\n",
+			r->name,
+			(unsigned long long)r->insns,
+			(unsigned long long)r->ticks,
+			(unsigned long long)r->batches,
+			sec,
+			(double)r->insns / sec / 1e6,
+			sec * 1e9 / (double)insns,
+			(double)r->ticks / sec / 1e6,
+			r->batch_overhead_ns,
+			(unsigned long long)r->tx_bytes,
+			(unsigned long long)r->tape_edges,
+			(double)r->tape_edges / sec,
+			last ? "" : ",");
+		return;
+	}
+	printf("%-10s %10.2f MIPS  %8.2f ns/insn  %8.2f emulated MHz  %8.1f ns/batch\n",
+		r->name,
+		(double)r->insns / sec / 1e6,
+		sec * 1e9 / (double)insns,
+		(double)r->ticks / sec / 1e6,
+		r->batch_overhead_ns);
+	if (r->tape_edges)
+		printf("%-10s %10llu edges  %8.2f M edges/s  %8.1fx real time\n",
+			"",
+			(unsigned long long)r->tape_edges,
+			(double)r->tape_edges / sec / 1e6,
+			(double)r->ticks / sec / BENCH_CPU_HZ);
+}
+
+static void report_state(const char *name, const struct bench_state *r,
+			 bool json, bool last)
+{
+	if (json) {
+		printf("    { \"name\": \"%s\", \"bytes\": %ld, "
+			"\"ram_bytes\": %ld, \"ram_ratio\": %.2f, "
+			"\"save_us\": %.1f, \"load_us\": %.1f }%s\n",
+			name, r->bytes, r->ram_bytes, r->ratio,
+			r->save_us, r->load_us, last ? "" : ",");
+	} else {
+		printf("state %-8s %8ld bytes  ram %8ld bytes (%6.1f:1)  "
+			"save %7.1f us  load %6.1f us\n",
+			name, r->bytes, r->ram_bytes, r->ratio,
+			r->save_us, r->load_us);
+	}
+}
+
+static void usage(const char *argv0)
+{
+	fprintf(stderr, "usage: %s [--json] [million-instructions]\n", argv0);
+}
+
+int main(int argc, char **argv)
+{
+	uint64_t insns = 50ull * 1000000ull;
+	uint64_t cyc_switch = 0;
+	uint64_t cyc_table = 0;
+	uint64_t cyc_busfn = 0;
+	uint64_t cyc_pages = 0;
+	double sec_switch;
+	double sec_table;
+	double sec_busfn;
+	double sec_pages;
+	struct bench_result res[BENCH_WORKLOAD_COUNT];
+	struct bench_state st;
+	struct bench_state st_noise;
+	uint32_t x = 1u;
+	bool json = false;
+
+	for (int i = 1; i < argc; i++) {
+		long m;
+
+		if (strcmp(argv[i], "--json") == 0) {
+			json = true;
+			continue;
+		}
+		m = strtol(argv[i], NULL, 10);
+		if (m <= 0) {
+			usage(argv[0]);
+			return 2;
+		}
+		insns = (uint64_t)m * 1000000ull;
+	}
+
+	/* Warm caches and branch predictors before timing. */
+	(void)run_engine(i8080_step_switch, insns / 10u, &cyc_switch);
+	(void)run_engine(i8080_step_table, insns / 10u, &cyc_table);
+
+	sec_switch = run_engine(i8080_step_switch, insns, &cyc_switch);
+	sec_table = run_engine(i8080_step_table, insns, &cyc_table);
+	sec_busfn = run_altaid(false, insns, &cyc_busfn);
+	sec_pages = run_altaid(true, insns, &cyc_pages);
+
+	if (cyc_switch != cyc_table || cyc_switch != cyc_busfn ||
+	    cyc_switch != cyc_pages) {
+		fprintf(stderr, "bench: runs diverged (%llu/%llu/%llu/%llu cycles)\n",
+			(unsigned long long)cyc_switch,
+			(unsigned long long)cyc_table,
+			(unsigned long long)cyc_busfn,
+			(unsigned long long)cyc_pages);
+		return 1;
+	}
+
+	for (size_t i = 0; i < BENCH_WORKLOAD_COUNT; i++)
+		run_workload(&k_workloads[i], insns, &res[i]);
+
+	/* Whatever the last workload left behind is a typical machine. */
+	if (!run_stateio(&st))
+		return 1;
+	for (size_t i = 0; i < sizeof(g_core.hw.ram); i++) {
+		x = x * 1103515245u + 12345u;
+		((uint8_t *)g_core.hw.ram)[i] = (uint8_t)(x >> 24);
+	}
+	if (!run_stateio(&st_noise))
+		return 1;
+
+	if (json) {
+		printf("{\n");
+		printf("  \"version\": \"%s\",\n", altaid_emu_version());
+#ifdef I8080_DISPATCH_TABLE
+		printf("  \"dispatch\": \"table\",\n");
+#else
+		printf("  \"dispatch\": \"switch\",\n");
+#endif
+		printf("  \"cpu_hz\": %u,\n", BENCH_CPU_HZ);
+		printf("  \"batch_cycles\": %u,\n", BENCH_BATCH);
+		printf("  \"micro\": [\n");
+	} else {
+		printf("instructions: %llu\n", (unsigned long long)insns);
+	}
+
+	report_micro("switch", insns, cyc_switch, sec_switch, json, false);
+	report_micro("table", insns, cyc_table, sec_table, json, false);
+	if (!json)
+		printf("table/switch: %.2fx\n", sec_switch / safe_sec(sec_table));
+	report_micro("bus-fn", insns, cyc_busfn, sec_busfn, json, false);
+	report_micro("bus-page", insns, cyc_pages, sec_pages, json, true);
+
+	if (json) {
+		printf("  ],\n");
+		printf("  \"workloads\": [\n");
+	} else {
+		printf("page/fn: %.2fx\n", sec_busfn / safe_sec(sec_pages));
+		printf("core (%u-cycle batches at %u Hz):\n", BENCH_BATCH, BENCH_CPU_HZ);
+	}
+
+	for (size_t i = 0; i < BENCH_WORKLOAD_COUNT; i++)
+		report_workload(&res[i], json, i + 1u == BENCH_WORKLOAD_COUNT);
+
+	if (json)
+		printf("  ],\n  \"state\": [\n");
+	report_state("typical", &st, json, false);
+	report_state("noise", &st_noise, json, true);
+	if (json)
+		printf("  ]\n}\n");
+	return 0;
+}